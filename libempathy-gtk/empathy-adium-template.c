@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2008-2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-adium-template.h"
+
+#include <string.h>
+#include <tp-account-widgets/tpaw-time.h>
+
+/* An adium HTML template (Content.html, Status.html, etc) split once into
+ * a list of segments, so expanding it for a message does not have to look
+ * for %keywords% again. Each segment is a run of already escaped literal
+ * text followed by a keyword (or by nothing for the last one). */
+
+typedef struct
+{
+  /* Length of the literal text preceding the keyword, stored in
+   * EmpathyAdiumTemplate's literals */
+  gsize literal_len;
+  EmpathyAdiumKeyword keyword;
+  /* The X part of %foo{X}%, owned */
+  gchar *format;
+} Segment;
+
+struct _EmpathyAdiumTemplate
+{
+  GString *literals;
+  /* Array of Segment */
+  GArray *segments;
+};
+
+typedef struct
+{
+  const gchar *match;
+  EmpathyAdiumKeyword keyword;
+  gboolean with_format;
+} KeywordEntry;
+
+/* Order matters, keywords are tried in that order. */
+static const KeywordEntry keywords[] = {
+  { "%userIconPath%", EMPATHY_ADIUM_KEYWORD_USER_ICON_PATH, FALSE },
+  { "%senderScreenName%", EMPATHY_ADIUM_KEYWORD_SENDER_SCREEN_NAME, FALSE },
+  { "%sender%", EMPATHY_ADIUM_KEYWORD_SENDER, FALSE },
+  { "%senderColor%", EMPATHY_ADIUM_KEYWORD_SENDER_COLOR, FALSE },
+  { "%senderStatusIcon%", EMPATHY_ADIUM_KEYWORD_SENDER_STATUS_ICON, FALSE },
+  { "%messageDirection%", EMPATHY_ADIUM_KEYWORD_MESSAGE_DIRECTION, FALSE },
+  { "%senderDisplayName%", EMPATHY_ADIUM_KEYWORD_SENDER_DISPLAY_NAME, FALSE },
+  { "%senderPrefix%", EMPATHY_ADIUM_KEYWORD_SENDER_PREFIX, FALSE },
+  { "%textbackgroundcolor{", EMPATHY_ADIUM_KEYWORD_TEXT_BACKGROUND_COLOR,
+    TRUE },
+  { "%message%", EMPATHY_ADIUM_KEYWORD_MESSAGE, FALSE },
+  { "%time%", EMPATHY_ADIUM_KEYWORD_TIME, FALSE },
+  { "%time{", EMPATHY_ADIUM_KEYWORD_TIME, TRUE },
+  { "%shortTime%", EMPATHY_ADIUM_KEYWORD_SHORT_TIME, FALSE },
+  { "%service%", EMPATHY_ADIUM_KEYWORD_SERVICE, FALSE },
+  { "%variant%", EMPATHY_ADIUM_KEYWORD_VARIANT, FALSE },
+  { "%userIcons%", EMPATHY_ADIUM_KEYWORD_USER_ICONS, FALSE },
+  { "%messageClasses%", EMPATHY_ADIUM_KEYWORD_MESSAGE_CLASSES, FALSE },
+  { "%status%", EMPATHY_ADIUM_KEYWORD_STATUS, FALSE },
+};
+
+void
+empathy_adium_template_append_escaped (GString *string,
+    const gchar *str,
+    gssize len)
+{
+  while (str != NULL && *str != '\0' && len != 0)
+    {
+      switch (*str)
+        {
+          case '\\':
+            /* \ becomes \\ */
+            g_string_append (string, "\\\\");
+            break;
+          case '\"':
+            /* " becomes \" */
+            g_string_append (string, "\\\"");
+            break;
+          case '\n':
+            /* Remove end of lines */
+            break;
+          default:
+            g_string_append_c (string, *str);
+        }
+
+      str++;
+      len--;
+    }
+}
+
+/* If *str starts with match, returns TRUE and move pointer to the end */
+static gboolean
+template_match (const gchar **str,
+    const gchar *match)
+{
+  gint len;
+
+  len = strlen (match);
+  if (strncmp (*str, match, len) == 0)
+    {
+      *str += len - 1;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Like template_match() but also return the X part if match is
+ * like %foo{X}% */
+static gboolean
+template_match_with_format (const gchar **str,
+    const gchar *match,
+    gchar **format)
+{
+  const gchar *cur = *str;
+  const gchar *end;
+
+  if (!template_match (&cur, match))
+    return FALSE;
+
+  cur++;
+
+  end = strstr (cur, "}%");
+  if (!end)
+    return FALSE;
+
+  *format = g_strndup (cur , end - cur);
+  *str = end + 1;
+  return TRUE;
+}
+
+static void
+template_add_segment (EmpathyAdiumTemplate *tmpl,
+    gsize *literal_start,
+    EmpathyAdiumKeyword keyword,
+    gchar *format)
+{
+  Segment segment;
+
+  segment.literal_len = tmpl->literals->len - *literal_start;
+  segment.keyword = keyword;
+  segment.format = format;
+  g_array_append_val (tmpl->segments, segment);
+
+  *literal_start = tmpl->literals->len;
+}
+
+EmpathyAdiumTemplate *
+empathy_adium_template_new (const gchar *html)
+{
+  EmpathyAdiumTemplate *tmpl;
+  const gchar *cur;
+  gsize literal_start = 0;
+
+  if (html == NULL)
+    return NULL;
+
+  tmpl = g_slice_new0 (EmpathyAdiumTemplate);
+  tmpl->literals = g_string_sized_new (strlen (html));
+  tmpl->segments = g_array_new (FALSE, FALSE, sizeof (Segment));
+
+  for (cur = html; *cur != '\0'; cur++)
+    {
+      EmpathyAdiumKeyword keyword = EMPATHY_ADIUM_KEYWORD_NONE;
+      gchar *format = NULL;
+      guint i;
+
+      for (i = 0; i < G_N_ELEMENTS (keywords); i++)
+        {
+          gboolean matched;
+
+          if (keywords[i].with_format)
+            matched = template_match_with_format (&cur, keywords[i].match,
+                &format);
+          else
+            matched = template_match (&cur, keywords[i].match);
+
+          if (matched)
+            {
+              keyword = keywords[i].keyword;
+              break;
+            }
+        }
+
+      if (keyword == EMPATHY_ADIUM_KEYWORD_NONE)
+        {
+          empathy_adium_template_append_escaped (tmpl->literals, cur, 1);
+          continue;
+        }
+
+      template_add_segment (tmpl, &literal_start, keyword, format);
+    }
+
+  /* Trailing literal text */
+  template_add_segment (tmpl, &literal_start, EMPATHY_ADIUM_KEYWORD_NONE,
+      NULL);
+
+  return tmpl;
+}
+
+void
+empathy_adium_template_free (EmpathyAdiumTemplate *tmpl)
+{
+  guint i;
+
+  if (tmpl == NULL)
+    return;
+
+  for (i = 0; i < tmpl->segments->len; i++)
+    g_free (g_array_index (tmpl->segments, Segment, i).format);
+
+  g_array_unref (tmpl->segments);
+  g_string_free (tmpl->literals, TRUE);
+
+  g_slice_free (EmpathyAdiumTemplate, tmpl);
+}
+
+/* Size of the expanded template without any replacement */
+gsize
+empathy_adium_template_get_length_hint (EmpathyAdiumTemplate *tmpl)
+{
+  g_return_val_if_fail (tmpl != NULL, 0);
+
+  return tmpl->literals->len;
+}
+
+/* Append to @string the template with each keyword replaced by the value
+ * returned by @func, escaped to be used in a javascript string. */
+void
+empathy_adium_template_expand (EmpathyAdiumTemplate *tmpl,
+    GString *string,
+    EmpathyAdiumTemplateFunc func,
+    gpointer user_data)
+{
+  const gchar *literal;
+  guint i;
+
+  g_return_if_fail (tmpl != NULL);
+  g_return_if_fail (func != NULL);
+
+  literal = tmpl->literals->str;
+
+  for (i = 0; i < tmpl->segments->len; i++)
+    {
+      Segment *segment = &g_array_index (tmpl->segments, Segment, i);
+      const gchar *replace;
+      gchar *to_free = NULL;
+
+      g_string_append_len (string, literal, segment->literal_len);
+      literal += segment->literal_len;
+
+      if (segment->keyword == EMPATHY_ADIUM_KEYWORD_NONE)
+        continue;
+
+      replace = func (segment->keyword, segment->format, &to_free, user_data);
+      empathy_adium_template_append_escaped (string, replace, -1);
+      g_free (to_free);
+    }
+}
+
+/* Messages of a conversation are usually close in time, so most of the
+ * %time% keywords of a view expand to the string already computed for the
+ * previous message. The cache keeps the last string formatted with each
+ * strftime format, along with the period of time it is valid for. */
+
+typedef struct
+{
+  /* Number of seconds during which the formatted time does not change:
+   * 60 if the format does not show seconds, 1 otherwise */
+  gint64 resolution;
+  /* timestamp / resolution of the cached string */
+  gint64 period;
+  gchar *str;
+} TimeCacheEntry;
+
+struct _EmpathyAdiumTimeCache
+{
+  /* owned gchar * format -> owned TimeCacheEntry */
+  GHashTable *entries;
+};
+
+static void
+time_cache_entry_free (gpointer data)
+{
+  TimeCacheEntry *entry = data;
+
+  g_free (entry->str);
+  g_slice_free (TimeCacheEntry, entry);
+}
+
+/* Returns 60 if all the conversions of @format only depend on the minute
+ * (and coarser) fields of the date, 1 otherwise. Unknown conversions are
+ * assumed to show seconds. Time zone offsets are whole minutes so a local
+ * minute always starts on a multiple of 60 seconds. */
+static gint64
+time_format_get_resolution (const gchar *format)
+{
+  const gchar *cur;
+
+  for (cur = strchr (format, '%'); cur != NULL; cur = strchr (cur, '%'))
+    {
+      cur++;
+
+      /* Skip padding and alternative representation modifiers */
+      while (*cur != '\0' && strchr ("-_0EO", *cur) != NULL)
+        cur++;
+
+      if (*cur == '\0')
+        return 1;
+
+      if (strchr ("aAbBCdDeFgGhHIjklmMnpPRtuVwWyYzZ%", *cur) == NULL)
+        return 1;
+
+      cur++;
+    }
+
+  return 60;
+}
+
+EmpathyAdiumTimeCache *
+empathy_adium_time_cache_new (void)
+{
+  EmpathyAdiumTimeCache *cache;
+
+  cache = g_slice_new0 (EmpathyAdiumTimeCache);
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      time_cache_entry_free);
+
+  return cache;
+}
+
+void
+empathy_adium_time_cache_free (EmpathyAdiumTimeCache *cache)
+{
+  if (cache == NULL)
+    return;
+
+  g_hash_table_unref (cache->entries);
+  g_slice_free (EmpathyAdiumTimeCache, cache);
+}
+
+/* Forget all the formatted strings. The view does so whenever it loads its
+ * template again, as the theme or variant may have changed. */
+void
+empathy_adium_time_cache_clear (EmpathyAdiumTimeCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  g_hash_table_remove_all (cache->entries);
+}
+
+/* Same as tpaw_time_to_string_local() but the returned string is owned by
+ * @cache and valid until the next call. */
+const gchar *
+empathy_adium_time_cache_format (EmpathyAdiumTimeCache *cache,
+    gint64 timestamp,
+    const gchar *format)
+{
+  TimeCacheEntry *entry;
+  gint64 period;
+
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+
+  entry = g_hash_table_lookup (cache->entries, format);
+  if (entry == NULL)
+    {
+      entry = g_slice_new0 (TimeCacheEntry);
+      entry->resolution = time_format_get_resolution (format);
+      g_hash_table_insert (cache->entries, g_strdup (format), entry);
+    }
+
+  /* Round towards -infinity so dates before 1970 work too */
+  period = timestamp / entry->resolution;
+  if (timestamp < 0 && timestamp % entry->resolution != 0)
+    period--;
+
+  if (entry->str != NULL && entry->period == period)
+    return entry->str;
+
+  g_free (entry->str);
+  entry->str = tpaw_time_to_string_local (timestamp, format);
+  entry->period = period;
+
+  return entry->str;
+}
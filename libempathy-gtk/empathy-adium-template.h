@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2008-2012 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_ADIUM_TEMPLATE_H__
+#define __EMPATHY_ADIUM_TEMPLATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Keywords are listed in the same order than the adium spec. See
+ * http://trac.adium.im/wiki/CreatingMessageStyles */
+typedef enum
+{
+  EMPATHY_ADIUM_KEYWORD_NONE = 0,
+  EMPATHY_ADIUM_KEYWORD_USER_ICON_PATH,
+  EMPATHY_ADIUM_KEYWORD_SENDER_SCREEN_NAME,
+  EMPATHY_ADIUM_KEYWORD_SENDER,
+  EMPATHY_ADIUM_KEYWORD_SENDER_COLOR,
+  EMPATHY_ADIUM_KEYWORD_SENDER_STATUS_ICON,
+  EMPATHY_ADIUM_KEYWORD_MESSAGE_DIRECTION,
+  EMPATHY_ADIUM_KEYWORD_SENDER_DISPLAY_NAME,
+  EMPATHY_ADIUM_KEYWORD_SENDER_PREFIX,
+  EMPATHY_ADIUM_KEYWORD_TEXT_BACKGROUND_COLOR,
+  EMPATHY_ADIUM_KEYWORD_MESSAGE,
+  EMPATHY_ADIUM_KEYWORD_TIME,
+  EMPATHY_ADIUM_KEYWORD_SHORT_TIME,
+  EMPATHY_ADIUM_KEYWORD_SERVICE,
+  EMPATHY_ADIUM_KEYWORD_VARIANT,
+  EMPATHY_ADIUM_KEYWORD_USER_ICONS,
+  EMPATHY_ADIUM_KEYWORD_MESSAGE_CLASSES,
+  EMPATHY_ADIUM_KEYWORD_STATUS,
+} EmpathyAdiumKeyword;
+
+typedef struct _EmpathyAdiumTemplate EmpathyAdiumTemplate;
+
+/* Returns the replacement for @keyword, or NULL to replace it with nothing.
+ * @format is the X part of %time{X}% and %textbackgroundcolor{X}%, NULL
+ * otherwise. If the returned string has been allocated, it must also be
+ * stored in @to_free. */
+typedef const gchar * (*EmpathyAdiumTemplateFunc) (EmpathyAdiumKeyword keyword,
+    const gchar *format,
+    gchar **to_free,
+    gpointer user_data);
+
+EmpathyAdiumTemplate * empathy_adium_template_new (const gchar *html);
+void empathy_adium_template_free (EmpathyAdiumTemplate *tmpl);
+
+gsize empathy_adium_template_get_length_hint (EmpathyAdiumTemplate *tmpl);
+
+void empathy_adium_template_expand (EmpathyAdiumTemplate *tmpl,
+    GString *string,
+    EmpathyAdiumTemplateFunc func,
+    gpointer user_data);
+
+void empathy_adium_template_append_escaped (GString *string,
+    const gchar *str,
+    gssize len);
+
+typedef struct _EmpathyAdiumTimeCache EmpathyAdiumTimeCache;
+
+EmpathyAdiumTimeCache * empathy_adium_time_cache_new (void);
+void empathy_adium_time_cache_free (EmpathyAdiumTimeCache *cache);
+void empathy_adium_time_cache_clear (EmpathyAdiumTimeCache *cache);
+
+const gchar * empathy_adium_time_cache_format (EmpathyAdiumTimeCache *cache,
+    gint64 timestamp,
+    const gchar *format);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_ADIUM_TEMPLATE_H__ */
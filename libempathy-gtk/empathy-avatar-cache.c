@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-avatar-cache.h"
+
+#include "empathy-gsettings.h"
+
+/* Avatars decoded, scaled and rounded by empathy-ui-utils, shared by all the
+ * widgets displaying the same avatar at the same size. The key identifies
+ * the avatar image (its token, for example) and must change when the image
+ * does. Least recently used avatars are dropped once the pixbufs use more
+ * memory than the budget. */
+
+typedef struct
+{
+  gchar *key;
+  gint width;
+  gint height;
+  GdkPixbuf *pixbuf;
+  gsize size;
+  /* Link of this entry in EmpathyAvatarCache's lru queue */
+  GList *link;
+} Entry;
+
+struct _EmpathyAvatarCache
+{
+  /* Entry -> itself, owned */
+  GHashTable *entries;
+  /* Entry (borrowed), most recently used first */
+  GQueue lru;
+
+  gsize budget;
+  gsize size;
+
+  guint hits;
+  guint misses;
+};
+
+static guint
+entry_hash (gconstpointer data)
+{
+  const Entry *entry = data;
+
+  return g_str_hash (entry->key) ^ (entry->width << 16) ^ entry->height;
+}
+
+static gboolean
+entry_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const Entry *entry_a = a;
+  const Entry *entry_b = b;
+
+  return entry_a->width == entry_b->width &&
+      entry_a->height == entry_b->height &&
+      !g_strcmp0 (entry_a->key, entry_b->key);
+}
+
+static void
+entry_free (gpointer data)
+{
+  Entry *entry = data;
+
+  g_free (entry->key);
+  g_object_unref (entry->pixbuf);
+  g_slice_free (Entry, entry);
+}
+
+EmpathyAvatarCache *
+empathy_avatar_cache_new (gsize budget)
+{
+  EmpathyAvatarCache *cache;
+
+  cache = g_slice_new0 (EmpathyAvatarCache);
+  cache->entries = g_hash_table_new_full (entry_hash, entry_equal,
+      entry_free, NULL);
+  g_queue_init (&cache->lru);
+  cache->budget = budget;
+
+  return cache;
+}
+
+void
+empathy_avatar_cache_free (EmpathyAvatarCache *cache)
+{
+  if (cache == NULL)
+    return;
+
+  g_queue_clear (&cache->lru);
+  g_hash_table_unref (cache->entries);
+  g_slice_free (EmpathyAvatarCache, cache);
+}
+
+static gsize
+get_budget_setting (GSettings *gsettings)
+{
+  /* The key is in KiB */
+  return (gsize) g_settings_get_uint (gsettings,
+      EMPATHY_PREFS_UI_AVATAR_CACHE_SIZE) * 1024;
+}
+
+static void
+avatar_cache_size_changed_cb (GSettings *gsettings,
+    const gchar *key,
+    EmpathyAvatarCache *cache)
+{
+  empathy_avatar_cache_set_budget (cache, get_budget_setting (gsettings));
+}
+
+/* The cache used by empathy_pixbuf_avatar_from_contact_scaled () and
+ * empathy_pixbuf_avatar_from_individual_scaled_async (). Its budget follows
+ * the avatar-cache-size key. */
+EmpathyAvatarCache *
+empathy_avatar_cache_get_default (void)
+{
+  static EmpathyAvatarCache *cache = NULL;
+  static GSettings *gsettings = NULL;
+
+  if (G_UNLIKELY (cache == NULL))
+    {
+      /* Both live as long as the process */
+      gsettings = g_settings_new (EMPATHY_PREFS_UI_SCHEMA);
+      cache = empathy_avatar_cache_new (get_budget_setting (gsettings));
+
+      g_signal_connect (gsettings,
+          "changed::" EMPATHY_PREFS_UI_AVATAR_CACHE_SIZE,
+          G_CALLBACK (avatar_cache_size_changed_cb), cache);
+    }
+
+  return cache;
+}
+
+static void
+cache_remove_entry (EmpathyAvatarCache *cache,
+    Entry *entry)
+{
+  g_queue_delete_link (&cache->lru, entry->link);
+  cache->size -= entry->size;
+
+  g_hash_table_remove (cache->entries, entry);
+}
+
+static void
+cache_trim (EmpathyAvatarCache *cache)
+{
+  while (cache->size > cache->budget)
+    cache_remove_entry (cache, g_queue_peek_tail (&cache->lru));
+}
+
+void
+empathy_avatar_cache_set_budget (EmpathyAvatarCache *cache,
+    gsize budget)
+{
+  g_return_if_fail (cache != NULL);
+
+  cache->budget = budget;
+  cache_trim (cache);
+}
+
+gsize
+empathy_avatar_cache_get_budget (EmpathyAvatarCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, 0);
+
+  return cache->budget;
+}
+
+/* Memory used by the cached pixbufs, in bytes */
+gsize
+empathy_avatar_cache_get_size (EmpathyAvatarCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, 0);
+
+  return cache->size;
+}
+
+/* Returns a new ref on the pixbuf cached for @key at this size, or NULL */
+GdkPixbuf *
+empathy_avatar_cache_lookup (EmpathyAvatarCache *cache,
+    const gchar *key,
+    gint width,
+    gint height)
+{
+  Entry lookup = { (gchar *) key, width, height, NULL, 0, NULL };
+  Entry *entry;
+
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  entry = g_hash_table_lookup (cache->entries, &lookup);
+  if (entry == NULL)
+    {
+      cache->misses++;
+      return NULL;
+    }
+
+  cache->hits++;
+
+  /* Move to the front of the queue */
+  g_queue_unlink (&cache->lru, entry->link);
+  g_queue_push_head_link (&cache->lru, entry->link);
+
+  return g_object_ref (entry->pixbuf);
+}
+
+void
+empathy_avatar_cache_insert (EmpathyAvatarCache *cache,
+    const gchar *key,
+    gint width,
+    gint height,
+    GdkPixbuf *pixbuf)
+{
+  Entry lookup = { (gchar *) key, width, height, NULL, 0, NULL };
+  Entry *entry;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (GDK_IS_PIXBUF (pixbuf));
+
+  entry = g_hash_table_lookup (cache->entries, &lookup);
+  if (entry != NULL)
+    cache_remove_entry (cache, entry);
+
+  entry = g_slice_new0 (Entry);
+  entry->key = g_strdup (key);
+  entry->width = width;
+  entry->height = height;
+  entry->pixbuf = g_object_ref (pixbuf);
+  entry->size = gdk_pixbuf_get_rowstride (pixbuf) *
+      gdk_pixbuf_get_height (pixbuf);
+
+  /* Not worth dropping everything else for it */
+  if (entry->size > cache->budget)
+    {
+      entry_free (entry);
+      return;
+    }
+
+  g_hash_table_add (cache->entries, entry);
+  g_queue_push_head (&cache->lru, entry);
+  entry->link = g_queue_peek_head_link (&cache->lru);
+  cache->size += entry->size;
+
+  cache_trim (cache);
+}
+
+/* Forget all the sizes of the avatar identified by @key */
+void
+empathy_avatar_cache_remove (EmpathyAvatarCache *cache,
+    const gchar *key)
+{
+  GList *l, *next;
+
+  g_return_if_fail (cache != NULL);
+  g_return_if_fail (key != NULL);
+
+  for (l = cache->lru.head; l != NULL; l = next)
+    {
+      Entry *entry = l->data;
+
+      next = l->next;
+
+      if (!g_strcmp0 (entry->key, key))
+        cache_remove_entry (cache, entry);
+    }
+}
+
+void
+empathy_avatar_cache_clear (EmpathyAvatarCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  g_queue_clear (&cache->lru);
+  g_hash_table_remove_all (cache->entries);
+  cache->size = 0;
+}
+
+guint
+empathy_avatar_cache_get_hits (EmpathyAvatarCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, 0);
+
+  return cache->hits;
+}
+
+guint
+empathy_avatar_cache_get_misses (EmpathyAvatarCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, 0);
+
+  return cache->misses;
+}
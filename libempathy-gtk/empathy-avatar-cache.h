@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_AVATAR_CACHE_H__
+#define __EMPATHY_AVATAR_CACHE_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EmpathyAvatarCache EmpathyAvatarCache;
+
+EmpathyAvatarCache * empathy_avatar_cache_new (gsize budget);
+void empathy_avatar_cache_free (EmpathyAvatarCache *cache);
+
+EmpathyAvatarCache * empathy_avatar_cache_get_default (void);
+
+void empathy_avatar_cache_set_budget (EmpathyAvatarCache *cache,
+    gsize budget);
+gsize empathy_avatar_cache_get_budget (EmpathyAvatarCache *cache);
+gsize empathy_avatar_cache_get_size (EmpathyAvatarCache *cache);
+
+GdkPixbuf * empathy_avatar_cache_lookup (EmpathyAvatarCache *cache,
+    const gchar *key,
+    gint width,
+    gint height);
+void empathy_avatar_cache_insert (EmpathyAvatarCache *cache,
+    const gchar *key,
+    gint width,
+    gint height,
+    GdkPixbuf *pixbuf);
+void empathy_avatar_cache_remove (EmpathyAvatarCache *cache,
+    const gchar *key);
+void empathy_avatar_cache_clear (EmpathyAvatarCache *cache);
+
+guint empathy_avatar_cache_get_hits (EmpathyAvatarCache *cache);
+guint empathy_avatar_cache_get_misses (EmpathyAvatarCache *cache);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_AVATAR_CACHE_H__ */
@@ -38,6 +38,7 @@
 #include <tp-account-widgets/tpaw-utils.h>
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
+#include "empathy-backlog-reader.h"
 #include "empathy-client-factory.h"
 #include "empathy-gsettings.h"
 #include "empathy-individual-information-dialog.h"
@@ -60,6 +61,9 @@
 #define IS_ENTER(v) (v == GDK_KEY_Return || v == GDK_KEY_ISO_Enter || v == GDK_KEY_KP_Enter)
 #define COMPOSING_STOP_TIMEOUT 5
 
+/* Height of a message in pixels, until we know better */
+#define LOGS_MESSAGE_HEIGHT 40
+
 typedef enum
 {
   TRUST_LEVEL_NOT_PRIVATE,
@@ -68,6 +72,18 @@ typedef enum
   TRUST_LEVEL_FINISHED
 } TrustLevel;
 
+/* The pending messages, as seen by chat_log_filter() which runs in the
+ * thread of the log walker. The set is replaced before each fetch, but never
+ * modified once shared with that thread. */
+typedef struct {
+	GMutex      mutex;
+	/* owned set of keys built by dup_log_filter_key (), or NULL */
+	GHashTable *pending;
+	/* Only events older than this are walked, the others are still
+	 * displayed. Set before the walker is created. */
+	gint64      before;
+} ChatLogFilter;
+
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyChat)
 struct _EmpathyChatPriv {
 	EmpathyTpChat     *tp_chat;
@@ -83,7 +99,7 @@ struct _EmpathyChatPriv {
 	GSettings         *gsettings_ui;
 
 	TplLogManager     *log_manager;
-	TplLogWalker      *log_walker;
+	EmpathyBacklogReader *backlog;
 	/* Are we watching for scrolling movements? */
 	gboolean           watch_scroll;
 	/* Maximum page size of the chat->view. */
@@ -93,6 +109,11 @@ struct _EmpathyChatPriv {
 	 * restore the chat->view to the page it was on before the
 	 * latest batch of logs were inserted. */
 	guint              scroll_offset;
+	/* Value of empathy_theme_adium_get_n_pruned_messages() when the
+	 * log walker was last (re)created. */
+	guint              n_pruned_messages;
+	/* Filter of the walker of priv->backlog, owned by the walker */
+	ChatLogFilter     *log_filter;
 
 	TpAccountManager  *account_manager;
 	GList             *input_history;
@@ -2597,34 +2618,104 @@ chat_input_populate_popup_cb (GtkTextView *view,
 }
 
 
+/* Pending messages and logged events are the same if they have the same
+ * timestamp and body, as with empathy_message_equal() */
+static gchar *
+dup_log_filter_key (gint64       timestamp,
+		    const gchar *body)
+{
+	return g_strdup_printf ("%" G_GINT64_FORMAT "\n%s", timestamp,
+				body != NULL ? body : "");
+}
+
+static void
+chat_log_filter_free (gpointer data)
+{
+	ChatLogFilter *filter = data;
+
+	g_mutex_clear (&filter->mutex);
+	tp_clear_pointer (&filter->pending, g_hash_table_unref);
+
+	g_slice_free (ChatLogFilter, filter);
+}
+
+/* Called in the thread of the log walker, so it only uses the snapshot of
+ * the pending messages taken by chat_update_log_filter() */
 static gboolean
 chat_log_filter (TplEvent *event,
 		 gpointer user_data)
 {
-	EmpathyChat *chat = EMPATHY_CHAT (user_data);
-	EmpathyChatPriv *priv = GET_PRIV (chat);
-	EmpathyMessage *message;
-	const GList *pending;
-	bool retval = FALSE;
+	ChatLogFilter *filter = user_data;
+	TplTextEvent *text_event;
+	GHashTable *pending;
+	gint64 timestamp;
+	gchar *key;
+	gboolean retval;
 
 	g_return_val_if_fail (TPL_IS_EVENT (event), FALSE);
-	g_return_val_if_fail (EMPATHY_IS_CHAT (chat), FALSE);
 
-	pending = empathy_tp_chat_get_pending_messages (priv->tp_chat);
-	message = empathy_message_from_tpl_log_event (event);
+	if (!TPL_IS_TEXT_EVENT (event))
+		return TRUE;
 
-	for (; pending; pending = g_list_next (pending)) {
-		if (empathy_message_equal (message, pending->data))
-			goto out;
-	}
+	if (tpl_event_get_timestamp (event) >= filter->before)
+		return FALSE;
 
-	retval = TRUE;
+	g_mutex_lock (&filter->mutex);
+	pending = filter->pending != NULL ?
+		g_hash_table_ref (filter->pending) : NULL;
+	g_mutex_unlock (&filter->mutex);
+
+	if (pending == NULL)
+		return TRUE;
+
+	/* Edited messages have the time of the edit, as in
+	 * empathy_message_from_tpl_log_event() */
+	text_event = TPL_TEXT_EVENT (event);
+	if (tp_str_empty (tpl_text_event_get_supersedes_token (text_event)))
+		timestamp = tpl_event_get_timestamp (event);
+	else
+		timestamp = tpl_text_event_get_edit_timestamp (text_event);
+
+	/* Skip messages which are still pending, they are displayed by
+	 * show_pending_messages() */
+	key = dup_log_filter_key (timestamp,
+				  tpl_text_event_get_message (text_event));
+	retval = !g_hash_table_contains (pending, key);
+
+	g_free (key);
+	g_hash_table_unref (pending);
 
-out:
-	g_object_unref (message);
 	return retval;
 }
 
+/* Takes a snapshot of the pending messages for chat_log_filter(), before
+ * the log walker is asked for events */
+static void
+chat_update_log_filter (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+	GHashTable *pending, *old;
+	const GList *l;
+
+	pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					 NULL);
+
+	if (priv->tp_chat != NULL) {
+		for (l = empathy_tp_chat_get_pending_messages (priv->tp_chat);
+		     l != NULL; l = g_list_next (l))
+			g_hash_table_add (pending, dup_log_filter_key (
+				empathy_message_get_timestamp (l->data),
+				empathy_message_get_body (l->data)));
+	}
+
+	g_mutex_lock (&priv->log_filter->mutex);
+	old = priv->log_filter->pending;
+	priv->log_filter->pending = pending;
+	g_mutex_unlock (&priv->log_filter->mutex);
+
+	tp_clear_pointer (&old, g_hash_table_unref);
+}
+
 static void
 show_pending_messages (EmpathyChat *chat) {
 	EmpathyChatPriv *priv = GET_PRIV (chat);
@@ -2662,25 +2753,29 @@ chat_scrollable_set_value (gpointer user_data)
 	return G_SOURCE_REMOVE;
 }
 
+/* Read the next pages ahead while the user reads this one */
 static void
-got_filtered_messages_cb (GObject *walker,
-		GAsyncResult *result,
-		gpointer user_data)
+chat_prefetch_logs (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+
+	chat_update_log_filter (chat);
+	empathy_backlog_reader_prefetch (priv->backlog,
+		g_settings_get_uint (priv->gsettings_chat,
+			EMPATHY_PREFS_CHAT_BACKLOG_PREFETCH_PAGES));
+}
+
+/* Display @messages, a list of TplEvent in chronological order, and free
+ * it */
+static void
+chat_show_logs (EmpathyChat *chat,
+		GList *messages)
 {
 	GList *l;
-	GList *messages;
-	EmpathyChat *chat = EMPATHY_CHAT (user_data);
 	EmpathyChatPriv *priv = GET_PRIV (chat);
-	GError *error = NULL;
 
-	if (!tpl_log_walker_get_events_finish (TPL_LOG_WALKER (walker),
-		result, &messages, &error)) {
-		DEBUG ("%s. Aborting.", error->message);
-		empathy_theme_adium_append_event (chat->view,
-			_("Failed to retrieve recent logs"));
-		g_error_free (error);
-		goto out;
-	}
+	/* Insert the whole page of logs with a single script */
+	empathy_theme_adium_begin_batch (chat->view);
 
 	for (l = g_list_last (messages); l; l = g_list_previous (l)) {
 		EmpathyMessage *message;
@@ -2722,7 +2817,8 @@ got_filtered_messages_cb (GObject *walker,
 	}
 	g_list_free (messages);
 
-out:
+	empathy_theme_adium_end_batch (chat->view);
+
 	/* FIXME: See Bug#610994, we are forcing the ACK of the queue. See comments
 	 * about it in EmpathyChatPriv definition */
 	priv->retrieving_backlogs = FALSE;
@@ -2737,8 +2833,7 @@ out:
 	 * the upper edge and trigger another batch of logs to be
 	 * fetched.
 	 */
-	if (G_UNLIKELY (!priv->watch_scroll &&
-			!tpl_log_walker_is_end (priv->log_walker))) {
+	if (G_UNLIKELY (!priv->watch_scroll)) {
 		priv->watch_scroll = TRUE;
 		g_idle_add_full (G_PRIORITY_LOW, chat_scrollable_connect,
 		    g_object_ref (chat), g_object_unref);
@@ -2764,9 +2859,109 @@ out:
 		    g_object_ref (chat), g_object_unref);
 	}
 
+	chat_prefetch_logs (chat);
+}
+
+static void
+got_filtered_messages_cb (GObject *backlog,
+		GAsyncResult *result,
+		gpointer user_data)
+{
+	GList *messages;
+	EmpathyChat *chat = EMPATHY_CHAT (user_data);
+	GError *error = NULL;
+
+	if (!empathy_backlog_reader_get_page_finish (
+		EMPATHY_BACKLOG_READER (backlog), result, &messages, &error)) {
+		DEBUG ("%s. Aborting.", error->message);
+		empathy_theme_adium_append_event (chat->view,
+			_("Failed to retrieve recent logs"));
+		g_error_free (error);
+		messages = NULL;
+	}
+
+	chat_show_logs (chat, messages);
+
 	g_object_unref (chat);
 }
 
+/* Returns TRUE if some events have not been displayed yet, either because
+ * the walker did not return them yet or because they have been read ahead */
+static gboolean
+chat_has_more_logs (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+
+	return empathy_backlog_reader_has_more (priv->backlog);
+}
+
+static void
+chat_update_logs_page_size (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+	GtkAdjustment *adjustment;
+	gdouble message_height = LOGS_MESSAGE_HEIGHT;
+	guint n_messages;
+	guint size;
+
+	/* Enough messages to fill the view */
+	adjustment = gtk_scrollable_get_vadjustment (
+	    GTK_SCROLLABLE (chat->view));
+	n_messages = empathy_theme_adium_get_n_messages (chat->view);
+	if (n_messages > 0 && gtk_adjustment_get_upper (adjustment) > 0)
+		message_height = MAX (1,
+			gtk_adjustment_get_upper (adjustment) / n_messages);
+
+	size = gtk_adjustment_get_page_size (adjustment) / message_height + 1;
+
+	/* Pages get bigger while the user keeps hitting the top of the view
+	 * quickly */
+	empathy_backlog_reader_update_page_size (priv->backlog, size,
+		g_settings_get_uint (priv->gsettings_chat,
+			EMPATHY_PREFS_CHAT_BACKLOG_MAX_PAGE_SIZE));
+}
+
+/* Walks the logs from the most recent event older than @before */
+static void
+chat_create_backlog (EmpathyChat *chat,
+		     gint64       before)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+	TplLogWalker *walker;
+	TplEntity *target;
+
+	if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
+		target = tpl_entity_new_from_room_id (priv->id);
+	else
+		target = tpl_entity_new (priv->id, TPL_ENTITY_CONTACT, NULL, NULL);
+
+	/* The filter lives as long as the walker, which can outlive the
+	 * chat while fetching events */
+	priv->log_filter = g_slice_new0 (ChatLogFilter);
+	g_mutex_init (&priv->log_filter->mutex);
+	priv->log_filter->before = before;
+
+	walker = tpl_log_manager_walk_filtered_events (priv->log_manager, priv->account, target,
+						       TPL_EVENT_MASK_TEXT, chat_log_filter, priv->log_filter);
+	g_object_set_data_full (G_OBJECT (walker), "empathy-chat-log-filter",
+				priv->log_filter, chat_log_filter_free);
+
+	tp_clear_object (&priv->backlog);
+	priv->backlog = empathy_backlog_reader_new (walker);
+
+	g_object_unref (walker);
+	g_object_unref (target);
+}
+
+static gboolean
+chat_logs_pruned (EmpathyChat *chat)
+{
+	EmpathyChatPriv *priv = GET_PRIV (chat);
+
+	return empathy_theme_adium_get_n_pruned_messages (chat->view) !=
+		priv->n_pruned_messages;
+}
+
 static gboolean
 chat_add_logs (EmpathyChat *chat)
 {
@@ -2779,7 +2974,24 @@ chat_add_logs (EmpathyChat *chat)
 	/* Turn off scrolling temporarily */
 	empathy_theme_adium_scroll (chat->view, FALSE);
 
-	tpl_log_walker_get_events_async (priv->log_walker, 5,
+	if (chat_logs_pruned (chat)) {
+		/* The oldest messages have been removed from the view to
+		 * bound its size. Walk the logs again from the events older
+		 * than the ones which are still displayed. */
+		priv->n_pruned_messages =
+			empathy_theme_adium_get_n_pruned_messages (chat->view);
+		chat_create_backlog (chat,
+			empathy_theme_adium_get_oldest_timestamp (chat->view));
+
+		DEBUG ("Reloading logs removed from the view");
+	}
+
+	chat_update_logs_page_size (chat);
+	chat_update_log_filter (chat);
+
+	/* Logs read ahead are displayed right away, or as soon as they
+	 * arrive */
+	empathy_backlog_reader_get_page_async (priv->backlog,
 	    got_filtered_messages_cb, g_object_ref (chat));
 
 	return G_SOURCE_REMOVE;
@@ -2794,6 +3006,14 @@ chat_schedule_logs (EmpathyChat *chat)
 		return;
 
 	priv->retrieving_backlogs = TRUE;
+
+	/* Logs read ahead can be displayed right away */
+	if (empathy_backlog_reader_has_prefetched (priv->backlog)) {
+		g_idle_add_full (G_PRIORITY_LOW, (GSourceFunc) chat_add_logs,
+		    g_object_ref (chat), g_object_unref);
+		return;
+	}
+
 	g_timeout_add_full (G_PRIORITY_LOW, 500, /* ms */
 	    (GSourceFunc) chat_add_logs, g_object_ref (chat), g_object_unref);
 }
@@ -2806,7 +3026,7 @@ chat_view_adjustment_changed_cb (GtkAdjustment *adjustment,
 	EmpathyChatPriv *priv = GET_PRIV (chat);
 	guint page_size;
 
-	if (tpl_log_walker_is_end (priv->log_walker)) {
+	if (!chat_has_more_logs (chat)) {
 		g_signal_handlers_disconnect_by_func (adjustment,
 		    chat_view_adjustment_changed_cb, user_data);
 		return;
@@ -2834,11 +3054,10 @@ chat_view_adjustment_value_changed_cb (GtkAdjustment *adjustment,
 	guint lower;
 	guint value;
 
-	if (tpl_log_walker_is_end (priv->log_walker)) {
-		g_signal_handlers_disconnect_by_func (adjustment,
-		    chat_view_adjustment_value_changed_cb, user_data);
+	/* Keep watching once all the logs have been fetched: messages
+	 * removed from the view later can be fetched again. */
+	if (!chat_has_more_logs (chat) && !chat_logs_pruned (chat))
 		return;
-	}
 
 	lower = (guint) gtk_adjustment_get_lower (adjustment);
 	value = (guint) gtk_adjustment_get_value (adjustment);
@@ -3481,7 +3700,7 @@ chat_finalize (GObject *object)
 
 	g_object_unref (priv->account_manager);
 	g_object_unref (priv->log_manager);
-	g_object_unref (priv->log_walker);
+	tp_clear_object (&priv->backlog);
 
 	if (priv->tp_chat) {
 		g_signal_handlers_disconnect_by_func (priv->tp_chat,
@@ -3541,7 +3760,6 @@ chat_constructed (GObject *object)
 {
 	EmpathyChat *chat = EMPATHY_CHAT (object);
 	EmpathyChatPriv *priv = GET_PRIV (chat);
-	TplEntity *target;
 
 	if (priv->tp_chat != NULL) {
 		TpChannel *channel = TP_CHANNEL (priv->tp_chat);
@@ -3560,14 +3778,7 @@ chat_constructed (GObject *object)
 	 * longer needed. Pending messages are handled within
 	 * empathy_chat_set_tp_chat() so we don't have to care about them here.
 	 */
-	if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
-		target = tpl_entity_new_from_room_id (priv->id);
-	else
-		target = tpl_entity_new (priv->id, TPL_ENTITY_CONTACT, NULL, NULL);
-
-	priv->log_walker = tpl_log_manager_walk_filtered_events (priv->log_manager, priv->account, target,
-								 TPL_EVENT_MASK_TEXT, chat_log_filter, chat);
-	g_object_unref (target);
+	chat_create_backlog (chat, G_MAXINT64);
 
 	if (priv->handle_type != TP_HANDLE_TYPE_ROOM) {
 		chat_add_logs (chat);
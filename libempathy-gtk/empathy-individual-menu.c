@@ -1516,6 +1516,25 @@ empathy_individual_log_menu_item_activated (GtkMenuItem *item,
       empathy_contact_get_id (contact), FALSE, NULL);
 }
 
+static void
+log_menu_item_got_contact_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GtkWidget *item = user_data;
+  EmpathyContact *contact;
+
+  contact = empathy_contact_dup_best_for_action_finish (
+      FOLKS_INDIVIDUAL (source), result, NULL);
+
+  menu_item_set_contact (item, contact,
+      G_CALLBACK (empathy_individual_log_menu_item_activated),
+      EMPATHY_ACTION_VIEW_LOGS);
+
+  tp_clear_object (&contact);
+  g_object_unref (item);
+}
+
 static GtkWidget *
 empathy_individual_log_menu_item_new (FolksIndividual *individual)
 {
@@ -1529,9 +1548,13 @@ empathy_individual_log_menu_item_new (FolksIndividual *individual)
   gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (item), image);
   gtk_widget_show (image);
 
-  menu_item_set_first_contact (item, individual,
-      G_CALLBACK (empathy_individual_log_menu_item_activated),
-      EMPATHY_ACTION_VIEW_LOGS);
+  /* The logs of every persona are looked up in the background, then the
+   * item opens those of the best one having some. Until then, the item is
+   * insensitive. */
+  gtk_widget_set_sensitive (item, FALSE);
+  empathy_contact_dup_best_for_action_async (individual,
+      EMPATHY_ACTION_VIEW_LOGS, log_menu_item_got_contact_cb,
+      g_object_ref (item));
 
   return item;
 }
@@ -84,9 +84,23 @@ enum
   PROP_SORT_CRITERIUM
 };
 
+/* Columns of an individual's rows which need to be refreshed */
+typedef enum
+{
+  /* presence type and message, online state and status icon */
+  UPDATE_PRESENCE = 1 << 0,
+  UPDATE_ALIAS = 1 << 1,
+  UPDATE_AVATAR = 1 << 2,
+  /* audio/video call capabilities and client types */
+  UPDATE_CAPABILITIES = 1 << 3,
+  UPDATE_ALL = UPDATE_PRESENCE | UPDATE_ALIAS | UPDATE_AVATAR |
+      UPDATE_CAPABILITIES
+} IndividualStoreUpdate;
+
 /* prototypes to break cycles */
 static void individual_store_contact_update (EmpathyIndividualStore *self,
-    FolksIndividual *individual);
+    FolksIndividual *individual,
+    IndividualStoreUpdate what);
 
 G_DEFINE_TYPE (EmpathyIndividualStore, empathy_individual_store,
     GTK_TYPE_TREE_STORE);
@@ -374,7 +388,9 @@ empathy_individual_store_add_individual (EmpathyIndividualStore *self,
 
 
 finally:
-  individual_store_contact_update (self, individual);
+  /* add_individual_to_store () already set the name and capabilities */
+  individual_store_contact_update (self, individual,
+      UPDATE_PRESENCE | UPDATE_AVATAR);
 }
 
 static void
@@ -549,8 +565,30 @@ individual_avatar_pixbuf_received_cb (FolksIndividual *individual,
 }
 
 static void
-individual_store_contact_update (EmpathyIndividualStore *self,
+individual_store_load_avatar (EmpathyIndividualStore *self,
     FolksIndividual *individual)
+{
+  LoadAvatarData *load_avatar_data;
+
+  load_avatar_data = g_slice_new (LoadAvatarData);
+  load_avatar_data->store = self;
+  g_object_add_weak_pointer (G_OBJECT (self),
+      (gpointer *) &load_avatar_data->store);
+  load_avatar_data->cancellable = g_cancellable_new ();
+
+  self->priv->avatar_cancellables = g_list_prepend (
+      self->priv->avatar_cancellables, load_avatar_data->cancellable);
+
+  empathy_pixbuf_avatar_from_individual_scaled_async (individual, 32, 32,
+      load_avatar_data->cancellable,
+      (GAsyncReadyCallback) individual_avatar_pixbuf_received_cb,
+      load_avatar_data);
+}
+
+static void
+individual_store_contact_update (EmpathyIndividualStore *self,
+    FolksIndividual *individual,
+    IndividualStoreUpdate what)
 {
   ShowActiveData *data;
   GtkTreeModel *model;
@@ -563,8 +601,9 @@ individual_store_contact_update (EmpathyIndividualStore *self,
   gboolean do_set_active = FALSE;
   gboolean do_set_refresh = FALSE;
   gboolean show_avatar = FALSE;
-  GdkPixbuf *pixbuf_status;
-  LoadAvatarData *load_avatar_data;
+  gboolean can_audio_call = FALSE, can_video_call = FALSE;
+  const gchar * const *types = NULL;
+  GdkPixbuf *pixbuf_status = NULL;
 
   model = GTK_TREE_MODEL (self);
 
@@ -587,6 +626,7 @@ individual_store_contact_update (EmpathyIndividualStore *self,
       DEBUG ("Individual'%s' in list:NO, should be:YES",
           folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual)));
 
+      /* This does a full update of the new rows, if any */
       empathy_individual_store_add_individual (self, individual);
 
       if (self->priv->show_active)
@@ -594,6 +634,11 @@ individual_store_contact_update (EmpathyIndividualStore *self,
           do_set_active = TRUE;
         }
     }
+  else if (!(what & UPDATE_PRESENCE))
+    {
+      /* The online state didn't change */
+      set_model = TRUE;
+    }
   else
     {
       /* Get online state before. */
@@ -627,53 +672,51 @@ individual_store_contact_update (EmpathyIndividualStore *self,
       show_avatar = TRUE;
     }
 
-  /* Load the avatar asynchronously */
-  load_avatar_data = g_slice_new (LoadAvatarData);
-  load_avatar_data->store = self;
-  g_object_add_weak_pointer (G_OBJECT (self),
-      (gpointer *) &load_avatar_data->store);
-  load_avatar_data->cancellable = g_cancellable_new ();
-
-  self->priv->avatar_cancellables = g_list_prepend (
-      self->priv->avatar_cancellables, load_avatar_data->cancellable);
+  /* Only reload the avatar when it changed, presence changes are far more
+   * frequent */
+  if (set_model && (what & UPDATE_AVATAR))
+    individual_store_load_avatar (self, individual);
 
-  empathy_pixbuf_avatar_from_individual_scaled_async (individual, 32, 32,
-      load_avatar_data->cancellable,
-      (GAsyncReadyCallback) individual_avatar_pixbuf_received_cb,
-      load_avatar_data);
-
-  pixbuf_status =
-      empathy_individual_store_get_individual_status_icon (self, individual);
+  if (set_model && (what & UPDATE_PRESENCE))
+    pixbuf_status =
+        empathy_individual_store_get_individual_status_icon (self, individual);
 
-  for (l = iters; l && set_model; l = l->next)
+  if (set_model && (what & UPDATE_CAPABILITIES))
     {
-      gboolean can_audio_call, can_video_call;
-      const gchar * const *types;
-
       empathy_individual_can_audio_video_call (individual, &can_audio_call,
           &can_video_call, NULL);
 
       types = empathy_individual_get_client_types (individual);
+    }
 
-      gtk_tree_store_set (GTK_TREE_STORE (self), l->data,
-          EMPATHY_INDIVIDUAL_STORE_COL_ICON_STATUS, pixbuf_status,
-          EMPATHY_INDIVIDUAL_STORE_COL_PIXBUF_AVATAR_VISIBLE, show_avatar,
-          EMPATHY_INDIVIDUAL_STORE_COL_NAME,
-            folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual)),
-          EMPATHY_INDIVIDUAL_STORE_COL_PRESENCE_TYPE,
-            folks_presence_details_get_presence_type (
-                FOLKS_PRESENCE_DETAILS (individual)),
-          EMPATHY_INDIVIDUAL_STORE_COL_STATUS,
-            folks_presence_details_get_presence_message (
-                FOLKS_PRESENCE_DETAILS (individual)),
-          EMPATHY_INDIVIDUAL_STORE_COL_COMPACT, self->priv->is_compact,
-          EMPATHY_INDIVIDUAL_STORE_COL_IS_GROUP, FALSE,
-          EMPATHY_INDIVIDUAL_STORE_COL_IS_ONLINE, now_online,
-          EMPATHY_INDIVIDUAL_STORE_COL_IS_SEPARATOR, FALSE,
-          EMPATHY_INDIVIDUAL_STORE_COL_CAN_AUDIO_CALL, can_audio_call,
-          EMPATHY_INDIVIDUAL_STORE_COL_CAN_VIDEO_CALL, can_video_call,
-          EMPATHY_INDIVIDUAL_STORE_COL_CLIENT_TYPES, types,
-          -1);
+  for (l = iters; l && set_model; l = l->next)
+    {
+      if (what & UPDATE_PRESENCE)
+        gtk_tree_store_set (GTK_TREE_STORE (self), l->data,
+            EMPATHY_INDIVIDUAL_STORE_COL_ICON_STATUS, pixbuf_status,
+            EMPATHY_INDIVIDUAL_STORE_COL_PIXBUF_AVATAR_VISIBLE, show_avatar,
+            EMPATHY_INDIVIDUAL_STORE_COL_PRESENCE_TYPE,
+              folks_presence_details_get_presence_type (
+                  FOLKS_PRESENCE_DETAILS (individual)),
+            EMPATHY_INDIVIDUAL_STORE_COL_STATUS,
+              folks_presence_details_get_presence_message (
+                  FOLKS_PRESENCE_DETAILS (individual)),
+            EMPATHY_INDIVIDUAL_STORE_COL_COMPACT, self->priv->is_compact,
+            EMPATHY_INDIVIDUAL_STORE_COL_IS_ONLINE, now_online,
+            -1);
+
+      if (what & UPDATE_ALIAS)
+        gtk_tree_store_set (GTK_TREE_STORE (self), l->data,
+            EMPATHY_INDIVIDUAL_STORE_COL_NAME,
+              folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual)),
+            -1);
+
+      if (what & UPDATE_CAPABILITIES)
+        gtk_tree_store_set (GTK_TREE_STORE (self), l->data,
+            EMPATHY_INDIVIDUAL_STORE_COL_CAN_AUDIO_CALL, can_audio_call,
+            EMPATHY_INDIVIDUAL_STORE_COL_CAN_VIDEO_CALL, can_video_call,
+            EMPATHY_INDIVIDUAL_STORE_COL_CLIENT_TYPES, types,
+            -1);
     }
 
   if (self->priv->show_active && do_set_active)
@@ -704,7 +747,16 @@ individual_store_individual_updated_cb (FolksIndividual *individual,
     GParamSpec *param,
     EmpathyIndividualStore *self)
 {
-  individual_store_contact_update (self, individual);
+  IndividualStoreUpdate what;
+
+  if (!tp_strdiff (param->name, "avatar"))
+    what = UPDATE_AVATAR;
+  else if (!tp_strdiff (param->name, "alias"))
+    what = UPDATE_ALIAS;
+  else
+    what = UPDATE_PRESENCE;
+
+  individual_store_contact_update (self, individual, what);
 }
 
 static void
@@ -718,14 +770,15 @@ individual_store_contact_updated_cb (EmpathyContact *contact,
   if (individual == NULL)
     return;
 
-  individual_store_contact_update (self, individual);
+  individual_store_contact_update (self, individual, UPDATE_CAPABILITIES);
 }
 
+/* Follows the capabilities of the contacts of the personas of @individual */
 static void
-individual_personas_changed_cb (FolksIndividual *individual,
+individual_store_connect_personas (EmpathyIndividualStore *self,
+    FolksIndividual *individual,
     GeeSet *added,
-    GeeSet *removed,
-    EmpathyIndividualStore *self)
+    GeeSet *removed)
 {
   GeeIterator *iter;
 
@@ -788,6 +841,20 @@ individual_personas_changed_cb (FolksIndividual *individual,
   g_clear_object (&iter);
 }
 
+static void
+individual_personas_changed_cb (FolksIndividual *individual,
+    GeeSet *added,
+    GeeSet *removed,
+    EmpathyIndividualStore *self)
+{
+  individual_store_connect_personas (self, individual, added, removed);
+
+  /* The capabilities and the avatar are those of the personas, which
+   * notify of their own changes but not of being added or removed */
+  individual_store_contact_update (self, individual,
+      UPDATE_CAPABILITIES | UPDATE_AVATAR);
+}
+
 static void
 individual_store_favourites_changed_cb (FolksIndividual *individual,
     GParamSpec *param,
@@ -823,9 +890,10 @@ individual_store_add_individual_and_connect (EmpathyIndividualStore *self,
   g_signal_connect (individual, "notify::is-favourite",
       (GCallback) individual_store_favourites_changed_cb, self);
 
-  /* provide an empty set so the callback can assume non-NULL sets */
-  individual_personas_changed_cb (individual,
-      folks_individual_get_personas (individual), empty_set, self);
+  /* provide an empty set so the callback can assume non-NULL sets;
+   * empathy_individual_store_add_individual () already updated the rows */
+  individual_store_connect_personas (self, individual,
+      folks_individual_get_personas (individual), empty_set);
   g_clear_object (&empty_set);
 }
 
@@ -836,8 +904,8 @@ empathy_individual_store_disconnect_individual (EmpathyIndividualStore *self,
   GeeSet *empty_set = gee_set_empty (G_TYPE_NONE, NULL, NULL);
 
   /* provide an empty set so the callback can assume non-NULL sets */
-  individual_personas_changed_cb (individual, empty_set,
-      folks_individual_get_personas (individual), self);
+  individual_store_connect_personas (self, individual, empty_set,
+      folks_individual_get_personas (individual));
   g_clear_object (&empty_set);
 
   g_signal_handlers_disconnect_by_func (individual,
@@ -1106,9 +1174,7 @@ individual_store_contact_sort (FolksIndividual *individual_a,
   g_return_val_if_fail (individual_a != NULL || individual_b != NULL, 0);
 
   /* alias */
-  ret_val = g_utf8_collate (
-      folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual_a)),
-      folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual_b)));
+  ret_val = empathy_individual_compare_by_alias (individual_a, individual_b);
 
   if (ret_val != 0)
     goto out;
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-log-events-mirror.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+/* Reproduces the rows of the log window's events tree model in the
+ * empathy-log-window.html page. Filling the model with the events of a day
+ * changes thousands of rows in a row, so the scripts are accumulated and
+ * executed all at once from an idle callback. */
+
+struct _EmpathyLogEventsMirror
+{
+  GtkTreeModel *model;
+  WebKitWebView *webview;
+
+  gint text_column;
+  gint date_column;
+  gint icon_column;
+
+  /* Scripts not executed yet */
+  GString *batch;
+  guint flush_id;
+  guint n_executed;
+
+  /* Icon name -> owned path of its file, "" if it has none */
+  GHashTable *icons;
+  GtkIconTheme *icon_theme;
+};
+
+static gboolean
+mirror_flush_cb (gpointer user_data)
+{
+  EmpathyLogEventsMirror *mirror = user_data;
+
+  mirror->flush_id = 0;
+  empathy_log_events_mirror_flush (mirror);
+
+  return FALSE;
+}
+
+/* Scripts are executed in the order they were added, be it from the model's
+ * signals or by empathy_log_events_mirror_execute_script () */
+static void
+mirror_add_script (EmpathyLogEventsMirror *mirror,
+    const gchar *script)
+{
+  /* An exception must not prevent the following scripts from running, as
+   * it wouldn't if they were executed one by one */
+  g_string_append (mirror->batch, "try { ");
+  g_string_append (mirror->batch, script);
+  g_string_append (mirror->batch, "; } catch (e) {}\n");
+
+  if (mirror->flush_id == 0)
+    mirror->flush_id = g_idle_add (mirror_flush_cb, mirror);
+}
+
+static const gchar *
+mirror_lookup_icon (EmpathyLogEventsMirror *mirror,
+    const gchar *icon_name)
+{
+  gchar *filename;
+
+  if (tp_str_empty (icon_name))
+    return "";
+
+  filename = g_hash_table_lookup (mirror->icons, icon_name);
+
+  if (filename == NULL)
+    {
+      GtkIconInfo *icon_info = gtk_icon_theme_lookup_icon (mirror->icon_theme,
+          icon_name, GTK_ICON_SIZE_MENU, 0);
+
+      if (icon_info != NULL)
+        {
+          filename = g_strdup (gtk_icon_info_get_filename (icon_info));
+          g_object_unref (icon_info);
+        }
+
+      if (filename == NULL)
+        filename = g_strdup ("");
+
+      g_hash_table_insert (mirror->icons, g_strdup (icon_name), filename);
+    }
+
+  return filename;
+}
+
+static void
+mirror_icon_theme_changed_cb (GtkIconTheme *icon_theme,
+    EmpathyLogEventsMirror *mirror)
+{
+  g_hash_table_remove_all (mirror->icons);
+}
+
+/* Appends @path as a javascript array of indices */
+static void
+append_path (GString *script,
+    GtkTreePath *path)
+{
+  gint *indices, depth, i;
+
+  indices = gtk_tree_path_get_indices_with_depth (path, &depth);
+
+  g_string_append_c (script, '[');
+
+  for (i = 0; i < depth; i++)
+    g_string_append_printf (script, i > 0 ? ",%d" : "%d", indices[i]);
+
+  g_string_append_c (script, ']');
+}
+
+/* Appends @text as a javascript string literal */
+static void
+append_string (GString *script,
+    const gchar *text)
+{
+  gint i;
+
+  g_string_append_c (script, '\'');
+
+  /* Only need to deal with «'» and «\».
+   *
+   * Note that these never appear in non-ascii utf8 characters, so just
+   * pretend like we have an ascii string...
+   */
+  for (i = 0; text != NULL && text[i]; i++)
+    {
+      gchar c = text[i];
+
+      if (c == '\'' || c == '\\')
+        g_string_append_c (script, '\\');
+
+      g_string_append_c (script, c);
+    }
+
+  g_string_append_c (script, '\'');
+}
+
+static void
+insert_or_change_row (EmpathyLogEventsMirror *mirror,
+    const char *method,
+    GtkTreePath *path,
+    GtkTreeIter *iter)
+{
+  GString *script;
+  char *text, *date, *icon_name;
+
+  gtk_tree_model_get (mirror->model, iter,
+      mirror->text_column, &text,
+      mirror->date_column, &date,
+      mirror->icon_column, &icon_name,
+      -1);
+
+  script = g_string_new (method);
+  g_string_append_c (script, '(');
+  append_path (script, path);
+  g_string_append (script, ", ");
+  append_string (script, text);
+  g_string_append_printf (script, ", '%s', '%s')",
+      mirror_lookup_icon (mirror, icon_name),
+      date != NULL ? date : "(null)");
+
+  mirror_add_script (mirror, script->str);
+
+  g_string_free (script, TRUE);
+  g_free (text);
+  g_free (date);
+  g_free (icon_name);
+}
+
+static void
+model_row_inserted_cb (GtkTreeModel *model,
+    GtkTreePath *path,
+    GtkTreeIter *iter,
+    EmpathyLogEventsMirror *mirror)
+{
+  insert_or_change_row (mirror, "insertRow", path, iter);
+}
+
+static void
+model_row_changed_cb (GtkTreeModel *model,
+    GtkTreePath *path,
+    GtkTreeIter *iter,
+    EmpathyLogEventsMirror *mirror)
+{
+  insert_or_change_row (mirror, "changeRow", path, iter);
+}
+
+static void
+model_row_deleted_cb (GtkTreeModel *model,
+    GtkTreePath *path,
+    EmpathyLogEventsMirror *mirror)
+{
+  GString *script = g_string_new ("deleteRow(");
+
+  append_path (script, path);
+  g_string_append_c (script, ')');
+
+  mirror_add_script (mirror, script->str);
+
+  g_string_free (script, TRUE);
+}
+
+static void
+model_row_has_child_toggled_cb (GtkTreeModel *model,
+    GtkTreePath *path,
+    GtkTreeIter *iter,
+    EmpathyLogEventsMirror *mirror)
+{
+  GString *script = g_string_new ("hasChildRows(");
+
+  append_path (script, path);
+  g_string_append_printf (script, ", %u)",
+      gtk_tree_model_iter_has_child (model, iter));
+
+  mirror_add_script (mirror, script->str);
+
+  g_string_free (script, TRUE);
+}
+
+static void
+model_rows_reordered_cb (GtkTreeModel *model,
+    GtkTreePath *path,
+    GtkTreeIter *iter,
+    int *new_order,
+    EmpathyLogEventsMirror *mirror)
+{
+  GString *script = g_string_new ("reorderRows(");
+  int i, children = gtk_tree_model_iter_n_children (model, iter);
+
+  append_path (script, path);
+  g_string_append (script, ", [");
+
+  for (i = 0; i < children; i++)
+    g_string_append_printf (script, i > 0 ? ",%i" : "%i", new_order[i]);
+
+  g_string_append (script, "])");
+
+  mirror_add_script (mirror, script->str);
+
+  g_string_free (script, TRUE);
+}
+
+EmpathyLogEventsMirror *
+empathy_log_events_mirror_new (GtkTreeModel *model,
+    WebKitWebView *webview,
+    gint text_column,
+    gint date_column,
+    gint icon_column)
+{
+  EmpathyLogEventsMirror *mirror;
+
+  g_return_val_if_fail (GTK_IS_TREE_MODEL (model), NULL);
+  g_return_val_if_fail (WEBKIT_IS_WEB_VIEW (webview), NULL);
+
+  mirror = g_slice_new0 (EmpathyLogEventsMirror);
+  mirror->model = g_object_ref (model);
+  mirror->webview = g_object_ref (webview);
+  mirror->text_column = text_column;
+  mirror->date_column = date_column;
+  mirror->icon_column = icon_column;
+  mirror->batch = g_string_new (NULL);
+
+  mirror->icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      g_free);
+  mirror->icon_theme = g_object_ref (gtk_icon_theme_get_default ());
+
+  g_signal_connect (mirror->icon_theme, "changed",
+      G_CALLBACK (mirror_icon_theme_changed_cb), mirror);
+
+  g_signal_connect (model, "row-inserted",
+      G_CALLBACK (model_row_inserted_cb), mirror);
+  g_signal_connect (model, "row-changed",
+      G_CALLBACK (model_row_changed_cb), mirror);
+  g_signal_connect (model, "row-deleted",
+      G_CALLBACK (model_row_deleted_cb), mirror);
+  g_signal_connect (model, "rows-reordered",
+      G_CALLBACK (model_rows_reordered_cb), mirror);
+  g_signal_connect (model, "row-has-child-toggled",
+      G_CALLBACK (model_row_has_child_toggled_cb), mirror);
+
+  return mirror;
+}
+
+void
+empathy_log_events_mirror_free (EmpathyLogEventsMirror *mirror)
+{
+  if (mirror->flush_id != 0)
+    g_source_remove (mirror->flush_id);
+
+  g_signal_handlers_disconnect_by_data (mirror->model, mirror);
+  g_signal_handlers_disconnect_by_data (mirror->icon_theme, mirror);
+
+  g_object_unref (mirror->model);
+  g_object_unref (mirror->webview);
+  g_object_unref (mirror->icon_theme);
+  g_hash_table_unref (mirror->icons);
+  g_string_free (mirror->batch, TRUE);
+
+  g_slice_free (EmpathyLogEventsMirror, mirror);
+}
+
+/* Runs @script in the page once the pending changes of the model have been
+ * reproduced in it */
+void
+empathy_log_events_mirror_execute_script (EmpathyLogEventsMirror *mirror,
+    const gchar *script)
+{
+  mirror_add_script (mirror, script);
+}
+
+/* Executes the pending scripts right away rather than from the idle
+ * callback */
+void
+empathy_log_events_mirror_flush (EmpathyLogEventsMirror *mirror)
+{
+  if (mirror->flush_id != 0)
+    {
+      g_source_remove (mirror->flush_id);
+      mirror->flush_id = 0;
+    }
+
+  if (mirror->batch->len == 0)
+    return;
+
+  webkit_web_view_execute_script (mirror->webview, mirror->batch->str);
+  mirror->n_executed++;
+
+  g_string_truncate (mirror->batch, 0);
+}
+
+/* Number of times webkit_web_view_execute_script () has been called */
+guint
+empathy_log_events_mirror_get_n_executed (EmpathyLogEventsMirror *mirror)
+{
+  return mirror->n_executed;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_LOG_EVENTS_MIRROR_H__
+#define __EMPATHY_LOG_EVENTS_MIRROR_H__
+
+#include <gtk/gtk.h>
+#include <webkit/webkit.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EmpathyLogEventsMirror EmpathyLogEventsMirror;
+
+EmpathyLogEventsMirror * empathy_log_events_mirror_new (GtkTreeModel *model,
+    WebKitWebView *webview,
+    gint text_column,
+    gint date_column,
+    gint icon_column);
+void empathy_log_events_mirror_free (EmpathyLogEventsMirror *mirror);
+
+void empathy_log_events_mirror_execute_script (EmpathyLogEventsMirror *mirror,
+    const gchar *script);
+void empathy_log_events_mirror_flush (EmpathyLogEventsMirror *mirror);
+
+guint empathy_log_events_mirror_get_n_executed (EmpathyLogEventsMirror *mirror);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_LOG_EVENTS_MIRROR_H__ */
@@ -40,6 +40,10 @@
 #include "empathy-gsettings.h"
 #include "empathy-images.h"
 #include "empathy-individual-information-dialog.h"
+#include "empathy-log-events-mirror.h"
+#include "empathy-log-index.h"
+#include "empathy-log-hits.h"
+#include "empathy-log-pager.h"
 #include "empathy-request-util.h"
 #include "empathy-theme-manager.h"
 #include "empathy-ui-utils.h"
@@ -74,6 +78,23 @@ struct _EmpathyLogWindowPriv
   GtkWidget *webview;
 
   GtkTreeStore *store_events;
+  EmpathyLogEventsMirror *events_mirror;
+
+  /* Pages of the events displayed, and what they are filtered on */
+  EmpathyLogPager *pager;
+  TplEventTypeMask pager_event_mask;
+  guint pager_subtype;
+  gboolean first_page;
+
+  /* Distance of the displayed events from the bottom of the page, to keep
+   * them in place when rows are added or removed above them */
+  gboolean restore_scroll;
+  gdouble scroll_offset;
+
+  /* Whether the window of events should be trimmed once the last page has
+   * been displayed, and from which end */
+  gboolean trim_pending;
+  gboolean trim_newer;
 
   GtkWidget *account_chooser;
 
@@ -82,8 +103,12 @@ struct _EmpathyLogWindowPriv
   /* List of selected GDates, free with g_list_free_full (l, g_date_free) */
   GList *current_dates;
 
+  /* Julian days of the dates listed in the when view */
+  GHashTable *when_days;
+
   TplActionChain *chain;
   TplLogManager *log_manager;
+  EmpathyLogIndex *log_index;
 
   /* Hash of TpChannel<->TpAccount for use by the observer until we can
    * get a TpAccount from a TpConnection or wherever */
@@ -99,8 +124,8 @@ struct _EmpathyLogWindowPriv
   /* Used to cancel logger calls when no longer needed */
   guint count;
 
-  /* List of owned TplLogSearchHits, free with tpl_log_search_hit_free */
-  GList *hits;
+  /* Hits of the current search, or NULL if there is none */
+  EmpathyLogHits *hits;
   guint source;
 
   /* Only used while waiting for the account chooser to be ready */
@@ -134,9 +159,14 @@ static void log_window_when_changed_cb           (GtkTreeSelection *selection,
                                                   EmpathyLogWindow *self);
 static void log_window_delete_menu_clicked_cb    (GtkMenuItem      *menuitem,
                                                   EmpathyLogWindow *self);
-static void start_spinner                        (void);
+static void log_window_events_adjustment_changed_cb (GtkAdjustment *adjustment,
+                                                  EmpathyLogWindow *self);
+static void log_window_events_adjustment_value_changed_cb (
+                                                  GtkAdjustment *adjustment,
+                                                  EmpathyLogWindow *self);
 
 static void log_window_create_observer           (EmpathyLogWindow *window);
+static void log_window_update_index              (EmpathyLogWindow *window);
 static gboolean log_window_events_button_press_event (GtkWidget *webview,
     GdkEventButton *event, EmpathyLogWindow *self);
 static void log_window_update_buttons_sensitivity (EmpathyLogWindow *self);
@@ -230,8 +260,6 @@ log_window_get_selected (EmpathyLogWindow *window,
 
 static EmpathyLogWindow *log_window = NULL;
 
-static gboolean has_element;
-
 #ifndef _date_copy
 #define _date_copy(d) g_date_new_julian (g_date_get_julian (d))
 #endif
@@ -282,6 +310,25 @@ ctx_free (Ctx *ctx)
   g_slice_free (Ctx, ctx);
 }
 
+static void
+log_window_clear_events (EmpathyLogWindow *self)
+{
+  tp_clear_object (&self->priv->pager);
+  gtk_tree_store_clear (self->priv->store_events);
+}
+
+static void
+log_window_clear_dates (EmpathyLogWindow *self)
+{
+  GtkListStore *store;
+
+  store = GTK_LIST_STORE (gtk_tree_view_get_model (
+        GTK_TREE_VIEW (self->priv->treeview_when)));
+
+  gtk_list_store_clear (store);
+  g_hash_table_remove_all (self->priv->when_days);
+}
+
 static void
 select_account_once_ready (EmpathyLogWindow *self,
     TpAccount *account,
@@ -349,162 +396,6 @@ toolbutton_av_clicked (GtkToolButton *toolbutton,
       video, gtk_get_current_event_time ());
 }
 
-static void
-insert_or_change_row (EmpathyLogWindow *self,
-    const char *method,
-    GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter)
-{
-  char *str = gtk_tree_path_to_string (path);
-  char *script, *text, *date, *stock_icon;
-  GString *escaped_text;
-  char *icon = NULL;
-  gint i;
-
-  gtk_tree_model_get (model, iter,
-      COL_EVENTS_TEXT, &text,
-      COL_EVENTS_PRETTY_DATE, &date,
-      COL_EVENTS_ICON, &stock_icon,
-      -1);
-
-  if (!tp_str_empty (stock_icon))
-    {
-      GtkIconInfo *icon_info = gtk_icon_theme_lookup_icon (
-          gtk_icon_theme_get_default (),
-          stock_icon,
-          GTK_ICON_SIZE_MENU, 0);
-
-      if (icon_info != NULL)
-        icon = g_strdup (gtk_icon_info_get_filename (icon_info));
-
-      g_object_unref (icon_info);
-    }
-
-  escaped_text = g_string_new (NULL);
-
-  /* Only need to deal with «'» and «\».
-   *
-   * Note that these never appear in non-ascii utf8 characters, so just
-   * pretend like we have an ascii string...
-   */
-  for (i = 0; text && text[i]; i++)
-    {
-      gchar c = text[i];
-
-      if (c == '\'' || c == '\\')
-        g_string_append_c (escaped_text, '\\');
-
-      g_string_append_c (escaped_text, c);
-    }
-
-  script = g_strdup_printf ("javascript:%s([%s], '%s', '%s', '%s');",
-      method,
-      g_strdelimit (str, ":", ','),
-      escaped_text->str,
-      icon != NULL ? icon : "",
-      date);
-
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
-
-  g_string_free (escaped_text, TRUE);
-  g_free (str);
-  g_free (text);
-  g_free (date);
-  g_free (stock_icon);
-  g_free (icon);
-  g_free (script);
-}
-
-static void
-store_events_row_inserted (GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    EmpathyLogWindow *self)
-{
-  insert_or_change_row (self, "insertRow", model, path, iter);
-}
-
-static void
-store_events_row_changed (GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    EmpathyLogWindow *self)
-{
-  insert_or_change_row (self, "changeRow", model, path, iter);
-}
-
-static void
-store_events_row_deleted (GtkTreeModel *model,
-    GtkTreePath *path,
-    EmpathyLogWindow *self)
-{
-  char *str = gtk_tree_path_to_string (path);
-  char *script;
-
-  script = g_strdup_printf ("javascript:deleteRow([%s]);",
-      g_strdelimit (str, ":", ','));
-
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
-
-  g_free (str);
-  g_free (script);
-}
-
-static void
-store_events_has_child_rows (GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    EmpathyLogWindow *self)
-{
-  char *str = gtk_tree_path_to_string (path);
-  char *script;
-
-  script = g_strdup_printf ("javascript:hasChildRows([%s], %u);",
-      g_strdelimit (str, ":", ','),
-      gtk_tree_model_iter_has_child (model, iter));
-
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
-
-  g_free (str);
-  g_free (script);
-}
-
-static void
-store_events_rows_reordered (GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    int *new_order,
-    EmpathyLogWindow *self)
-{
-  char *str = gtk_tree_path_to_string (path);
-  int i, children = gtk_tree_model_iter_n_children (model, iter);
-  char **new_order_strv, *new_order_s;
-  char *script;
-
-  new_order_strv = g_new0 (char *, children + 1);
-
-  for (i = 0; i < children; i++)
-    new_order_strv[i] = g_strdup_printf ("%i", new_order[i]);
-
-  new_order_s = g_strjoinv (",", new_order_strv);
-
-  script = g_strdup_printf ("javascript:reorderRows([%s], [%s]);",
-      str == NULL ? "" : g_strdelimit (str, ":", ','),
-      new_order_s);
-
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self->priv->webview),
-      script);
-
-  g_free (str);
-  g_free (script);
-  g_free (new_order_s);
-  g_strfreev (new_order_strv);
-}
-
 static gboolean
 events_webview_handle_navigation (WebKitWebView *webview,
     WebKitWebFrame *frame,
@@ -563,9 +454,12 @@ empathy_log_window_dispose (GObject *object)
 
   tp_clear_pointer (&self->priv->chain, _tpl_action_chain_free);
   tp_clear_pointer (&self->priv->channels, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->when_days, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->hits, empathy_log_hits_free);
 
   tp_clear_object (&self->priv->observer);
   tp_clear_object (&self->priv->log_manager);
+  tp_clear_object (&self->priv->log_index);
   tp_clear_object (&self->priv->selected_account);
   tp_clear_object (&self->priv->selected_contact);
   tp_clear_object (&self->priv->events_contact);
@@ -574,6 +468,9 @@ empathy_log_window_dispose (GObject *object)
   tp_clear_object (&self->priv->gsettings_chat);
   tp_clear_object (&self->priv->gsettings_desktop);
 
+  tp_clear_object (&self->priv->pager);
+  tp_clear_pointer (&self->priv->events_mirror,
+      empathy_log_events_mirror_free);
   tp_clear_object (&self->priv->store_events);
 
   G_OBJECT_CLASS (empathy_log_window_parent_class)->dispose (object);
@@ -613,17 +510,22 @@ empathy_log_window_init (EmpathyLogWindow *self)
   GFile *gfile;
   GtkWidget *vbox, *accounts, *search, *label, *closeitem;
   GtkWidget *scrolledwindow_events;
+  GtkAdjustment *vadjustment;
   gchar *uri;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
       EMPATHY_TYPE_LOG_WINDOW, EmpathyLogWindowPriv);
 
   self->priv->chain = _tpl_action_chain_new_async (NULL, NULL, NULL);
+  self->priv->when_days = g_hash_table_new (NULL, NULL);
 
   self->priv->camera_monitor = tpaw_camera_monitor_dup_singleton ();
 
   self->priv->log_manager = tpl_log_manager_dup_singleton ();
 
+  self->priv->log_index = empathy_log_index_dup_singleton ();
+  log_window_update_index (self);
+
   self->priv->gsettings_chat = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
   self->priv->gsettings_desktop = g_settings_new (
       EMPATHY_PREFS_DESKTOP_INTERFACE_SCHEMA);
@@ -766,21 +668,23 @@ empathy_log_window_init (EmpathyLogWindow *self)
       G_CALLBACK (events_webview_handle_navigation), self);
 
   /* listen to changes to the treemodel */
-  g_signal_connect (self->priv->store_events, "row-inserted",
-      G_CALLBACK (store_events_row_inserted), self);
-  g_signal_connect (self->priv->store_events, "row-changed",
-      G_CALLBACK (store_events_row_changed), self);
-  g_signal_connect (self->priv->store_events, "row-deleted",
-      G_CALLBACK (store_events_row_deleted), self);
-  g_signal_connect (self->priv->store_events, "rows-reordered",
-      G_CALLBACK (store_events_rows_reordered), self);
-  g_signal_connect (self->priv->store_events, "row-has-child-toggled",
-      G_CALLBACK (store_events_has_child_rows), self);
+  self->priv->events_mirror = empathy_log_events_mirror_new (
+      GTK_TREE_MODEL (self->priv->store_events),
+      WEBKIT_WEB_VIEW (self->priv->webview),
+      COL_EVENTS_TEXT, COL_EVENTS_PRETTY_DATE, COL_EVENTS_ICON);
 
   /* track clicked row */
   g_signal_connect (self->priv->webview, "button-press-event",
       G_CALLBACK (log_window_events_button_press_event), self);
 
+  /* load more events as the user scrolls */
+  vadjustment = gtk_scrolled_window_get_vadjustment (
+      GTK_SCROLLED_WINDOW (scrolledwindow_events));
+  g_signal_connect (vadjustment, "changed",
+      G_CALLBACK (log_window_events_adjustment_changed_cb), self);
+  g_signal_connect (vadjustment, "value-changed",
+      G_CALLBACK (log_window_events_adjustment_value_changed_cb), self);
+
   log_window_update_buttons_sensitivity (self);
   gtk_widget_show (GTK_WIDGET (self));
 
@@ -854,9 +758,52 @@ is_same_confroom (TplEvent *e1,
       tpl_entity_get_identifier (room2));
 }
 
+/* Keep the search index up to date with what the logger is storing */
+static void
+index_message (TpChannel *channel,
+    TpAccount *account,
+    TpMessage *message)
+{
+  TplEntity *target;
+  TpHandleType handle_type;
+  TpContact *contact;
+  const gchar *alias;
+  GDateTime *now;
+  GDate *today;
+  gchar *text;
+
+  tp_channel_get_handle (channel, &handle_type);
+  contact = tp_channel_get_target_contact (channel);
+
+  if (contact != NULL)
+    alias = tp_contact_get_alias (contact);
+  else
+    alias = tp_channel_get_identifier (channel);
+
+  target = tpl_entity_new (tp_channel_get_identifier (channel),
+      handle_type == TP_HANDLE_TYPE_ROOM ? TPL_ENTITY_ROOM : TPL_ENTITY_CONTACT,
+      alias, NULL);
+
+  /* The logger names its files after UTC dates */
+  now = g_date_time_new_now_utc ();
+  today = g_date_new_dmy (g_date_time_get_day_of_month (now),
+      g_date_time_get_month (now),
+      g_date_time_get_year (now));
+
+  text = tp_message_to_text (message, NULL);
+  empathy_log_index_add_text (log_window->priv->log_index, account, target,
+      today, text);
+
+  g_free (text);
+  g_date_free (today);
+  g_date_time_unref (now);
+  g_object_unref (target);
+}
+
 static void
 maybe_refresh_logs (TpChannel *channel,
-    TpAccount *account)
+    TpAccount *account,
+    TpMessage *message)
 {
   GList *accounts = NULL, *entities = NULL, *dates = NULL;
   GList *acc, *ent;
@@ -867,6 +814,9 @@ maybe_refresh_logs (TpChannel *channel,
   gboolean anyone;
   const gchar *type;
 
+  if (message != NULL && account != NULL)
+    index_message (channel, account, message);
+
   if (!log_window_get_selected (log_window,
       &accounts, &entities, &anyone, &dates, &event_mask, NULL))
     {
@@ -945,7 +895,7 @@ on_msg_sent (TpTextChannel *channel,
 {
   TpAccount *account = g_hash_table_lookup (self->priv->channels, channel);
 
-  maybe_refresh_logs (TP_CHANNEL (channel), account);
+  maybe_refresh_logs (TP_CHANNEL (channel), account, TP_MESSAGE (message));
 }
 
 static void
@@ -961,7 +911,7 @@ on_msg_received (TpTextChannel *channel,
       type != TP_CHANNEL_TEXT_MESSAGE_TYPE_ACTION)
     return;
 
-  maybe_refresh_logs (TP_CHANNEL (channel), account);
+  maybe_refresh_logs (TP_CHANNEL (channel), account, msg);
 }
 
 static void
@@ -984,7 +934,7 @@ on_call_ended (TpChannel *channel,
 {
   TpAccount *account = g_hash_table_lookup (self->priv->channels, channel);
 
-  maybe_refresh_logs (channel, account);
+  maybe_refresh_logs (channel, account, NULL);
 
   if (self->priv->channels != NULL)
     g_hash_table_remove (self->priv->channels, channel);
@@ -1070,6 +1020,51 @@ log_window_create_observer (EmpathyLogWindow *self)
   g_object_unref (am);
 }
 
+static void
+index_account_manager_prepared_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpAccountManager *am = TP_ACCOUNT_MANAGER (source);
+  EmpathyLogIndex *log_index = user_data;
+  TplLogManager *log_manager;
+  GList *accounts;
+  GError *error = NULL;
+
+  if (!tp_proxy_prepare_finish (am, result, &error))
+    {
+      DEBUG ("Failed to prepare account manager: %s", error->message);
+      g_error_free (error);
+      goto out;
+    }
+
+  accounts = tp_account_manager_dup_valid_accounts (am);
+  log_manager = tpl_log_manager_dup_singleton ();
+
+  /* Index the logs written since the last time, in the background */
+  empathy_log_index_update_async (log_index, log_manager, accounts,
+      NULL, NULL);
+
+  g_object_unref (log_manager);
+  g_list_free_full (accounts, g_object_unref);
+
+out:
+  g_object_unref (log_index);
+}
+
+static void
+log_window_update_index (EmpathyLogWindow *self)
+{
+  TpAccountManager *am;
+
+  am = tp_account_manager_dup ();
+
+  tp_proxy_prepare_async (am, NULL, index_account_manager_prepared_cb,
+      g_object_ref (self->priv->log_index));
+
+  g_object_unref (am);
+}
+
 static TplEntity *
 event_get_target (TplEvent *event)
 {
@@ -1082,10 +1077,13 @@ event_get_target (TplEvent *event)
   return sender;
 }
 
+/* Whether @event belongs to the conversation of the top-level row @iter,
+ * which it is prepended or appended to */
 static gboolean
 model_is_parent (GtkTreeModel *model,
     GtkTreeIter *iter,
-    TplEvent *event)
+    TplEvent *event,
+    gboolean prepend)
 {
   TplEvent *stored_event;
   TplEntity *target;
@@ -1111,7 +1109,7 @@ model_is_parent (GtkTreeModel *model,
       gint64 timestamp;
 
       gtk_tree_model_iter_nth_child (model, &child, iter,
-          gtk_tree_model_iter_n_children (model, iter) - 1);
+          prepend ? 0 : gtk_tree_model_iter_n_children (model, iter) - 1);
 
       gtk_tree_model_get (model, &child,
           COL_EVENTS_TS, &timestamp,
@@ -1166,9 +1164,42 @@ get_display_string_for_chat_message (EmpathyMessage *message,
   return g_markup_printf_escaped (format, empathy_contact_get_alias (target));
 }
 
+static gchar *
+format_conversation_date (TplEvent *event)
+{
+  GDateTime *date;
+  gchar *pretty_date;
+
+  date = g_date_time_new_from_unix_local (tpl_event_get_timestamp (event));
+  pretty_date = g_date_time_format (date,
+      C_("A date with the time", "%A, %e %B %Y %X"));
+
+  g_date_time_unref (date);
+
+  return pretty_date;
+}
+
+/* Makes @event the first one of the conversation row @iter */
+static void
+conversation_set_first_event (GtkTreeStore *store,
+    GtkTreeIter *iter,
+    TplEvent *event)
+{
+  gchar *pretty_date = format_conversation_date (event);
+
+  gtk_tree_store_set (store, iter,
+      COL_EVENTS_TS, tpl_event_get_timestamp (event),
+      COL_EVENTS_PRETTY_DATE, pretty_date,
+      COL_EVENTS_EVENT, event,
+      -1);
+
+  g_free (pretty_date);
+}
+
 static void
 get_parent_iter_for_message (TplEvent *event,
     EmpathyMessage *message,
+    gboolean prepend,
     GtkTreeIter *parent)
 {
   GtkTreeStore *store;
@@ -1184,28 +1215,30 @@ get_parent_iter_for_message (TplEvent *event,
        next;
        next = gtk_tree_model_iter_next (model, &iter))
     {
-      if ((parent_found = model_is_parent (model, &iter, event)))
+      if ((parent_found = model_is_parent (model, &iter, event, prepend)))
         break;
     }
 
   if (parent_found)
     {
+      /* Older pages are displayed from their newest event */
+      if (prepend)
+        conversation_set_first_event (store, &iter, event);
+
       *parent = iter;
     }
   else
     {
-      GDateTime *date;
       gchar *body, *pretty_date;
 
-      date = g_date_time_new_from_unix_local (
-          tpl_event_get_timestamp (event));
-
-      pretty_date = g_date_time_format (date,
-          C_("A date with the time", "%A, %e %B %Y %X"));
-
+      pretty_date = format_conversation_date (event);
       body = get_display_string_for_chat_message (message, event);
 
-      gtk_tree_store_append (store, &iter, NULL);
+      if (prepend)
+        gtk_tree_store_prepend (store, &iter, NULL);
+      else
+        gtk_tree_store_append (store, &iter, NULL);
+
       gtk_tree_store_set (store, &iter,
           COL_EVENTS_TS, tpl_event_get_timestamp (event),
           COL_EVENTS_PRETTY_DATE, pretty_date,
@@ -1220,7 +1253,6 @@ get_parent_iter_for_message (TplEvent *event,
 
       g_free (body);
       g_free (pretty_date);
-      g_date_time_unref (date);
     }
 }
 
@@ -1255,8 +1287,9 @@ get_icon_for_event (TplEvent *event)
 }
 
 static void
-log_window_append_chat_message (TplEvent *event,
-    EmpathyMessage *message)
+log_window_add_chat_message (TplEvent *event,
+    EmpathyMessage *message,
+    gboolean prepend)
 {
   GtkTreeStore *store = log_window->priv->store_events;
   GtkTreeIter iter, parent;
@@ -1270,7 +1303,7 @@ log_window_append_chat_message (TplEvent *event,
 
   pretty_date = g_date_time_format (date, "%X");
 
-  get_parent_iter_for_message (event, message, &parent);
+  get_parent_iter_for_message (event, message, prepend, &parent);
 
   alias = g_markup_escape_text (
       tpl_entity_get_alias (tpl_event_get_sender (event)), -1);
@@ -1297,7 +1330,11 @@ log_window_append_chat_message (TplEvent *event,
       body = g_strdup_printf (_("<b>%s:</b> %s"), alias, msg->str);
     }
 
-  gtk_tree_store_append (store, &iter, &parent);
+  if (prepend)
+    gtk_tree_store_prepend (store, &iter, &parent);
+  else
+    gtk_tree_store_append (store, &iter, &parent);
+
   gtk_tree_store_set (store, &iter,
       COL_EVENTS_TS, tpl_event_get_timestamp (event),
       COL_EVENTS_PRETTY_DATE, pretty_date,
@@ -1316,8 +1353,9 @@ log_window_append_chat_message (TplEvent *event,
 }
 
 static void
-log_window_append_call (TplEvent *event,
-    EmpathyMessage *message)
+log_window_add_call (TplEvent *event,
+    EmpathyMessage *message,
+    gboolean prepend)
 {
   TplCallEvent *call = TPL_CALL_EVENT (event);
   GtkTreeStore *store = log_window->priv->store_events;
@@ -1347,7 +1385,11 @@ log_window_append_call (TplEvent *event,
   pretty_date = g_date_time_format (started_date,
       C_("A date with the time", "%A, %e %B %Y %X"));
 
-  gtk_tree_store_append (store, &iter, NULL);
+  if (prepend)
+    gtk_tree_store_prepend (store, &iter, NULL);
+  else
+    gtk_tree_store_append (store, &iter, NULL);
+
   gtk_tree_store_set (store, &iter,
       COL_EVENTS_TS, tpl_event_get_timestamp (event),
       COL_EVENTS_PRETTY_DATE, pretty_date,
@@ -1406,14 +1448,16 @@ log_window_append_call (TplEvent *event,
   g_date_time_unref (started_date);
 }
 
+/* Older events are prepended to the events pane, newer ones appended */
 static void
-log_window_append_message (TplEvent *event,
-    EmpathyMessage *message)
+log_window_add_message (TplEvent *event,
+    EmpathyMessage *message,
+    gboolean prepend)
 {
   if (TPL_IS_TEXT_EVENT (event))
-    log_window_append_chat_message (event, message);
+    log_window_add_chat_message (event, message, prepend);
   else if (TPL_IS_CALL_EVENT (event))
-    log_window_append_call (event, message);
+    log_window_add_call (event, message, prepend);
   else
     DEBUG ("Message type not handled");
 }
@@ -1577,60 +1621,11 @@ log_window_get_selected (EmpathyLogWindow *self,
   return TRUE;
 }
 
-static gboolean
-model_has_entity (GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    gpointer data)
-{
-  TplLogSearchHit *hit = data;
-  TplEntity *e;
-  TpAccount *a;
-  gboolean ret = FALSE;
-
-  gtk_tree_model_get (model, iter,
-      COL_WHO_TARGET, &e,
-      COL_WHO_ACCOUNT, &a,
-      -1);
-
-  if (e != NULL && entity_equal (hit->target, e) &&
-      a != NULL && account_equal (hit->account, a))
-    {
-      ret = has_element = TRUE;
-    }
-
-  tp_clear_object (&e);
-  tp_clear_object (&a);
-
-  return ret;
-}
-
-static gboolean
-model_has_date (GtkTreeModel *model,
-    GtkTreePath *path,
-    GtkTreeIter *iter,
-    gpointer data)
-{
-  GDate *date = data;
-  GDate *d;
-
-  gtk_tree_model_get (model, iter,
-      COL_WHEN_DATE, &d,
-      -1);
-
-  if (!g_date_compare (date, d))
-    {
-      has_element = TRUE;
-      g_date_free (d);
-      return TRUE;
-    }
-
-  g_date_free (d);
-  return FALSE;
-}
-
-static void
-get_events_for_date (TplActionChain *chain, gpointer user_data);
+static EmpathyLogPager * log_window_pager_new (EmpathyLogWindow *self);
+static void log_window_show_pages (EmpathyLogWindow *self,
+    EmpathyLogPager *pager,
+    TplEventTypeMask event_mask,
+    EventSubtype subtype);
 
 static void
 populate_events_from_search_hits (GList *accounts,
@@ -1639,59 +1634,37 @@ populate_events_from_search_hits (GList *accounts,
 {
   TplEventTypeMask event_mask;
   EventSubtype subtype;
+  EmpathyLogPager *pager;
   GDate *anytime;
-  GList *l;
+  GList *hits, *l;
   gboolean is_anytime = FALSE;
 
   if (!log_window_get_selected (log_window,
       NULL, NULL, NULL, NULL, &event_mask, &subtype))
     return;
 
+  pager = log_window_pager_new (log_window);
+
   anytime = g_date_new_dmy (2, 1, -1);
   if (g_list_find_custom (dates, anytime, (GCompareFunc) g_date_compare))
     is_anytime = TRUE;
 
-  for (l = log_window->priv->hits; l != NULL; l = l->next)
-    {
-      TplLogSearchHit *hit = l->data;
-      GList *acc, *targ;
-      gboolean found = FALSE;
-
-      /* Protect against invalid data (corrupt or old log files). */
-      if (hit->account == NULL || hit->target == NULL)
-        continue;
-
-      for (acc = accounts, targ = targets;
-           acc != NULL && targ != NULL && !found;
-           acc = acc->next, targ = targ->next)
-        {
-          TpAccount *account = acc->data;
-          TplEntity *target = targ->data;
-
-          if (account_equal (hit->account, account) &&
-              entity_equal (hit->target, target))
-            found = TRUE;
-        }
+  hits = empathy_log_hits_get_hits (log_window->priv->hits, accounts, targets,
+      is_anytime ? NULL : dates);
 
-        if (!found)
-          continue;
-
-      if (is_anytime ||
-          g_list_find_custom (dates, hit->date, (GCompareFunc) g_date_compare)
-              != NULL)
-        {
-          Ctx *ctx;
+  for (l = hits; l != NULL; l = l->next)
+    {
+      EmpathyLogHit *hit = l->data;
 
-          ctx = ctx_new (log_window, hit->account, hit->target, hit->date,
-              event_mask, subtype, log_window->priv->count);
-          _tpl_action_chain_append (log_window->priv->chain,
-              get_events_for_date, ctx);
-        }
+      empathy_log_pager_add_date (pager, hit->account, hit->target,
+          event_mask, hit->date);
     }
 
-  start_spinner ();
-  _tpl_action_chain_start (log_window->priv->chain);
+  g_list_free (hits);
+
+  log_window_show_pages (log_window, pager, event_mask, subtype);
 
+  g_object_unref (pager);
   g_date_free (anytime);
 }
 
@@ -1748,20 +1721,20 @@ static void
 add_date_if_needed (EmpathyLogWindow *self,
     GDate *date)
 {
-  GtkTreeModel *model;
   GtkListStore *store;
+  gpointer day;
   gchar *text;
 
-  model = gtk_tree_view_get_model (GTK_TREE_VIEW (
-        log_window->priv->treeview_when));
-  store = GTK_LIST_STORE (model);
+  store = GTK_LIST_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (
+        log_window->priv->treeview_when)));
 
   /* Add the date if it's not already there */
-  has_element = FALSE;
-  gtk_tree_model_foreach (model, model_has_date, date);
-  if (has_element)
+  day = GUINT_TO_POINTER (g_date_get_julian (date));
+  if (g_hash_table_contains (self->priv->when_days, day))
     return;
 
+  g_hash_table_add (self->priv->when_days, day);
+
   text = format_date_for_display (date);
 
   gtk_list_store_insert_with_values (store, NULL, -1,
@@ -1777,7 +1750,7 @@ static void
 populate_dates_from_search_hits (GList *accounts,
     GList *targets)
 {
-  GList *l;
+  GList *dates, *l;
   GtkTreeView *view;
   GtkTreeModel *model;
   GtkListStore *store;
@@ -1792,33 +1765,13 @@ populate_dates_from_search_hits (GList *accounts,
   store = GTK_LIST_STORE (model);
   selection = gtk_tree_view_get_selection (view);
 
-  for (l = log_window->priv->hits; l != NULL; l = l->next)
-    {
-      TplLogSearchHit *hit = l->data;
-      GList *acc, *targ;
-      gboolean found = FALSE;
-
-      /* Protect against invalid data (corrupt or old log files). */
-      if (hit->account == NULL || hit->target == NULL)
-        continue;
-
-      for (acc = accounts, targ = targets;
-           acc != NULL && targ != NULL && !found;
-           acc = acc->next, targ = targ->next)
-        {
-          TpAccount *account = acc->data;
-          TplEntity *target = targ->data;
-
-          if (account_equal (hit->account, account) &&
-              entity_equal (hit->target, target))
-            found = TRUE;
-        }
+  dates = empathy_log_hits_get_dates (log_window->priv->hits, accounts,
+      targets);
 
-        if (!found)
-          continue;
+  for (l = dates; l != NULL; l = l->next)
+    add_date_if_needed (log_window, l->data);
 
-      add_date_if_needed (log_window, hit->date);
-    }
+  g_list_free (dates);
 
   if (gtk_tree_model_get_iter_first (model, &iter))
     {
@@ -1893,7 +1846,7 @@ populate_entities_from_search_hits (void)
   GtkTreeSelection *selection;
   GtkTreeIter iter;
   GtkListStore *store;
-  GList *l;
+  GList *hits, *l;
 
   view = GTK_TREE_VIEW (log_window->priv->treeview_who);
   model = gtk_tree_view_get_model (view);
@@ -1905,27 +1858,21 @@ populate_entities_from_search_hits (void)
   account_chooser = EMPATHY_ACCOUNT_CHOOSER (log_window->priv->account_chooser);
   account = empathy_account_chooser_get_account (account_chooser);
 
-  for (l = log_window->priv->hits; l; l = l->next)
-    {
-      TplLogSearchHit *hit = l->data;
+  /* The search didn't return any hit */
+  if (log_window->priv->hits == NULL)
+    return;
 
-      /* Protect against invalid data (corrupt or old log files). */
-      if (hit->account == NULL || hit->target == NULL)
-        continue;
+  hits = empathy_log_hits_get_entities (log_window->priv->hits, account);
 
-      /* Filter based on the selected account */
-      if (account != NULL && !account_equal (account, hit->account))
-        continue;
+  for (l = hits; l != NULL; l = l->next)
+    {
+      EmpathyLogHit *hit = l->data;
 
-      /* Add the entity if it's not already there */
-      has_element = FALSE;
-      gtk_tree_model_foreach (model, model_has_entity, hit);
-      if (!has_element)
-        {
-          add_event_to_store (log_window, hit->account, hit->target);
-        }
+      add_event_to_store (log_window, hit->account, hit->target);
     }
 
+  g_list_free (hits);
+
   if (gtk_tree_model_get_iter_first (model, &iter))
     {
       gtk_list_store_prepend (store, &iter);
@@ -1946,14 +1893,33 @@ populate_entities_from_search_hits (void)
     gtk_tree_selection_select_iter (selection, &iter);
 }
 
+/* Takes ownership of @hits */
+static void
+log_window_set_search_hits (GList *hits)
+{
+  GtkTreeView *view;
+  GtkTreeSelection *selection;
+
+  tp_clear_pointer (&log_window->priv->hits, empathy_log_hits_free);
+  if (hits != NULL)
+    log_window->priv->hits = empathy_log_hits_new (hits);
+
+  view = GTK_TREE_VIEW (log_window->priv->treeview_when);
+  selection = gtk_tree_view_get_selection (view);
+
+  g_signal_handlers_unblock_by_func (selection,
+      log_window_when_changed_cb,
+      log_window);
+
+  populate_entities_from_search_hits ();
+}
+
 static void
 log_manager_searched_new_cb (GObject *manager,
     GAsyncResult *result,
     gpointer user_data)
 {
   GList *hits;
-  GtkTreeView *view;
-  GtkTreeSelection *selection;
   GError *error = NULL;
 
   if (log_window == NULL)
@@ -1967,17 +1933,30 @@ log_manager_searched_new_cb (GObject *manager,
       return;
     }
 
-  tp_clear_pointer (&log_window->priv->hits, tpl_log_manager_search_free);
-  log_window->priv->hits = hits;
+  log_window_set_search_hits (empathy_log_hits_from_search (hits));
+}
 
-  view = GTK_TREE_VIEW (log_window->priv->treeview_when);
-  selection = gtk_tree_view_get_selection (view);
+static void
+log_index_searched_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GList *hits;
+  GError *error = NULL;
 
-  g_signal_handlers_unblock_by_func (selection,
-      log_window_when_changed_cb,
-      log_window);
+  if (log_window == NULL)
+    return;
 
-  populate_entities_from_search_hits ();
+  hits = empathy_log_index_search_finish (EMPATHY_LOG_INDEX (source), result,
+      &error);
+  if (error != NULL)
+    {
+      DEBUG ("%s. Aborting", error->message);
+      g_error_free (error);
+      return;
+    }
+
+  log_window_set_search_hits (hits);
 }
 
 static void
@@ -1989,7 +1968,7 @@ log_window_find_populate (EmpathyLogWindow *self,
   GtkTreeSelection *selection;
   GtkListStore *store;
 
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
 
   view = GTK_TREE_VIEW (self->priv->treeview_who);
   model = gtk_tree_view_get_model (view);
@@ -1998,15 +1977,13 @@ log_window_find_populate (EmpathyLogWindow *self,
   gtk_list_store_clear (store);
 
   view = GTK_TREE_VIEW (self->priv->treeview_when);
-  model = gtk_tree_view_get_model (view);
-  store = GTK_LIST_STORE (model);
   selection = gtk_tree_view_get_selection (view);
 
-  gtk_list_store_clear (store);
+  log_window_clear_dates (self);
 
   if (TPAW_STR_EMPTY (search_criteria))
     {
-      tp_clear_pointer (&self->priv->hits, tpl_log_manager_search_free);
+      tp_clear_pointer (&self->priv->hits, empathy_log_hits_free);
       webkit_web_view_set_highlight_text_matches (
           WEBKIT_WEB_VIEW (self->priv->webview), FALSE);
       log_window_who_populate (self);
@@ -2021,6 +1998,15 @@ log_window_find_populate (EmpathyLogWindow *self,
   webkit_web_view_mark_text_matches (WEBKIT_WEB_VIEW (self->priv->webview),
       search_criteria, FALSE, 0);
 
+  /* Only scan all the logs until they have been indexed */
+  if (empathy_log_index_is_ready (self->priv->log_index))
+    {
+      empathy_log_index_search_async (self->priv->log_index,
+          self->priv->log_manager, search_criteria,
+          log_index_searched_cb, NULL);
+      return;
+    }
+
   tpl_log_manager_search_async (self->priv->log_manager,
       search_criteria, TPL_EVENT_MASK_ANY,
       log_manager_searched_new_cb, NULL);
@@ -2753,7 +2739,7 @@ log_window_chats_accounts_changed_cb (GtkWidget *combobox,
     EmpathyLogWindow *self)
 {
   /* Clear all current messages shown in the textview */
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
 
   log_window_who_populate (self);
 }
@@ -3141,9 +3127,8 @@ log_window_maybe_expand_events (void)
 
   /* If there's only one result, expand it */
   if (gtk_tree_model_iter_n_children (model, NULL) == 1)
-    webkit_web_view_execute_script (
-        WEBKIT_WEB_VIEW (log_window->priv->webview),
-        "javascript:expandAll()");
+    empathy_log_events_mirror_execute_script (
+        log_window->priv->events_mirror, "expandAll()");
 }
 
 static gboolean
@@ -3164,15 +3149,12 @@ show_spinner (gpointer data)
 }
 
 static void
-show_events (TplActionChain *chain,
-    gpointer user_data)
+show_events (void)
 {
   log_window_maybe_expand_events ();
   gtk_spinner_stop (GTK_SPINNER (log_window->priv->spinner));
   gtk_notebook_set_current_page (GTK_NOTEBOOK (log_window->priv->notebook),
       PAGE_EVENTS);
-
-  _tpl_action_chain_continue (chain);
 }
 
 static void
@@ -3183,132 +3165,370 @@ start_spinner (void)
       PAGE_EMPTY);
 
   g_timeout_add (1000, show_spinner, NULL);
-  _tpl_action_chain_append (log_window->priv->chain, show_events, NULL);
+}
+
+/* Whether @event is one of the calls selected in the What pane, if it is a
+ * call */
+static gboolean
+log_window_event_is_selected (TplEvent *event,
+    TplEventTypeMask event_mask,
+    EventSubtype subtype)
+{
+  TplCallEvent *call;
+  TpCallStateChangeReason reason;
+  TplEntity *sender, *receiver;
+
+  if (!TPL_IS_CALL_EVENT (event) ||
+      !(event_mask & TPL_EVENT_MASK_CALL) ||
+      event_mask == TPL_EVENT_MASK_ANY)
+    return TRUE;
+
+  if (subtype & EVENT_CALL_ALL)
+    return TRUE;
+
+  call = TPL_CALL_EVENT (event);
+  reason = tpl_call_event_get_end_reason (call);
+  sender = tpl_event_get_sender (event);
+  receiver = tpl_event_get_receiver (event);
+
+  if (reason == TP_CALL_STATE_CHANGE_REASON_NO_ANSWER)
+    return (subtype & EVENT_CALL_MISSED) != 0;
+  else if (subtype & EVENT_CALL_OUTGOING
+      && tpl_entity_get_entity_type (sender) == TPL_ENTITY_SELF)
+    return TRUE;
+  else if (subtype & EVENT_CALL_INCOMING
+      && tpl_entity_get_entity_type (receiver) == TPL_ENTITY_SELF)
+    return TRUE;
+
+  return FALSE;
 }
 
 static void
-log_window_got_messages_for_date_cb (GObject *manager,
-    GAsyncResult *result,
-    gpointer user_data)
+log_window_scroll_to_last_row (EmpathyLogWindow *self)
 {
-  Ctx *ctx = user_data;
-  GtkTreeModel *model;
+  GtkTreeModel *model = GTK_TREE_MODEL (self->priv->store_events);
   GtkTreeIter iter;
-  GList *events;
-  GList *l;
-  GError *error = NULL;
   gint n;
 
-  if (log_window == NULL)
+  n = gtk_tree_model_iter_n_children (model, NULL) - 1;
+
+  if (n >= 0 && gtk_tree_model_iter_nth_child (model, &iter, NULL, n))
     {
-      ctx_free (ctx);
-      return;
-    }
+      GtkTreePath *path;
+      char *str, *script;
 
-  if (log_window->priv->count != ctx->count)
-    goto out;
+      path = gtk_tree_model_get_path (model, &iter);
+      str = gtk_tree_path_to_string (path);
 
-  if (!tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (manager),
-      result, &events, &error))
-    {
-      DEBUG ("Unable to retrieve messages for the selected date: %s. Aborting",
-          error->message);
-      g_error_free (error);
-      goto out;
+      script = g_strdup_printf ("scrollToRow([%s])",
+          g_strdelimit (str, ":", ','));
+
+      empathy_log_events_mirror_execute_script (self->priv->events_mirror,
+          script);
+
+      gtk_tree_path_free (path);
+      g_free (str);
+      g_free (script);
     }
+}
+
+/* Removes the events logged at or after @timestamp if @newer is TRUE, the
+ * ones logged before it otherwise */
+static void
+log_window_remove_events (EmpathyLogWindow *self,
+    gint64 timestamp,
+    gboolean newer)
+{
+  GtkTreeStore *store = self->priv->store_events;
+  GtkTreeModel *model = GTK_TREE_MODEL (store);
+  GArray *shortened;
+  GtkTreeIter iter;
+  gboolean valid;
+  guint i;
+
+  /* Conversations whose first events have been removed. Their start is
+   * only updated once we are done iterating, as it changes their position
+   * in the store. */
+  shortened = g_array_new (FALSE, FALSE, sizeof (GtkTreeIter));
+
+  valid = gtk_tree_model_get_iter_first (model, &iter);
 
-  for (l = events; l; l = l->next)
+  while (valid)
     {
-      TplEvent *event = l->data;
-      gboolean append = TRUE;
+      GtkTreeIter child;
+      gboolean has_children, child_valid;
+      gint64 ts;
 
-      if (TPL_IS_CALL_EVENT (l->data)
-          && ctx->event_mask & TPL_EVENT_MASK_CALL
-          && ctx->event_mask != TPL_EVENT_MASK_ANY)
-        {
-          TplCallEvent *call = l->data;
+      has_children = gtk_tree_model_iter_children (model, &child, &iter);
 
-          append = FALSE;
+      for (child_valid = has_children; child_valid;)
+        {
+          gtk_tree_model_get (model, &child,
+              COL_EVENTS_TS, &ts,
+              -1);
 
-          if (ctx->subtype & EVENT_CALL_ALL)
-            {
-              append = TRUE;
-            }
+          if ((ts >= timestamp) == newer)
+            child_valid = gtk_tree_store_remove (store, &child);
           else
-            {
-              TpCallStateChangeReason reason =
-                tpl_call_event_get_end_reason (call);
-              TplEntity *sender = tpl_event_get_sender (event);
-              TplEntity *receiver = tpl_event_get_receiver (event);
-
-              if (reason == TP_CALL_STATE_CHANGE_REASON_NO_ANSWER)
-                {
-                  if (ctx->subtype & EVENT_CALL_MISSED)
-                    append = TRUE;
-                }
-              else if (ctx->subtype & EVENT_CALL_OUTGOING
-                  && tpl_entity_get_entity_type (sender) == TPL_ENTITY_SELF)
-                {
-                  append = TRUE;
-                }
-              else if (ctx->subtype & EVENT_CALL_INCOMING
-                  && tpl_entity_get_entity_type (receiver) == TPL_ENTITY_SELF)
-                {
-                  append = TRUE;
-                }
-            }
+            child_valid = gtk_tree_model_iter_next (model, &child);
         }
 
-      if (append)
+      gtk_tree_model_get (model, &iter,
+          COL_EVENTS_TS, &ts,
+          -1);
+
+      if (has_children && gtk_tree_model_iter_children (model, &child, &iter))
+        {
+          gint64 child_ts;
+
+          gtk_tree_model_get (model, &child,
+              COL_EVENTS_TS, &child_ts,
+              -1);
+
+          if (child_ts != ts)
+            g_array_append_val (shortened, iter);
+
+          valid = gtk_tree_model_iter_next (model, &iter);
+        }
+      else if (has_children || (ts >= timestamp) == newer)
+        {
+          valid = gtk_tree_store_remove (store, &iter);
+        }
+      else
         {
-          EmpathyMessage *msg = empathy_message_from_tpl_log_event (event);
-          log_window_append_message (event, msg);
-          tp_clear_object (&msg);
+          valid = gtk_tree_model_iter_next (model, &iter);
         }
+    }
+
+  for (i = 0; i < shortened->len; i++)
+    {
+      GtkTreeIter *parent = &g_array_index (shortened, GtkTreeIter, i);
+      GtkTreeIter child;
+      TplEvent *event;
+
+      gtk_tree_model_iter_children (model, &child, parent);
+      gtk_tree_model_get (model, &child,
+          COL_EVENTS_EVENT, &event,
+          -1);
+
+      conversation_set_first_event (store, parent, event);
 
       g_object_unref (event);
     }
-  g_list_free (events);
 
-  model = GTK_TREE_MODEL (log_window->priv->store_events);
-  n = gtk_tree_model_iter_n_children (model, NULL) - 1;
+  g_array_unref (shortened);
+}
 
-  if (n >= 0 && gtk_tree_model_iter_nth_child (model, &iter, NULL, n))
+/* Drops events from the other end of the window if it has grown too big */
+static void
+log_window_trim_events (EmpathyLogWindow *self,
+    gboolean newer)
+{
+  gint64 timestamp;
+
+  if (self->priv->pager == NULL)
+    return;
+
+  if (newer && empathy_log_pager_trim_newer (self->priv->pager, &timestamp))
+    log_window_remove_events (self, timestamp, TRUE);
+  else if (!newer &&
+      empathy_log_pager_trim_older (self->priv->pager, &timestamp))
+    log_window_remove_events (self, timestamp, FALSE);
+}
+
+static void log_window_load_page (EmpathyLogWindow *self,
+    gboolean older);
+
+static void
+log_window_got_page_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyLogPager *pager = EMPATHY_LOG_PAGER (source);
+  EmpathyLogWindow *self = log_window;
+  gboolean older = GPOINTER_TO_INT (user_data);
+  GtkAdjustment *adjustment;
+  GList *events = NULL, *l;
+  GError *error = NULL;
+  gboolean failed = FALSE;
+  guint n_shown = 0;
+
+  if (!empathy_log_pager_get_events_finish (pager, result, &events, &error))
     {
-      GtkTreePath *path;
-      char *str, *script;
+      DEBUG ("Unable to retrieve messages for the selected dates: %s",
+          error->message);
+      g_clear_error (&error);
+      failed = TRUE;
+    }
 
-      path = gtk_tree_model_get_path (model, &iter);
-      str = gtk_tree_path_to_string (path);
+  /* The window has been closed or shows something else now */
+  if (self == NULL || self->priv->pager != pager)
+    {
+      g_list_free_full (events, g_object_unref);
+      return;
+    }
 
-      script = g_strdup_printf ("javascript:scrollToRow([%s]);",
-          g_strdelimit (str, ":", ','));
+  adjustment = gtk_scrollable_get_vadjustment (
+      GTK_SCROLLABLE (self->priv->webview));
 
-      webkit_web_view_execute_script (
-          WEBKIT_WEB_VIEW (log_window->priv->webview),
-          script);
+  /* Older events are added from the newest one, so they can be prepended to
+   * their conversation */
+  for (l = older ? g_list_last (events) : events;
+       l != NULL;
+       l = older ? l->prev : l->next)
+    {
+      TplEvent *event = l->data;
+      EmpathyMessage *msg;
 
-      gtk_tree_path_free (path);
-      g_free (str);
-      g_free (script);
+      if (!log_window_event_is_selected (event, self->priv->pager_event_mask,
+            self->priv->pager_subtype))
+        continue;
+
+      msg = empathy_message_from_tpl_log_event (event);
+      log_window_add_message (event, msg, older);
+      g_object_unref (msg);
+
+      n_shown++;
     }
 
- out:
-  ctx_free (ctx);
+  g_list_free_full (events, g_object_unref);
 
-  _tpl_action_chain_continue (log_window->priv->chain);
+  /* The spinner is shown until there is something to display */
+  if (self->priv->first_page &&
+      (n_shown > 0 || failed || !empathy_log_pager_has_older (pager)))
+    {
+      self->priv->first_page = FALSE;
+      log_window_scroll_to_last_row (self);
+      show_events ();
+    }
+  else if (n_shown > 0 && older)
+    {
+      /* Keep the events the user was looking at in place */
+      self->priv->scroll_offset = gtk_adjustment_get_upper (adjustment) -
+          gtk_adjustment_get_value (adjustment);
+      self->priv->restore_scroll = TRUE;
+    }
+
+  if (n_shown > 0)
+    {
+      /* Only make room for the new events once they are displayed */
+      self->priv->trim_pending = TRUE;
+      self->priv->trim_newer = older;
+    }
+  else
+    {
+      log_window_trim_events (self, older);
+
+      /* Nothing new to display, look further */
+      if (!failed)
+        log_window_load_page (self, older);
+    }
 }
 
 static void
-get_events_for_date (TplActionChain *chain, gpointer user_data)
+log_window_load_page (EmpathyLogWindow *self,
+    gboolean older)
 {
-  Ctx *ctx = user_data;
+  EmpathyLogPager *pager = self->priv->pager;
 
-  tpl_log_manager_get_events_for_date_async (ctx->self->priv->log_manager,
-      ctx->account, ctx->entity, ctx->event_mask,
-      ctx->date,
-      log_window_got_messages_for_date_cb,
-      ctx);
+  if (pager == NULL || empathy_log_pager_is_busy (pager))
+    return;
+
+  if (older && empathy_log_pager_has_older (pager))
+    empathy_log_pager_get_older_async (pager, log_window_got_page_cb,
+        GINT_TO_POINTER (TRUE));
+  else if (!older && empathy_log_pager_has_newer (pager))
+    empathy_log_pager_get_newer_async (pager, log_window_got_page_cb,
+        GINT_TO_POINTER (FALSE));
+}
+
+static void
+log_window_events_adjustment_changed_cb (GtkAdjustment *adjustment,
+    EmpathyLogWindow *self)
+{
+  gdouble upper = gtk_adjustment_get_upper (adjustment);
+
+  if (self->priv->restore_scroll)
+    {
+      self->priv->restore_scroll = FALSE;
+      gtk_adjustment_set_value (adjustment,
+          upper - self->priv->scroll_offset);
+    }
+
+  if (self->priv->trim_pending)
+    {
+      self->priv->trim_pending = FALSE;
+
+      /* Removing older events moves the newer ones up */
+      if (!self->priv->trim_newer)
+        {
+          self->priv->scroll_offset = upper -
+              gtk_adjustment_get_value (adjustment);
+          self->priv->restore_scroll = TRUE;
+        }
+
+      log_window_trim_events (self, self->priv->trim_newer);
+    }
+
+  /* Fill the view */
+  if (upper <= gtk_adjustment_get_page_size (adjustment))
+    log_window_load_page (self, TRUE);
+}
+
+static void
+log_window_events_adjustment_value_changed_cb (GtkAdjustment *adjustment,
+    EmpathyLogWindow *self)
+{
+  gdouble value = gtk_adjustment_get_value (adjustment);
+
+  if (value <= gtk_adjustment_get_lower (adjustment))
+    log_window_load_page (self, TRUE);
+  else if (value + gtk_adjustment_get_page_size (adjustment) >=
+      gtk_adjustment_get_upper (adjustment))
+    log_window_load_page (self, FALSE);
+}
+
+/* The window of events holds two pages at least, so that one can be
+ * added while the previous one is still displayed */
+static EmpathyLogPager *
+log_window_pager_new (EmpathyLogWindow *self)
+{
+  guint page_size, max_events;
+
+  page_size = g_settings_get_uint (self->priv->gsettings_chat,
+      EMPATHY_PREFS_CHAT_LOG_VIEWER_PAGE_SIZE);
+  max_events = g_settings_get_uint (self->priv->gsettings_chat,
+      EMPATHY_PREFS_CHAT_LOG_VIEWER_MAX_EVENTS);
+
+  page_size = MAX (page_size, 1);
+
+  if (max_events != 0)
+    max_events = MAX (max_events, 2 * page_size);
+
+  return empathy_log_pager_new (self->priv->log_manager, page_size,
+      max_events);
+}
+
+/* Displays the newest page of the events of @pager, and the other ones as
+ * the user scrolls */
+static void
+log_window_show_pages (EmpathyLogWindow *self,
+    EmpathyLogPager *pager,
+    TplEventTypeMask event_mask,
+    EventSubtype subtype)
+{
+  tp_clear_object (&self->priv->pager);
+
+  self->priv->pager = g_object_ref (pager);
+  self->priv->pager_event_mask = event_mask;
+  self->priv->pager_subtype = subtype;
+  self->priv->first_page = TRUE;
+  self->priv->restore_scroll = FALSE;
+  self->priv->trim_pending = FALSE;
+
+  start_spinner ();
+  empathy_log_pager_get_older_async (pager, log_window_got_page_cb,
+      GINT_TO_POINTER (TRUE));
 }
 
 static void
@@ -3318,6 +3538,7 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
   GList *accounts, *targets, *acc, *targ, *l;
   TplEventTypeMask event_mask;
   EventSubtype subtype;
+  EmpathyLogPager *pager;
   GDate *date, *anytime, *separator;
 
   if (!log_window_get_selected (self,
@@ -3330,6 +3551,8 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
   _tpl_action_chain_clear (self->priv->chain);
   self->priv->count++;
 
+  pager = log_window_pager_new (self);
+
   for (acc = accounts, targ = targets;
        acc != NULL && targ != NULL;
        acc = acc->next, targ = targ->next)
@@ -3344,11 +3567,8 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
           /* Get events */
           if (g_date_compare (date, anytime) != 0)
             {
-              Ctx *ctx;
-
-              ctx = ctx_new (self, account, target, date, event_mask, subtype,
-                  self->priv->count);
-              _tpl_action_chain_append (self->priv->chain, get_events_for_date, ctx);
+              empathy_log_pager_add_date (pager, account, target, event_mask,
+                  date);
             }
           else
             {
@@ -3362,19 +3582,14 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
                    next;
                    next = gtk_tree_model_iter_next (model, &iter))
                 {
-                  Ctx *ctx;
-
                   gtk_tree_model_get (model, &iter,
                       COL_WHEN_DATE, &d,
                       -1);
 
                   if (g_date_compare (d, anytime) != 0 &&
                       g_date_compare (d, separator) != 0)
-                    {
-                      ctx = ctx_new (self, account, target, d,
-                          event_mask, subtype, self->priv->count);
-                      _tpl_action_chain_append (self->priv->chain, get_events_for_date, ctx);
-                    }
+                    empathy_log_pager_add_date (pager, account, target,
+                        event_mask, d);
 
                   g_date_free (d);
                 }
@@ -3382,8 +3597,9 @@ log_window_get_messages_for_dates (EmpathyLogWindow *self,
         }
     }
 
-  start_spinner ();
-  _tpl_action_chain_start (self->priv->chain);
+  log_window_show_pages (self, pager, event_mask, subtype);
+
+  g_object_unref (pager);
 
   g_list_free_full (accounts, g_object_unref);
   g_list_free_full (targets, g_object_unref);
@@ -3547,7 +3763,6 @@ log_window_chats_get_messages (EmpathyLogWindow *self,
   TplEventTypeMask event_mask;
   GtkTreeView *view;
   GtkTreeModel *model;
-  GtkListStore *store;
   GtkTreeSelection *selection;
 
   if (!log_window_get_selected (self, &accounts, &targets, NULL,
@@ -3557,10 +3772,9 @@ log_window_chats_get_messages (EmpathyLogWindow *self,
   view = GTK_TREE_VIEW (self->priv->treeview_when);
   selection = gtk_tree_view_get_selection (view);
   model = gtk_tree_view_get_model (view);
-  store = GTK_LIST_STORE (model);
 
   /* Clear all current messages shown in the textview */
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
 
   _tpl_action_chain_clear (self->priv->chain);
   self->priv->count++;
@@ -3574,7 +3788,7 @@ log_window_chats_get_messages (EmpathyLogWindow *self,
               log_window_when_changed_cb,
               self);
 
-          gtk_list_store_clear (store);
+          log_window_clear_dates (self);
 
           g_signal_handlers_unblock_by_func (selection,
               log_window_when_changed_cb,
@@ -3628,7 +3842,7 @@ log_window_chats_get_messages (EmpathyLogWindow *self,
           log_window_when_changed_cb,
           self);
 
-      gtk_list_store_clear (store);
+      log_window_clear_dates (self);
 
       g_signal_handlers_unblock_by_func (selection,
           log_window_when_changed_cb,
@@ -3714,14 +3928,20 @@ log_window_logger_clear_account_cb (TpProxy *proxy,
     gpointer user_data,
     GObject *weak_object)
 {
-  EmpathyLogWindow *self = EMPATHY_LOG_WINDOW (user_data);
+  EmpathyLogWindow *self = EMPATHY_LOG_WINDOW (weak_object);
+  /* NULL if the logs of all the accounts have been cleared */
+  TpAccount *account = user_data;
 
   if (error != NULL)
     g_warning ("Error when clearing logs: %s", error->message);
+  else
+    empathy_log_index_forget (self->priv->log_index, account, NULL);
+
+  empathy_contact_invalidate_has_log (NULL, NULL);
 
   /* Refresh the log viewer so the logs are cleared if the account
    * has been deleted */
-  gtk_tree_store_clear (self->priv->store_events);
+  log_window_clear_events (self);
   log_window_who_populate (self);
 
   /* Re-filter the account chooser so the accounts without logs get
@@ -3803,7 +4023,7 @@ log_window_delete_menu_clicked_cb (GtkMenuItem *menuitem,
 
       emp_cli_logger_call_clear (logger, -1,
           log_window_logger_clear_account_cb,
-          self, NULL, G_OBJECT (self));
+          NULL, NULL, G_OBJECT (self));
     }
   else
     {
@@ -3816,7 +4036,7 @@ log_window_delete_menu_clicked_cb (GtkMenuItem *menuitem,
       emp_cli_logger_call_clear_account (logger, -1,
           tp_proxy_get_object_path (account),
           log_window_logger_clear_account_cb,
-          self, NULL, G_OBJECT (self));
+          g_object_ref (account), g_object_unref, G_OBJECT (self));
     }
 
   g_object_unref (logger);
@@ -35,6 +35,9 @@ struct _EmpathyRosterContactPriv
   FolksIndividual *individual;
   gchar *group;
 
+  /* The widgets displaying the individual are only created while the row is
+   * close to the visible part of the view, see
+   * empathy_roster_contact_ensure_widgets(). They are all NULL otherwise. */
   GtkWidget *avatar;
   GtkWidget *first_line_alig;
   GtkWidget *alias;
@@ -123,6 +126,14 @@ avatar_loaded_cb (GObject *source,
   pixbuf = empathy_pixbuf_avatar_from_individual_scaled_finish (
       FOLKS_INDIVIDUAL (source), result, NULL);
 
+  if (self->priv->avatar == NULL)
+    {
+      /* Widgets have been released while we were loading the avatar */
+      tp_clear_object (&pixbuf);
+      g_object_unref (self);
+      goto out;
+    }
+
   if (pixbuf == NULL)
     {
       pixbuf = tpaw_pixbuf_from_icon_name_sized (
@@ -141,6 +152,9 @@ out:
 static void
 update_avatar (EmpathyRosterContact *self)
 {
+  if (self->priv->avatar == NULL)
+    return;
+
   empathy_pixbuf_avatar_from_individual_scaled_async (self->priv->individual,
       AVATAR_SIZE, AVATAR_SIZE, NULL, avatar_loaded_cb,
       tp_weak_ref_new (self, NULL, NULL));
@@ -157,7 +171,8 @@ avatar_changed_cb (FolksIndividual *individual,
 static void
 update_alias (EmpathyRosterContact *self)
 {
-  gtk_label_set_text (GTK_LABEL (self->priv->alias), get_alias (self));
+  if (self->priv->alias != NULL)
+    gtk_label_set_text (GTK_LABEL (self->priv->alias), get_alias (self));
 
   g_object_notify (G_OBJECT (self), "alias");
 }
@@ -176,6 +191,9 @@ update_presence_msg (EmpathyRosterContact *self)
   const gchar *msg;
   GStrv types;
 
+  if (self->priv->presence_msg == NULL)
+    return;
+
   msg = folks_presence_details_get_presence_message (
       FOLKS_PRESENCE_DETAILS (self->priv->individual));
 
@@ -235,6 +253,9 @@ update_presence_icon (EmpathyRosterContact *self)
 {
   const gchar *icon;
 
+  if (self->priv->presence_icon == NULL)
+    return;
+
   if (self->priv->event_icon == NULL)
     icon = empathy_icon_name_for_individual (self->priv->individual);
   else
@@ -313,11 +334,7 @@ empathy_roster_contact_constructed (GObject *object)
   tp_g_signal_connect_object (self->priv->individual, "notify::presence-status",
       G_CALLBACK (presence_status_changed_cb), self, 0);
 
-  update_avatar (self);
   update_alias (self);
-  update_presence_msg (self);
-  update_presence_icon (self);
-
   update_online (self);
 }
 
@@ -390,12 +407,75 @@ empathy_roster_contact_class_init (
 
 static void
 empathy_roster_contact_init (EmpathyRosterContact *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EMPATHY_TYPE_ROSTER_CONTACT, EmpathyRosterContactPriv);
+}
+
+GtkWidget *
+empathy_roster_contact_new (FolksIndividual *individual,
+    const gchar *group)
+{
+  g_return_val_if_fail (FOLKS_IS_INDIVIDUAL (individual), NULL);
+
+  return g_object_new (EMPATHY_TYPE_ROSTER_CONTACT,
+      "individual", individual,
+      "group", group,
+      NULL);
+}
+
+FolksIndividual *
+empathy_roster_contact_get_individual (EmpathyRosterContact *self)
+{
+  return self->priv->individual;
+}
+
+gboolean
+empathy_roster_contact_is_online (EmpathyRosterContact *self)
+{
+  return self->priv->online;
+}
+
+const gchar *
+empathy_roster_contact_get_group (EmpathyRosterContact *self)
+{
+  return self->priv->group;
+}
+
+void
+empathy_roster_contact_set_event_icon (EmpathyRosterContact *self,
+    const gchar *icon)
+{
+  if (!tp_strdiff (self->priv->event_icon, icon))
+    return;
+
+  g_free (self->priv->event_icon);
+  self->priv->event_icon = g_strdup (icon);
+
+  update_presence_icon (self);
+}
+
+/* Returns NULL if the widgets of the row have not been created */
+GdkPixbuf *
+empathy_roster_contact_get_avatar_pixbuf (EmpathyRosterContact *self)
+{
+  if (self->priv->avatar == NULL)
+    return NULL;
+
+  return gtk_image_get_pixbuf (GTK_IMAGE (self->priv->avatar));
+}
+
+/* Rows of big rosters are mostly out of sight, so they are created empty and
+ * the view only calls this function for the ones close to its visible part.
+ * Does nothing if the widgets have already been created. */
+void
+empathy_roster_contact_ensure_widgets (EmpathyRosterContact *self)
 {
   GtkWidget *alig, *main_box, *box, *first_line_box;
   GtkStyleContext *context;
 
-  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
-      EMPATHY_TYPE_ROSTER_CONTACT, EmpathyRosterContactPriv);
+  if (self->priv->avatar != NULL)
+    return;
 
   alig = gtk_alignment_new (0.5, 0.5, 1, 1);
   gtk_widget_show (alig);
@@ -461,53 +541,37 @@ empathy_roster_contact_init (EmpathyRosterContact *self)
   gtk_container_add (GTK_CONTAINER (self), alig);
   gtk_container_add (GTK_CONTAINER (alig), main_box);
   gtk_widget_show (main_box);
-}
-
-GtkWidget *
-empathy_roster_contact_new (FolksIndividual *individual,
-    const gchar *group)
-{
-  g_return_val_if_fail (FOLKS_IS_INDIVIDUAL (individual), NULL);
-
-  return g_object_new (EMPATHY_TYPE_ROSTER_CONTACT,
-      "individual", individual,
-      "group", group,
-      NULL);
-}
-
-FolksIndividual *
-empathy_roster_contact_get_individual (EmpathyRosterContact *self)
-{
-  return self->priv->individual;
-}
 
-gboolean
-empathy_roster_contact_is_online (EmpathyRosterContact *self)
-{
-  return self->priv->online;
-}
-
-const gchar *
-empathy_roster_contact_get_group (EmpathyRosterContact *self)
-{
-  return self->priv->group;
+  update_avatar (self);
+  update_alias (self);
+  update_presence_msg (self);
+  update_presence_icon (self);
 }
 
+/* Destroy the widgets created by empathy_roster_contact_ensure_widgets(),
+ * leaving an empty row keeping track of the individual. */
 void
-empathy_roster_contact_set_event_icon (EmpathyRosterContact *self,
-    const gchar *icon)
+empathy_roster_contact_release_widgets (EmpathyRosterContact *self)
 {
-  if (!tp_strdiff (self->priv->event_icon, icon))
+  GtkWidget *child;
+
+  if (self->priv->avatar == NULL)
     return;
 
-  g_free (self->priv->event_icon);
-  self->priv->event_icon = g_strdup (icon);
+  self->priv->avatar = NULL;
+  self->priv->first_line_alig = NULL;
+  self->priv->alias = NULL;
+  self->priv->presence_msg = NULL;
+  self->priv->presence_icon = NULL;
+  self->priv->phone_icon = NULL;
 
-  update_presence_icon (self);
+  child = gtk_bin_get_child (GTK_BIN (self));
+  if (child != NULL)
+    gtk_container_remove (GTK_CONTAINER (self), child);
 }
 
-GdkPixbuf *
-empathy_roster_contact_get_avatar_pixbuf (EmpathyRosterContact *self)
+gboolean
+empathy_roster_contact_has_widgets (EmpathyRosterContact *self)
 {
-  return gtk_image_get_pixbuf (GTK_IMAGE (self->priv->avatar));
+  return self->priv->avatar != NULL;
 }
@@ -62,6 +62,10 @@ void empathy_roster_contact_set_event_icon (EmpathyRosterContact *self,
 GdkPixbuf * empathy_roster_contact_get_avatar_pixbuf (
     EmpathyRosterContact *self);
 
+void empathy_roster_contact_ensure_widgets (EmpathyRosterContact *self);
+void empathy_roster_contact_release_widgets (EmpathyRosterContact *self);
+gboolean empathy_roster_contact_has_widgets (EmpathyRosterContact *self);
+
 G_END_DECLS
 
 #endif /* #ifndef __EMPATHY_ROSTER_CONTACT_H__*/
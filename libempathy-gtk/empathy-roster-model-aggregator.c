@@ -94,7 +94,7 @@ individual_group_changed_cb (FolksIndividual *individual,
 }
 
 static void
-add_to_filtered_individuals (EmpathyRosterModelAggregator *self,
+add_to_filtered_individuals_no_signal (EmpathyRosterModelAggregator *self,
     FolksIndividual *individual)
 {
   g_hash_table_add (self->priv->filtered_individuals,
@@ -102,6 +102,13 @@ add_to_filtered_individuals (EmpathyRosterModelAggregator *self,
 
   tp_g_signal_connect_object (individual, "group-changed",
       G_CALLBACK (individual_group_changed_cb), self, 0);
+}
+
+static void
+add_to_filtered_individuals (EmpathyRosterModelAggregator *self,
+    FolksIndividual *individual)
+{
+  add_to_filtered_individuals_no_signal (self, individual);
 
   empathy_roster_model_fire_individual_added (EMPATHY_ROSTER_MODEL (self),
       individual);
@@ -134,8 +141,9 @@ individual_notify_cb (FolksIndividual *individual,
     add_to_filtered_individuals (self, individual);
 }
 
-static void
-add_individual (EmpathyRosterModelAggregator *self,
+/* Returns TRUE if @individual passes the filter */
+static gboolean
+add_individual_no_signal (EmpathyRosterModelAggregator *self,
     FolksIndividual *individual)
 {
   if (self->priv->filter_func != NULL)
@@ -145,10 +153,39 @@ add_individual (EmpathyRosterModelAggregator *self,
 
       if (!self->priv->filter_func (EMPATHY_ROSTER_MODEL (self), individual,
               self))
-        return;
+        return FALSE;
     }
 
-  add_to_filtered_individuals (self, individual);
+  add_to_filtered_individuals_no_signal (self, individual);
+  return TRUE;
+}
+
+/* Add all the individuals from @iter, announcing them in one go if there are
+ * several of them. */
+static void
+add_individuals (EmpathyRosterModelAggregator *self,
+    GeeIterator *iter)
+{
+  GList *added = NULL;
+
+  while (iter != NULL && gee_iterator_next (iter))
+    {
+      FolksIndividual *individual = gee_iterator_get (iter);
+
+      if (add_individual_no_signal (self, individual))
+        added = g_list_prepend (added, individual);
+      else
+        g_object_unref (individual);
+    }
+
+  if (added != NULL && added->next == NULL)
+    empathy_roster_model_fire_individual_added (EMPATHY_ROSTER_MODEL (self),
+        added->data);
+  else if (added != NULL)
+    empathy_roster_model_fire_individuals_added (EMPATHY_ROSTER_MODEL (self),
+        added);
+
+  g_list_free_full (added, g_object_unref);
 }
 
 static void
@@ -168,18 +205,18 @@ static void
 populate_individuals (EmpathyRosterModelAggregator *self)
 {
   GeeMap *individuals;
-  GeeMapIterator *iter;
+  GeeCollection *values;
+  GeeIterator *iter;
 
   individuals = folks_individual_aggregator_get_individuals (
       self->priv->aggregator);
-  iter = gee_map_map_iterator (individuals);
-  while (gee_map_iterator_next (iter))
-    {
-      FolksIndividual *individual = gee_map_iterator_get_value (iter);
-      add_individual (self, individual);
-      g_object_unref (individual);
-    }
+  values = gee_map_get_values (individuals);
+  iter = gee_iterable_iterator (GEE_ITERABLE (values));
+
+  add_individuals (self, iter);
+
   g_clear_object (&iter);
+  g_clear_object (&values);
 }
 
 static void
@@ -195,12 +232,7 @@ aggregator_individuals_changed_cb (FolksIndividualAggregator *aggregator,
     {
       GeeIterator *iter = gee_iterable_iterator (GEE_ITERABLE (added));
 
-      while (iter != NULL && gee_iterator_next (iter))
-        {
-          FolksIndividual *individual = gee_iterator_get (iter);
-          add_individual (self, individual);
-          g_object_unref (individual);
-        }
+      add_individuals (self, iter);
       g_clear_object (&iter);
     }
 
@@ -54,8 +54,8 @@ static guint signals[LAST_SIGNAL];
 struct _EmpathyRosterModelManagerPriv
 {
   EmpathyIndividualManager *manager;
-  /* FolksIndividual (borrowed) */
-  GList *top_group_members;
+  /* Set of FolksIndividual (borrowed) */
+  GHashTable *top_group_members;
 };
 
 static gboolean
@@ -83,7 +83,7 @@ static gboolean
 individual_in_top_group_members (EmpathyRosterModelManager *self,
     FolksIndividual *individual)
 {
-  return (g_list_find (self->priv->top_group_members, individual) != NULL);
+  return g_hash_table_contains (self->priv->top_group_members, individual);
 }
 
 static gboolean
@@ -103,16 +103,14 @@ static void
 add_to_top_group_members (EmpathyRosterModelManager *self,
     FolksIndividual *individual)
 {
-  self->priv->top_group_members = g_list_prepend (self->priv->top_group_members,
-      individual);
+  g_hash_table_add (self->priv->top_group_members, individual);
 }
 
 static void
 remove_from_top_group_members (EmpathyRosterModelManager *self,
     FolksIndividual *individual)
 {
-  self->priv->top_group_members = g_list_remove (self->priv->top_group_members,
-      individual);
+  g_hash_table_remove (self->priv->top_group_members, individual);
 }
 
 static void
@@ -147,11 +145,16 @@ members_changed_cb (EmpathyIndividualManager *manager,
       if (individual_should_be_in_top_group_members (self, l->data) &&
           !individual_in_top_group_members (self, l->data))
         add_to_top_group_members (self, l->data);
-
-      empathy_roster_model_fire_individual_added (EMPATHY_ROSTER_MODEL (self),
-          l->data);
     }
 
+  /* Lots of individuals are added at once when connecting */
+  if (added != NULL && added->next == NULL)
+    empathy_roster_model_fire_individual_added (EMPATHY_ROSTER_MODEL (self),
+        added->data);
+  else if (added != NULL)
+    empathy_roster_model_fire_individuals_added (EMPATHY_ROSTER_MODEL (self),
+        added);
+
   for (l = removed; l != NULL; l = g_list_next (l))
     {
       if (individual_in_top_group_members (self, l->data))
@@ -178,7 +181,9 @@ top_individuals_changed_cb (EmpathyIndividualManager *manager,
     GParamSpec *spec,
     EmpathyRosterModelManager *self)
 {
-  GList *tops, *l;
+  GList *tops, *l, *removed = NULL;
+  GHashTableIter iter;
+  gpointer individual;
 
   tops = empathy_individual_manager_get_top_individuals (self->priv->manager);
 
@@ -194,23 +199,24 @@ top_individuals_changed_cb (EmpathyIndividualManager *manager,
         }
     }
 
-  l = self->priv->top_group_members;
-  while (l != NULL)
+  /* Don't fire signals while iterating as handlers may look at the set */
+  g_hash_table_iter_init (&iter, self->priv->top_group_members);
+  while (g_hash_table_iter_next (&iter, &individual, NULL))
     {
-      FolksIndividual *individual = l->data;
-
-      /* remove_from_top_group_members will modify the list so we already take
-       * the next pointer. */
-      l = g_list_next (l);
-
       if (!individual_should_be_in_top_group_members (self, individual))
         {
-          remove_from_top_group_members (self, individual);
-
-          empathy_roster_model_fire_groups_changed (EMPATHY_ROSTER_MODEL (self),
-              individual, EMPATHY_ROSTER_MODEL_GROUP_TOP_GROUP, FALSE);
+          g_hash_table_iter_remove (&iter);
+          removed = g_list_prepend (removed, individual);
         }
     }
+
+  for (l = removed; l != NULL; l = g_list_next (l))
+    {
+      empathy_roster_model_fire_groups_changed (EMPATHY_ROSTER_MODEL (self),
+          l->data, EMPATHY_ROSTER_MODEL_GROUP_TOP_GROUP, FALSE);
+    }
+
+  g_list_free (removed);
 }
 
 static void
@@ -321,7 +327,7 @@ empathy_roster_model_manager_finalize (GObject *object)
   void (*chain_up) (GObject *) =
       ((GObjectClass *) empathy_roster_model_manager_parent_class)->finalize;
 
-  g_list_free (self->priv->top_group_members);
+  g_hash_table_unref (self->priv->top_group_members);
 
   if (chain_up != NULL)
     chain_up (object);
@@ -355,7 +361,7 @@ empathy_roster_model_manager_init (EmpathyRosterModelManager *self)
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
       EMPATHY_TYPE_ROSTER_MODEL_MANAGER, EmpathyRosterModelManagerPriv);
 
-  self->priv->top_group_members = NULL;
+  self->priv->top_group_members = g_hash_table_new (NULL, NULL);
 }
 
 EmpathyRosterModelManager *
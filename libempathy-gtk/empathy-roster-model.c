@@ -25,6 +25,7 @@ G_DEFINE_INTERFACE (EmpathyRosterModel, empathy_roster_model, G_TYPE_OBJECT)
 enum
 {
   SIG_INDIVIDUAL_ADDED,
+  SIG_INDIVIDUALS_ADDED,
   SIG_INDIVIDUAL_REMOVED,
   SIG_GROUPS_CHANGED,
   LAST_SIGNAL
@@ -43,6 +44,17 @@ empathy_roster_model_default_init (EmpathyRosterModelInterface *iface)
         G_TYPE_NONE, 1,
         FOLKS_TYPE_INDIVIDUAL);
 
+  /* Emitted instead of individual-added when a lot of individuals are added
+   * at once, such as when connecting. The argument is a GList of
+   * FolksIndividual. */
+  signals[SIG_INDIVIDUALS_ADDED] =
+    g_signal_new ("individuals-added",
+        EMPATHY_TYPE_ROSTER_MODEL,
+        G_SIGNAL_RUN_LAST,
+        0, NULL, NULL, NULL,
+        G_TYPE_NONE, 1,
+        G_TYPE_POINTER);
+
   signals[SIG_INDIVIDUAL_REMOVED] =
     g_signal_new ("individual-removed",
         EMPATHY_TYPE_ROSTER_MODEL,
@@ -71,6 +83,13 @@ empathy_roster_model_fire_individual_added (EmpathyRosterModel *self,
   g_signal_emit (self, signals[SIG_INDIVIDUAL_ADDED], 0, individual);
 }
 
+void
+empathy_roster_model_fire_individuals_added (EmpathyRosterModel *self,
+    GList *individuals)
+{
+  g_signal_emit (self, signals[SIG_INDIVIDUALS_ADDED], 0, individuals);
+}
+
 void
 empathy_roster_model_fire_individual_removed (EmpathyRosterModel *self,
     FolksIndividual *individual)
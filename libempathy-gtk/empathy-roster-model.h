@@ -64,6 +64,9 @@ GType empathy_roster_model_get_type (void);
 void empathy_roster_model_fire_individual_added (EmpathyRosterModel *self,
     FolksIndividual *individual);
 
+void empathy_roster_model_fire_individuals_added (EmpathyRosterModel *self,
+    GList *individuals);
+
 void empathy_roster_model_fire_individual_removed (EmpathyRosterModel *self,
     FolksIndividual *individual);
 
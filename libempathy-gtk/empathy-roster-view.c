@@ -17,6 +17,21 @@ G_DEFINE_TYPE (EmpathyRosterView, empathy_roster_view, GTK_TYPE_LIST_BOX)
  * of the live search. */
 #define SEARCH_TIMEOUT 500
 
+/* Number of rows above and below the visible part of the view whose widgets
+ * are created, so scrolling a bit does not show empty rows. */
+#define MATERIALIZE_MARGIN_ROWS 10
+
+/* Height of an empty contact row until we know the one of a real row */
+#define DEFAULT_ROW_HEIGHT 56
+
+/* Contact rows showing a presence message are taller than the others */
+typedef enum
+{
+  ROW_KIND_ALIAS,
+  ROW_KIND_PRESENCE_MESSAGE,
+  NUM_ROW_KINDS
+} RowKind;
+
 enum
 {
   PROP_MODEL = 1,
@@ -37,6 +52,13 @@ enum
 
 static guint signals[LAST_SIGNAL];
 
+/* Values of the search_results hash table */
+enum
+{
+  SEARCH_NO_MATCH = 1,
+  SEARCH_MATCH,
+};
+
 #define NO_GROUP "X-no-group"
 
 struct _EmpathyRosterViewPriv
@@ -51,8 +73,20 @@ struct _EmpathyRosterViewPriv
   GHashTable *roster_contacts;
   /* (gchar *group_name) -> EmpathyRosterGroup (borrowed) */
   GHashTable *roster_groups;
+  /* Set of FolksIndividual (borrowed) in the model's top group */
+  GHashTable *top_individuals;
   /* Hash of the EmpathyRosterContact currently displayed */
   GHashTable *displayed_contacts;
+  /* Hash of the EmpathyRosterContact whose widgets have been created */
+  GHashTable *materialized_contacts;
+  /* Height requested by contact rows without widgets, per RowKind */
+  gint row_heights[NUM_ROW_KINDS];
+  /* Whether row_heights have been measured on real rows with the current
+   * style */
+  gboolean row_heights_measured[NUM_ROW_KINDS];
+  guint materialize_id;
+  /* The vertical adjustment of our scrollable parent, if any (owned) */
+  GtkAdjustment *adjustment;
 
   guint last_event_id;
   /* queue of (Event *). The most recent events are in the head of the queue
@@ -66,8 +100,18 @@ struct _EmpathyRosterViewPriv
   gboolean show_offline;
   gboolean show_groups;
   gboolean empty;
+  /* TRUE while adding a batch of individuals: their rows are sorted and
+   * filtered once they have all been added */
+  gboolean adding_individuals;
 
   TpawLiveSearch *search;
+  /* FolksIndividual (borrowed) -> SEARCH_MATCH or SEARCH_NO_MATCH for the
+   * search_results_text search. Filled as individuals are filtered. */
+  GHashTable *search_results;
+  gchar *search_results_text;
+  /* The results of the search we did before, if search_results_text extends
+   * it: individuals which did not match it can't match now either. */
+  GHashTable *previous_search_results;
 
   EmpathyRosterModel *model;
 };
@@ -164,14 +208,263 @@ empathy_roster_view_set_property (GObject *object,
     }
 }
 
+static void
+forget_search_result (EmpathyRosterView *self,
+    FolksIndividual *individual)
+{
+  g_hash_table_remove (self->priv->search_results, individual);
+  g_hash_table_remove (self->priv->previous_search_results, individual);
+}
+
 static void
 roster_contact_changed_cb (GtkListBoxRow *child,
     GParamSpec *spec,
     EmpathyRosterView *self)
 {
+  /* The alias may have changed */
+  forget_search_result (self, empathy_roster_contact_get_individual (
+        EMPATHY_ROSTER_CONTACT (child)));
+
   gtk_list_box_row_changed (child);
 }
 
+/* Contact rows are created empty, their widgets are only built while they are
+ * close to the visible part of the view and released when they scroll out of
+ * it. Empty rows request the height of a real row of the same kind so the
+ * size of the list, and so the scrollbar, stay the same. */
+
+static RowKind
+get_row_kind (EmpathyRosterContact *contact)
+{
+  FolksIndividual *individual;
+
+  individual = empathy_roster_contact_get_individual (contact);
+
+  if (tp_str_empty (folks_presence_details_get_presence_message (
+          FOLKS_PRESENCE_DETAILS (individual))))
+    return ROW_KIND_ALIAS;
+
+  return ROW_KIND_PRESENCE_MESSAGE;
+}
+
+static void
+set_empty_row_height (EmpathyRosterView *self,
+    EmpathyRosterContact *contact)
+{
+  gtk_widget_set_size_request (GTK_WIDGET (contact), -1,
+      self->priv->row_heights[get_row_kind (contact)]);
+}
+
+static void
+update_row_height (EmpathyRosterView *self,
+    EmpathyRosterContact *contact)
+{
+  RowKind kind = get_row_kind (contact);
+  GHashTableIter iter;
+  gpointer v;
+  gint height;
+
+  gtk_widget_get_preferred_height (GTK_WIDGET (contact), &height, NULL);
+  if (height <= 0)
+    return;
+
+  self->priv->row_heights_measured[kind] = TRUE;
+
+  if (height == self->priv->row_heights[kind])
+    return;
+
+  self->priv->row_heights[kind] = height;
+
+  /* This is the first real row of this kind since the style changed, resize
+   * the empty rows of the same kind */
+  g_hash_table_iter_init (&iter, self->priv->roster_contacts);
+  while (g_hash_table_iter_next (&iter, NULL, &v))
+    {
+      GHashTable *group_contacts = v;
+      GHashTableIter group_iter;
+      gpointer c;
+
+      g_hash_table_iter_init (&group_iter, group_contacts);
+      while (g_hash_table_iter_next (&group_iter, NULL, &c))
+        {
+          if (!empathy_roster_contact_has_widgets (c) &&
+              get_row_kind (c) == kind)
+            gtk_widget_set_size_request (c, -1, height);
+        }
+    }
+}
+
+static void
+materialize_contact (EmpathyRosterView *self,
+    EmpathyRosterContact *contact)
+{
+  if (!empathy_roster_contact_has_widgets (contact))
+    {
+      empathy_roster_contact_ensure_widgets (contact);
+      g_hash_table_add (self->priv->materialized_contacts, contact);
+
+      /* Real rows get their natural height */
+      gtk_widget_set_size_request (GTK_WIDGET (contact), -1, -1);
+    }
+
+  if (!self->priv->row_heights_measured[get_row_kind (contact)])
+    update_row_height (self, contact);
+}
+
+static void
+get_materialize_range (EmpathyRosterView *self,
+    gint *top,
+    gint *bottom)
+{
+  gint margin = MATERIALIZE_MARGIN_ROWS *
+      MAX (self->priv->row_heights[ROW_KIND_ALIAS],
+          self->priv->row_heights[ROW_KIND_PRESENCE_MESSAGE]);
+
+  if (self->priv->adjustment != NULL)
+    {
+      gdouble value, page_size;
+
+      /* The view is in a viewport so its allocation starts at 0 and the
+       * value of the adjustment is the position of its visible part. */
+      value = gtk_adjustment_get_value (self->priv->adjustment);
+      page_size = gtk_adjustment_get_page_size (self->priv->adjustment);
+
+      *top = (gint) value - margin;
+      *bottom = (gint) (value + page_size) + margin;
+    }
+  else
+    {
+      GtkAllocation allocation;
+
+      gtk_widget_get_allocation (GTK_WIDGET (self), &allocation);
+
+      *top = 0;
+      *bottom = allocation.height;
+    }
+}
+
+static gboolean
+materialize_visible_rows_cb (gpointer user_data)
+{
+  EmpathyRosterView *self = user_data;
+  GHashTable *visible;
+  GHashTableIter iter;
+  gpointer key;
+  GtkListBoxRow *row;
+  gint top, bottom, index;
+
+  self->priv->materialize_id = 0;
+
+  get_materialize_range (self, &top, &bottom);
+
+  row = gtk_list_box_get_row_at_y (GTK_LIST_BOX (self), MAX (top, 0));
+  if (row != NULL)
+    index = gtk_list_box_row_get_index (row);
+  else if (top <= 0)
+    index = 0;
+  else
+    index = -1;
+
+  visible = g_hash_table_new (NULL, NULL);
+
+  while (index >= 0)
+    {
+      GtkAllocation allocation;
+
+      row = gtk_list_box_get_row_at_index (GTK_LIST_BOX (self), index++);
+      if (row == NULL)
+        break;
+
+      /* Rows hidden by the filter don't have a meaningful allocation */
+      if (!gtk_widget_get_child_visible (GTK_WIDGET (row)))
+        continue;
+
+      gtk_widget_get_allocation (GTK_WIDGET (row), &allocation);
+      if (allocation.y > bottom)
+        break;
+
+      if (!EMPATHY_IS_ROSTER_CONTACT (row))
+        continue;
+
+      materialize_contact (self, EMPATHY_ROSTER_CONTACT (row));
+      g_hash_table_add (visible, row);
+    }
+
+  /* Release the rows which are not visible any more */
+  g_hash_table_iter_init (&iter, self->priv->materialized_contacts);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (g_hash_table_contains (visible, key))
+        continue;
+
+      empathy_roster_contact_release_widgets (key);
+      set_empty_row_height (self, key);
+      g_hash_table_iter_remove (&iter);
+    }
+
+  g_hash_table_unref (visible);
+  return FALSE;
+}
+
+static void
+schedule_materialize (EmpathyRosterView *self)
+{
+  if (self->priv->materialize_id != 0)
+    return;
+
+  /* Run once the new layout has been computed */
+  self->priv->materialize_id = g_idle_add (materialize_visible_rows_cb, self);
+}
+
+static void
+adjustment_changed_cb (GtkAdjustment *adjustment,
+    EmpathyRosterView *self)
+{
+  schedule_materialize (self);
+}
+
+static void
+set_adjustment (EmpathyRosterView *self,
+    GtkAdjustment *adjustment)
+{
+  if (self->priv->adjustment == adjustment)
+    return;
+
+  if (self->priv->adjustment != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (self->priv->adjustment,
+          adjustment_changed_cb, self);
+      g_clear_object (&self->priv->adjustment);
+    }
+
+  if (adjustment == NULL)
+    return;
+
+  self->priv->adjustment = g_object_ref (adjustment);
+
+  g_signal_connect (adjustment, "value-changed",
+      G_CALLBACK (adjustment_changed_cb), self);
+  g_signal_connect (adjustment, "changed",
+      G_CALLBACK (adjustment_changed_cb), self);
+}
+
+static void
+roster_contact_presence_message_changed_cb (FolksIndividual *individual,
+    GParamSpec *spec,
+    EmpathyRosterContact *contact)
+{
+  GtkWidget *parent;
+
+  /* Real rows follow their content */
+  if (empathy_roster_contact_has_widgets (contact))
+    return;
+
+  /* The row may have changed kind */
+  parent = gtk_widget_get_parent (GTK_WIDGET (contact));
+  if (EMPATHY_IS_ROSTER_VIEW (parent))
+    set_empty_row_height (EMPATHY_ROSTER_VIEW (parent), contact);
+}
+
 static GtkWidget *
 add_roster_contact (EmpathyRosterView *self,
     FolksIndividual *individual,
@@ -189,6 +482,10 @@ add_roster_contact (EmpathyRosterView *self,
   g_signal_connect (contact, "notify::alias",
       G_CALLBACK (roster_contact_changed_cb), self);
 
+  g_signal_connect_object (individual, "notify::presence-message",
+      G_CALLBACK (roster_contact_presence_message_changed_cb), contact, 0);
+
+  set_empty_row_height (self, EMPATHY_ROSTER_CONTACT (contact));
   gtk_widget_show (contact);
   gtk_container_add (GTK_CONTAINER (self), contact);
 
@@ -386,11 +683,25 @@ individual_favourite_change_cb (FolksIndividual *individual,
   gtk_list_box_row_changed (GTK_LIST_BOX_ROW (contact));
 }
 
+static void
+individual_personas_changed_cb (FolksIndividual *individual,
+    GeeSet *added,
+    GeeSet *removed,
+    gchar *message,
+    FolksPersona *actor,
+    FolksGroupDetailsChangeReason reason,
+    EmpathyRosterView *self)
+{
+  /* The IDs of the individual may have changed */
+  forget_search_result (self, individual);
+}
+
 static void
 individual_added (EmpathyRosterView *self,
     FolksIndividual *individual)
 {
   GHashTable *contacts;
+  GList *groups, *l;
 
   contacts = g_hash_table_lookup (self->priv->roster_contacts, individual);
   if (contacts != NULL)
@@ -400,17 +711,19 @@ individual_added (EmpathyRosterView *self,
 
   g_hash_table_insert (self->priv->roster_contacts, individual, contacts);
 
+  groups = empathy_roster_model_dup_groups_for_individual (self->priv->model,
+      individual);
+
+  if (g_list_find_custom (groups, EMPATHY_ROSTER_MODEL_GROUP_TOP_GROUP,
+        (GCompareFunc) g_strcmp0) != NULL)
+    g_hash_table_add (self->priv->top_individuals, individual);
+
   if (!self->priv->show_groups)
     {
       add_to_group (self, individual, NO_GROUP);
     }
   else
     {
-      GList *groups, *l;
-
-      groups = empathy_roster_model_dup_groups_for_individual (self->priv->model,
-          individual);
-
       if (g_list_length (groups) > 0)
         {
           for (l = groups; l != NULL; l = g_list_next (l))
@@ -423,12 +736,14 @@ individual_added (EmpathyRosterView *self,
           /* No group, adds to Ungrouped */
           add_to_group (self, individual, EMPATHY_ROSTER_MODEL_GROUP_UNGROUPED);
         }
-
-      g_list_free_full (groups, g_free);
     }
 
+  g_list_free_full (groups, g_free);
+
   tp_g_signal_connect_object (individual, "notify::is-favourite",
       G_CALLBACK (individual_favourite_change_cb), self, 0);
+  tp_g_signal_connect_object (individual, "personas-changed",
+      G_CALLBACK (individual_personas_changed_cb), self, 0);
 }
 
 static void
@@ -553,6 +868,7 @@ individual_removed (EmpathyRosterView *self,
     return;
 
   remove_all_individual_event (self, individual);
+  forget_search_result (self, individual);
 
   g_hash_table_iter_init (&iter, contacts);
   while (g_hash_table_iter_next (&iter, &key, &value))
@@ -572,6 +888,7 @@ individual_removed (EmpathyRosterView *self,
     }
 
   g_hash_table_remove (self->priv->roster_contacts, individual);
+  g_hash_table_remove (self->priv->top_individuals, individual);
 }
 
 static void
@@ -582,6 +899,24 @@ individual_added_cb (EmpathyRosterModel *model,
   individual_added (self, individual);
 }
 
+static void
+individuals_added_cb (EmpathyRosterModel *model,
+    GList *individuals,
+    EmpathyRosterView *self)
+{
+  GList *l;
+
+  self->priv->adding_individuals = TRUE;
+
+  for (l = individuals; l != NULL; l = g_list_next (l))
+    individual_added (self, l->data);
+
+  self->priv->adding_individuals = FALSE;
+
+  gtk_list_box_invalidate_sort (GTK_LIST_BOX (self));
+  gtk_list_box_invalidate_filter (GTK_LIST_BOX (self));
+}
+
 static void
 individual_removed_cb (EmpathyRosterModel *model,
     FolksIndividual *individual,
@@ -597,22 +932,8 @@ contact_in_top (EmpathyRosterView *self,
   if (!self->priv->show_groups)
     {
       /* Always display top contacts in non-group mode. */
-      GList *groups;
-      FolksIndividual *individual;
-      gboolean result = FALSE;
-
-      individual = empathy_roster_contact_get_individual (contact);
-
-      groups = empathy_roster_model_dup_groups_for_individual (
-          self->priv->model, individual);
-
-      if (g_list_find_custom (groups, EMPATHY_ROSTER_MODEL_GROUP_TOP_GROUP,
-            (GCompareFunc) g_strcmp0) != NULL)
-        result = TRUE;
-
-      g_list_free_full (groups, g_free);
-
-      return result;
+      return g_hash_table_contains (self->priv->top_individuals,
+          empathy_roster_contact_get_individual (contact));
     }
 
   if (!tp_strdiff (empathy_roster_contact_get_group (contact),
@@ -629,16 +950,9 @@ static gint
 compare_roster_contacts_by_alias (EmpathyRosterContact *a,
     EmpathyRosterContact *b)
 {
-  FolksIndividual *ind_a, *ind_b;
-  const gchar *alias_a, *alias_b;
-
-  ind_a = empathy_roster_contact_get_individual (a);
-  ind_b = empathy_roster_contact_get_individual (b);
-
-  alias_a = folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (ind_a));
-  alias_b = folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (ind_b));
-
-  return g_utf8_collate (alias_a, alias_b);
+  return empathy_individual_compare_by_alias (
+      empathy_roster_contact_get_individual (a),
+      empathy_roster_contact_get_individual (b));
 }
 
 static gint
@@ -744,6 +1058,10 @@ roster_view_sort (GtkListBoxRow *a,
 {
   EmpathyRosterView *self = user_data;
 
+  /* Rows will be sorted once the whole batch has been added */
+  if (self->priv->adding_individuals)
+    return 0;
+
   if (EMPATHY_IS_ROSTER_CONTACT (a) && EMPATHY_IS_ROSTER_CONTACT (b))
     return compare_roster_contacts (self, EMPATHY_ROSTER_CONTACT (a),
         EMPATHY_ROSTER_CONTACT (b));
@@ -848,6 +1166,63 @@ contact_is_favorite (EmpathyRosterContact *contact)
       FOLKS_FAVOURITE_DETAILS (individual));
 }
 
+static void
+update_search_results_text (EmpathyRosterView *self,
+    const gchar *text)
+{
+  GHashTable *tmp;
+
+  if (self->priv->search_results_text != NULL &&
+      g_str_has_prefix (text, self->priv->search_results_text))
+    {
+      /* Only individuals which matched the previous text can match this one,
+       * keep its results to filter out the others. */
+      tmp = self->priv->previous_search_results;
+      self->priv->previous_search_results = self->priv->search_results;
+      self->priv->search_results = tmp;
+    }
+  else
+    {
+      g_hash_table_remove_all (self->priv->previous_search_results);
+    }
+
+  g_hash_table_remove_all (self->priv->search_results);
+
+  g_free (self->priv->search_results_text);
+  self->priv->search_results_text = g_strdup (text);
+}
+
+static gboolean
+individual_match_search (EmpathyRosterView *self,
+    FolksIndividual *individual)
+{
+  const gchar *text;
+  gpointer result;
+  gboolean match;
+
+  text = tpaw_live_search_get_text (self->priv->search);
+  if (tp_strdiff (text, self->priv->search_results_text))
+    update_search_results_text (self, text);
+
+  /* Individuals are filtered once per group they are in */
+  result = g_hash_table_lookup (self->priv->search_results, individual);
+  if (result != NULL)
+    return GPOINTER_TO_INT (result) == SEARCH_MATCH;
+
+  result = g_hash_table_lookup (self->priv->previous_search_results,
+      individual);
+  if (GPOINTER_TO_INT (result) == SEARCH_NO_MATCH)
+    match = FALSE;
+  else
+    match = empathy_individual_match_string (individual, text,
+        tpaw_live_search_get_words (self->priv->search));
+
+  g_hash_table_insert (self->priv->search_results, individual,
+      GINT_TO_POINTER (match ? SEARCH_MATCH : SEARCH_NO_MATCH));
+
+  return match;
+}
+
 /**
  * check if @contact should be displayed according to @self's current status
  * and without consideration for the state of @contact's groups.
@@ -862,9 +1237,7 @@ contact_should_be_displayed (EmpathyRosterView *self,
 
       individual = empathy_roster_contact_get_individual (contact);
 
-      return empathy_individual_match_string (individual,
-          tpaw_live_search_get_text (self->priv->search),
-          tpaw_live_search_get_words (self->priv->search));
+      return individual_match_search (self, individual);
     }
 
   if (self->priv->show_offline)
@@ -947,6 +1320,9 @@ filter_list (GtkListBoxRow *child,
 {
   EmpathyRosterView *self = user_data;
 
+  if (self->priv->adding_individuals)
+    return TRUE;
+
   if (EMPATHY_IS_ROSTER_CONTACT (child))
     return filter_contact (self, EMPATHY_ROSTER_CONTACT (child));
 
@@ -1014,6 +1390,15 @@ groups_changed_cb (EmpathyRosterModel *model,
     gboolean is_member,
     EmpathyRosterView *self)
 {
+  if (!tp_strdiff (group, EMPATHY_ROSTER_MODEL_GROUP_TOP_GROUP) &&
+      g_hash_table_contains (self->priv->roster_contacts, individual))
+    {
+      if (is_member)
+        g_hash_table_add (self->priv->top_individuals, individual);
+      else
+        g_hash_table_remove (self->priv->top_individuals, individual);
+    }
+
   if (!self->priv->show_groups)
     {
       gtk_list_box_invalidate_sort (GTK_LIST_BOX (self));
@@ -1049,6 +1434,8 @@ empathy_roster_view_constructed (GObject *object)
 
   tp_g_signal_connect_object (self->priv->model, "individual-added",
       G_CALLBACK (individual_added_cb), self, 0);
+  tp_g_signal_connect_object (self->priv->model, "individuals-added",
+      G_CALLBACK (individuals_added_cb), self, 0);
   tp_g_signal_connect_object (self->priv->model, "individual-removed",
       G_CALLBACK (individual_removed_cb), self, 0);
   tp_g_signal_connect_object (self->priv->model, "groups-changed",
@@ -1069,7 +1456,10 @@ clear_view (EmpathyRosterView *self)
 {
   g_hash_table_remove_all (self->priv->roster_contacts);
   g_hash_table_remove_all (self->priv->roster_groups);
+  g_hash_table_remove_all (self->priv->top_individuals);
   g_hash_table_remove_all (self->priv->displayed_contacts);
+  g_hash_table_remove_all (self->priv->search_results);
+  g_hash_table_remove_all (self->priv->previous_search_results);
 
   gtk_container_foreach (GTK_CONTAINER (self),
       (GtkCallback) gtk_widget_destroy, NULL);
@@ -1097,6 +1487,14 @@ empathy_roster_view_dispose (GObject *object)
       self->priv->search_id = 0;
     }
 
+  if (self->priv->materialize_id != 0)
+    {
+      g_source_remove (self->priv->materialize_id);
+      self->priv->materialize_id = 0;
+    }
+
+  set_adjustment (self, NULL);
+
   if (chain_up != NULL)
     chain_up (object);
 }
@@ -1110,7 +1508,12 @@ empathy_roster_view_finalize (GObject *object)
 
   g_hash_table_unref (self->priv->roster_contacts);
   g_hash_table_unref (self->priv->roster_groups);
+  g_hash_table_unref (self->priv->top_individuals);
   g_hash_table_unref (self->priv->displayed_contacts);
+  g_hash_table_unref (self->priv->materialized_contacts);
+  g_hash_table_unref (self->priv->search_results);
+  g_hash_table_unref (self->priv->previous_search_results);
+  g_free (self->priv->search_results_text);
   g_queue_free_full (self->priv->events, event_free);
 
   if (chain_up != NULL)
@@ -1294,7 +1697,44 @@ empathy_roster_view_remove (GtkContainer *container,
   chain_up (container, widget);
 
   if (EMPATHY_IS_ROSTER_CONTACT (widget))
-    remove_from_displayed (self, (EmpathyRosterContact *) widget);
+    {
+      remove_from_displayed (self, (EmpathyRosterContact *) widget);
+      g_hash_table_remove (self->priv->materialized_contacts, widget);
+    }
+}
+
+static void
+empathy_roster_view_size_allocate (GtkWidget *widget,
+    GtkAllocation *allocation)
+{
+  EmpathyRosterView *self = EMPATHY_ROSTER_VIEW (widget);
+  void (*chain_up) (GtkWidget *, GtkAllocation *) =
+      ((GtkWidgetClass *) empathy_roster_view_parent_class)->size_allocate;
+
+  chain_up (widget, allocation);
+
+  /* GtkListBox picks the adjustment of its viewport when it's added to it */
+  set_adjustment (self, gtk_list_box_get_adjustment (GTK_LIST_BOX (self)));
+
+  /* Rows have been added, removed, filtered or sorted */
+  schedule_materialize (self);
+}
+
+static void
+empathy_roster_view_style_updated (GtkWidget *widget)
+{
+  EmpathyRosterView *self = EMPATHY_ROSTER_VIEW (widget);
+  guint i;
+
+  ((GtkWidgetClass *) empathy_roster_view_parent_class)->style_updated (
+      widget);
+
+  /* Measure the real rows again once they have been laid out with the new
+   * style */
+  for (i = 0; i < NUM_ROW_KINDS; i++)
+    self->priv->row_heights_measured[i] = FALSE;
+
+  schedule_materialize (self);
 }
 
 static void
@@ -1316,6 +1756,8 @@ empathy_roster_view_class_init (
   widget_class->button_press_event = empathy_roster_view_button_press_event;
   widget_class->key_press_event = empathy_roster_view_key_press_event;
   widget_class->query_tooltip = empathy_roster_view_query_tooltip;
+  widget_class->size_allocate = empathy_roster_view_size_allocate;
+  widget_class->style_updated = empathy_roster_view_style_updated;
 
   container_class->remove = empathy_roster_view_remove;
 
@@ -1387,7 +1829,13 @@ empathy_roster_view_init (EmpathyRosterView *self)
       NULL, (GDestroyNotify) g_hash_table_unref);
   self->priv->roster_groups = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, NULL);
+  self->priv->top_individuals = g_hash_table_new (NULL, NULL);
   self->priv->displayed_contacts = g_hash_table_new (NULL, NULL);
+  self->priv->materialized_contacts = g_hash_table_new (NULL, NULL);
+  self->priv->row_heights[ROW_KIND_ALIAS] = DEFAULT_ROW_HEIGHT;
+  self->priv->row_heights[ROW_KIND_PRESENCE_MESSAGE] = DEFAULT_ROW_HEIGHT;
+  self->priv->search_results = g_hash_table_new (NULL, NULL);
+  self->priv->previous_search_results = g_hash_table_new (NULL, NULL);
 
   self->priv->events = g_queue_new ();
 
@@ -23,64 +23,105 @@
 #include "config.h"
 #include "empathy-smiley-manager.h"
 
+#include <string.h>
 #include <tp-account-widgets/tpaw-pixbuf-utils.h>
 #include <tp-account-widgets/tpaw-utils.h>
 
 #include "empathy-ui-utils.h"
 #include "empathy-utils.h"
 
-typedef struct _SmileyManagerTree SmileyManagerTree;
-
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathySmileyManager)
+
+/* The smileys are compiled into an automaton: a trie of the smiley strings
+ * whose nodes also have a failure link. Parsing a text follows the trie
+ * as far as possible from the start of a potential smiley, and only reports
+ * a smiley if it ends exactly where the walk stopped. When the walk stops
+ * on a node which is not a smiley, the text has to be looked at again from
+ * the character following the start. That second look only depends on the
+ * string leading to the node, so it is done once when compiling: the
+ * failure link is the node it ends on, along with the smileys it finds on
+ * the way. The text is thus read only once. */
+
+/* Index of the root node. It is never the child of another node, so it also
+ * means "no child". */
+#define ROOT 0
+
+typedef struct {
+	gchar     *str;
+	GdkPixbuf *pixbuf;
+	gchar     *path;
+} SmileyPattern;
+
+typedef struct {
+	gunichar c;
+	guint    node;
+} SmileyTransition;
+
+/* Smiley found while following a failure link, with positions relative
+ * to the start of the string leading to the node. */
+typedef struct {
+	guint node;
+	guint start;
+	guint end;
+} SmileyFailHit;
+
+typedef struct {
+	/* Length in bytes of the string leading to this node */
+	guint                depth;
+	/* The smiley matching that string, if any */
+	const SmileyPattern *pattern;
+	/* Transitions to the children, sorted by character, in
+	 * priv->transitions */
+	guint                first_transition;
+	guint                n_transitions;
+	/* Node reached by parsing the string without its first character, and
+	 * smileys found doing so, in priv->fail_hits */
+	guint                fail;
+	guint                first_fail_hit;
+	guint                n_fail_hits;
+} SmileyNode;
+
 typedef struct {
-	SmileyManagerTree *tree;
+	/* Owned SmileyPattern, in the order they were added */
+	GPtrArray         *patterns;
+	/* Compiled automaton, NULL if a smiley has been added since it was
+	 * compiled. Array of SmileyNode, ROOT first. */
+	GArray            *nodes;
+	/* Array of SmileyTransition */
+	GArray            *transitions;
+	/* Array of SmileyFailHit */
+	GArray            *fail_hits;
+	/* Children of ROOT for ASCII characters, the most common ones */
+	guint              root_ascii[128];
 	GSList            *smileys;
 } EmpathySmileyManagerPriv;
 
-struct _SmileyManagerTree {
-	gunichar     c;
-	GdkPixbuf   *pixbuf;
-	gchar       *path;
-	GSList      *childrens;
-};
+typedef void (*SmileyHitFunc) (const SmileyPattern *pattern,
+			       guint                start,
+			       guint                end,
+			       gpointer             user_data);
 
 G_DEFINE_TYPE (EmpathySmileyManager, empathy_smiley_manager, G_TYPE_OBJECT);
 
 static EmpathySmileyManager *manager_singleton = NULL;
 
-static SmileyManagerTree *
-smiley_manager_tree_new (gunichar c)
+static void
+smiley_pattern_free (SmileyPattern *pattern)
 {
-	SmileyManagerTree *tree;
-
-	tree = g_slice_new0 (SmileyManagerTree);
-	tree->c = c;
-	tree->pixbuf = NULL;
-	tree->childrens = NULL;
-	tree->path = NULL;
-
-	return tree;
+	g_free (pattern->str);
+	g_object_unref (pattern->pixbuf);
+	g_free (pattern->path);
+	g_slice_free (SmileyPattern, pattern);
 }
 
 static void
-smiley_manager_tree_free (SmileyManagerTree *tree)
+smiley_manager_clear_automaton (EmpathySmileyManager *manager)
 {
-	GSList *l;
-
-	if (!tree) {
-		return;
-	}
-
-	for (l = tree->childrens; l; l = l->next) {
-		smiley_manager_tree_free (l->data);
-	}
+	EmpathySmileyManagerPriv *priv = GET_PRIV (manager);
 
-	if (tree->pixbuf) {
-		g_object_unref (tree->pixbuf);
-	}
-	g_slist_free (tree->childrens);
-	g_free (tree->path);
-	g_slice_free (SmileyManagerTree, tree);
+	tp_clear_pointer (&priv->nodes, g_array_unref);
+	tp_clear_pointer (&priv->transitions, g_array_unref);
+	tp_clear_pointer (&priv->fail_hits, g_array_unref);
 }
 
 static EmpathySmiley *
@@ -108,7 +149,8 @@ smiley_manager_finalize (GObject *object)
 {
 	EmpathySmileyManagerPriv *priv = GET_PRIV (object);
 
-	smiley_manager_tree_free (priv->tree);
+	smiley_manager_clear_automaton (EMPATHY_SMILEY_MANAGER (object));
+	g_ptr_array_unref (priv->patterns);
 	g_slist_foreach (priv->smileys, (GFunc) smiley_free, NULL);
 	g_slist_free (priv->smileys);
 }
@@ -151,7 +193,8 @@ empathy_smiley_manager_init (EmpathySmileyManager *manager)
 		EMPATHY_TYPE_SMILEY_MANAGER, EmpathySmileyManagerPriv);
 
 	manager->priv = priv;
-	priv->tree = smiley_manager_tree_new ('\0');
+	priv->patterns = g_ptr_array_new_with_free_func (
+		(GDestroyNotify) smiley_pattern_free);
 	priv->smileys = NULL;
 
 	empathy_smiley_manager_load (manager);
@@ -163,57 +206,6 @@ empathy_smiley_manager_dup_singleton (void)
 	return g_object_new (EMPATHY_TYPE_SMILEY_MANAGER, NULL);
 }
 
-static SmileyManagerTree *
-smiley_manager_tree_find_child (SmileyManagerTree *tree, gunichar c)
-{
-	GSList *l;
-
-	for (l = tree->childrens; l; l = l->next) {
-		SmileyManagerTree *child = l->data;
-
-		if (child->c == c) {
-			return child;
-		}
-	}
-
-	return NULL;
-}
-
-static SmileyManagerTree *
-smiley_manager_tree_find_or_insert_child (SmileyManagerTree *tree, gunichar c)
-{
-	SmileyManagerTree *child;
-
-	child = smiley_manager_tree_find_child (tree, c);
-
-	if (!child) {
-		child = smiley_manager_tree_new (c);
-		tree->childrens = g_slist_prepend (tree->childrens, child);
-	}
-
-	return child;
-}
-
-static void
-smiley_manager_tree_insert (SmileyManagerTree *tree,
-			    GdkPixbuf         *pixbuf,
-			    const gchar       *str,
-			    const gchar       *path)
-{
-	SmileyManagerTree *child;
-
-	child = smiley_manager_tree_find_or_insert_child (tree, g_utf8_get_char (str));
-
-	str = g_utf8_next_char (str);
-	if (*str) {
-		smiley_manager_tree_insert (child, pixbuf, str, path);
-		return;
-	}
-
-	child->pixbuf = g_object_ref (pixbuf);
-	child->path = g_strdup (path);
-}
-
 static void
 smiley_manager_add_valist (EmpathySmileyManager *manager,
 			   GdkPixbuf            *pixbuf,
@@ -226,9 +218,22 @@ smiley_manager_add_valist (EmpathySmileyManager *manager,
 	EmpathySmiley            *smiley;
 
 	for (str = first_str; str; str = va_arg (var_args, gchar*)) {
-		smiley_manager_tree_insert (priv->tree, pixbuf, str, path);
+		SmileyPattern *pattern;
+
+		if (*str == '\0') {
+			continue;
+		}
+
+		pattern = g_slice_new (SmileyPattern);
+		pattern->str = g_strdup (str);
+		pattern->pixbuf = g_object_ref (pixbuf);
+		pattern->path = g_strdup (path);
+		g_ptr_array_add (priv->patterns, pattern);
 	}
 
+	/* Compiled again on next parse */
+	smiley_manager_clear_automaton (manager);
+
 	g_object_set_data_full (G_OBJECT (pixbuf), "smiley_str",
 				g_strdup (first_str), g_free);
 	smiley = smiley_new (pixbuf, first_str);
@@ -290,20 +295,361 @@ empathy_smiley_manager_load (EmpathySmileyManager *manager)
 	empathy_smiley_manager_add (manager, "face-worried",    ":-S",   ":S",   ":-s", ":s", NULL);
 }
 
-static EmpathySmileyHit *
-smiley_hit_new (SmileyManagerTree *tree,
-		guint              start,
-		guint              end)
+static guint
+smiley_manager_find_child (EmpathySmileyManagerPriv *priv,
+			   guint                     node,
+			   gunichar                  c)
+{
+	const SmileyNode       *n;
+	const SmileyTransition *transitions;
+	guint                   low, high;
+
+	if (node == ROOT && c < G_N_ELEMENTS (priv->root_ascii)) {
+		return priv->root_ascii[c];
+	}
+
+	n = &g_array_index (priv->nodes, SmileyNode, node);
+	transitions = &g_array_index (priv->transitions, SmileyTransition,
+				      n->first_transition);
+
+	/* Binary search in the sorted transitions */
+	low = 0;
+	high = n->n_transitions;
+	while (low < high) {
+		guint mid = (low + high) / 2;
+
+		if (transitions[mid].c == c) {
+			return transitions[mid].node;
+		} else if (transitions[mid].c < c) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return ROOT;
+}
+
+/* Feed the character c, found at byte offset pos, to the automaton in state
+ * node. Calls func for each smiley that c ends, and returns the new state. */
+static guint
+smiley_manager_step (EmpathySmileyManagerPriv *priv,
+		     guint                     node,
+		     gunichar                  c,
+		     guint                     pos,
+		     SmileyHitFunc             func,
+		     gpointer                  user_data)
 {
-	EmpathySmileyHit *hit;
+	while (TRUE) {
+		const SmileyNode *n;
+		guint             child;
+		guint             start;
+		guint             i;
+
+		/* If we have a child it means c is part of a smiley */
+		child = smiley_manager_find_child (priv, node, c);
+		if (child != ROOT || node == ROOT) {
+			return child;
+		}
+
+		n = &g_array_index (priv->nodes, SmileyNode, node);
+		start = pos - n->depth;
+
+		/* c is not part of a smiley. let's check if we found a smiley
+		 * before it, and then if a new smiley starts with c. */
+		if (n->pattern != NULL) {
+			func (n->pattern, start, pos, user_data);
+			node = ROOT;
+			continue;
+		}
+
+		/* We searched a smiley starting at 'start' but we ended with
+		 * no smiley. Look again starting from next char, which has
+		 * been done when compiling.
+		 *
+		 * For example ">:)" and ":(" are both valid smileys, when
+		 * parsing text ">:(" we first see '>' which could be the start
+		 * of a smiley. Then we see ':' which is still potential smiley,
+		 * and '(' which is NOT part of the smiley, ">:(" does not
+		 * exist. The failure link of ">:" is ":", from which '(' leads
+		 * to ":(" which is correct smiley. */
+		for (i = 0; i < n->n_fail_hits; i++) {
+			const SmileyFailHit *hit;
+			const SmileyNode    *hit_node;
+
+			hit = &g_array_index (priv->fail_hits, SmileyFailHit,
+					      n->first_fail_hit + i);
+			hit_node = &g_array_index (priv->nodes, SmileyNode,
+						   hit->node);
+			func (hit_node->pattern, start + hit->start,
+			      start + hit->end, user_data);
+		}
+
+		node = n->fail;
+	}
+}
+
+typedef struct {
+	EmpathySmileyManagerPriv *priv;
+	GArray                   *fail_hits;
+} CompileData;
+
+static void
+smiley_manager_add_fail_hit (const SmileyPattern *pattern,
+			     guint                start,
+			     guint                end,
+			     gpointer             user_data)
+{
+	CompileData   *data = user_data;
+	SmileyFailHit  hit;
+	guint          i;
+
+	/* Find back the node of that smiley. This only happens when
+	 * compiling, and there are very few of them. */
+	for (i = 0; i < data->priv->nodes->len; i++) {
+		if (g_array_index (data->priv->nodes, SmileyNode, i).pattern ==
+		    pattern) {
+			break;
+		}
+	}
+
+	hit.node = i;
+	hit.start = start;
+	hit.end = end;
+	g_array_append_val (data->fail_hits, hit);
+}
+
+static gint
+smiley_transition_compare (gconstpointer a,
+			   gconstpointer b)
+{
+	const SmileyTransition *ta = a;
+	const SmileyTransition *tb = b;
+
+	if (ta->c == tb->c) {
+		return 0;
+	}
+
+	return ta->c < tb->c ? -1 : 1;
+}
+
+static void
+smiley_manager_compile (EmpathySmileyManager *manager)
+{
+	EmpathySmileyManagerPriv *priv = GET_PRIV (manager);
+	/* Array of GArray of SmileyTransition, the children of each node */
+	GPtrArray                *children;
+	SmileyNode                root = { 0, };
+	CompileData               data;
+	guint                     i;
+
+	if (priv->nodes != NULL) {
+		return;
+	}
+
+	priv->nodes = g_array_new (FALSE, FALSE, sizeof (SmileyNode));
+	priv->transitions = g_array_new (FALSE, FALSE,
+					 sizeof (SmileyTransition));
+	priv->fail_hits = g_array_new (FALSE, FALSE, sizeof (SmileyFailHit));
+	children = g_ptr_array_new_with_free_func (
+		(GDestroyNotify) g_array_unref);
+
+	g_array_append_val (priv->nodes, root);
+	g_ptr_array_add (children,
+			 g_array_new (FALSE, FALSE, sizeof (SmileyTransition)));
+
+	/* Build the trie. If a smiley has been added twice, the last one
+	 * wins. */
+	for (i = 0; i < priv->patterns->len; i++) {
+		SmileyPattern *pattern = g_ptr_array_index (priv->patterns, i);
+		const gchar   *str;
+		guint          node = ROOT;
+
+		for (str = pattern->str; *str != '\0';
+		     str = g_utf8_next_char (str)) {
+			GArray           *node_children;
+			SmileyTransition  transition;
+			guint             j;
+
+			node_children = g_ptr_array_index (children, node);
+			transition.c = g_utf8_get_char (str);
+			transition.node = ROOT;
+
+			for (j = 0; j < node_children->len; j++) {
+				SmileyTransition *t = &g_array_index (
+					node_children, SmileyTransition, j);
+
+				if (t->c == transition.c) {
+					transition.node = t->node;
+					break;
+				}
+			}
+
+			if (transition.node == ROOT) {
+				SmileyNode child = { 0, };
+
+				child.depth = g_utf8_next_char (str) -
+					pattern->str;
+				transition.node = priv->nodes->len;
+				g_array_append_val (priv->nodes, child);
+				g_ptr_array_add (children, g_array_new (FALSE,
+					FALSE, sizeof (SmileyTransition)));
+				g_array_append_val (node_children, transition);
+			}
+
+			node = transition.node;
+		}
+
+		g_array_index (priv->nodes, SmileyNode, node).pattern = pattern;
+	}
+
+	/* Store the sorted transitions of all nodes in a single array */
+	for (i = 0; i < priv->nodes->len; i++) {
+		SmileyNode *node = &g_array_index (priv->nodes, SmileyNode, i);
+		GArray     *node_children = g_ptr_array_index (children, i);
+
+		g_array_sort (node_children, smiley_transition_compare);
+		node->first_transition = priv->transitions->len;
+		node->n_transitions = node_children->len;
+		g_array_append_vals (priv->transitions, node_children->data,
+				     node_children->len);
+	}
+
+	memset (priv->root_ascii, 0, sizeof (priv->root_ascii));
+	root = g_array_index (priv->nodes, SmileyNode, ROOT);
+	for (i = 0; i < root.n_transitions; i++) {
+		SmileyTransition *t = &g_array_index (priv->transitions,
+			SmileyTransition, root.first_transition + i);
+
+		if (t->c < G_N_ELEMENTS (priv->root_ascii)) {
+			priv->root_ascii[t->c] = t->node;
+		}
+	}
+
+	/* Compute the failure links in breadth-first order: the failure link
+	 * of a node is always less deep than the node, so it is known when
+	 * reaching its children. The failure link of a child is the state
+	 * reached by feeding its character to the failure link of its
+	 * parent. */
+	data.priv = priv;
+	data.fail_hits = priv->fail_hits;
+
+	{
+		GQueue queue = G_QUEUE_INIT;
+
+		g_queue_push_tail (&queue, GUINT_TO_POINTER (ROOT));
+
+		while (!g_queue_is_empty (&queue)) {
+			guint       parent;
+			SmileyNode *p;
+			guint       j;
+
+			parent = GPOINTER_TO_UINT (g_queue_pop_head (&queue));
+			p = &g_array_index (priv->nodes, SmileyNode, parent);
+
+			for (j = 0; j < p->n_transitions; j++) {
+				SmileyTransition *t;
+				SmileyNode       *child;
+				guint             first_fail_hit;
+				guint             fail = ROOT;
+
+				t = &g_array_index (priv->transitions,
+					SmileyTransition, p->first_transition + j);
+				first_fail_hit = priv->fail_hits->len;
+
+				if (parent != ROOT) {
+					guint k;
+
+					/* The parent's smileys, which start
+					 * at the same position */
+					for (k = 0; k < p->n_fail_hits; k++) {
+						SmileyFailHit hit = g_array_index (
+							priv->fail_hits, SmileyFailHit,
+							p->first_fail_hit + k);
+
+						g_array_append_val (priv->fail_hits,
+								    hit);
+					}
+
+					fail = smiley_manager_step (priv,
+						p->fail, t->c, p->depth,
+						smiley_manager_add_fail_hit,
+						&data);
+				}
+
+				child = &g_array_index (priv->nodes,
+					SmileyNode, t->node);
+				child->fail = fail;
+				child->first_fail_hit = first_fail_hit;
+				child->n_fail_hits = priv->fail_hits->len -
+					first_fail_hit;
+
+				g_queue_push_tail (&queue,
+					GUINT_TO_POINTER (t->node));
+			}
+		}
+	}
+
+	g_ptr_array_unref (children);
+}
+
+/* Parse the len first bytes of text, calling func for each smiley found,
+ * in order. */
+static void
+smiley_manager_parse (EmpathySmileyManager *manager,
+		      const gchar          *text,
+		      gssize                len,
+		      SmileyHitFunc         func,
+		      gpointer              user_data)
+{
+	EmpathySmileyManagerPriv *priv = GET_PRIV (manager);
+	const SmileyNode         *n;
+	const gchar              *cur_str;
+	guint                     node = ROOT;
+
+	smiley_manager_compile (manager);
+
+	/* If len is negative, parse the string until we find '\0' */
+	if (len < 0) {
+		len = G_MAXSSIZE;
+	}
+
+	/* cur_str is a pointer in the text showing the current position
+	 * of the parsing. It is always at the begining of an UTF-8 character,
+	 * because we support unicode smileys! For example we could want to
+	 * replace ™ by an image. */
+	for (cur_str = text;
+	     *cur_str != '\0' && cur_str - text < len;
+	     cur_str = g_utf8_next_char (cur_str)) {
+		node = smiley_manager_step (priv, node,
+			g_utf8_get_char (cur_str), cur_str - text,
+			func, user_data);
+	}
+
+	/* Check if last char of the text was the end of a smiley */
+	n = &g_array_index (priv->nodes, SmileyNode, node);
+	if (n->pattern != NULL) {
+		func (n->pattern, cur_str - text - n->depth, cur_str - text,
+		      user_data);
+	}
+}
+
+static void
+smiley_manager_prepend_hit (const SmileyPattern *pattern,
+			    guint                start,
+			    guint                end,
+			    gpointer             user_data)
+{
+	GSList           **hits = user_data;
+	EmpathySmileyHit  *hit;
 
 	hit = g_slice_new (EmpathySmileyHit);
-	hit->pixbuf = tree->pixbuf;
-	hit->path = tree->path;
+	hit->pixbuf = pattern->pixbuf;
+	hit->path = pattern->path;
 	hit->start = start;
 	hit->end = end;
 
-	return hit;
+	*hits = g_slist_prepend (*hits, hit);
 }
 
 void
@@ -319,90 +665,65 @@ empathy_smiley_manager_parse_len (EmpathySmileyManager *manager,
 				  const gchar          *text,
 				  gssize                len)
 {
-	EmpathySmileyManagerPriv *priv = GET_PRIV (manager);
-	EmpathySmileyHit         *hit;
-	GSList                   *hits = NULL;
-	SmileyManagerTree        *cur_tree = priv->tree;
-	const gchar              *cur_str;
-	const gchar              *start = NULL;
+	GSList *hits = NULL;
 
 	g_return_val_if_fail (EMPATHY_IS_SMILEY_MANAGER (manager), NULL);
 	g_return_val_if_fail (text != NULL, NULL);
 
-	/* If len is negative, parse the string until we find '\0' */
-	if (len < 0) {
-		len = G_MAXSSIZE;
-	}
-
 	/* Parse the len first bytes of text to find smileys. Each time a smiley
 	 * is detected, append a EmpathySmileyHit struct to the returned list,
 	 * containing the smiley pixbuf and the position of the text to be
-	 * replaced by it.
-	 * cur_str is a pointer in the text showing the current position
-	 * of the parsing. It is always at the begining of an UTF-8 character,
-	 * because we support unicode smileys! For example we could want to
-	 * replace ™ by an image. */
+	 * replaced by it. */
+	smiley_manager_parse (manager, text, len,
+			      smiley_manager_prepend_hit, &hits);
 
-	for (cur_str = text;
-	     *cur_str != '\0' && cur_str - text < len;
-	     cur_str = g_utf8_next_char (cur_str)) {
-		SmileyManagerTree *child;
-		gunichar           c;
+	return g_slist_reverse (hits);
+}
 
-		c = g_utf8_get_char (cur_str);
-		child = smiley_manager_tree_find_child (cur_tree, c);
+typedef struct {
+	EmpathySmileyManager *manager;
+	EmpathySmileyHitFunc  func;
+	gpointer              user_data;
+} ForeachHitData;
 
-		/* If we have a child it means c is part of a smiley */
-		if (child) {
-			if (cur_tree == priv->tree) {
-				/* c is the first char of some smileys, keep
-				 * the begining position */
-				start = cur_str;
-			}
-			cur_tree = child;
-			continue;
-		}
+static void
+smiley_manager_foreach_hit_cb (const SmileyPattern *pattern,
+			       guint                start,
+			       guint                end,
+			       gpointer             user_data)
+{
+	ForeachHitData   *data = user_data;
+	EmpathySmileyHit  hit;
 
-		/* c is not part of a smiley. let's check if we found a smiley
-		 * before it. */
-		if (cur_tree->pixbuf != NULL) {
-			/* found! */
-			hit = smiley_hit_new (cur_tree, start - text,
-					      cur_str - text);
-			hits = g_slist_prepend (hits, hit);
-
-			/* c was not part of this smiley, check if a new smiley
-			 * start with it. */
-			cur_tree = smiley_manager_tree_find_child (priv->tree, c);
-			if (cur_tree) {
-				start = cur_str;
-			} else {
-				cur_tree = priv->tree;
-			}
-		} else if (cur_tree != priv->tree) {
-			/* We searched a smiley starting at 'start' but we ended
-			 * with no smiley. Look again starting from next char.
-			 *
-			 * For example ">:)" and ":(" are both valid smileys,
-			 * when parsing text ">:(" we first see '>' which could
-			 * be the start of a smiley. 'start' variable is set to
-			 * that position and we parse next char which is ':' and
-			 * is still potential smiley. Then we see '(' which is
-			 * NOT part of the smiley, ">:(" does not exist, so we
-			 * have to start again from ':' to find ":(" which is
-			 * correct smiley. */
-			cur_str = start;
-			cur_tree = priv->tree;
-		}
-	}
+	hit.pixbuf = pattern->pixbuf;
+	hit.path = pattern->path;
+	hit.start = start;
+	hit.end = end;
 
-	/* Check if last char of the text was the end of a smiley */
-	if (cur_tree->pixbuf != NULL) {
-		hit = smiley_hit_new (cur_tree, start - text, cur_str - text);
-		hits = g_slist_prepend (hits, hit);
-	}
+	data->func (data->manager, &hit, data->user_data);
+}
 
-	return g_slist_reverse (hits);
+/* Same as empathy_smiley_manager_parse_len() but calls func for each hit,
+ * in order, instead of allocating a list. */
+void
+empathy_smiley_manager_foreach_hit (EmpathySmileyManager *manager,
+				    const gchar          *text,
+				    gssize                len,
+				    EmpathySmileyHitFunc  func,
+				    gpointer              user_data)
+{
+	ForeachHitData data;
+
+	g_return_if_fail (EMPATHY_IS_SMILEY_MANAGER (manager));
+	g_return_if_fail (text != NULL);
+	g_return_if_fail (func != NULL);
+
+	data.manager = manager;
+	data.func = func;
+	data.user_data = user_data;
+
+	smiley_manager_parse (manager, text, len,
+			      smiley_manager_foreach_hit_cb, &data);
 }
 
 GSList *
@@ -62,6 +62,11 @@ typedef void (*EmpathySmileyMenuFunc) (EmpathySmileyManager *manager,
 				       EmpathySmiley        *smiley,
 				       gpointer              user_data);
 
+/* hit is only valid during the call */
+typedef void (*EmpathySmileyHitFunc)  (EmpathySmileyManager   *manager,
+				       const EmpathySmileyHit *hit,
+				       gpointer                user_data);
+
 GType                 empathy_smiley_manager_get_type        (void) G_GNUC_CONST;
 EmpathySmileyManager *empathy_smiley_manager_dup_singleton   (void);
 void                  empathy_smiley_manager_load            (EmpathySmileyManager *manager);
@@ -73,6 +78,11 @@ GSList *              empathy_smiley_manager_get_all         (EmpathySmileyManag
 GSList *              empathy_smiley_manager_parse_len       (EmpathySmileyManager *manager,
 							      const gchar          *text,
 							      gssize                len);
+void                  empathy_smiley_manager_foreach_hit     (EmpathySmileyManager *manager,
+							      const gchar          *text,
+							      gssize                len,
+							      EmpathySmileyHitFunc  func,
+							      gpointer              user_data);
 GtkWidget *           empathy_smiley_menu_new                (EmpathySmileyManager *manager,
 							      EmpathySmileyMenuFunc func,
 							      gpointer              user_data);
@@ -28,6 +28,7 @@
 #include <tp-account-widgets/tpaw-pixbuf-utils.h>
 #include <tp-account-widgets/tpaw-utils.h>
 
+#include "empathy-adium-template.h"
 #include "empathy-gsettings.h"
 #include "empathy-images.h"
 #include "empathy-plist.h"
@@ -44,6 +45,24 @@
 /* "Join" consecutive messages with timestamps within five minutes */
 #define MESSAGE_JOIN_PERIOD 5*60
 
+/* Views can have a quarter more messages than max-rendered-messages before
+ * being pruned, so messages are removed in bursts rather than one by one */
+#define PRUNE_SLACK_RATIO 4
+
+/* Class of the first message or event of each block, so the top-level
+ * nodes of the block can be found */
+#define BLOCK_CLASS_PREFIX "x-empathy-block-"
+
+/* Messages and events added to the chat as a top-level node */
+typedef struct
+{
+  /* Unique in the view, see BLOCK_CLASS_PREFIX */
+  guint id;
+  guint n_messages;
+  /* Timestamp of the oldest message of the block */
+  gint64 timestamp;
+} Block;
+
 struct _EmpathyThemeAdiumPriv
 {
   EmpathyAdiumData *data;
@@ -71,6 +90,44 @@ struct _EmpathyThemeAdiumPriv
   gchar *variant;
   gboolean in_construction;
   gboolean show_avatars;
+  /* Total size of the scripts executed in the view */
+  guint64 script_bytes;
+  /* Scripts waiting to be executed at once, see
+   * empathy_theme_adium_begin_batch() */
+  GString *batch;
+  guint batch_depth;
+
+  /* Owned Block of the chat, in display order. Events are blocks without
+   * messages. */
+  GQueue blocks;
+  /* Id of the next block to add */
+  guint next_block_id;
+  /* Number of messages currently displayed */
+  guint n_messages;
+  /* Number of messages removed from the top of the view since its
+   * creation to bound its size */
+  guint n_pruned;
+  guint prune_id;
+
+  /* Ids (guint32) of the acknowledged messages whose unread mark has to be
+   * removed, all at once when going back to the main loop */
+  GHashTable *unmark_ids;
+  guint unmark_id;
+  /* guint32 message id -> GPtrArray of the WebKitDOMElement of that
+   * message still having an unread mark */
+  GHashTable *focus_nodes;
+  /* Ids (guint32) of the unread messages added since the elements of the
+   * others were looked up, and which are not in focus_nodes yet */
+  GArray *unmapped_focus_ids;
+
+  /* Formatting state shared by all the messages of the view */
+  gboolean show_smileys;
+  EmpathyAdiumTimeCache *time_cache;
+  /* owned gchar * contact id -> static color used by %senderColor% */
+  GHashTable *sender_colors;
+  /* owned EmpathyContact whose messages show a fallback avatar until their
+   * avatar file is known */
+  GHashTable *avatar_waits;
 };
 
 struct _EmpathyAdiumData
@@ -104,10 +161,33 @@ struct _EmpathyAdiumData
    * We do this because of fallbacks, some htmls could be pointing the
    * same string. */
   GPtrArray *strings_to_free;
+
+  /* Message html bits parsed once, so adding a message does not have to
+   * look for keywords again. */
+  EmpathyAdiumTemplate *in_content_tmpl;
+  EmpathyAdiumTemplate *in_context_tmpl;
+  EmpathyAdiumTemplate *in_nextcontent_tmpl;
+  EmpathyAdiumTemplate *in_nextcontext_tmpl;
+  EmpathyAdiumTemplate *out_content_tmpl;
+  EmpathyAdiumTemplate *out_context_tmpl;
+  EmpathyAdiumTemplate *out_nextcontent_tmpl;
+  EmpathyAdiumTemplate *out_nextcontext_tmpl;
+  EmpathyAdiumTemplate *status_tmpl;
+
+  /* Same as strings_to_free: templates compiled from the same string are
+   * shared. */
+  GPtrArray *templates_to_free;
 };
 
 static gchar * adium_info_dup_path_for_variant (GHashTable *info,
     const gchar *variant);
+static void theme_adium_schedule_prune (EmpathyThemeAdium *self);
+static void theme_adium_add_block (EmpathyThemeAdium *self,
+    gint64 timestamp,
+    gboolean is_message,
+    gboolean prepend);
+static void theme_adium_clear_focus_nodes (EmpathyThemeAdium *self);
+static void theme_adium_clear_avatar_waits (EmpathyThemeAdium *self);
 
 enum
 {
@@ -222,6 +302,72 @@ string_with_format (const gchar *format,
   return g_string_free (result, FALSE);
 }
 
+static void
+theme_adium_run_script (EmpathyThemeAdium *self,
+    const gchar *script)
+{
+  self->priv->script_bytes += strlen (script);
+
+  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self), script);
+}
+
+static void
+theme_adium_execute_script (EmpathyThemeAdium *self,
+    const gchar *script)
+{
+  if (self->priv->batch == NULL)
+    {
+      theme_adium_run_script (self, script);
+      return;
+    }
+
+  /* An exception must not prevent the following scripts from running, as
+   * it wouldn't if they were executed one by one */
+  g_string_append (self->priv->batch, "try { ");
+  g_string_append (self->priv->batch, script);
+  g_string_append (self->priv->batch, "; } catch (e) {}\n");
+}
+
+/* Execute the scripts batched so far. This has to be called before
+ * accessing the DOM directly, so operations are applied in order. */
+static void
+theme_adium_flush_batch (EmpathyThemeAdium *self)
+{
+  GString *batch = self->priv->batch;
+
+  if (batch == NULL || batch->len == 0)
+    return;
+
+  theme_adium_run_script (self, batch->str);
+
+  g_string_truncate (batch, 0);
+}
+
+/* Install the helper functions used by the scripts adding messages. This
+ * has to be done each time the template has been (re)loaded. */
+static void
+theme_adium_install_js (EmpathyThemeAdium *self)
+{
+  GBytes *bytes;
+  gchar *js;
+
+  bytes = g_resources_lookup_data ("/org/gnome/Empathy/Chat/empathy-chat.js",
+      G_RESOURCE_LOOKUP_FLAGS_NONE,
+      NULL);
+
+  if (bytes == NULL)
+    return;
+
+  /* The resource data is not guaranteed to be nul-terminated. Don't batch
+   * it, the functions it declares have to stay global. */
+  js = g_strndup (g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes));
+  theme_adium_flush_batch (self);
+  theme_adium_run_script (self, js);
+
+  g_free (js);
+  g_bytes_unref (bytes);
+}
+
 static void
 theme_adium_load_template (EmpathyThemeAdium *self)
 {
@@ -229,6 +375,19 @@ theme_adium_load_template (EmpathyThemeAdium *self)
   gchar *variant_path;
   gchar *template;
 
+  /* Scripts batched so far were meant for the current page */
+  theme_adium_flush_batch (self);
+
+  /* Messages are formatted again for the new page, so only the senders
+   * and times shown there are cached */
+  empathy_adium_time_cache_clear (self->priv->time_cache);
+  g_hash_table_remove_all (self->priv->sender_colors);
+
+  /* The new page has no unread marks */
+  g_hash_table_remove_all (self->priv->unmark_ids);
+  theme_adium_clear_focus_nodes (self);
+  theme_adium_clear_avatar_waits (self);
+
   self->priv->pages_loading++;
   basedir_uri = g_strconcat ("file://", self->priv->data->basedir, NULL);
 
@@ -251,18 +410,24 @@ theme_adium_parse_body (EmpathyThemeAdium *self,
   const gchar *text,
   const gchar *token)
 {
+  static const gchar prefix[] = "<div style=\"display: inline; "
+    "white-space: pre-wrap\"'>";
+  static const gchar suffix[] = "</div>";
   TpawStringParser *parsers;
   GString *string;
 
   /* Check if we have to parse smileys */
-  parsers = empathy_webkit_get_string_parser (
-    g_settings_get_boolean (self->priv->gsettings_chat,
-      EMPATHY_PREFS_CHAT_SHOW_SMILEYS));
+  parsers = empathy_webkit_get_string_parser (self->priv->show_smileys);
 
   /* Parse text and construct string with links and smileys replaced
    * by html tags. Also escape text to make sure html code is
    * displayed verbatim. */
-  string = g_string_sized_new (strlen (text));
+  string = g_string_sized_new (strlen (text) + sizeof (prefix) +
+      sizeof (suffix));
+
+  /* Wrap body in order to make tabs and multiple spaces displayed
+   * properly. See bug #625745. */
+  g_string_append_len (string, prefix, sizeof (prefix) - 1);
 
   /* wrap this in HTML that allows us to find the message for later
    * editing */
@@ -276,83 +441,11 @@ theme_adium_parse_body (EmpathyThemeAdium *self,
   if (!tp_str_empty (token))
     g_string_append (string, "</span>");
 
-  /* Wrap body in order to make tabs and multiple spaces displayed
-   * properly. See bug #625745. */
-  g_string_prepend (string, "<div style=\"display: inline; "
-                 "white-space: pre-wrap\"'>");
-  g_string_append (string, "</div>");
+  g_string_append_len (string, suffix, sizeof (suffix) - 1);
 
   return g_string_free (string, FALSE);
 }
 
-static void
-escape_and_append_len (GString *string, const gchar *str, gint len)
-{
-  while (str != NULL && *str != '\0' && len != 0)
-    {
-      switch (*str)
-        {
-          case '\\':
-            /* \ becomes \\ */
-            g_string_append (string, "\\\\");
-            break;
-          case '\"':
-            /* " becomes \" */
-            g_string_append (string, "\\\"");
-            break;
-          case '\n':
-            /* Remove end of lines */
-            break;
-          default:
-            g_string_append_c (string, *str);
-        }
-
-      str++;
-      len--;
-    }
-}
-
-/* If *str starts with match, returns TRUE and move pointer to the end */
-static gboolean
-theme_adium_match (const gchar **str,
-    const gchar *match)
-{
-  gint len;
-
-  len = strlen (match);
-  if (strncmp (*str, match, len) == 0)
-    {
-      *str += len - 1;
-      return TRUE;
-    }
-
-  return FALSE;
-}
-
-/* Like theme_adium_match() but also return the X part if match is
- * like %foo{X}% */
-static gboolean
-theme_adium_match_with_format (const gchar **str,
-    const gchar *match,
-    gchar **format)
-{
-  const gchar *cur = *str;
-  const gchar *end;
-
-  if (!theme_adium_match (&cur, match))
-    return FALSE;
-
-  cur++;
-
-  end = strstr (cur, "}%");
-  if (!end)
-    return FALSE;
-
-  *format = g_strndup (cur , end - cur);
-  *str = end + 1;
-  return TRUE;
-}
-
 /* List of colors used by %senderColor%. Copied from
  * adium/Frameworks/AIUtilities\ Framework/Source/AIColorAdditions.m
  */
@@ -379,6 +472,24 @@ static gchar *colors[] = {
   "yellowgreen",
 };
 
+/* A color derived from the sender's id, computed once per sender */
+static const gchar *
+theme_adium_get_sender_color (EmpathyThemeAdium *self,
+    const gchar *contact_id)
+{
+  const gchar *color;
+
+  color = g_hash_table_lookup (self->priv->sender_colors, contact_id);
+  if (color == NULL)
+    {
+      color = colors[g_str_hash (contact_id) % G_N_ELEMENTS (colors)];
+      g_hash_table_insert (self->priv->sender_colors, g_strdup (contact_id),
+          (gpointer) color);
+    }
+
+  return color;
+}
+
 static const gchar *
 nsdate_to_strftime (EmpathyAdiumData *data, const gchar *nsdate)
 {
@@ -521,10 +632,204 @@ nsdate_to_strftime (EmpathyAdiumData *data, const gchar *nsdate)
   return g_string_free (string, FALSE);
 }
 
+typedef struct
+{
+  EmpathyThemeAdium *self;
+  const gchar *message;
+  const gchar *avatar_filename;
+  const gchar *name;
+  const gchar *contact_id;
+  const gchar *service_name;
+  const gchar *message_classes;
+  gint64 timestamp;
+  gboolean is_backlog;
+  gboolean outgoing;
+  PangoDirection direction;
+} HtmlData;
+
+static const gchar *
+theme_adium_replace_keyword (EmpathyAdiumKeyword keyword,
+    const gchar *format,
+    gchar **to_free,
+    gpointer user_data)
+{
+  HtmlData *html_data = user_data;
+  EmpathyThemeAdium *self = html_data->self;
+  const gchar *replace = NULL;
+
+  /* Those are all well known keywords that needs replacement in
+   * html files. Please keep them in the same order than the adium
+   * spec. See http://trac.adium.im/wiki/CreatingMessageStyles */
+  switch (keyword)
+    {
+      case EMPATHY_ADIUM_KEYWORD_USER_ICON_PATH:
+        replace = html_data->avatar_filename;
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SENDER_SCREEN_NAME:
+        replace = html_data->contact_id;
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SENDER:
+        replace = html_data->name;
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SENDER_COLOR:
+        /* A color derived from the user's name.
+         * FIXME: If a colon separated list of HTML colors is at
+         * Incoming/SenderColors.txt it will be used instead of
+         * the default colors.
+         */
+
+        /* Ensure we always use the same color when sending messages
+         * (bgo #658821) */
+        if (html_data->outgoing)
+          {
+            replace = "inherit";
+          }
+        else if (html_data->contact_id != NULL)
+          {
+            replace = theme_adium_get_sender_color (self,
+                html_data->contact_id);
+          }
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SENDER_STATUS_ICON:
+        /* FIXME: The path to the status icon of the sender
+         * (available, away, etc...)
+         */
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_MESSAGE_DIRECTION:
+        switch (html_data->direction)
+          {
+            case PANGO_DIRECTION_LTR:
+            case PANGO_DIRECTION_TTB_LTR:
+            case PANGO_DIRECTION_WEAK_LTR:
+              replace = "ltr";
+              break;
+            case PANGO_DIRECTION_RTL:
+            case PANGO_DIRECTION_TTB_RTL:
+            case PANGO_DIRECTION_WEAK_RTL:
+              replace = "rtl";
+              break;
+            case PANGO_DIRECTION_NEUTRAL:
+            default:
+              break;
+          }
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SENDER_DISPLAY_NAME:
+        /* FIXME: The serverside (remotely set) name of the
+         * sender, such as an MSN display name.
+         *
+         *  We don't have access to that yet so we use
+         * local alias instead.
+         */
+        replace = html_data->name;
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SENDER_PREFIX:
+        /* FIXME: If we supported IRC user mode flags, this
+         * would be replaced with @ if the user is an op, + if
+         * the user has voice, etc. as per
+         * http://hg.adium.im/adium/rev/b586b027de42. But we
+         * don't, so for now we just strip it. */
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_TEXT_BACKGROUND_COLOR:
+        /* FIXME: This keyword is used to represent the
+         * highlight background color. "X" is the opacity of the
+         * background, ranges from 0 to 1 and can be any decimal
+         * between.
+         */
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_MESSAGE:
+        replace = html_data->message;
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_TIME:
+        {
+          const gchar *strftime_format;
+
+          strftime_format = nsdate_to_strftime (self->priv->data, format);
+          if (strftime_format == NULL)
+            strftime_format = html_data->is_backlog ?
+              TPAW_TIME_DATE_FORMAT_DISPLAY_SHORT :
+              TPAW_TIME_FORMAT_DISPLAY_SHORT;
+
+          replace = empathy_adium_time_cache_format (self->priv->time_cache,
+              html_data->timestamp, strftime_format);
+        }
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SHORT_TIME:
+        replace = empathy_adium_time_cache_format (self->priv->time_cache,
+            html_data->timestamp, TPAW_TIME_FORMAT_DISPLAY_SHORT);
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_SERVICE:
+        replace = html_data->service_name;
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_VARIANT:
+        /* FIXME: The name of the active message style variant,
+         * with all spaces replaced with an underscore.
+         * A variant named "Alternating Messages - Blue Red"
+         * will become "Alternating_Messages_-_Blue_Red".
+         */
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_USER_ICONS:
+        replace = self->priv->show_avatars ? "showIcons" : "hideIcons";
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_MESSAGE_CLASSES:
+        replace = html_data->message_classes;
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_STATUS:
+        /* FIXME: A description of the status event. This is
+         * neither in the user's local language nor expected to
+         * be displayed; it may be useful to use a different div
+         * class to present different types of status messages.
+         * The following is a list of some of the more important
+         * status messages; your message style should be able to
+         * handle being shown a status message not in this list,
+         * as even at present the list is incomplete and is
+         * certain to become out of date in the future:
+         *  online
+         *  offline
+         *  away
+         *  away_message
+         *  return_away
+         *  idle
+         *  return_idle
+         *  date_separator
+         *  contact_joined (group chats)
+         *  contact_left
+         *  error
+         *  timed_out
+         *  encryption (all OTR messages use this status)
+         *  purple (all IRC topic and join/part messages use this status)
+         *  fileTransferStarted
+         *  fileTransferCompleted
+         */
+        break;
+
+      case EMPATHY_ADIUM_KEYWORD_NONE:
+      default:
+        break;
+    }
+
+  return replace;
+}
+
 static void
 theme_adium_add_html (EmpathyThemeAdium *self,
     const gchar *func,
-    const gchar *html,
+    EmpathyAdiumTemplate *tmpl,
     const gchar *message,
     const gchar *avatar_filename,
     const gchar *name,
@@ -536,212 +841,22 @@ theme_adium_add_html (EmpathyThemeAdium *self,
     gboolean outgoing,
     PangoDirection direction)
 {
-  GBytes *bytes;
   GString *string;
-  const gchar *cur = NULL;
-  const gchar *js;
   gchar *script;
+  HtmlData html_data = { self, message, avatar_filename, name, contact_id,
+      service_name, message_classes, timestamp, is_backlog, outgoing,
+      direction };
 
   /* Make some search-and-replace in the html code */
-  string = g_string_sized_new (strlen (html) + strlen (message));
+  string = g_string_sized_new (empathy_adium_template_get_length_hint (tmpl) +
+      strlen (message));
   g_string_append_printf (string, "%s(\"", func);
-
-  for (cur = html; *cur != '\0'; cur++)
-    {
-      const gchar *replace = NULL;
-      gchar *dup_replace = NULL;
-      gchar *format = NULL;
-
-      /* Those are all well known keywords that needs replacement in
-       * html files. Please keep them in the same order than the adium
-       * spec. See http://trac.adium.im/wiki/CreatingMessageStyles */
-      if (theme_adium_match (&cur, "%userIconPath%"))
-        {
-          replace = avatar_filename;
-        }
-      else if (theme_adium_match (&cur, "%senderScreenName%"))
-        {
-          replace = contact_id;
-        }
-      else if (theme_adium_match (&cur, "%sender%"))
-        {
-          replace = name;
-        }
-      else if (theme_adium_match (&cur, "%senderColor%"))
-        {
-          /* A color derived from the user's name.
-           * FIXME: If a colon separated list of HTML colors is at
-           * Incoming/SenderColors.txt it will be used instead of
-           * the default colors.
-           */
-
-          /* Ensure we always use the same color when sending messages
-           * (bgo #658821) */
-          if (outgoing)
-            {
-              replace = "inherit";
-            }
-          else if (contact_id != NULL)
-            {
-              guint hash = g_str_hash (contact_id);
-              replace = colors[hash % G_N_ELEMENTS (colors)];
-            }
-        }
-      else if (theme_adium_match (&cur, "%senderStatusIcon%"))
-        {
-          /* FIXME: The path to the status icon of the sender
-           * (available, away, etc...)
-           */
-        }
-      else if (theme_adium_match (&cur, "%messageDirection%"))
-        {
-          switch (direction)
-            {
-              case PANGO_DIRECTION_LTR:
-              case PANGO_DIRECTION_TTB_LTR:
-              case PANGO_DIRECTION_WEAK_LTR:
-                replace = "ltr";
-                break;
-              case PANGO_DIRECTION_RTL:
-              case PANGO_DIRECTION_TTB_RTL:
-              case PANGO_DIRECTION_WEAK_RTL:
-                replace = "rtl";
-                break;
-              case PANGO_DIRECTION_NEUTRAL:
-              default:
-                break;
-            }
-        }
-      else if (theme_adium_match (&cur, "%senderDisplayName%"))
-        {
-          /* FIXME: The serverside (remotely set) name of the
-           * sender, such as an MSN display name.
-           *
-           *  We don't have access to that yet so we use
-           * local alias instead.
-           */
-          replace = name;
-        }
-      else if (theme_adium_match (&cur, "%senderPrefix%"))
-        {
-          /* FIXME: If we supported IRC user mode flags, this
-           * would be replaced with @ if the user is an op, + if
-           * the user has voice, etc. as per
-           * http://hg.adium.im/adium/rev/b586b027de42. But we
-           * don't, so for now we just strip it. */
-        }
-      else if (theme_adium_match_with_format (&cur, "%textbackgroundcolor{",
-            &format))
-        {
-          /* FIXME: This keyword is used to represent the
-           * highlight background color. "X" is the opacity of the
-           * background, ranges from 0 to 1 and can be any decimal
-           * between.
-           */
-        }
-      else if (theme_adium_match (&cur, "%message%"))
-        {
-          replace = message;
-        }
-      else if (theme_adium_match (&cur, "%time%") ||
-           theme_adium_match_with_format (&cur, "%time{", &format))
-        {
-          const gchar *strftime_format;
-
-          strftime_format = nsdate_to_strftime (self->priv->data, format);
-          if (is_backlog)
-            dup_replace = tpaw_time_to_string_local (timestamp,
-              strftime_format ? strftime_format :
-              TPAW_TIME_DATE_FORMAT_DISPLAY_SHORT);
-          else
-            dup_replace = tpaw_time_to_string_local (timestamp,
-              strftime_format ? strftime_format :
-              TPAW_TIME_FORMAT_DISPLAY_SHORT);
-
-          replace = dup_replace;
-        }
-      else if (theme_adium_match (&cur, "%shortTime%"))
-        {
-          dup_replace = tpaw_time_to_string_local (timestamp,
-            TPAW_TIME_FORMAT_DISPLAY_SHORT);
-          replace = dup_replace;
-        }
-      else if (theme_adium_match (&cur, "%service%"))
-        {
-          replace = service_name;
-        }
-      else if (theme_adium_match (&cur, "%variant%"))
-        {
-          /* FIXME: The name of the active message style variant,
-           * with all spaces replaced with an underscore.
-           * A variant named "Alternating Messages - Blue Red"
-           * will become "Alternating_Messages_-_Blue_Red".
-           */
-        }
-      else if (theme_adium_match (&cur, "%userIcons%"))
-        {
-          replace = self->priv->show_avatars ? "showIcons" : "hideIcons";
-        }
-      else if (theme_adium_match (&cur, "%messageClasses%"))
-        {
-          replace = message_classes;
-        }
-      else if (theme_adium_match (&cur, "%status%"))
-        {
-          /* FIXME: A description of the status event. This is
-           * neither in the user's local language nor expected to
-           * be displayed; it may be useful to use a different div
-           * class to present different types of status messages.
-           * The following is a list of some of the more important
-           * status messages; your message style should be able to
-           * handle being shown a status message not in this list,
-           * as even at present the list is incomplete and is
-           * certain to become out of date in the future:
-           *  online
-           *  offline
-           *  away
-           *  away_message
-           *  return_away
-           *  idle
-           *  return_idle
-           *  date_separator
-           *  contact_joined (group chats)
-           *  contact_left
-           *  error
-           *  timed_out
-           *  encryption (all OTR messages use this status)
-           *  purple (all IRC topic and join/part messages use this status)
-           *  fileTransferStarted
-           *  fileTransferCompleted
-           */
-        }
-      else
-        {
-          escape_and_append_len (string, cur, 1);
-          continue;
-        }
-
-      /* Here we have a replacement to make */
-      escape_and_append_len (string, replace, -1);
-
-      g_free (dup_replace);
-      g_free (format);
-    }
+  empathy_adium_template_expand (tmpl, string, theme_adium_replace_keyword,
+      &html_data);
   g_string_append (string, "\")");
 
-  bytes = g_resources_lookup_data ("/org/gnome/Empathy/Chat/empathy-chat.js",
-      G_RESOURCE_LOOKUP_FLAGS_NONE,
-      NULL);
-
-  if (bytes != NULL)
-    {
-      js = (const gchar *) g_bytes_get_data (bytes, NULL);
-      g_string_prepend (string, js);
-      g_bytes_unref (bytes);
-    }
-
   script = g_string_free (string, FALSE);
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self), script);
+  theme_adium_execute_script (self, script);
   g_free (script);
 }
 
@@ -750,9 +865,17 @@ theme_adium_append_event_escaped (EmpathyThemeAdium *self,
     const gchar *escaped,
     PangoDirection direction)
 {
+  gchar *classes;
+
+  classes = g_strdup_printf ("event " BLOCK_CLASS_PREFIX "%u",
+      self->priv->next_block_id);
   theme_adium_add_html (self, "appendMessage",
-      self->priv->data->status_html, escaped, NULL, NULL, NULL,
-      NULL, "event", tpaw_time_get_current (), FALSE, FALSE, direction);
+      self->priv->data->status_tmpl, escaped, NULL, NULL, NULL,
+      NULL, classes, tpaw_time_get_current (), FALSE, FALSE, direction);
+  g_free (classes);
+
+  theme_adium_add_block (self, G_MAXINT64, FALSE, FALSE);
+  theme_adium_schedule_prune (self);
 
   /* There is no last contact */
   if (self->priv->last_contact)
@@ -762,87 +885,328 @@ theme_adium_append_event_escaped (EmpathyThemeAdium *self,
     }
 }
 
+static void
+theme_adium_remove_focus_mark (WebKitDOMElement *element)
+{
+  gchar *class_name;
+  gchar **classes, **iter;
+  GString *new_class_name;
+  gboolean first = TRUE;
+
+  class_name = webkit_dom_element_get_class_name (element);
+  classes = g_strsplit (class_name, " ", -1);
+  new_class_name = g_string_sized_new (strlen (class_name));
+
+  /* Remove focus and firstFocus class */
+  for (iter = classes; *iter != NULL; iter++)
+    {
+      if (tp_strdiff (*iter, "focus") &&
+          tp_strdiff (*iter, "firstFocus"))
+        {
+          if (!first)
+            g_string_append_c (new_class_name, ' ');
+
+          g_string_append (new_class_name, *iter);
+          first = FALSE;
+        }
+    }
+
+  webkit_dom_element_set_class_name (element, new_class_name->str);
+
+  g_free (class_name);
+  g_strfreev (classes);
+  g_string_free (new_class_name, TRUE);
+}
+
 static void
 theme_adium_remove_focus_marks (EmpathyThemeAdium *self,
     WebKitDOMNodeList *nodes)
 {
   guint i;
 
-  /* Remove focus and firstFocus class */
   for (i = 0; i < webkit_dom_node_list_get_length (nodes); i++)
     {
       WebKitDOMNode *node = webkit_dom_node_list_item (nodes, i);
-      WebKitDOMElement *element = WEBKIT_DOM_ELEMENT (node);
+
+      if (WEBKIT_DOM_IS_ELEMENT (node))
+        theme_adium_remove_focus_mark (WEBKIT_DOM_ELEMENT (node));
+    }
+}
+
+static void
+theme_adium_clear_focus_nodes (EmpathyThemeAdium *self)
+{
+  g_hash_table_remove_all (self->priv->focus_nodes);
+  g_array_set_size (self->priv->unmapped_focus_ids, 0);
+}
+
+/* Whether @node is still part of the document */
+static gboolean
+theme_adium_node_is_attached (WebKitDOMNode *node)
+{
+  WebKitDOMNode *parent;
+
+  while ((parent = webkit_dom_node_get_parent_node (node)) != NULL)
+    node = parent;
+
+  return WEBKIT_DOM_IS_DOCUMENT (node);
+}
+
+/* Removes the elements which are not part of the document anymore from
+ * the map, so they are not kept alive */
+static void
+theme_adium_forget_removed_focus_nodes (EmpathyThemeAdium *self)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->priv->focus_nodes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GPtrArray *elements = value;
+
+      /* All the elements of a message are removed together */
+      if (elements->len == 0 ||
+          !theme_adium_node_is_attached (g_ptr_array_index (elements, 0)))
+        g_hash_table_iter_remove (&iter);
+    }
+}
+
+/* Returns the map from message id to the elements of that message having
+ * an unread mark, adding the unread messages added since the last call to
+ * it with a single query for them. */
+static GHashTable *
+theme_adium_get_focus_nodes (EmpathyThemeAdium *self)
+{
+  static const gchar prefix[] = "x-empathy-message-id-";
+  WebKitDOMDocument *dom;
+  WebKitDOMNodeList *nodes;
+  GString *selector;
+  GError *error = NULL;
+  guint i;
+
+  if (self->priv->unmapped_focus_ids->len == 0)
+    return self->priv->focus_nodes;
+
+  theme_adium_flush_batch (self);
+
+  /* Only look up the elements of the new unread messages */
+  selector = g_string_new (NULL);
+  for (i = 0; i < self->priv->unmapped_focus_ids->len; i++)
+    g_string_append_printf (selector, "%s.focus.%s%u", i > 0 ? ", " : "",
+        prefix, g_array_index (self->priv->unmapped_focus_ids, guint32, i));
+
+  g_array_set_size (self->priv->unmapped_focus_ids, 0);
+
+  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (self));
+  if (dom == NULL)
+    {
+      g_string_free (selector, TRUE);
+      return self->priv->focus_nodes;
+    }
+
+  nodes = webkit_dom_document_query_selector_all (dom, selector->str,
+      &error);
+  g_string_free (selector, TRUE);
+
+  if (nodes == NULL)
+    {
+      DEBUG ("Error getting focus nodes: %s",
+        error ? error->message : "No error");
+      g_clear_error (&error);
+      return self->priv->focus_nodes;
+    }
+
+  for (i = 0; i < webkit_dom_node_list_get_length (nodes); i++)
+    {
+      WebKitDOMNode *node = webkit_dom_node_list_item (nodes, i);
+      GPtrArray *elements;
       gchar *class_name;
-      gchar **classes, **iter;
-      GString *new_class_name;
-      gboolean first = TRUE;
+      const gchar *id_str;
+      guint32 id;
 
-      if (element == NULL)
+      if (!WEBKIT_DOM_IS_ELEMENT (node))
         continue;
 
-      class_name = webkit_dom_element_get_class_name (element);
-      classes = g_strsplit (class_name, " ", -1);
-      new_class_name = g_string_sized_new (strlen (class_name));
+      class_name = webkit_dom_element_get_class_name (
+          WEBKIT_DOM_ELEMENT (node));
+      id_str = strstr (class_name, prefix);
 
-      for (iter = classes; *iter != NULL; iter++)
+      if (id_str == NULL)
         {
-          if (tp_strdiff (*iter, "focus") &&
-              tp_strdiff (*iter, "firstFocus"))
-            {
-              if (!first)
-                g_string_append_c (new_class_name, ' ');
+          g_free (class_name);
+          continue;
+        }
 
-              g_string_append (new_class_name, *iter);
-              first = FALSE;
-            }
+      id = g_ascii_strtoull (id_str + sizeof (prefix) - 1, NULL, 10);
+      g_free (class_name);
+
+      elements = g_hash_table_lookup (self->priv->focus_nodes,
+          GUINT_TO_POINTER (id));
+      if (elements == NULL)
+        {
+          elements = g_ptr_array_new_with_free_func (g_object_unref);
+          g_hash_table_insert (self->priv->focus_nodes,
+              GUINT_TO_POINTER (id), elements);
         }
 
-      webkit_dom_element_set_class_name (element, new_class_name->str);
+      g_ptr_array_add (elements, g_object_ref (node));
+    }
+
+  g_object_unref (nodes);
+
+  return self->priv->focus_nodes;
+}
+
+static void
+theme_adium_remove_all_focus_marks (EmpathyThemeAdium *self)
+{
+  WebKitDOMDocument *dom;
+  WebKitDOMNodeList *nodes;
+  GError *error = NULL;
+
+  if (!self->priv->has_unread_message)
+    return;
+
+  self->priv->has_unread_message = FALSE;
+
+  theme_adium_flush_batch (self);
+  theme_adium_clear_focus_nodes (self);
+
+  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (self));
+  if (dom == NULL)
+    return;
+
+  /* Get all nodes with focus class */
+  nodes = webkit_dom_document_query_selector_all (dom, ".focus", &error);
+
+  if (nodes == NULL)
+    {
+      DEBUG ("Error getting focus nodes: %s",
+        error ? error->message : "No error");
+      g_clear_error (&error);
+      return;
+    }
+
+  theme_adium_remove_focus_marks (self, nodes);
+}
+
+enum
+{
+  ADD_CONSECUTIVE_MSG_SCROLL = 0,
+  ADD_CONSECUTIVE_MSG_NO_SCROLL = 1,
+  ADD_MSG_SCROLL = 2,
+  ADD_MSG_NO_SCROLL = 3
+};
+
+/* Fragment appended to the fallback avatar of the messages of a contact
+ * whose avatar file isn't known yet, so they can be found once it is */
+#define AVATAR_WAIT_FRAGMENT "#x-empathy-avatar-"
+
+static gchar *
+theme_adium_dup_avatar_wait_fragment (EmpathyContact *contact)
+{
+  gchar *escaped, *fragment;
 
-      g_free (class_name);
-      g_strfreev (classes);
-      g_string_free (new_class_name, TRUE);
-    }
+  escaped = tp_escape_as_identifier (empathy_contact_get_id (contact));
+  fragment = g_strconcat (AVATAR_WAIT_FRAGMENT, escaped, NULL);
+  g_free (escaped);
+
+  return fragment;
 }
 
 static void
-theme_adium_remove_all_focus_marks (EmpathyThemeAdium *self)
+theme_adium_avatar_notify_cb (EmpathyContact *contact,
+    GParamSpec *pspec,
+    EmpathyThemeAdium *self)
 {
+  const gchar *filename;
   WebKitDOMDocument *dom;
-  WebKitDOMNodeList *nodes;
+  WebKitDOMNodeList *nodes = NULL;
+  gchar *fragment, *selector;
   GError *error = NULL;
+  guint i;
 
-  if (!self->priv->has_unread_message)
+  filename = empathy_contact_get_avatar_filename (contact);
+  if (filename == NULL)
     return;
 
-  self->priv->has_unread_message = FALSE;
+  /* The messages added so far have to be in the page */
+  theme_adium_flush_batch (self);
 
-  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (self));
-  if (dom == NULL)
-    return;
+  fragment = theme_adium_dup_avatar_wait_fragment (contact);
+  selector = g_strdup_printf ("img[src$='%s']", fragment);
+  g_free (fragment);
 
-  /* Get all nodes with focus class */
-  nodes = webkit_dom_document_query_selector_all (dom, ".focus", &error);
+  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (self));
+  if (dom != NULL)
+    nodes = webkit_dom_document_query_selector_all (dom, selector, &error);
 
   if (nodes == NULL)
     {
-      DEBUG ("Error getting focus nodes: %s",
-        error ? error->message : "No error");
+      DEBUG ("Error getting the avatars of %s: %s",
+          empathy_contact_get_id (contact),
+          error ? error->message : "No error");
       g_clear_error (&error);
-      return;
     }
+  else
+    {
+      for (i = 0; i < webkit_dom_node_list_get_length (nodes); i++)
+        {
+          WebKitDOMNode *node = webkit_dom_node_list_item (nodes, i);
 
-  theme_adium_remove_focus_marks (self, nodes);
+          if (WEBKIT_DOM_IS_ELEMENT (node))
+            webkit_dom_element_set_attribute (WEBKIT_DOM_ELEMENT (node),
+                "src", filename, NULL);
+        }
+
+      g_object_unref (nodes);
+    }
+
+  g_free (selector);
+
+  /* Later messages use the file directly */
+  g_signal_handlers_disconnect_by_func (contact,
+      theme_adium_avatar_notify_cb, self);
+  g_hash_table_remove (self->priv->avatar_waits, contact);
 }
 
-enum
+/* Returns the fallback avatar @filename, marked so the messages of
+ * @contact get their avatar once the contact has read its file */
+static gchar *
+theme_adium_wait_for_avatar (EmpathyThemeAdium *self,
+    EmpathyContact *contact,
+    const gchar *filename)
 {
-  ADD_CONSECUTIVE_MSG_SCROLL = 0,
-  ADD_CONSECUTIVE_MSG_NO_SCROLL = 1,
-  ADD_MSG_SCROLL = 2,
-  ADD_MSG_NO_SCROLL = 3
-};
+  gchar *fragment, *marked;
+
+  if (!g_hash_table_contains (self->priv->avatar_waits, contact))
+    {
+      g_hash_table_add (self->priv->avatar_waits, g_object_ref (contact));
+      g_signal_connect (contact, "notify::avatar",
+          G_CALLBACK (theme_adium_avatar_notify_cb), self);
+    }
+
+  fragment = theme_adium_dup_avatar_wait_fragment (contact);
+  marked = g_strconcat (filename, fragment, NULL);
+  g_free (fragment);
+
+  return marked;
+}
+
+static void
+theme_adium_clear_avatar_waits (EmpathyThemeAdium *self)
+{
+  GHashTableIter iter;
+  gpointer contact;
+
+  g_hash_table_iter_init (&iter, self->priv->avatar_waits);
+  while (g_hash_table_iter_next (&iter, &contact, NULL))
+    g_signal_handlers_disconnect_by_func (contact,
+        theme_adium_avatar_notify_cb, self);
+
+  g_hash_table_remove_all (self->priv->avatar_waits);
+}
 
 /*
  * theme_adium_add_message:
@@ -876,8 +1240,10 @@ enum
  * - last message was recieved recently,
  * - last message and this message both are/aren't backlog, and
  * - DisableCombineConsecutive is not set in theme's settings
+ *
+ * Returns: %TRUE if @msg was added as a consecutive message
  */
-static void
+static gboolean
 theme_adium_add_message (EmpathyThemeAdium *self,
     EmpathyMessage *msg,
     EmpathyContact **prev_contact,
@@ -892,10 +1258,10 @@ theme_adium_add_message (EmpathyThemeAdium *self,
   gchar *body_escaped, *name_escaped;
   const gchar *name;
   const gchar *contact_id;
-  EmpathyAvatar *avatar;
   const gchar *avatar_filename = NULL;
+  gchar *fallback_avatar = NULL;
   gint64 timestamp;
-  const gchar *html = NULL;
+  EmpathyAdiumTemplate *tmpl = NULL;
   const gchar *func;
   const gchar *service_name;
   GString *message_classes = NULL;
@@ -943,10 +1309,9 @@ theme_adium_add_message (EmpathyThemeAdium *self,
       body_escaped = str;
     }
 
-  /* Get the avatar filename, or a fallback */
-  avatar = empathy_contact_get_avatar (sender);
-  if (avatar)
-    avatar_filename = avatar->filename;
+  /* Get the avatar filename, or a fallback until the contact has read its
+   * avatar file */
+  avatar_filename = empathy_contact_get_avatar_filename (sender);
 
   if (!avatar_filename)
     {
@@ -964,6 +1329,10 @@ theme_adium_add_message (EmpathyThemeAdium *self,
 
           avatar_filename = self->priv->data->default_avatar_filename;
         }
+
+      fallback_avatar = theme_adium_wait_for_avatar (self, sender,
+          avatar_filename);
+      avatar_filename = fallback_avatar;
     }
 
   is_backlog = empathy_message_is_backlog (msg);
@@ -990,6 +1359,9 @@ theme_adium_add_message (EmpathyThemeAdium *self,
 
   if (consecutive)
     g_string_append (message_classes, " consecutive");
+  else
+    g_string_append_printf (message_classes, " " BLOCK_CLASS_PREFIX "%u",
+        self->priv->next_block_id);
 
   if (empathy_contact_is_user (sender))
     g_string_append (message_classes, " outgoing");
@@ -1026,8 +1398,14 @@ theme_adium_add_message (EmpathyThemeAdium *self,
 
       id = tp_message_get_pending_message_id (tp_msg, &valid);
       if (valid)
-        g_string_append_printf (message_classes,
-            " x-empathy-message-id-%u", id);
+        {
+          g_string_append_printf (message_classes,
+              " x-empathy-message-id-%u", id);
+
+          /* Its unread mark is looked up when needed */
+          if (!self->priv->has_focus && !is_backlog)
+            g_array_append_val (self->priv->unmapped_focus_ids, id);
+        }
     }
 
   /* Define javascript function to use */
@@ -1043,12 +1421,12 @@ theme_adium_add_message (EmpathyThemeAdium *self,
       /* out */
       if (is_backlog)
         /* context */
-        html = consecutive ? self->priv->data->out_nextcontext_html :
-          self->priv->data->out_context_html;
+        tmpl = consecutive ? self->priv->data->out_nextcontext_tmpl :
+          self->priv->data->out_context_tmpl;
       else
         /* content */
-        html = consecutive ? self->priv->data->out_nextcontent_html :
-          self->priv->data->out_content_html;
+        tmpl = consecutive ? self->priv->data->out_nextcontent_tmpl :
+          self->priv->data->out_content_tmpl;
 
       /* remove all the unread marks when we are sending a message */
       theme_adium_remove_all_focus_marks (self);
@@ -1058,17 +1436,17 @@ theme_adium_add_message (EmpathyThemeAdium *self,
       /* in */
       if (is_backlog)
         /* context */
-        html = consecutive ? self->priv->data->in_nextcontext_html :
-          self->priv->data->in_context_html;
+        tmpl = consecutive ? self->priv->data->in_nextcontext_tmpl :
+          self->priv->data->in_context_tmpl;
       else
         /* content */
-        html = consecutive ? self->priv->data->in_nextcontent_html :
-          self->priv->data->in_content_html;
+        tmpl = consecutive ? self->priv->data->in_nextcontent_tmpl :
+          self->priv->data->in_content_tmpl;
     }
 
   direction = pango_find_base_dir (empathy_message_get_body (msg), -1);
 
-  theme_adium_add_html (self, func, html, body_escaped,
+  theme_adium_add_html (self, func, tmpl, body_escaped,
       avatar_filename, name_escaped, contact_id,
       service_name, message_classes->str,
       timestamp, is_backlog, empathy_contact_is_user (sender), direction);
@@ -1083,7 +1461,226 @@ theme_adium_add_message (EmpathyThemeAdium *self,
 
   g_free (body_escaped);
   g_free (name_escaped);
+  g_free (fallback_avatar);
   g_string_free (message_classes, TRUE);
+
+  return consecutive;
+}
+
+static void
+block_free (gpointer block)
+{
+  g_slice_free (Block, block);
+}
+
+static void
+theme_adium_clear_blocks (EmpathyThemeAdium *self)
+{
+  g_queue_foreach (&self->priv->blocks, (GFunc) block_free, NULL);
+  g_queue_clear (&self->priv->blocks);
+  self->priv->n_messages = 0;
+}
+
+/* Adds the block whose first message or event has just been added with
+ * the next block id in its classes */
+static void
+theme_adium_add_block (EmpathyThemeAdium *self,
+    gint64 timestamp,
+    gboolean is_message,
+    gboolean prepend)
+{
+  Block *block;
+
+  block = g_slice_new0 (Block);
+  block->id = self->priv->next_block_id++;
+  block->timestamp = timestamp;
+
+  if (is_message)
+    {
+      block->n_messages = 1;
+      self->priv->n_messages++;
+    }
+
+  if (prepend)
+    g_queue_push_head (&self->priv->blocks, block);
+  else
+    g_queue_push_tail (&self->priv->blocks, block);
+}
+
+static void
+theme_adium_count_message (EmpathyThemeAdium *self,
+    gint64 timestamp,
+    gboolean consecutive,
+    gboolean prepend)
+{
+  Block *block;
+
+  block = prepend ? g_queue_peek_head (&self->priv->blocks) :
+    g_queue_peek_tail (&self->priv->blocks);
+
+  if (!consecutive || block == NULL)
+    {
+      theme_adium_add_block (self, timestamp, TRUE, prepend);
+      return;
+    }
+
+  block->n_messages++;
+  block->timestamp = MIN (block->timestamp, timestamp);
+  self->priv->n_messages++;
+}
+
+/* Same as nearBottom () in Template.html */
+static gboolean
+theme_adium_is_near_bottom (EmpathyThemeAdium *self)
+{
+  GtkAdjustment *adj;
+
+  adj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (self));
+  if (adj == NULL)
+    return TRUE;
+
+  return gtk_adjustment_get_value (adj) >= gtk_adjustment_get_upper (adj) -
+      1.2 * gtk_adjustment_get_page_size (adj);
+}
+
+/* Returns the top-level node of @block, the child of @chat holding its
+ * first message or event, or %NULL if it can't be found */
+static WebKitDOMNode *
+theme_adium_get_block_node (EmpathyThemeAdium *self,
+    WebKitDOMDocument *dom,
+    WebKitDOMElement *chat,
+    Block *block)
+{
+  WebKitDOMElement *element;
+  WebKitDOMNode *node, *parent;
+  gchar *selector;
+  GError *error = NULL;
+
+  selector = g_strdup_printf ("." BLOCK_CLASS_PREFIX "%u", block->id);
+  element = webkit_dom_document_query_selector (dom, selector, &error);
+  g_free (selector);
+
+  if (element == NULL)
+    {
+      DEBUG ("Block %u not found: %s", block->id,
+          error ? error->message : "No error");
+      g_clear_error (&error);
+      return NULL;
+    }
+
+  node = WEBKIT_DOM_NODE (element);
+  while ((parent = webkit_dom_node_get_parent_node (node)) != NULL)
+    {
+      if (webkit_dom_node_is_same_node (parent, WEBKIT_DOM_NODE (chat)))
+        return node;
+
+      node = parent;
+    }
+
+  /* Still waiting to be added to the chat */
+  return NULL;
+}
+
+static gboolean
+theme_adium_prune_cb (gpointer user_data)
+{
+  EmpathyThemeAdium *self = user_data;
+  WebKitDOMDocument *dom;
+  WebKitDOMElement *chat;
+  WebKitDOMNode *first_kept, *child;
+  GList *l;
+  guint max_messages;
+  guint n_messages;
+  guint pruned = 0;
+
+  max_messages = g_settings_get_uint (self->priv->gsettings_chat,
+      EMPATHY_PREFS_CHAT_MAX_RENDERED_MESSAGES);
+  if (max_messages == 0 || self->priv->n_messages <=
+      max_messages + max_messages / PRUNE_SLACK_RATIO)
+    goto done;
+
+  /* Don't remove the history the user is reading, or has just loaded by
+   * scrolling up, but try again once the user is back to the bottom */
+  if (!theme_adium_is_near_bottom (self))
+    return G_SOURCE_CONTINUE;
+
+  theme_adium_flush_batch (self);
+
+  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (self));
+  if (dom == NULL)
+    goto done;
+
+  chat = webkit_dom_document_get_element_by_id (dom, "Chat");
+  if (chat == NULL)
+    goto done;
+
+  /* Find the oldest block to keep, always keeping the last one as it
+   * holds the insertion point for consecutive messages. */
+  n_messages = self->priv->n_messages;
+  for (l = self->priv->blocks.head;
+      l->next != NULL && n_messages > max_messages;
+      l = l->next)
+    n_messages -= ((Block *) l->data)->n_messages;
+
+  first_kept = theme_adium_get_block_node (self, dom, chat, l->data);
+  if (first_kept == NULL)
+    goto done;
+
+  /* Remove all the nodes of the older blocks */
+  while ((child = webkit_dom_node_get_first_child (
+          WEBKIT_DOM_NODE (chat))) != NULL &&
+      !webkit_dom_node_is_same_node (child, first_kept))
+    {
+      GError *error = NULL;
+
+      webkit_dom_node_remove_child (WEBKIT_DOM_NODE (chat), child, &error);
+
+      if (error != NULL)
+        {
+          DEBUG ("Error removing old message: %s", error->message);
+          g_error_free (error);
+          break;
+        }
+    }
+
+  while (self->priv->blocks.head != l)
+    {
+      Block *block = g_queue_pop_head (&self->priv->blocks);
+
+      self->priv->n_messages -= block->n_messages;
+      pruned += block->n_messages;
+      block_free (block);
+    }
+
+  if (pruned > 0)
+    {
+      DEBUG ("Removed %u old messages from the view", pruned);
+      self->priv->n_pruned += pruned;
+
+      /* Don't keep removed nodes alive */
+      theme_adium_forget_removed_focus_nodes (self);
+
+      /* The first displayed message is gone, next prepended message
+       * can't be consecutive with it */
+      g_clear_object (&self->priv->first_contact);
+    }
+
+done:
+  self->priv->prune_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/* Messages are only pruned while the user is looking at the bottom of the
+ * view, so the history the user is scrolling back to is kept until the user
+ * comes back to the new messages. */
+static void
+theme_adium_schedule_prune (EmpathyThemeAdium *self)
+{
+  if (self->priv->prune_id != 0)
+    return;
+
+  self->priv->prune_id = g_timeout_add_seconds (1, theme_adium_prune_cb,
+      self);
 }
 
 void
@@ -1095,6 +1692,7 @@ empathy_theme_adium_append_message (EmpathyThemeAdium *self,
       "appendNextMessageNoScroll",
       "appendMessage",
       "appendMessageNoScroll" };
+  gboolean consecutive;
 
   if (self->priv->pages_loading != 0)
     {
@@ -1103,9 +1701,13 @@ empathy_theme_adium_append_message (EmpathyThemeAdium *self,
       return;
     }
 
-  theme_adium_add_message (self, msg, &self->priv->last_contact,
-      &self->priv->last_timestamp, &self->priv->last_is_backlog,
-      should_highlight, js_funcs);
+  consecutive = theme_adium_add_message (self, msg,
+      &self->priv->last_contact, &self->priv->last_timestamp,
+      &self->priv->last_is_backlog, should_highlight, js_funcs);
+
+  theme_adium_count_message (self, empathy_message_get_timestamp (msg),
+      consecutive, FALSE);
+  theme_adium_schedule_prune (self);
 }
 
 void
@@ -1147,6 +1749,7 @@ empathy_theme_adium_prepend_message (EmpathyThemeAdium *self,
       "prependPrev",
       "prepend",
       "prepend" };
+  gboolean consecutive;
 
   if (self->priv->pages_loading != 0)
     {
@@ -1155,9 +1758,13 @@ empathy_theme_adium_prepend_message (EmpathyThemeAdium *self,
       return;
     }
 
-  theme_adium_add_message (self, msg, &self->priv->first_contact,
-      &self->priv->first_timestamp, &self->priv->first_is_backlog,
-      should_highlight, js_funcs);
+  consecutive = theme_adium_add_message (self, msg,
+      &self->priv->first_contact, &self->priv->first_timestamp,
+      &self->priv->first_is_backlog, should_highlight, js_funcs);
+
+  theme_adium_count_message (self, empathy_message_get_timestamp (msg),
+      consecutive, TRUE);
+  theme_adium_schedule_prune (self);
 }
 
 void
@@ -1177,6 +1784,9 @@ empathy_theme_adium_edit_message (EmpathyThemeAdium *self,
       return;
     }
 
+  /* The message to edit could still be in the batch */
+  theme_adium_flush_batch (self);
+
   id = g_strdup_printf ("message-token-%s",
     empathy_message_get_supersedes (message));
   /* we don't pass a token here, because doing so will return another
@@ -1276,7 +1886,7 @@ empathy_theme_adium_scroll (EmpathyThemeAdium *self,
 void
 empathy_theme_adium_scroll_down (EmpathyThemeAdium *self)
 {
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self), "alignChat(true);");
+  theme_adium_execute_script (self, "alignChat(true);");
 }
 
 gboolean
@@ -1290,6 +1900,8 @@ empathy_theme_adium_clear (EmpathyThemeAdium *self)
 {
   theme_adium_load_template (self);
 
+  theme_adium_clear_blocks (self);
+
   /* Clear last contact to avoid trying to add a 'joined'
    * message when we don't have an insertion point. */
   if (self->priv->last_contact)
@@ -1355,33 +1967,64 @@ empathy_theme_adium_copy_clipboard (EmpathyThemeAdium *self)
 }
 
 static void
-theme_adium_remove_mark_from_message (EmpathyThemeAdium *self,
-    guint32 id)
+theme_adium_flush_unmarks (EmpathyThemeAdium *self)
 {
-  WebKitDOMDocument *dom;
-  WebKitDOMNodeList *nodes;
-  gchar *class;
-  GError *error = NULL;
+  GHashTable *focus_nodes;
+  GHashTableIter iter;
+  gpointer key;
 
-  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (self));
-  if (dom == NULL)
-    return;
+  if (self->priv->unmark_id != 0)
+    {
+      g_source_remove (self->priv->unmark_id);
+      self->priv->unmark_id = 0;
+    }
 
-  class = g_strdup_printf (".x-empathy-message-id-%u", id);
+  if (g_hash_table_size (self->priv->unmark_ids) == 0)
+    return;
 
-  /* Get all nodes with focus class */
-  nodes = webkit_dom_document_query_selector_all (dom, class, &error);
-  g_free (class);
+  focus_nodes = theme_adium_get_focus_nodes (self);
 
-  if (nodes == NULL)
+  g_hash_table_iter_init (&iter, self->priv->unmark_ids);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
     {
-      DEBUG ("Error getting focus nodes: %s",
-        error ? error->message : "No error");
-      g_clear_error (&error);
-      return;
+      GPtrArray *elements;
+      guint i;
+
+      elements = g_hash_table_lookup (focus_nodes, key);
+      if (elements == NULL)
+        continue;
+
+      for (i = 0; i < elements->len; i++)
+        theme_adium_remove_focus_mark (g_ptr_array_index (elements, i));
+
+      g_hash_table_remove (focus_nodes, key);
     }
 
-  theme_adium_remove_focus_marks (self, nodes);
+  g_hash_table_remove_all (self->priv->unmark_ids);
+}
+
+static gboolean
+theme_adium_flush_unmarks_cb (gpointer user_data)
+{
+  EmpathyThemeAdium *self = user_data;
+
+  self->priv->unmark_id = 0;
+  theme_adium_flush_unmarks (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Acknowledgements usually come in bursts, for example when focusing a
+ * room with many unread messages: remove all their marks at once when
+ * going back to the main loop. */
+static void
+theme_adium_remove_mark_from_message (EmpathyThemeAdium *self,
+    guint32 id)
+{
+  g_hash_table_add (self->priv->unmark_ids, GUINT_TO_POINTER (id));
+
+  if (self->priv->unmark_id == 0)
+    self->priv->unmark_id = g_idle_add (theme_adium_flush_unmarks_cb, self);
 }
 
 static void
@@ -1406,6 +2049,7 @@ empathy_theme_adium_focus_toggled (EmpathyThemeAdium *self,
       g_queue_foreach (&self->priv->acked_messages,
           theme_adium_remove_acked_message_unread_mark_foreach, self);
       g_queue_clear (&self->priv->acked_messages);
+      theme_adium_flush_unmarks (self);
 
       self->priv->has_unread_message = FALSE;
     }
@@ -1491,6 +2135,11 @@ theme_adium_load_finished_cb (WebKitWebView *view,
   if (self->priv->pages_loading != 0)
     return;
 
+  /* Install helpers and display queued messages in one go */
+  empathy_theme_adium_begin_batch (self);
+
+  theme_adium_install_js (self);
+
   /* Display queued messages */
   for (l = self->priv->message_queue.head; l != NULL; l = l->next)
     {
@@ -1516,6 +2165,18 @@ theme_adium_load_finished_cb (WebKitWebView *view,
     }
 
   g_queue_clear (&self->priv->message_queue);
+
+  empathy_theme_adium_end_batch (self);
+}
+
+static void
+theme_adium_show_smileys_changed_cb (GSettings *gsettings,
+    const gchar *key,
+    gpointer user_data)
+{
+  EmpathyThemeAdium *self = user_data;
+
+  self->priv->show_smileys = g_settings_get_boolean (gsettings, key);
 }
 
 static void
@@ -1530,6 +2191,13 @@ theme_adium_finalize (GObject *object)
 
   g_free (self->priv->variant);
 
+  empathy_adium_time_cache_free (self->priv->time_cache);
+  g_hash_table_unref (self->priv->unmark_ids);
+  g_hash_table_unref (self->priv->sender_colors);
+  g_hash_table_unref (self->priv->avatar_waits);
+  g_hash_table_unref (self->priv->focus_nodes);
+  g_array_unref (self->priv->unmapped_focus_ids);
+
   G_OBJECT_CLASS (empathy_theme_adium_parent_class)->finalize (object);
 }
 
@@ -1563,6 +2231,29 @@ theme_adium_dispose (GObject *object)
       g_queue_clear (&self->priv->acked_messages);
     }
 
+  if (self->priv->unmark_id != 0)
+    {
+      g_source_remove (self->priv->unmark_id);
+      self->priv->unmark_id = 0;
+    }
+
+  theme_adium_clear_focus_nodes (self);
+  theme_adium_clear_avatar_waits (self);
+
+  if (self->priv->batch != NULL)
+    {
+      g_string_free (self->priv->batch, TRUE);
+      self->priv->batch = NULL;
+    }
+
+  if (self->priv->prune_id != 0)
+    {
+      g_source_remove (self->priv->prune_id);
+      self->priv->prune_id = 0;
+    }
+
+  theme_adium_clear_blocks (self);
+
   G_OBJECT_CLASS (empathy_theme_adium_parent_class)->dispose (object);
 }
 
@@ -1759,6 +2450,7 @@ empathy_theme_adium_init (EmpathyThemeAdium *self)
 
   self->priv->in_construction = TRUE;
   g_queue_init (&self->priv->message_queue);
+  g_queue_init (&self->priv->blocks);
   self->priv->allow_scrolling = TRUE;
   self->priv->smiley_manager = empathy_smiley_manager_dup_singleton ();
 
@@ -1775,6 +2467,23 @@ empathy_theme_adium_init (EmpathyThemeAdium *self)
   self->priv->gsettings_chat = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
   self->priv->gsettings_desktop = g_settings_new (
     EMPATHY_PREFS_DESKTOP_INTERFACE_SCHEMA);
+
+  self->priv->show_smileys = g_settings_get_boolean (
+    self->priv->gsettings_chat, EMPATHY_PREFS_CHAT_SHOW_SMILEYS);
+  g_signal_connect (self->priv->gsettings_chat,
+      "changed::" EMPATHY_PREFS_CHAT_SHOW_SMILEYS,
+      G_CALLBACK (theme_adium_show_smileys_changed_cb), self);
+
+  self->priv->time_cache = empathy_adium_time_cache_new ();
+  self->priv->unmark_ids = g_hash_table_new (NULL, NULL);
+  self->priv->sender_colors = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  self->priv->avatar_waits = g_hash_table_new_full (NULL, NULL,
+      g_object_unref, NULL);
+  self->priv->focus_nodes = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_ptr_array_unref);
+  self->priv->unmapped_focus_ids = g_array_new (FALSE, FALSE,
+      sizeof (guint32));
 }
 
 EmpathyThemeAdium *
@@ -1811,7 +2520,7 @@ empathy_theme_adium_set_variant (EmpathyThemeAdium *self,
   script = g_strdup_printf ("setStylesheet(\"mainStyle\",\"%s\");",
       variant_path);
 
-  webkit_web_view_execute_script (WEBKIT_WEB_VIEW (self), script);
+  theme_adium_execute_script (self, script);
 
   g_free (variant_path);
   g_free (script);
@@ -1819,6 +2528,89 @@ empathy_theme_adium_set_variant (EmpathyThemeAdium *self,
   g_object_notify (G_OBJECT (self), "variant");
 }
 
+/**
+ * empathy_theme_adium_begin_batch:
+ * @self: an #EmpathyThemeAdium
+ *
+ * Until the matching empathy_theme_adium_end_batch() call, messages and
+ * events added to @self are not inserted one by one, but all at once with
+ * a single script execution. Edits are still applied in order with the
+ * messages added before them. Calls can be nested.
+ */
+void
+empathy_theme_adium_begin_batch (EmpathyThemeAdium *self)
+{
+  g_return_if_fail (EMPATHY_IS_THEME_ADIUM (self));
+
+  if (self->priv->batch_depth++ == 0)
+    self->priv->batch = g_string_new (NULL);
+}
+
+void
+empathy_theme_adium_end_batch (EmpathyThemeAdium *self)
+{
+  g_return_if_fail (EMPATHY_IS_THEME_ADIUM (self));
+  g_return_if_fail (self->priv->batch_depth > 0);
+
+  if (--self->priv->batch_depth > 0)
+    return;
+
+  theme_adium_flush_batch (self);
+
+  g_string_free (self->priv->batch, TRUE);
+  self->priv->batch = NULL;
+}
+
+/* Number of messages currently displayed in the view */
+guint
+empathy_theme_adium_get_n_messages (EmpathyThemeAdium *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_THEME_ADIUM (self), 0);
+
+  return self->priv->n_messages;
+}
+
+/* Timestamp of the oldest message displayed in the view, or G_MAXINT64 if
+ * there is none */
+gint64
+empathy_theme_adium_get_oldest_timestamp (EmpathyThemeAdium *self)
+{
+  GList *l;
+
+  g_return_val_if_fail (EMPATHY_IS_THEME_ADIUM (self), G_MAXINT64);
+
+  for (l = self->priv->blocks.head; l != NULL; l = l->next)
+    {
+      Block *block = l->data;
+
+      if (block->n_messages > 0)
+        return block->timestamp;
+    }
+
+  return G_MAXINT64;
+}
+
+/* Number of messages removed from the top of the view since it has been
+ * created, because there were more than the max-rendered-messages
+ * setting. */
+guint
+empathy_theme_adium_get_n_pruned_messages (EmpathyThemeAdium *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_THEME_ADIUM (self), 0);
+
+  return self->priv->n_pruned;
+}
+
+/* Number of bytes of javascript executed in the view since it has been
+ * created, useful to check how much we push to WebKit. */
+guint64
+empathy_theme_adium_get_script_bytes (EmpathyThemeAdium *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_THEME_ADIUM (self), 0);
+
+  return self->priv->script_bytes;
+}
+
 void
 empathy_theme_adium_show_inspector (EmpathyThemeAdium *self)
 {
@@ -2032,6 +2824,7 @@ empathy_adium_data_new_with_info (const gchar *path,
   EmpathyAdiumData *data;
   gchar *template_html = NULL;
   gchar *footer_html = NULL;
+  GHashTable *compiled;
   gchar *tmp;
 
   g_return_val_if_fail (empathy_adium_path_is_valid (path), NULL);
@@ -2110,6 +2903,36 @@ empathy_adium_data_new_with_info (const gchar *path,
 
 #undef FALLBACK
 
+  /* Parse message html bits, sharing templates between htmls pointing to
+   * the same string because of fallbacks */
+  data->templates_to_free = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) empathy_adium_template_free);
+  compiled = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+#define COMPILE(html, tmpl) \
+  if (html != NULL) { \
+    tmpl = g_hash_table_lookup (compiled, html); \
+    if (tmpl == NULL) { \
+      tmpl = empathy_adium_template_new (html); \
+      g_ptr_array_add (data->templates_to_free, tmpl); \
+      g_hash_table_insert (compiled, (gpointer) html, tmpl); \
+    } \
+  }
+
+  COMPILE (data->in_content_html,      data->in_content_tmpl);
+  COMPILE (data->in_context_html,      data->in_context_tmpl);
+  COMPILE (data->in_nextcontent_html,  data->in_nextcontent_tmpl);
+  COMPILE (data->in_nextcontext_html,  data->in_nextcontext_tmpl);
+  COMPILE (data->out_content_html,     data->out_content_tmpl);
+  COMPILE (data->out_context_html,     data->out_context_tmpl);
+  COMPILE (data->out_nextcontent_html, data->out_nextcontent_tmpl);
+  COMPILE (data->out_nextcontext_html, data->out_nextcontext_tmpl);
+  COMPILE (data->status_html,          data->status_tmpl);
+
+#undef COMPILE
+
+  g_hash_table_unref (compiled);
+
   /* template -> empathy's template */
   data->custom_template = (template_html != NULL);
   if (template_html == NULL)
@@ -2214,6 +3037,7 @@ empathy_adium_data_unref (EmpathyAdiumData *data)
     g_free (data->default_outgoing_avatar_filename);
     g_hash_table_unref (data->info);
     g_ptr_array_unref (data->strings_to_free);
+    g_ptr_array_unref (data->templates_to_free);
     tp_clear_pointer (&data->date_format_cache, g_hash_table_unref);
 
     g_slice_free (EmpathyAdiumData, data);
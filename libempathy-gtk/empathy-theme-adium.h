@@ -134,6 +134,15 @@ void empathy_theme_adium_message_acknowledged (EmpathyThemeAdium *self,
 void empathy_theme_adium_set_show_avatars (EmpathyThemeAdium *self,
     gboolean show_avatars);
 
+void empathy_theme_adium_begin_batch (EmpathyThemeAdium *self);
+void empathy_theme_adium_end_batch (EmpathyThemeAdium *self);
+
+guint empathy_theme_adium_get_n_messages (EmpathyThemeAdium *self);
+guint empathy_theme_adium_get_n_pruned_messages (EmpathyThemeAdium *self);
+gint64 empathy_theme_adium_get_oldest_timestamp (EmpathyThemeAdium *self);
+
+guint64 empathy_theme_adium_get_script_bytes (EmpathyThemeAdium *self);
+
 /* not methods functions */
 
 gboolean empathy_adium_path_is_valid (const gchar *path);
@@ -40,6 +40,7 @@
 #include <tp-account-widgets/tpaw-pixbuf-utils.h>
 #include <tp-account-widgets/tpaw-utils.h>
 
+#include "empathy-avatar-cache.h"
 #include "empathy-ft-factory.h"
 #include "empathy-images.h"
 #include "empathy-utils.h"
@@ -319,7 +320,9 @@ avatar_pixbuf_from_loader (GdkPixbufLoader *loader)
   return pixbuf_round_corners (pixbuf);
 }
 
-static GdkPixbuf *
+/* Decoded avatars are kept in the default EmpathyAvatarCache, keyed by their
+ * token. Avatars without a token are decoded each time. */
+GdkPixbuf *
 empathy_pixbuf_from_avatar_scaled (EmpathyAvatar *avatar,
     gint width,
     gint height)
@@ -328,10 +331,24 @@ empathy_pixbuf_from_avatar_scaled (EmpathyAvatar *avatar,
   GdkPixbufLoader *loader;
   struct SizeData data;
   GError *error = NULL;
+  gchar *key = NULL;
 
   if (!avatar)
     return NULL;
 
+  if (!TPAW_STR_EMPTY (avatar->token))
+    {
+      key = g_strdup_printf ("token:%s", avatar->token);
+
+      pixbuf = empathy_avatar_cache_lookup (
+          empathy_avatar_cache_get_default (), key, width, height);
+      if (pixbuf != NULL)
+        {
+          g_free (key);
+          return pixbuf;
+        }
+    }
+
   data.width = width;
   data.height = height;
   data.preserve_aspect_ratio = TRUE;
@@ -344,6 +361,7 @@ empathy_pixbuf_from_avatar_scaled (EmpathyAvatar *avatar,
   if (avatar->len == 0)
     {
       g_warning ("Avatar has 0 length");
+      g_free (key);
       return NULL;
     }
   else if (!gdk_pixbuf_loader_write (loader, avatar->data, avatar->len, &error))
@@ -353,6 +371,7 @@ empathy_pixbuf_from_avatar_scaled (EmpathyAvatar *avatar,
           avatar->data, avatar->len, error->message);
 
       g_error_free (error);
+      g_free (key);
       return NULL;
     }
 
@@ -361,6 +380,13 @@ empathy_pixbuf_from_avatar_scaled (EmpathyAvatar *avatar,
 
   g_object_unref (loader);
 
+  if (key != NULL)
+    {
+      empathy_avatar_cache_insert (empathy_avatar_cache_get_default (), key,
+          width, height, pixbuf);
+      g_free (key);
+    }
+
   return pixbuf;
 }
 
@@ -384,6 +410,7 @@ typedef struct
   guint width;
   guint height;
   GCancellable *cancellable;
+  gchar *cache_key;
 } PixbufAvatarFromIndividualClosure;
 
 static PixbufAvatarFromIndividualClosure *
@@ -391,7 +418,8 @@ pixbuf_avatar_from_individual_closure_new (FolksIndividual *individual,
     GSimpleAsyncResult *result,
     gint width,
     gint height,
-    GCancellable *cancellable)
+    GCancellable *cancellable,
+    const gchar *cache_key)
 {
   PixbufAvatarFromIndividualClosure *closure;
 
@@ -402,6 +430,7 @@ pixbuf_avatar_from_individual_closure_new (FolksIndividual *individual,
   closure->result = g_object_ref (result);
   closure->width = width;
   closure->height = height;
+  closure->cache_key = g_strdup (cache_key);
 
   if (cancellable != NULL)
     closure->cancellable = g_object_ref (cancellable);
@@ -415,6 +444,7 @@ pixbuf_avatar_from_individual_closure_free (
 {
   g_clear_object (&closure->cancellable);
   g_object_unref (closure->result);
+  g_free (closure->cache_key);
   g_slice_free (PixbufAvatarFromIndividualClosure, closure);
 }
 
@@ -468,6 +498,9 @@ avatar_icon_load_cb (GObject *object,
 
   final_pixbuf = transform_pixbuf (pixbuf);
 
+  empathy_avatar_cache_insert (empathy_avatar_cache_get_default (),
+      closure->cache_key, closure->width, closure->height, final_pixbuf);
+
   /* Pass ownership of final_pixbuf to the result */
   g_simple_async_result_set_op_res_gpointer (closure->result,
       final_pixbuf, g_object_unref);
@@ -479,6 +512,38 @@ out:
   pixbuf_avatar_from_individual_closure_free (closure);
 }
 
+static void
+avatar_icon_finalized (gpointer data)
+{
+  gchar *key = data;
+
+  empathy_avatar_cache_remove (empathy_avatar_cache_get_default (), key);
+  g_free (key);
+}
+
+/* Folks gives a new GLoadableIcon to an individual when its avatar changes,
+ * so the icon itself identifies the image. Its decoded versions are dropped
+ * from the cache when it is destroyed, before its address can be reused. */
+static const gchar *
+avatar_icon_get_cache_key (GLoadableIcon *icon)
+{
+  static GQuark quark = 0;
+  gchar *key;
+
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("empathy-avatar-cache-key");
+
+  key = g_object_get_qdata (G_OBJECT (icon), quark);
+  if (key == NULL)
+    {
+      key = g_strdup_printf ("icon:%p", icon);
+      g_object_set_qdata_full (G_OBJECT (icon), quark, key,
+          avatar_icon_finalized);
+    }
+
+  return key;
+}
+
 void
 empathy_pixbuf_avatar_from_individual_scaled_async (
     FolksIndividual *individual,
@@ -491,6 +556,8 @@ empathy_pixbuf_avatar_from_individual_scaled_async (
   GLoadableIcon *avatar_icon;
   GSimpleAsyncResult *result;
   PixbufAvatarFromIndividualClosure *closure;
+  const gchar *cache_key;
+  GdkPixbuf *pixbuf;
 
   result = g_simple_async_result_new (G_OBJECT (individual),
       callback, user_data, empathy_pixbuf_avatar_from_individual_scaled_async);
@@ -508,8 +575,23 @@ empathy_pixbuf_avatar_from_individual_scaled_async (
       return;
     }
 
+  cache_key = avatar_icon_get_cache_key (avatar_icon);
+
+  pixbuf = empathy_avatar_cache_lookup (empathy_avatar_cache_get_default (),
+      cache_key, width, height);
+  if (pixbuf != NULL)
+    {
+      /* Pass ownership of pixbuf to the result */
+      g_simple_async_result_set_op_res_gpointer (result, pixbuf,
+          g_object_unref);
+
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+      return;
+    }
+
   closure = pixbuf_avatar_from_individual_closure_new (individual, result,
-      width, height, cancellable);
+      width, height, cancellable, cache_key);
 
   g_return_if_fail (closure != NULL);
 
@@ -1007,67 +1089,344 @@ empathy_get_current_action_time (void)
   return (tp_user_action_time_from_x11 (gtk_get_current_event_time ()));
 }
 
-/* @words = tpaw_live_search_strip_utf8_string (@text);
- *
- * User has to pass both so we don't have to compute @words ourself each time
- * this function is called. */
+/* Returns the words of @string as returned by
+ * tpaw_live_search_strip_utf8_string(), joined with spaces. Matching a search
+ * against this key with empathy_live_search_match_key() gives the same result
+ * as tpaw_live_search_match_words() on @string, without having to strip it
+ * again. */
+gchar *
+empathy_live_search_strip_key (const gchar *string)
+{
+  GPtrArray *words;
+  GString *key;
+  guint i;
+
+  words = tpaw_live_search_strip_utf8_string (string);
+  if (words == NULL)
+    return g_strdup ("");
+
+  key = g_string_new (NULL);
+
+  for (i = 0; i < words->len; i++)
+    {
+      if (i > 0)
+        g_string_append_c (key, ' ');
+
+      g_string_append (key, g_ptr_array_index (words, i));
+    }
+
+  g_ptr_array_unref (words);
+  return g_string_free (key, FALSE);
+}
+
+/* Same algorithm as tpaw_live_search_match_words(): @prefix has to match the
+ * beginning of a word, but word separators inside @prefix are ignored. */
+static gboolean
+live_search_key_match_prefix (const gchar *key,
+    const gchar *prefix)
+{
+  const gchar *p, *prefix_p;
+  gboolean next_word = FALSE;
+
+  if (prefix == NULL || prefix[0] == '\0')
+    return TRUE;
+
+  prefix_p = prefix;
+  for (p = key; *p != '\0'; p = g_utf8_next_char (p))
+    {
+      /* Keys only contain alpha-num chars separated by spaces */
+      if (*p == ' ')
+        {
+          next_word = FALSE;
+          continue;
+        }
+
+      if (next_word)
+        continue;
+
+      if (g_utf8_get_char (p) != g_utf8_get_char (prefix_p))
+        {
+          next_word = TRUE;
+          prefix_p = prefix;
+          continue;
+        }
+
+      prefix_p = g_utf8_next_char (prefix_p);
+      if (*prefix_p == '\0')
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* @key = empathy_live_search_strip_key (@string);
+ * @words = tpaw_live_search_strip_utf8_string (@text); */
 gboolean
-empathy_individual_match_string (FolksIndividual *individual,
-    const char *text,
+empathy_live_search_match_key (const gchar *key,
     GPtrArray *words)
 {
-  const gchar *str;
+  guint i;
+
+  if (words == NULL)
+    return TRUE;
+
+  for (i = 0; i < words->len; i++)
+    {
+      if (!live_search_key_match_prefix (key, g_ptr_array_index (words, i)))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* What empathy_individual_match_string() looks at, stripped once and kept
+ * on the individual until its alias or its personas change. */
+typedef struct
+{
+  /* The alias the keys have been computed from, and its key */
+  gchar *alias;
+  gchar *alias_key;
+  /* Interesting personas (owned) */
+  GPtrArray *personas;
+  /* Display IDs of these personas, and the keys of these IDs without their
+   * @server part */
+  GPtrArray *ids;
+  GPtrArray *id_keys;
+} IndividualSearchKeys;
+
+static void
+individual_search_keys_free (gpointer data)
+{
+  IndividualSearchKeys *keys = data;
+
+  g_free (keys->alias);
+  g_free (keys->alias_key);
+  g_ptr_array_unref (keys->personas);
+  g_ptr_array_unref (keys->ids);
+  g_ptr_array_unref (keys->id_keys);
+
+  g_slice_free (IndividualSearchKeys, keys);
+}
+
+static gboolean
+individual_search_keys_personas_valid (IndividualSearchKeys *keys,
+    FolksIndividual *individual)
+{
   GeeSet *personas;
   GeeIterator *iter;
-  gboolean retval = FALSE;
+  guint n = 0;
+  gboolean valid = TRUE;
 
-  /* check alias name */
-  str = folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual));
+  personas = folks_individual_get_personas (individual);
 
-  if (tpaw_live_search_match_words (str, words))
-    return TRUE;
+  iter = gee_iterable_iterator (GEE_ITERABLE (personas));
+  while (valid && gee_iterator_next (iter))
+    {
+      FolksPersona *persona = gee_iterator_get (iter);
+
+      if (empathy_folks_persona_is_interesting (persona))
+        {
+          if (n >= keys->personas->len ||
+              g_ptr_array_index (keys->personas, n) != persona)
+            valid = FALSE;
+
+          n++;
+        }
+
+      g_object_unref (persona);
+    }
+  g_object_unref (iter);
+
+  return valid && n == keys->personas->len;
+}
+
+static void
+individual_search_keys_update_personas (IndividualSearchKeys *keys,
+    FolksIndividual *individual)
+{
+  GeeSet *personas;
+  GeeIterator *iter;
+
+  g_ptr_array_set_size (keys->personas, 0);
+  g_ptr_array_set_size (keys->ids, 0);
+  g_ptr_array_set_size (keys->id_keys, 0);
 
   personas = folks_individual_get_personas (individual);
 
-  /* check contact id, remove the @server.com part */
   iter = gee_iterable_iterator (GEE_ITERABLE (personas));
-  while (retval == FALSE && gee_iterator_next (iter))
+  while (gee_iterator_next (iter))
     {
       FolksPersona *persona = gee_iterator_get (iter);
-      const gchar *p;
 
       if (empathy_folks_persona_is_interesting (persona))
         {
-          str = folks_persona_get_display_id (persona);
-
-          /* Accept the persona if @text is a full prefix of his ID; that allows
-           * user to find, say, a jabber contact by typing his JID. */
-          if (g_str_has_prefix (str, text))
-            {
-              retval = TRUE;
-            }
-          else
-            {
-              gchar *dup_str = NULL;
-              gboolean visible;
-
-              p = strstr (str, "@");
-              if (p != NULL)
-                str = dup_str = g_strndup (str, p - str);
-
-              visible = tpaw_live_search_match_words (str, words);
-              g_free (dup_str);
-              if (visible)
-                retval = TRUE;
-            }
+          const gchar *id;
+          gchar *dup_id = NULL;
+          const gchar *p;
+
+          id = folks_persona_get_display_id (persona);
+
+          g_ptr_array_add (keys->personas, g_object_ref (persona));
+          g_ptr_array_add (keys->ids, g_strdup (id));
+
+          /* Remove the @server.com part */
+          p = strstr (id, "@");
+          if (p != NULL)
+            id = dup_id = g_strndup (id, p - id);
+
+          g_ptr_array_add (keys->id_keys, empathy_live_search_strip_key (id));
+          g_free (dup_id);
         }
-      g_clear_object (&persona);
+
+      g_object_unref (persona);
+    }
+  g_object_unref (iter);
+}
+
+static IndividualSearchKeys *
+individual_get_search_keys (FolksIndividual *individual)
+{
+  static GQuark quark = 0;
+  IndividualSearchKeys *keys;
+  const gchar *alias;
+
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("empathy-individual-search-keys");
+
+  keys = g_object_get_qdata (G_OBJECT (individual), quark);
+  if (keys == NULL)
+    {
+      keys = g_slice_new0 (IndividualSearchKeys);
+      keys->personas = g_ptr_array_new_with_free_func (g_object_unref);
+      keys->ids = g_ptr_array_new_with_free_func (g_free);
+      keys->id_keys = g_ptr_array_new_with_free_func (g_free);
+
+      individual_search_keys_update_personas (keys, individual);
+
+      g_object_set_qdata_full (G_OBJECT (individual), quark, keys,
+          individual_search_keys_free);
+    }
+  else if (!individual_search_keys_personas_valid (keys, individual))
+    {
+      individual_search_keys_update_personas (keys, individual);
+    }
+
+  /* Comparing the alias is cheaper than stripping it again, and does not
+   * depend on the order in which notify::alias callbacks are called. */
+  alias = folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual));
+  if (keys->alias_key == NULL || tp_strdiff (keys->alias, alias))
+    {
+      g_free (keys->alias);
+      g_free (keys->alias_key);
+      keys->alias = g_strdup (alias);
+      keys->alias_key = empathy_live_search_strip_key (alias);
+    }
+
+  return keys;
+}
+
+/* @words = tpaw_live_search_strip_utf8_string (@text);
+ *
+ * User has to pass both so we don't have to compute @words ourself each time
+ * this function is called. */
+gboolean
+empathy_individual_match_string (FolksIndividual *individual,
+    const char *text,
+    GPtrArray *words)
+{
+  IndividualSearchKeys *keys;
+  guint i;
+
+  keys = individual_get_search_keys (individual);
+
+  /* check alias name */
+  if (empathy_live_search_match_key (keys->alias_key, words))
+    return TRUE;
+
+  /* check contact id, without the @server.com part */
+  for (i = 0; i < keys->ids->len; i++)
+    {
+      /* Accept the persona if @text is a full prefix of his ID; that allows
+       * user to find, say, a jabber contact by typing his JID. */
+      if (g_str_has_prefix (g_ptr_array_index (keys->ids, i), text))
+        return TRUE;
+
+      if (empathy_live_search_match_key (g_ptr_array_index (keys->id_keys, i),
+            words))
+        return TRUE;
     }
-  g_clear_object (&iter);
 
   /* FIXME: Add more rules here, we could check phone numbers in
    * contact's vCard for example. */
-  return retval;
+  return FALSE;
+}
+
+/* The collation key of an individual's alias, kept on the individual until
+ * its alias changes. */
+typedef struct
+{
+  gchar *alias;
+  gchar *key;
+} IndividualCollateKey;
+
+static void
+individual_collate_key_free (gpointer data)
+{
+  IndividualCollateKey *collate_key = data;
+
+  g_free (collate_key->alias);
+  g_free (collate_key->key);
+
+  g_slice_free (IndividualCollateKey, collate_key);
+}
+
+/* Comparing two of these keys with strcmp() gives the same result as
+ * comparing the aliases with g_utf8_collate(), without having to
+ * normalize and collate them again. */
+const gchar *
+empathy_individual_get_collate_key (FolksIndividual *individual)
+{
+  static GQuark quark = 0;
+  IndividualCollateKey *collate_key;
+  const gchar *alias;
+
+  g_return_val_if_fail (FOLKS_IS_INDIVIDUAL (individual), NULL);
+
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("empathy-individual-collate-key");
+
+  alias = folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual));
+  if (alias == NULL)
+    alias = "";
+
+  collate_key = g_object_get_qdata (G_OBJECT (individual), quark);
+  if (collate_key == NULL)
+    {
+      collate_key = g_slice_new0 (IndividualCollateKey);
+
+      g_object_set_qdata_full (G_OBJECT (individual), quark, collate_key,
+          individual_collate_key_free);
+    }
+  else if (!tp_strdiff (collate_key->alias, alias))
+    {
+      return collate_key->key;
+    }
+
+  g_free (collate_key->alias);
+  g_free (collate_key->key);
+  collate_key->alias = g_strdup (alias);
+  collate_key->key = g_utf8_collate_key (alias, -1);
+
+  return collate_key->key;
+}
+
+/* Sorts individuals by alias, as g_utf8_collate() would */
+gint
+empathy_individual_compare_by_alias (FolksIndividual *a,
+    FolksIndividual *b)
+{
+  return strcmp (empathy_individual_get_collate_key (a),
+      empathy_individual_get_collate_key (b));
 }
 
 void
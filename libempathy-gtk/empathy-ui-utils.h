@@ -69,6 +69,9 @@ GdkPixbuf * empathy_pixbuf_avatar_from_individual_scaled_finish (
     FolksIndividual *individual,
     GAsyncResult *result,
     GError **error);
+GdkPixbuf * empathy_pixbuf_from_avatar_scaled (EmpathyAvatar *avatar,
+    gint width,
+    gint height);
 GdkPixbuf * empathy_pixbuf_avatar_from_contact_scaled (EmpathyContact *contact,
     gint width,
     gint height);
@@ -106,6 +109,15 @@ gboolean empathy_individual_match_string (
     const gchar *text,
     GPtrArray *words);
 
+const gchar * empathy_individual_get_collate_key (
+    FolksIndividual *individual);
+gint empathy_individual_compare_by_alias (FolksIndividual *a,
+    FolksIndividual *b);
+
+gchar * empathy_live_search_strip_key (const gchar *string);
+gboolean empathy_live_search_match_key (const gchar *key,
+    GPtrArray *words);
+
 void empathy_launch_program (const gchar *dir,
     const gchar *name,
     const gchar *args);
@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-backlog-reader.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+/* Reads the backlog of a chat from a TplLogWalker, a page at a time going
+ * back from the most recent events.
+ *
+ * Pages have enough events to fill the view, and get bigger while the user
+ * keeps asking for more of them quickly. Pages can be read ahead with
+ * empathy_backlog_reader_prefetch () while the user reads the previous one,
+ * so they are returned right away once asked for. */
+
+/* Asking for a page again within that delay means the user is scrolling back
+ * fast, so bigger pages are read */
+#define FAST_SCROLL_DELAY (2 * G_USEC_PER_SEC)
+#define MAX_SPEEDUP 8
+
+struct _EmpathyBacklogReaderPriv
+{
+  TplLogWalker *walker;
+
+  guint page_size;
+  guint speedup;
+  gint64 last_request;
+
+  /* owned TplEvent read ahead but not returned yet, from the oldest one to
+   * the most recent one */
+  GQueue *prefetched;
+  gboolean prefetching;
+
+  /* The page being read, NULL if none */
+  GTask *task;
+};
+
+G_DEFINE_TYPE (EmpathyBacklogReader, empathy_backlog_reader, G_TYPE_OBJECT);
+
+static void
+events_free (gpointer events)
+{
+  g_list_free_full (events, g_object_unref);
+}
+
+/* Returns the page being read with the most recent prefetched events */
+static void
+reader_return_page (EmpathyBacklogReader *self)
+{
+  GTask *task = self->priv->task;
+  GList *events = NULL;
+  guint i;
+
+  for (i = 0; i < self->priv->page_size &&
+       !g_queue_is_empty (self->priv->prefetched); i++)
+    events = g_list_prepend (events,
+        g_queue_pop_tail (self->priv->prefetched));
+
+  self->priv->task = NULL;
+  g_task_return_pointer (task, events, events_free);
+  g_object_unref (task);
+}
+
+static void
+reader_got_page_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyBacklogReader *self = user_data;
+  GTask *task = self->priv->task;
+  GList *events;
+  GError *error = NULL;
+
+  self->priv->task = NULL;
+
+  if (!tpl_log_walker_get_events_finish (TPL_LOG_WALKER (source), result,
+        &events, &error))
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, events, events_free);
+
+  g_object_unref (task);
+}
+
+/* Returns the page being read if the events are at hand, or reads them
+ * unless they are being read ahead already */
+static void
+reader_serve_page (EmpathyBacklogReader *self)
+{
+  if (g_queue_is_empty (self->priv->prefetched) && self->priv->prefetching)
+    return;
+
+  if (!g_queue_is_empty (self->priv->prefetched) ||
+      tpl_log_walker_is_end (self->priv->walker))
+    {
+      reader_return_page (self);
+      return;
+    }
+
+  tpl_log_walker_get_events_async (self->priv->walker, self->priv->page_size,
+      reader_got_page_cb, self);
+}
+
+static void
+reader_got_prefetched_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyBacklogReader *self = user_data;
+  GList *events, *l;
+  GError *error = NULL;
+
+  self->priv->prefetching = FALSE;
+
+  if (!tpl_log_walker_get_events_finish (TPL_LOG_WALKER (source), result,
+        &events, &error))
+    {
+      DEBUG ("Failed to read logs ahead: %s", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      /* They are older than the ones already read ahead */
+      for (l = g_list_last (events); l != NULL; l = g_list_previous (l))
+        g_queue_push_head (self->priv->prefetched, l->data);
+
+      g_list_free (events);
+    }
+
+  /* The page was asked for while it was being read ahead */
+  if (self->priv->task != NULL)
+    reader_serve_page (self);
+
+  g_object_unref (self);
+}
+
+static void
+empathy_backlog_reader_finalize (GObject *object)
+{
+  EmpathyBacklogReader *self = EMPATHY_BACKLOG_READER (object);
+
+  /* Pages being read keep a ref on the reader */
+  g_assert (self->priv->task == NULL);
+
+  g_object_unref (self->priv->walker);
+  g_queue_free_full (self->priv->prefetched, g_object_unref);
+
+  G_OBJECT_CLASS (empathy_backlog_reader_parent_class)->finalize (object);
+}
+
+static void
+empathy_backlog_reader_class_init (EmpathyBacklogReaderClass *klass)
+{
+  GObjectClass *oclass = G_OBJECT_CLASS (klass);
+
+  oclass->finalize = empathy_backlog_reader_finalize;
+
+  g_type_class_add_private (klass, sizeof (EmpathyBacklogReaderPriv));
+}
+
+static void
+empathy_backlog_reader_init (EmpathyBacklogReader *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EMPATHY_TYPE_BACKLOG_READER, EmpathyBacklogReaderPriv);
+
+  self->priv->prefetched = g_queue_new ();
+  self->priv->page_size = EMPATHY_BACKLOG_READER_MIN_PAGE_SIZE;
+  self->priv->speedup = 1;
+}
+
+/* Reads the events of @walker, which must not be used by anything else */
+EmpathyBacklogReader *
+empathy_backlog_reader_new (TplLogWalker *walker)
+{
+  EmpathyBacklogReader *self;
+
+  g_return_val_if_fail (TPL_IS_LOG_WALKER (walker), NULL);
+
+  self = g_object_new (EMPATHY_TYPE_BACKLOG_READER, NULL);
+  self->priv->walker = g_object_ref (walker);
+
+  return self;
+}
+
+/* Sets the size of the next pages from @n_visible, the number of messages
+ * fitting in the view, doubling it each time this is called again shortly
+ * after. The size is at least EMPATHY_BACKLOG_READER_MIN_PAGE_SIZE and at
+ * most @max_page_size. */
+guint
+empathy_backlog_reader_update_page_size (EmpathyBacklogReader *self,
+    guint n_visible,
+    guint max_page_size)
+{
+  gint64 now;
+
+  g_return_val_if_fail (EMPATHY_IS_BACKLOG_READER (self), 0);
+
+  now = g_get_monotonic_time ();
+  if (self->priv->last_request != 0 &&
+      now - self->priv->last_request < FAST_SCROLL_DELAY)
+    self->priv->speedup = MIN (self->priv->speedup * 2, MAX_SPEEDUP);
+  else
+    self->priv->speedup = 1;
+  self->priv->last_request = now;
+
+  self->priv->page_size = CLAMP (n_visible * self->priv->speedup,
+      EMPATHY_BACKLOG_READER_MIN_PAGE_SIZE,
+      MAX (max_page_size, EMPATHY_BACKLOG_READER_MIN_PAGE_SIZE));
+
+  return self->priv->page_size;
+}
+
+guint
+empathy_backlog_reader_get_page_size (EmpathyBacklogReader *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_BACKLOG_READER (self), 0);
+
+  return self->priv->page_size;
+}
+
+/* Reads the page of events preceding the ones returned so far */
+void
+empathy_backlog_reader_get_page_async (EmpathyBacklogReader *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  g_return_if_fail (EMPATHY_IS_BACKLOG_READER (self));
+
+  if (self->priv->task != NULL)
+    {
+      g_task_report_new_error (self, callback, user_data,
+          empathy_backlog_reader_get_page_async, G_IO_ERROR,
+          G_IO_ERROR_PENDING, "A page is already being read");
+      return;
+    }
+
+  self->priv->task = g_task_new (self, NULL, callback, user_data);
+  g_task_set_source_tag (self->priv->task,
+      empathy_backlog_reader_get_page_async);
+
+  reader_serve_page (self);
+}
+
+/* @events is set to a list of owned TplEvent in chronological order, empty
+ * if all the events have been returned */
+gboolean
+empathy_backlog_reader_get_page_finish (EmpathyBacklogReader *self,
+    GAsyncResult *result,
+    GList **events,
+    GError **error)
+{
+  GError *err = NULL;
+  GList *page;
+
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+  page = g_task_propagate_pointer (G_TASK (result), &err);
+
+  if (err != NULL)
+    {
+      g_propagate_error (error, err);
+      return FALSE;
+    }
+
+  if (events != NULL)
+    *events = page;
+  else
+    events_free (page);
+
+  return TRUE;
+}
+
+/* Reads events ahead until @n_pages pages of the current size are at hand.
+ * This does nothing while a page or events ahead are being read. */
+void
+empathy_backlog_reader_prefetch (EmpathyBacklogReader *self,
+    guint n_pages)
+{
+  guint wanted, n_prefetched;
+
+  g_return_if_fail (EMPATHY_IS_BACKLOG_READER (self));
+
+  if (self->priv->task != NULL || self->priv->prefetching ||
+      tpl_log_walker_is_end (self->priv->walker))
+    return;
+
+  wanted = n_pages * self->priv->page_size;
+  n_prefetched = g_queue_get_length (self->priv->prefetched);
+
+  if (n_prefetched >= wanted)
+    return;
+
+  self->priv->prefetching = TRUE;
+
+  tpl_log_walker_get_events_async (self->priv->walker, wanted - n_prefetched,
+      reader_got_prefetched_cb, g_object_ref (self));
+}
+
+/* Whether some events have not been returned yet, either because the walker
+ * did not return them yet or because they have been read ahead */
+gboolean
+empathy_backlog_reader_has_more (EmpathyBacklogReader *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_BACKLOG_READER (self), FALSE);
+
+  return !tpl_log_walker_is_end (self->priv->walker) ||
+      empathy_backlog_reader_has_prefetched (self);
+}
+
+/* Whether events have been or are being read ahead, so the next page will be
+ * returned without waiting for the walker or as soon as they are read */
+gboolean
+empathy_backlog_reader_has_prefetched (EmpathyBacklogReader *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_BACKLOG_READER (self), FALSE);
+
+  return !g_queue_is_empty (self->priv->prefetched) ||
+      self->priv->prefetching;
+}
+
+/* Number of events read ahead and not returned yet */
+guint
+empathy_backlog_reader_get_n_prefetched (EmpathyBacklogReader *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_BACKLOG_READER (self), 0);
+
+  return g_queue_get_length (self->priv->prefetched);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_BACKLOG_READER_H__
+#define __EMPATHY_BACKLOG_READER_H__
+
+#include <telepathy-logger/telepathy-logger.h>
+
+G_BEGIN_DECLS
+
+#define EMPATHY_BACKLOG_READER_MIN_PAGE_SIZE 5
+
+#define EMPATHY_TYPE_BACKLOG_READER         (empathy_backlog_reader_get_type ())
+#define EMPATHY_BACKLOG_READER(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), EMPATHY_TYPE_BACKLOG_READER, EmpathyBacklogReader))
+#define EMPATHY_BACKLOG_READER_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), EMPATHY_TYPE_BACKLOG_READER, EmpathyBacklogReaderClass))
+#define EMPATHY_IS_BACKLOG_READER(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), EMPATHY_TYPE_BACKLOG_READER))
+#define EMPATHY_IS_BACKLOG_READER_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), EMPATHY_TYPE_BACKLOG_READER))
+#define EMPATHY_BACKLOG_READER_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), EMPATHY_TYPE_BACKLOG_READER, EmpathyBacklogReaderClass))
+
+typedef struct _EmpathyBacklogReader      EmpathyBacklogReader;
+typedef struct _EmpathyBacklogReaderClass EmpathyBacklogReaderClass;
+typedef struct _EmpathyBacklogReaderPriv  EmpathyBacklogReaderPriv;
+
+struct _EmpathyBacklogReader
+{
+  GObject parent;
+  EmpathyBacklogReaderPriv *priv;
+};
+
+struct _EmpathyBacklogReaderClass
+{
+  GObjectClass parent_class;
+};
+
+GType empathy_backlog_reader_get_type (void) G_GNUC_CONST;
+
+EmpathyBacklogReader * empathy_backlog_reader_new (TplLogWalker *walker);
+
+guint empathy_backlog_reader_update_page_size (EmpathyBacklogReader *self,
+    guint n_visible,
+    guint max_page_size);
+guint empathy_backlog_reader_get_page_size (EmpathyBacklogReader *self);
+
+void empathy_backlog_reader_get_page_async (EmpathyBacklogReader *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+gboolean empathy_backlog_reader_get_page_finish (EmpathyBacklogReader *self,
+    GAsyncResult *result,
+    GList **events,
+    GError **error);
+
+void empathy_backlog_reader_prefetch (EmpathyBacklogReader *self,
+    guint n_pages);
+
+gboolean empathy_backlog_reader_has_more (EmpathyBacklogReader *self);
+gboolean empathy_backlog_reader_has_prefetched (EmpathyBacklogReader *self);
+guint empathy_backlog_reader_get_n_prefetched (EmpathyBacklogReader *self);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_BACKLOG_READER_H__ */
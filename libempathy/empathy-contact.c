@@ -44,6 +44,10 @@ typedef struct {
   gchar *alias;
   gchar *logged_alias;
   EmpathyAvatar *avatar;
+  /* Path of the avatar file being read, if any */
+  gchar *avatar_load_path;
+  /* Whether "has-log" will be notified once the logs are listed */
+  gboolean has_log_pending;
   TpConnectionPresenceType presence;
   guint handle;
   EmpathyCapabilities capabilities;
@@ -82,8 +86,9 @@ static void set_capabilities_from_tp_caps (EmpathyContact *self,
 static void contact_set_avatar (EmpathyContact *contact,
     EmpathyAvatar *avatar);
 static void contact_set_avatar_from_tp_contact (EmpathyContact *contact);
-static gboolean contact_load_avatar_cache (EmpathyContact *contact,
+static void contact_load_avatar_cache (EmpathyContact *contact,
     const gchar *token);
+static gboolean contact_has_log (EmpathyContact *contact);
 
 G_DEFINE_TYPE (EmpathyContact, empathy_contact, G_TYPE_OBJECT);
 
@@ -103,7 +108,8 @@ enum
   PROP_CAPABILITIES,
   PROP_IS_USER,
   PROP_LOCATION,
-  PROP_CLIENT_TYPES
+  PROP_CLIENT_TYPES,
+  PROP_HAS_LOG
 };
 
 enum {
@@ -116,6 +122,14 @@ static guint signals[LAST_SIGNAL];
 /* TpContact* -> EmpathyContact*, both borrowed ref */
 static GHashTable *contacts_table = NULL;
 
+/* "account path\nidentifier" (owned) -> EmpathyContact* (borrowed), indexing
+ * the contacts of contacts_table by the TplEntity they would match */
+static GHashTable *contacts_by_entity = NULL;
+
+/* "account path\nidentifier" -> TplContactCacheEntry*, the contact last built
+ * for a TplEntity with this identifier */
+static GHashTable *tpl_contacts_table = NULL;
+
 static void
 tp_contact_notify_cb (TpContact *tp_contact,
                       GParamSpec *param,
@@ -381,6 +395,14 @@ empathy_contact_class_init (EmpathyContactClass *class)
         G_TYPE_STRV,
         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class,
+      PROP_HAS_LOG,
+      g_param_spec_boolean ("has-log",
+        "Contact has logs",
+        "Whether there are logs with the contact, assumed until known",
+        TRUE,
+        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   signals[PRESENCE_CHANGED] =
     g_signal_new ("presence-changed",
                   G_TYPE_FROM_CLASS (class),
@@ -421,6 +443,7 @@ contact_finalize (GObject *object)
   g_free (priv->alias);
   g_free (priv->logged_alias);
   g_free (priv->id);
+  g_free (priv->avatar_load_path);
   g_strfreev (priv->client_types);
 
   G_OBJECT_CLASS (empathy_contact_parent_class)->finalize (object);
@@ -573,6 +596,9 @@ contact_get_property (GObject *object,
       case PROP_IS_USER:
         g_value_set_boolean (value, empathy_contact_is_user (contact));
         break;
+      case PROP_HAS_LOG:
+        g_value_set_boolean (value, contact_has_log (contact));
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
         break;
@@ -638,6 +664,48 @@ remove_tp_contact (gpointer data,
   g_hash_table_remove (contacts_table, data);
 }
 
+static gchar *
+dup_entity_key (TpAccount *account,
+    const gchar *id)
+{
+  return g_strdup_printf ("%s\n%s", tp_proxy_get_object_path (account), id);
+}
+
+static void
+remove_contact_by_entity (gpointer data,
+    GObject *object)
+{
+  gchar *key = data;
+
+  /* Another contact may have replaced this one, e.g. after a reconnection */
+  if (g_hash_table_lookup (contacts_by_entity, key) == object)
+    g_hash_table_remove (contacts_by_entity, key);
+
+  g_free (key);
+}
+
+static void
+add_contact_by_entity (EmpathyContact *contact,
+    TpContact *tp_contact)
+{
+  TpAccount *account;
+
+  account = tp_connection_get_account (tp_contact_get_connection (tp_contact));
+  if (account == NULL)
+    return;
+
+  if (contacts_by_entity == NULL)
+    contacts_by_entity = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, NULL);
+
+  g_hash_table_insert (contacts_by_entity,
+      dup_entity_key (account, tp_contact_get_identifier (tp_contact)),
+      contact);
+
+  g_object_weak_ref (G_OBJECT (contact), remove_contact_by_entity,
+      dup_entity_key (account, tp_contact_get_identifier (tp_contact)));
+}
+
 static EmpathyContact *
 empathy_contact_new (TpContact *tp_contact)
 {
@@ -656,26 +724,93 @@ empathy_contact_new (TpContact *tp_contact)
 
 typedef struct
 {
-  TplEntity *entity;
-  TpAccount *account;
-} FindContactData;
+  gchar *key;
+  /* borrowed, NULL once finalized */
+  EmpathyContact *contact;
+  gchar *alias;
+  gchar *avatar_token;
+  TplEntityType type;
+} TplContactCacheEntry;
 
-static gboolean
-contact_is_tpl_entity (gpointer key,
-    gpointer value,
-    gpointer user_data)
+static void
+tpl_contact_finalized_cb (gpointer data,
+    GObject *object)
 {
-  EmpathyContact *contact = value;
-  FindContactData *data = user_data;
-  TpAccount *account = empathy_contact_get_account (contact);
-  const gchar *path = NULL;
+  TplContactCacheEntry *entry = data;
 
-  if (account != NULL)
-    path = tp_proxy_get_object_path (account);
+  entry->contact = NULL;
+  g_hash_table_remove (tpl_contacts_table, entry->key);
+}
+
+static void
+tpl_contact_cache_entry_free (gpointer data)
+{
+  TplContactCacheEntry *entry = data;
+
+  if (entry->contact != NULL)
+    g_object_weak_unref (G_OBJECT (entry->contact), tpl_contact_finalized_cb,
+        entry);
+
+  g_free (entry->key);
+  g_free (entry->alias);
+  g_free (entry->avatar_token);
+
+  g_slice_free (TplContactCacheEntry, entry);
+}
 
-  return !tp_strdiff (empathy_contact_get_id (contact),
-              tpl_entity_get_identifier (data->entity)) &&
-         !tp_strdiff (tp_proxy_get_object_path (data->account), path);
+/* Returns a new ref on the contact last built for @tpl_entity, if it is still
+ * alive and nothing changed since then. */
+static EmpathyContact *
+dup_cached_tpl_contact (const gchar *key,
+    TplEntity *tpl_entity)
+{
+  TplContactCacheEntry *entry;
+
+  if (tpl_contacts_table == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (tpl_contacts_table, key);
+  if (entry == NULL)
+    return NULL;
+
+  if (entry->type != tpl_entity_get_entity_type (tpl_entity) ||
+      tp_strdiff (entry->alias, tpl_entity_get_alias (tpl_entity)) ||
+      tp_strdiff (entry->avatar_token,
+        tpl_entity_get_avatar_token (tpl_entity)))
+    return NULL;
+
+  /* We may know the TpContact of this entity now */
+  if (empathy_contact_get_tp_contact (entry->contact) == NULL &&
+      contacts_by_entity != NULL &&
+      g_hash_table_contains (contacts_by_entity, key))
+    return NULL;
+
+  return g_object_ref (entry->contact);
+}
+
+static void
+cache_tpl_contact (gchar *key,
+    TplEntity *tpl_entity,
+    EmpathyContact *contact)
+{
+  TplContactCacheEntry *entry;
+
+  if (tpl_contacts_table == NULL)
+    tpl_contacts_table = g_hash_table_new_full (g_str_hash, g_str_equal,
+        NULL, tpl_contact_cache_entry_free);
+
+  entry = g_slice_new0 (TplContactCacheEntry);
+  entry->key = key;
+  entry->contact = contact;
+  entry->alias = g_strdup (tpl_entity_get_alias (tpl_entity));
+  entry->avatar_token = g_strdup (tpl_entity_get_avatar_token (tpl_entity));
+  entry->type = tpl_entity_get_entity_type (tpl_entity);
+
+  g_object_weak_ref (G_OBJECT (contact), tpl_contact_finalized_cb, entry);
+
+  /* Replaces the entry of the previous contact, if any. The key belongs to
+   * the entry, so it has to be replaced as well. */
+  g_hash_table_replace (tpl_contacts_table, entry->key, entry);
 }
 
 static void
@@ -718,20 +853,25 @@ empathy_contact_from_tpl_contact (TpAccount *account,
   EmpathyContact *retval;
   gboolean is_user;
   EmpathyContact *existing_contact = NULL;
+  gchar *key;
 
+  g_return_val_if_fail (TP_IS_ACCOUNT (account), NULL);
   g_return_val_if_fail (TPL_IS_ENTITY (tpl_entity), NULL);
 
-  if (contacts_table != NULL)
-    {
-      FindContactData data;
-
-      data.entity = tpl_entity;
-      data.account = account;
+  key = dup_entity_key (account, tpl_entity_get_identifier (tpl_entity));
 
-      existing_contact = g_hash_table_find (contacts_table,
-        contact_is_tpl_entity, &data);
+  /* Log pages and search results contain many events from the same few
+   * entities, build a single contact for all of them. */
+  retval = dup_cached_tpl_contact (key, tpl_entity);
+  if (retval != NULL)
+    {
+      g_free (key);
+      return retval;
     }
 
+  if (contacts_by_entity != NULL)
+    existing_contact = g_hash_table_lookup (contacts_by_entity, key);
+
   if (existing_contact != NULL)
     {
       retval = g_object_new (EMPATHY_TYPE_CONTACT,
@@ -774,6 +914,8 @@ empathy_contact_from_tpl_contact (TpAccount *account,
     contact_load_avatar_cache (retval,
         tpl_entity_get_avatar_token (tpl_entity));
 
+  cache_tpl_contact (key, tpl_entity, retval);
+
   return retval;
 }
 
@@ -934,6 +1076,23 @@ empathy_contact_get_avatar (EmpathyContact *contact)
   return priv->avatar;
 }
 
+/* Returns the path of the avatar file of @contact, or %NULL until the file
+ * has been read; #EmpathyContact:avatar is notified once it is known */
+const gchar *
+empathy_contact_get_avatar_filename (EmpathyContact *contact)
+{
+  EmpathyContactPriv *priv;
+
+  g_return_val_if_fail (EMPATHY_IS_CONTACT (contact), NULL);
+
+  priv = GET_PRIV (contact);
+
+  if (priv->avatar != NULL)
+    return priv->avatar->filename;
+
+  return NULL;
+}
+
 static void
 contact_set_avatar (EmpathyContact *contact,
                     EmpathyAvatar *avatar)
@@ -1267,24 +1426,454 @@ empathy_contact_can_use_rfb_stream_tube (EmpathyContact *contact)
   return priv->capabilities & EMPATHY_CAPABILITIES_RFB_STREAM_TUBE;
 }
 
+/* Which entities of an account have logs. Listing them reads the file system,
+ * so it's done asynchronously, once per account, and the list is then kept up
+ * to date with the events the logger records. */
+typedef struct
+{
+  TpAccount *account;
+
+  /* Identifiers of the entities having logs, or NULL until they are listed */
+  GHashTable *ids;
+
+  /* Whether the entities are being listed, in which case the AccountLogs
+   * can't be freed */
+  gboolean running;
+  /* Whether the logs changed since the entities started being listed */
+  gboolean stale;
+  /* owned GTask waiting for the list, whose source object is the contact
+   * they ask about */
+  GList *tasks;
+  /* TpWeakRef<EmpathyContact> to notify of "has-log" once the list is known */
+  GList *contacts;
+} AccountLogs;
+
+/* Object path of the account -> owned AccountLogs */
+static GHashTable *account_logs = NULL;
+
+/* While some logs are listed, observes the channels whose events the logger
+ * records so the lists stay up to date */
+static TpBaseClient *log_observer = NULL;
+/* owned TpChannel being observed -> itself */
+static GHashTable *log_observed_channels = NULL;
+
+static void
+account_logs_free (gpointer data)
+{
+  AccountLogs *logs = data;
+
+  g_object_unref (logs->account);
+  tp_clear_pointer (&logs->ids, g_hash_table_unref);
+  g_list_free_full (logs->contacts, (GDestroyNotify) tp_weak_ref_destroy);
+
+  g_slice_free (AccountLogs, logs);
+}
+
+/* Returns TRUE if @logs can be forgotten, otherwise the entities will be
+ * listed again once the current listing is done */
 static gboolean
-contact_has_log (EmpathyContact *contact)
+account_logs_invalidate (AccountLogs *logs)
+{
+  if (!logs->running)
+    return TRUE;
+
+  logs->stale = TRUE;
+  return FALSE;
+}
+
+static void account_logs_start (AccountLogs *logs,
+    gchar *key);
+
+static void
+account_logs_done_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  gchar *key = user_data;
+  AccountLogs *logs = g_hash_table_lookup (account_logs, key);
+  GList *entities = NULL, *tasks, *contacts, *l;
+  GHashTable *ids;
+  GError *error = NULL;
+
+  logs->running = FALSE;
+
+  if (!tpl_log_manager_get_entities_finish (TPL_LOG_MANAGER (source), result,
+        &entities, &error))
+    {
+      DEBUG ("Failed to list the entities having logs with %s: %s", key,
+          error->message);
+      g_error_free (error);
+    }
+
+  if (logs->stale)
+    {
+      logs->stale = FALSE;
+      g_list_free_full (entities, g_object_unref);
+      account_logs_start (logs, key);
+      return;
+    }
+
+  logs->ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (l = entities; l != NULL; l = g_list_next (l))
+    g_hash_table_add (logs->ids,
+        g_strdup (tpl_entity_get_identifier (l->data)));
+
+  DEBUG ("%u entities have logs with %s", g_hash_table_size (logs->ids), key);
+
+  /* Callbacks may invalidate the logs, freeing them */
+  ids = g_hash_table_ref (logs->ids);
+  tasks = logs->tasks;
+  logs->tasks = NULL;
+  contacts = logs->contacts;
+  logs->contacts = NULL;
+
+  for (l = tasks; l != NULL; l = g_list_next (l))
+    {
+      EmpathyContact *contact = g_task_get_source_object (l->data);
+
+      g_task_return_boolean (l->data,
+          g_hash_table_contains (ids, empathy_contact_get_id (contact)));
+    }
+
+  for (l = contacts; l != NULL; l = g_list_next (l))
+    {
+      EmpathyContact *contact = tp_weak_ref_dup_object (l->data);
+
+      if (contact != NULL)
+        {
+          GET_PRIV (contact)->has_log_pending = FALSE;
+          g_object_notify (G_OBJECT (contact), "has-log");
+          g_object_unref (contact);
+        }
+
+      tp_weak_ref_destroy (l->data);
+    }
+
+  g_hash_table_unref (ids);
+  g_list_free_full (tasks, g_object_unref);
+  g_list_free (contacts);
+  g_list_free_full (entities, g_object_unref);
+  g_free (key);
+}
+
+/* Takes ownership of @key */
+static void
+account_logs_start (AccountLogs *logs,
+    gchar *key)
 {
   TplLogManager *manager;
-  TplEntity *entity;
-  gboolean have_log;
 
+  /* The AccountLogs is not freed while running */
+  logs->running = TRUE;
+
+  /* The log manager isn't thread-safe, so it's only used from the main
+   * thread */
   manager = tpl_log_manager_dup_singleton ();
-  entity = tpl_entity_new (empathy_contact_get_id (contact),
-      TPL_ENTITY_CONTACT, NULL, NULL);
+  tpl_log_manager_get_entities_async (manager, logs->account,
+      account_logs_done_cb, key);
+  g_object_unref (manager);
+}
 
-  have_log = tpl_log_manager_exists (manager,
-      empathy_contact_get_account (contact), entity, TPL_EVENT_MASK_TEXT);
+/* The logger recorded an event of @channel */
+static void
+log_observer_channel_logged (TpChannel *channel)
+{
+  TpAccount *account;
+  AccountLogs *logs;
 
-  g_object_unref (entity);
-  g_object_unref (manager);
+  account = tp_connection_get_account (tp_channel_get_connection (channel));
+  if (account == NULL)
+    return;
+
+  logs = g_hash_table_lookup (account_logs,
+      tp_proxy_get_object_path (account));
+  if (logs == NULL)
+    return;
+
+  if (logs->running)
+    logs->stale = TRUE;
+  else
+    g_hash_table_add (logs->ids,
+        g_strdup (tp_channel_get_identifier (channel)));
+}
+
+static void
+log_observer_message_received_cb (TpTextChannel *channel,
+    TpSignalledMessage *message,
+    gpointer user_data)
+{
+  log_observer_channel_logged (TP_CHANNEL (channel));
+}
+
+static void
+log_observer_message_sent_cb (TpTextChannel *channel,
+    TpSignalledMessage *message,
+    guint flags,
+    gchar *token,
+    gpointer user_data)
+{
+  log_observer_channel_logged (TP_CHANNEL (channel));
+}
+
+static void
+log_observer_invalidated_cb (TpChannel *channel,
+    guint domain,
+    gint code,
+    gchar *message,
+    gpointer user_data)
+{
+  /* Calls are logged once they have ended */
+  if (!TP_IS_TEXT_CHANNEL (channel))
+    log_observer_channel_logged (channel);
+
+  g_hash_table_remove (log_observed_channels, channel);
+}
+
+static void
+log_observed_channel_free (gpointer data)
+{
+  TpChannel *channel = data;
+
+  g_signal_handlers_disconnect_by_func (channel,
+      log_observer_message_received_cb, NULL);
+  g_signal_handlers_disconnect_by_func (channel,
+      log_observer_message_sent_cb, NULL);
+  g_signal_handlers_disconnect_by_func (channel,
+      log_observer_invalidated_cb, NULL);
+
+  g_object_unref (channel);
+}
+
+static void
+log_observer_observe_channels_cb (TpSimpleObserver *observer,
+    TpAccount *account,
+    TpConnection *connection,
+    GList *channels,
+    TpChannelDispatchOperation *dispatch_operation,
+    GList *requests,
+    TpObserveChannelsContext *context,
+    gpointer user_data)
+{
+  GList *l;
+
+  for (l = channels; l != NULL; l = g_list_next (l))
+    {
+      TpChannel *channel = l->data;
+
+      if (tp_proxy_get_invalidated (channel) != NULL ||
+          g_hash_table_contains (log_observed_channels, channel))
+        continue;
+
+      if (TP_IS_TEXT_CHANNEL (channel))
+        {
+          g_signal_connect (channel, "message-received",
+              G_CALLBACK (log_observer_message_received_cb), NULL);
+          g_signal_connect (channel, "message-sent",
+              G_CALLBACK (log_observer_message_sent_cb), NULL);
+        }
+
+      g_signal_connect (channel, "invalidated",
+          G_CALLBACK (log_observer_invalidated_cb), NULL);
+
+      g_hash_table_add (log_observed_channels, g_object_ref (channel));
+    }
+
+  tp_observe_channels_context_accept (context);
+}
+
+static void
+log_observer_start (void)
+{
+  TpAccountManager *am;
+
+  am = tp_account_manager_dup ();
+
+  /* Recover the channels opened before we started observing, as their
+   * events are logged as well */
+  log_observer = tp_simple_observer_new_with_am (am, TRUE,
+      "Empathy.LogChecks", TRUE, log_observer_observe_channels_cb,
+      NULL, NULL);
+  log_observed_channels = g_hash_table_new_full (NULL, NULL,
+      log_observed_channel_free, NULL);
+
+  tp_base_client_take_observer_filter (log_observer,
+      tp_asv_new (
+          TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+            TP_IFACE_CHANNEL_TYPE_TEXT,
+          NULL));
+  tp_base_client_take_observer_filter (log_observer,
+      tp_asv_new (
+          TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+            TP_IFACE_CHANNEL_TYPE_CALL,
+          NULL));
+
+  tp_base_client_register (log_observer, NULL);
+
+  g_object_unref (am);
+}
+
+static void
+log_observer_stop (void)
+{
+  tp_base_client_unregister (log_observer);
+  tp_clear_object (&log_observer);
+  tp_clear_pointer (&log_observed_channels, g_hash_table_unref);
+}
+
+/* Returns the AccountLogs of the account of @contact, starting to list them
+ * if they haven't been already. Only the processes looking logs up observe
+ * channels, and only until the lists are forgotten. */
+static AccountLogs *
+contact_ensure_account_logs (EmpathyContact *contact)
+{
+  TpAccount *account = empathy_contact_get_account (contact);
+  const gchar *path = tp_proxy_get_object_path (account);
+  AccountLogs *logs;
+
+  if (account_logs == NULL)
+    {
+      account_logs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+          account_logs_free);
+      log_observer_start ();
+    }
+
+  logs = g_hash_table_lookup (account_logs, path);
+  if (logs != NULL)
+    return logs;
+
+  logs = g_slice_new0 (AccountLogs);
+  logs->account = g_object_ref (account);
+
+  g_hash_table_insert (account_logs, g_strdup (path), logs);
+  account_logs_start (logs, g_strdup (path));
+
+  return logs;
+}
+
+static gboolean
+contact_has_log (EmpathyContact *contact)
+{
+  EmpathyContactPriv *priv = GET_PRIV (contact);
+  AccountLogs *logs;
+
+  if (empathy_contact_get_account (contact) == NULL)
+    return FALSE;
+
+  logs = contact_ensure_account_logs (contact);
+
+  if (logs->ids != NULL)
+    return g_hash_table_contains (logs->ids, empathy_contact_get_id (contact));
+
+  /* Until we know, assume there are some; "has-log" is notified once the
+   * answer is known. Callers that can't offer a wrong answer use
+   * empathy_contact_has_log_async (). */
+  if (!priv->has_log_pending)
+    {
+      priv->has_log_pending = TRUE;
+      logs->contacts = g_list_prepend (logs->contacts,
+          tp_weak_ref_new (contact, NULL, NULL));
+    }
+
+  return TRUE;
+}
+
+/**
+ * empathy_contact_has_log_async:
+ * @contact: an #EmpathyContact
+ * @callback: called once whether there are logs with @contact is known
+ * @user_data: data to pass to @callback
+ *
+ * Finds out whether there are logs of conversations with @contact, without
+ * blocking. The entities having logs are listed once per account, and the
+ * list is kept up to date with the events the logger records.
+ */
+void
+empathy_contact_has_log_async (EmpathyContact *contact,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  AccountLogs *logs;
+  GTask *task;
+
+  g_return_if_fail (EMPATHY_IS_CONTACT (contact));
+
+  task = g_task_new (contact, NULL, callback, user_data);
+
+  if (empathy_contact_get_account (contact) == NULL)
+    {
+      g_task_return_boolean (task, FALSE);
+      g_object_unref (task);
+      return;
+    }
+
+  logs = contact_ensure_account_logs (contact);
 
-  return have_log;
+  if (logs->ids != NULL)
+    {
+      g_task_return_boolean (task, g_hash_table_contains (logs->ids,
+            empathy_contact_get_id (contact)));
+      g_object_unref (task);
+      return;
+    }
+
+  logs->tasks = g_list_prepend (logs->tasks, task);
+}
+
+gboolean
+empathy_contact_has_log_finish (EmpathyContact *contact,
+    GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, contact), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * empathy_contact_invalidate_has_log:
+ * @account: (allow-none): a #TpAccount
+ * @id: (allow-none): the identifier of a contact of @account
+ *
+ * Forgets whether there are logs with the contact @id of @account, as
+ * returned by empathy_contact_has_log_async (). As the entities having logs
+ * are listed per account, this forgets about every contact of @account. If
+ * @account is %NULL, forgets about every contact.
+ */
+void
+empathy_contact_invalidate_has_log (TpAccount *account,
+    const gchar *id)
+{
+  if (account_logs == NULL)
+    return;
+
+  if (account != NULL)
+    {
+      const gchar *path = tp_proxy_get_object_path (account);
+      AccountLogs *logs = g_hash_table_lookup (account_logs, path);
+
+      if (logs != NULL && account_logs_invalidate (logs))
+        g_hash_table_remove (account_logs, path);
+    }
+  else
+    {
+      GHashTableIter iter;
+      gpointer value;
+
+      g_hash_table_iter_init (&iter, account_logs);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          if (account_logs_invalidate (value))
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+
+  /* Nothing needs to be kept up to date anymore */
+  if (g_hash_table_size (account_logs) == 0)
+    {
+      tp_clear_pointer (&account_logs, g_hash_table_unref);
+      log_observer_stop ();
+    }
 }
 
 gboolean
@@ -1327,6 +1916,8 @@ static gchar *
 contact_get_avatar_filename (EmpathyContact *contact,
                              const gchar *token)
 {
+  /* Directories we already created, no need to hit the disk again */
+  static GHashTable *avatar_dirs = NULL;
   TpAccount *account;
   gchar *avatar_path;
   gchar *avatar_file;
@@ -1344,7 +1935,16 @@ contact_get_avatar_filename (EmpathyContact *contact,
       tp_account_get_cm_name (account),
       tp_account_get_protocol_name (account),
       NULL);
-  g_mkdir_with_parents (avatar_path, 0700);
+
+  if (avatar_dirs == NULL)
+    avatar_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        NULL);
+
+  if (!g_hash_table_contains (avatar_dirs, avatar_path))
+    {
+      g_mkdir_with_parents (avatar_path, 0700);
+      g_hash_table_add (avatar_dirs, g_strdup (avatar_path));
+    }
 
   avatar_file = g_build_filename (avatar_path, token_escaped, NULL);
 
@@ -1354,43 +1954,141 @@ contact_get_avatar_filename (EmpathyContact *contact,
   return avatar_file;
 }
 
-static gboolean
-contact_load_avatar_cache (EmpathyContact *contact,
-                           const gchar *token)
+/* Avatar files being read: path -> AvatarLoad */
+static GHashTable *avatar_loads = NULL;
+
+typedef struct
 {
+  gchar *path;
+  gchar *token;
+  gchar *mime;
+  /* TpWeakRef<EmpathyContact> waiting for this file */
+  GSList *contacts;
+} AvatarLoad;
+
+static void
+avatar_file_loaded_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  AvatarLoad *load = user_data;
   EmpathyAvatar *avatar = NULL;
-  gchar *filename;
-  gchar *data = NULL;
+  gchar *data;
   gsize len;
+  gboolean missing = FALSE;
+  GSList *l;
   GError *error = NULL;
 
-  g_return_val_if_fail (EMPATHY_IS_CONTACT (contact), FALSE);
-  g_return_val_if_fail (!TPAW_STR_EMPTY (token), FALSE);
+  if (!g_file_load_contents_finish (G_FILE (source), result, &data, &len,
+        NULL, &error))
+    {
+      /* The avatar of this token hasn't been cached */
+      missing = g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
 
-  /* Load the avatar from file if it exists */
-  filename = contact_get_avatar_filename (contact, token);
-  if (filename && g_file_test (filename, G_FILE_TEST_EXISTS))
+      DEBUG ("Failed to load avatar from %s: %s", load->path, error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      DEBUG ("Avatar loaded from %s", load->path);
+      avatar = empathy_avatar_new ((guchar *) data, len, load->mime,
+          load->path);
+      avatar->token = g_strdup (load->token);
+      g_free (data);
+    }
+
+  g_hash_table_remove (avatar_loads, load->path);
+
+  /* All the contacts which requested this file share the same avatar */
+  for (l = load->contacts; l != NULL; l = g_slist_next (l))
     {
-      if (!g_file_get_contents (filename, &data, &len, &error))
+      EmpathyContact *contact = tp_weak_ref_dup_object (l->data);
+
+      if (contact != NULL)
         {
-          DEBUG ("Failed to load avatar from cache: %s",
-            error ? error->message : "No error given");
-          g_clear_error (&error);
+          EmpathyContactPriv *priv = GET_PRIV (contact);
+
+          /* Ignore files the contact doesn't care about anymore */
+          if (!tp_strdiff (priv->avatar_load_path, load->path))
+            {
+              g_free (priv->avatar_load_path);
+              priv->avatar_load_path = NULL;
+
+              if (!missing)
+                contact_set_avatar (contact, avatar);
+            }
+
+          g_object_unref (contact);
         }
+
+      tp_weak_ref_destroy (l->data);
     }
 
-  if (data != NULL)
+  if (avatar != NULL)
+    empathy_avatar_unref (avatar);
+
+  g_slist_free (load->contacts);
+  g_free (load->path);
+  g_free (load->token);
+  g_free (load->mime);
+  g_slice_free (AvatarLoad, load);
+}
+
+/* Asynchronously set the avatar of @contact from the file at @path. Contacts
+ * requesting the same file while it is being read share a single read. */
+static void
+contact_load_avatar_file (EmpathyContact *contact,
+    const gchar *path,
+    const gchar *token,
+    const gchar *mime)
+{
+  EmpathyContactPriv *priv = GET_PRIV (contact);
+  AvatarLoad *load = NULL;
+
+  g_free (priv->avatar_load_path);
+  priv->avatar_load_path = g_strdup (path);
+
+  if (avatar_loads == NULL)
+    avatar_loads = g_hash_table_new (g_str_hash, g_str_equal);
+  else
+    load = g_hash_table_lookup (avatar_loads, path);
+
+  if (load == NULL)
     {
-      DEBUG ("Avatar loaded from %s", filename);
-      avatar = empathy_avatar_new ((guchar *) data, len, NULL, filename);
-      contact_set_avatar (contact, avatar);
-      empathy_avatar_unref (avatar);
+      GFile *file;
+
+      load = g_slice_new0 (AvatarLoad);
+      load->path = g_strdup (path);
+      load->token = g_strdup (token);
+      load->mime = g_strdup (mime);
+
+      g_hash_table_insert (avatar_loads, load->path, load);
+
+      file = g_file_new_for_path (path);
+      g_file_load_contents_async (file, NULL, avatar_file_loaded_cb, load);
+      g_object_unref (file);
     }
 
-  g_free (data);
-  g_free (filename);
+  load->contacts = g_slist_prepend (load->contacts,
+      tp_weak_ref_new (contact, NULL, NULL));
+}
+
+static void
+contact_load_avatar_cache (EmpathyContact *contact,
+                           const gchar *token)
+{
+  gchar *filename;
 
-  return data != NULL;
+  g_return_if_fail (EMPATHY_IS_CONTACT (contact));
+  g_return_if_fail (!TPAW_STR_EMPTY (token));
+
+  /* Load the avatar from file if it exists; a missing file just fails to
+   * be read */
+  filename = contact_get_avatar_filename (contact, token);
+  if (filename != NULL)
+    contact_load_avatar_file (contact, filename, token, NULL);
+
+  g_free (filename);
 }
 
 GType
@@ -1447,6 +2145,7 @@ empathy_avatar_unref (EmpathyAvatar *avatar)
     {
       g_free (avatar->data);
       g_free (avatar->format);
+      g_free (avatar->token);
       g_free (avatar->filename);
       g_slice_free (EmpathyAvatar, avatar);
     }
@@ -1733,42 +2432,28 @@ static void
 contact_set_avatar_from_tp_contact (EmpathyContact *contact)
 {
   EmpathyContactPriv *priv = GET_PRIV (contact);
-  const gchar *mime;
   GFile *file;
+  gchar *path = NULL;
 
-  mime = tp_contact_get_avatar_mime_type (priv->tp_contact);
   file = tp_contact_get_avatar_file (priv->tp_contact);
-
   if (file != NULL)
-    {
-      EmpathyAvatar *avatar;
-      gchar *data;
-      gsize len;
-      gchar *path;
-      GError *error = NULL;
+    path = g_file_get_path (file);
 
-      if (!g_file_load_contents (file, NULL, &data, &len, NULL, &error))
-        {
-          DEBUG ("Failed to load avatar: %s", error->message);
-
-          g_error_free (error);
-          contact_set_avatar (contact, NULL);
-          return;
-        }
-
-      path = g_file_get_path (file);
-
-      avatar = empathy_avatar_new ((guchar *) data, len, mime, path);
-
-      contact_set_avatar (contact, avatar);
-      empathy_avatar_unref (avatar);
-      g_free (path);
-      g_free (data);
+  if (path != NULL)
+    {
+      contact_load_avatar_file (contact, path,
+          tp_contact_get_avatar_token (priv->tp_contact),
+          tp_contact_get_avatar_mime_type (priv->tp_contact));
     }
   else
     {
+      g_free (priv->avatar_load_path);
+      priv->avatar_load_path = NULL;
+
       contact_set_avatar (contact, NULL);
     }
+
+  g_free (path);
 }
 
 EmpathyContact *
@@ -1791,6 +2476,7 @@ empathy_contact_dup_from_tp_contact (TpContact *tp_contact)
        * contact keeps a ref to tp_contact, and is removed from the table in
        * contact_dispose() */
       g_hash_table_insert (contacts_table, tp_contact, contact);
+      add_contact_by_entity (contact, tp_contact);
     }
   else
     {
@@ -1938,38 +2624,23 @@ get_sort_func_for_action (EmpathyActionType action_type)
     }
 }
 
-/**
- * empathy_contact_dup_best_for_action:
- * @individual: a #FolksIndividual
- * @action_type: the type of action to be performed on the contact
- *
- * Chooses a #FolksPersona from the given @individual which is best-suited for
- * the given @action_type. "Best-suited" is determined by choosing the persona
- * with the highest presence out of all the personas which can perform the given
- * @action_type (e.g. are capable of video calling).
- *
- * Return value: an #EmpathyContact for the best persona, or %NULL;
- * unref with g_object_unref()
- */
-EmpathyContact *
-empathy_contact_dup_best_for_action (FolksIndividual *individual,
-    EmpathyActionType action_type)
+/* Returns a list of owned EmpathyContact for the interesting personas of
+ * @individual */
+static GList *
+individual_dup_contacts (FolksIndividual *individual)
 {
   GeeSet *personas;
   GeeIterator *iter;
-  GList *contacts;
-  EmpathyContact *best_contact = NULL;
+  GList *contacts = NULL;
 
-  /* Build a list of EmpathyContacts that we can sort */
   personas = folks_individual_get_personas (individual);
-  contacts = NULL;
 
   iter = gee_iterable_iterator (GEE_ITERABLE (personas));
   while (gee_iterator_next (iter))
     {
       FolksPersona *persona = gee_iterator_get (iter);
       TpContact *tp_contact;
-      EmpathyContact *contact = NULL;
+      EmpathyContact *contact;
 
       if (!empathy_folks_persona_is_interesting (persona))
         goto while_finish;
@@ -1981,31 +2652,188 @@ empathy_contact_dup_best_for_action (FolksIndividual *individual,
       contact = empathy_contact_dup_from_tp_contact (tp_contact);
       empathy_contact_set_persona (contact, FOLKS_PERSONA (persona));
 
-      /* Only choose the contact if they're actually capable of the specified
-       * action. */
-      if (empathy_contact_can_do_action (contact, action_type))
-        contacts = g_list_prepend (contacts, g_object_ref (contact));
+      contacts = g_list_prepend (contacts, contact);
 
 while_finish:
-      g_clear_object (&contact);
       g_clear_object (&persona);
     }
   g_clear_object (&iter);
 
+  return g_list_reverse (contacts);
+}
+
+/* Returns a ref on the best contact of @contacts for @action_type, or %NULL
+ * if none of them can do it */
+static EmpathyContact *
+dup_best_contact (GList *contacts,
+    EmpathyActionType action_type)
+{
+  GList *capable = NULL, *l;
+  EmpathyContact *best_contact = NULL;
+
+  /* Only choose the contact if they're actually capable of the specified
+   * action. */
+  for (l = contacts; l != NULL; l = g_list_next (l))
+    {
+      if (empathy_contact_can_do_action (l->data, action_type))
+        capable = g_list_prepend (capable, l->data);
+    }
+
   /* Sort the contacts by some heuristic based on the action type, then take
    * the top contact. */
-  if (contacts != NULL)
+  if (capable != NULL)
     {
-      contacts = g_list_sort (contacts, get_sort_func_for_action (action_type));
-      best_contact = g_object_ref (contacts->data);
+      capable = g_list_sort (capable, get_sort_func_for_action (action_type));
+      best_contact = g_object_ref (capable->data);
     }
 
-  g_list_foreach (contacts, (GFunc) g_object_unref, NULL);
-  g_list_free (contacts);
+  g_list_free (capable);
+
+  return best_contact;
+}
+
+/**
+ * empathy_contact_dup_best_for_action:
+ * @individual: a #FolksIndividual
+ * @action_type: the type of action to be performed on the contact
+ *
+ * Chooses a #FolksPersona from the given @individual which is best-suited for
+ * the given @action_type. "Best-suited" is determined by choosing the persona
+ * with the highest presence out of all the personas which can perform the given
+ * @action_type (e.g. are capable of video calling).
+ *
+ * For %EMPATHY_ACTION_VIEW_LOGS, the personas whose logs haven't been
+ * looked up yet are assumed to have some; use
+ * empathy_contact_dup_best_for_action_async () to look them up first.
+ *
+ * Return value: an #EmpathyContact for the best persona, or %NULL;
+ * unref with g_object_unref()
+ */
+EmpathyContact *
+empathy_contact_dup_best_for_action (FolksIndividual *individual,
+    EmpathyActionType action_type)
+{
+  GList *contacts;
+  EmpathyContact *best_contact;
+
+  contacts = individual_dup_contacts (individual);
+  best_contact = dup_best_contact (contacts, action_type);
+
+  g_list_free_full (contacts, g_object_unref);
 
   return best_contact;
 }
 
+typedef struct
+{
+  EmpathyActionType action_type;
+  /* owned EmpathyContact */
+  GList *contacts;
+  /* Number of contacts whose logs are being looked up */
+  guint n_pending;
+} BestForActionData;
+
+static void
+best_for_action_data_free (gpointer data)
+{
+  BestForActionData *best_data = data;
+
+  g_list_free_full (best_data->contacts, g_object_unref);
+
+  g_slice_free (BestForActionData, best_data);
+}
+
+static void
+best_for_action_return (GTask *task)
+{
+  BestForActionData *data = g_task_get_task_data (task);
+
+  g_task_return_pointer (task,
+      dup_best_contact (data->contacts, data->action_type),
+      g_object_unref);
+}
+
+static void
+best_for_action_has_log_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GTask *task = user_data;
+  BestForActionData *data = g_task_get_task_data (task);
+
+  /* The answer is cached, so empathy_contact_can_do_action () knows it now */
+  empathy_contact_has_log_finish (EMPATHY_CONTACT (source), result, NULL);
+
+  if (--data->n_pending == 0)
+    best_for_action_return (task);
+
+  g_object_unref (task);
+}
+
+/**
+ * empathy_contact_dup_best_for_action_async:
+ * @individual: a #FolksIndividual
+ * @action_type: the type of action to be performed on the contact
+ * @callback: called once the best persona is known
+ * @user_data: data to pass to @callback
+ *
+ * Like empathy_contact_dup_best_for_action (), but looks up the logs of all
+ * the personas of @individual first for %EMPATHY_ACTION_VIEW_LOGS.
+ */
+void
+empathy_contact_dup_best_for_action_async (FolksIndividual *individual,
+    EmpathyActionType action_type,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  BestForActionData *data;
+  GTask *task;
+  GList *l;
+
+  g_return_if_fail (FOLKS_IS_INDIVIDUAL (individual));
+
+  task = g_task_new (individual, NULL, callback, user_data);
+
+  data = g_slice_new0 (BestForActionData);
+  data->action_type = action_type;
+  data->contacts = individual_dup_contacts (individual);
+  g_task_set_task_data (task, data, best_for_action_data_free);
+
+  if (action_type != EMPATHY_ACTION_VIEW_LOGS || data->contacts == NULL)
+    {
+      best_for_action_return (task);
+      g_object_unref (task);
+      return;
+    }
+
+  data->n_pending = g_list_length (data->contacts);
+
+  for (l = data->contacts; l != NULL; l = g_list_next (l))
+    empathy_contact_has_log_async (l->data, best_for_action_has_log_cb,
+        g_object_ref (task));
+
+  g_object_unref (task);
+}
+
+/**
+ * empathy_contact_dup_best_for_action_finish:
+ * @individual: a #FolksIndividual
+ * @result: the #GAsyncResult passed to the callback
+ * @error: a #GError to fill, or %NULL
+ *
+ * Return value: an #EmpathyContact for the best persona, or %NULL;
+ * unref with g_object_unref()
+ */
+EmpathyContact *
+empathy_contact_dup_best_for_action_finish (FolksIndividual *individual,
+    GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, individual), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 #define declare_contact_cb(name) \
 static void \
 contact_##name##_cb (GObject *source, \
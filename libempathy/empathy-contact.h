@@ -80,6 +80,7 @@ void empathy_contact_set_alias (EmpathyContact *contact, const gchar *alias);
 void empathy_contact_change_group (EmpathyContact *contact, const gchar *group,
     gboolean is_member);
 EmpathyAvatar * empathy_contact_get_avatar (EmpathyContact *contact);
+const gchar * empathy_contact_get_avatar_filename (EmpathyContact *contact);
 TpAccount * empathy_contact_get_account (EmpathyContact *contact);
 FolksPersona * empathy_contact_get_persona (EmpathyContact *contact);
 void empathy_contact_set_persona (EmpathyContact *contact,
@@ -114,6 +115,15 @@ typedef enum {
 gboolean empathy_contact_can_do_action (EmpathyContact *self,
     EmpathyActionType action_type);
 
+void empathy_contact_has_log_async (EmpathyContact *contact,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+gboolean empathy_contact_has_log_finish (EmpathyContact *contact,
+    GAsyncResult *result,
+    GError **error);
+void empathy_contact_invalidate_has_log (TpAccount *account,
+    const gchar *id);
+
 #define EMPATHY_TYPE_AVATAR (empathy_avatar_get_type ())
 GType empathy_avatar_get_type (void) G_GNUC_CONST;
 EmpathyAvatar * empathy_avatar_new (const guchar *data,
@@ -135,6 +145,15 @@ EmpathyContact *empathy_contact_dup_from_tp_contact (TpContact *tp_contact);
 EmpathyContact * empathy_contact_dup_best_for_action (
     FolksIndividual *individual,
     EmpathyActionType action_type);
+void empathy_contact_dup_best_for_action_async (
+    FolksIndividual *individual,
+    EmpathyActionType action_type,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+EmpathyContact * empathy_contact_dup_best_for_action_finish (
+    FolksIndividual *individual,
+    GAsyncResult *result,
+    GError **error);
 
 void empathy_contact_add_to_contact_list (EmpathyContact *self,
     const gchar *message);
@@ -68,6 +68,11 @@ G_BEGIN_DECLS
 #define EMPATHY_PREFS_CHAT_WEBKIT_DEVELOPER_TOOLS  "enable-webkit-developer-tools"
 #define EMPATHY_PREFS_CHAT_ROOM_LAST_ACCOUNT       "room-last-account"
 #define EMPATHY_PREFS_CHAT_SEND_CHAT_STATES        "send-chat-states"
+#define EMPATHY_PREFS_CHAT_MAX_RENDERED_MESSAGES   "max-rendered-messages"
+#define EMPATHY_PREFS_CHAT_BACKLOG_MAX_PAGE_SIZE   "backlog-max-page-size"
+#define EMPATHY_PREFS_CHAT_BACKLOG_PREFETCH_PAGES  "backlog-prefetch-pages"
+#define EMPATHY_PREFS_CHAT_LOG_VIEWER_PAGE_SIZE    "log-viewer-page-size"
+#define EMPATHY_PREFS_CHAT_LOG_VIEWER_MAX_EVENTS   "log-viewer-max-events"
 
 #define EMPATHY_PREFS_UI_SCHEMA EMPATHY_PREFS_SCHEMA ".ui"
 #define EMPATHY_PREFS_UI_SEPARATE_CHAT_WINDOWS     "separate-chat-windows"
@@ -77,6 +82,7 @@ G_BEGIN_DECLS
 #define EMPATHY_PREFS_UI_CHAT_WINDOW_PANED_POS     "chat-window-paned-pos"
 #define EMPATHY_PREFS_UI_SHOW_OFFLINE              "show-offline"
 #define EMPATHY_PREFS_UI_SHOW_GROUPS               "show-groups"
+#define EMPATHY_PREFS_UI_AVATAR_CACHE_SIZE         "avatar-cache-size"
 
 #define EMPATHY_PREFS_HINTS_SCHEMA EMPATHY_PREFS_SCHEMA ".hints"
 #define EMPATHY_PREFS_HINTS_CLOSE_MAIN_WINDOW      "close-main-window"
@@ -26,6 +26,7 @@
 #include <tp-account-widgets/tpaw-utils.h>
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
+#include "empathy-popularity-ranking.h"
 #include "empathy-utils.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_CONTACT
@@ -38,13 +39,6 @@
  * changes, not when the position of every single individual is updated. */
 #define TOP_INDIVIDUALS_LEN 5
 
-/* The constant INDIVIDUALS_COUNT_COMPRESS_FACTOR represents the number of
- * interactions needed to be considered as 1 interaction */
-#define INTERACTION_COUNT_COMPRESS_FACTOR 50
-
-/* The constant DAY_IN_SECONDS represents the seconds in a day */
-#define DAY_IN_SECONDS 86400
-
 /* This class only stores and refs Individuals who contain an EmpathyContact.
  *
  * This class merely forwards along signals from the aggregator and individuals
@@ -55,12 +49,9 @@ typedef struct
   GHashTable *individuals; /* Individual.id -> Individual */
   gboolean contacts_loaded;
 
-  /* reffed FolksIndividual sorted by popularity (most popular first) */
-  GSequence *individuals_pop;
-  /* The TOP_INDIVIDUALS_LEN first FolksIndividual (borrowed) from
-   * individuals_pop */
-  GList *top_individuals;
-  guint global_interaction_counter;
+  /* FolksIndividual (borrowed from individuals) sorted by popularity, also
+   * keeping track of the TOP_INDIVIDUALS_LEN most popular ones */
+  EmpathyPopularityRanking *popularity;
 } EmpathyIndividualManagerPriv;
 
 enum
@@ -97,7 +88,8 @@ individual_manager_get_property (GObject *object,
   switch (property_id)
     {
       case PROP_TOP_INDIVIDUALS:
-        g_value_set_pointer (value, priv->top_individuals);
+        g_value_set_pointer (value,
+            empathy_popularity_ranking_get_top (priv->popularity));
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
         break;
@@ -126,111 +118,108 @@ individual_notify_is_favourite_cb (FolksIndividual *individual,
 }
 
 
-/* Contacts that have been interacted with within the last 30 days and have
- * have an interaction count > INTERACTION_COUNT_COMPRESS_FACTOR have a
- * popularity value of the count/INTERACTION_COUNT_COMPRESS_FACTOR */
+/* @now is in seconds, so all the individuals are compared against the same
+ * reference time */
 static guint
-compute_popularity (FolksIndividual *individual)
+compute_popularity (FolksIndividual *individual,
+    gint64 now)
 {
   FolksInteractionDetails *details = FOLKS_INTERACTION_DETAILS (individual);
   GDateTime *last;
-  guint  current_timestamp, count;
-  float timediff;
 
   last = folks_interaction_details_get_last_im_interaction_datetime (details);
   if (last == NULL)
     return 0;
 
-  /* Convert g_get_real_time () fro microseconds to seconds */
-  current_timestamp = g_get_real_time () / 1000000;
-  timediff = current_timestamp - g_date_time_to_unix (last);
-
-  if (timediff / DAY_IN_SECONDS > 30)
-    return 0;
-
-  count = folks_interaction_details_get_im_interaction_count (details);
-  count = count / INTERACTION_COUNT_COMPRESS_FACTOR;
-  if (count == 0)
-    return 0;
+  return empathy_popularity_compute (
+      folks_interaction_details_get_im_interaction_count (details),
+      g_date_time_to_unix (last), now);
+}
 
-  return count;
+static gint64
+get_current_time (void)
+{
+  /* Convert g_get_real_time () from microseconds to seconds */
+  return g_get_real_time () / G_USEC_PER_SEC;
 }
 
-static void
-check_top_individuals (EmpathyIndividualManager *self)
+/* The popularity of the other individuals is only computed when their
+ * interaction count changes, so old interactions may have expired since.
+ * Re-compute it for the top individuals, until the top is made of
+ * up-to-date ones. Returns TRUE if its members changed. */
+static gboolean
+refresh_top_individuals (EmpathyIndividualManager *self,
+    gint64 now)
 {
   EmpathyIndividualManagerPriv *priv = GET_PRIV (self);
-  GSequenceIter *iter;
-  GList *l, *new_list = NULL;
-  gboolean modified = FALSE;
-  guint i;
+  gboolean changed = FALSE;
+  gboolean stale = TRUE;
 
-  iter = g_sequence_get_begin_iter (priv->individuals_pop);
-  l = priv->top_individuals;
-
-  /* Check if the TOP_INDIVIDUALS_LEN first individuals in individuals_pop are
-   * still the same as the ones in top_individuals */
-  for (i = 0; i < TOP_INDIVIDUALS_LEN && !g_sequence_iter_is_end (iter); i++)
+  while (stale)
     {
-      FolksIndividual *individual = g_sequence_get (iter);
-      guint pop;
+      GList *top, *l;
 
-      /* Don't include individual having 0 as pop */
-      pop = compute_popularity (individual);
-      if (pop <= 0)
-        break;
+      stale = FALSE;
+      top = g_list_copy (empathy_popularity_ranking_get_top (priv->popularity));
 
-      if (!modified)
+      for (l = top; l != NULL; l = g_list_next (l))
         {
-          if (l == NULL)
-            {
-              /* Old list is shorter than the new one */
-              modified = TRUE;
-            }
-          else
-            {
-              modified = (individual != l->data);
+          guint pop = compute_popularity (l->data, now);
 
-              l = g_list_next (l);
-            }
-        }
+          if (pop == empathy_popularity_ranking_get_popularity (
+                  priv->popularity, l->data))
+            continue;
 
-      new_list = g_list_prepend (new_list, individual);
+          stale = TRUE;
+          if (empathy_popularity_ranking_set (priv->popularity, l->data, pop))
+            changed = TRUE;
+        }
 
-      iter = g_sequence_iter_next (iter);
+      g_list_free (top);
     }
 
-  g_list_free (priv->top_individuals);
-  priv->top_individuals = g_list_reverse (new_list);
+  return changed;
+}
 
-  if (modified)
-    {
-      DEBUG ("Top individuals changed:");
+static void
+top_individuals_changed (EmpathyIndividualManager *self)
+{
+  EmpathyIndividualManagerPriv *priv = GET_PRIV (self);
+  GList *l;
 
-      for (l = priv->top_individuals; l != NULL; l = g_list_next (l))
-        {
-          FolksIndividual *individual = l->data;
+  DEBUG ("Top individuals changed:");
 
-          DEBUG ("  %s (%u)",
-              folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual)),
-              compute_popularity (individual));
-        }
+  for (l = empathy_popularity_ranking_get_top (priv->popularity); l != NULL;
+       l = g_list_next (l))
+    {
+      FolksIndividual *individual = l->data;
 
-      g_object_notify (G_OBJECT (self), "top-individuals");
+      DEBUG ("  %s (%u)",
+          folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (individual)),
+          empathy_popularity_ranking_get_popularity (priv->popularity,
+              individual));
     }
+
+  g_object_notify (G_OBJECT (self), "top-individuals");
 }
 
-static gint
-compare_individual_by_pop (gconstpointer a,
-    gconstpointer b,
-    gpointer user_data)
+/* Move @individual to its new position in the ranking */
+static void
+update_popularity (EmpathyIndividualManager *self,
+    FolksIndividual *individual)
 {
-  guint pop_a, pop_b;
+  EmpathyIndividualManagerPriv *priv = GET_PRIV (self);
+  gint64 now = get_current_time ();
+  gboolean changed;
 
-  pop_a = compute_popularity (FOLKS_INDIVIDUAL (a));
-  pop_b = compute_popularity (FOLKS_INDIVIDUAL (b));
+  changed = empathy_popularity_ranking_set (priv->popularity, individual,
+      compute_popularity (individual, now));
 
-  return pop_b - pop_a;
+  if (refresh_top_individuals (self, now))
+    changed = TRUE;
+
+  if (changed)
+    top_individuals_changed (self);
 }
 
 static void
@@ -238,18 +227,7 @@ individual_notify_im_interaction_count (FolksIndividual *individual,
     GParamSpec *pspec,
     EmpathyIndividualManager *self)
 {
-  EmpathyIndividualManagerPriv *priv = GET_PRIV (self);
-
-  /* We don't use g_sequence_sort_changed() because we'll first have to find
-   * the iter of @individual using g_sequence_lookup() but the lookup function
-   * won't work as it assumes that the sequence is sorted which is no longer
-   * the case at this point as @individual's popularity just changed. */
-  g_sequence_sort (priv->individuals_pop, compare_individual_by_pop, NULL);
-
-  /* Only check for top individuals after 10 interaction events happen */
-  if (priv->global_interaction_counter % 10 == 0)
-    check_top_individuals (self);
-  priv->global_interaction_counter++;
+  update_popularity (self, individual);
 }
 
 static void
@@ -261,9 +239,7 @@ add_individual (EmpathyIndividualManager *self, FolksIndividual *individual)
       g_strdup (folks_individual_get_id (individual)),
       g_object_ref (individual));
 
-  g_sequence_insert_sorted (priv->individuals_pop, g_object_ref (individual),
-      compare_individual_by_pop, NULL);
-  check_top_individuals (self);
+  update_popularity (self, individual);
 
   g_signal_connect (individual, "group-changed",
       G_CALLBACK (individual_group_changed_cb), self);
@@ -277,21 +253,9 @@ static void
 remove_individual (EmpathyIndividualManager *self, FolksIndividual *individual)
 {
   EmpathyIndividualManagerPriv *priv = GET_PRIV (self);
-  GSequenceIter *iter;
 
-  iter = g_sequence_lookup (priv->individuals_pop, individual,
-      compare_individual_by_pop, NULL);
-  if (iter != NULL)
-    {
-      /* priv->top_individuals borrows its reference from
-       * priv->individuals_pop so we take a reference on the individual while
-       * removing it to make sure it stays alive while calling
-       * check_top_individuals(). */
-      g_object_ref (individual);
-      g_sequence_remove (iter);
-      check_top_individuals (self);
-      g_object_unref (individual);
-    }
+  if (empathy_popularity_ranking_remove (priv->popularity, individual))
+    top_individuals_changed (self);
 
   g_signal_handlers_disconnect_by_func (individual,
       individual_group_changed_cb, self);
@@ -436,6 +400,8 @@ individual_manager_dispose (GObject *object)
 {
   EmpathyIndividualManagerPriv *priv = GET_PRIV (object);
 
+  /* Borrows the individuals from priv->individuals */
+  tp_clear_pointer (&priv->popularity, empathy_popularity_ranking_free);
   g_hash_table_unref (priv->individuals);
 
   tp_clear_object (&priv->aggregator);
@@ -443,16 +409,6 @@ individual_manager_dispose (GObject *object)
   G_OBJECT_CLASS (empathy_individual_manager_parent_class)->dispose (object);
 }
 
-static void
-individual_manager_finalize (GObject *object)
-{
-  EmpathyIndividualManagerPriv *priv = GET_PRIV (object);
-
-  g_sequence_free (priv->individuals_pop);
-
-  G_OBJECT_CLASS (empathy_individual_manager_parent_class)->finalize (object);
-}
-
 static GObject *
 individual_manager_constructor (GType type,
     guint n_props,
@@ -502,7 +458,6 @@ empathy_individual_manager_class_init (EmpathyIndividualManagerClass *klass)
 
   object_class->get_property = individual_manager_get_property;
   object_class->dispose = individual_manager_dispose;
-  object_class->finalize = individual_manager_finalize;
   object_class->constructor = individual_manager_constructor;
 
   spec = g_param_spec_pointer ("top-individuals", "top individuals",
@@ -583,7 +538,7 @@ empathy_individual_manager_init (EmpathyIndividualManager *self)
   priv->individuals = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, g_object_unref);
 
-  priv->individuals_pop = g_sequence_new (g_object_unref);
+  priv->popularity = empathy_popularity_ranking_new (TOP_INDIVIDUALS_LEN);
 
   priv->aggregator = folks_individual_aggregator_dup ();
   tp_g_signal_connect_object (priv->aggregator, "individuals-changed-detailed",
@@ -906,7 +861,7 @@ empathy_individual_manager_get_top_individuals (EmpathyIndividualManager *self)
 {
   EmpathyIndividualManagerPriv *priv = GET_PRIV (self);
 
-  return priv->top_individuals;
+  return empathy_popularity_ranking_get_top (priv->popularity);
 }
 
 static void
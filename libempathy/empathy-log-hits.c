@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-log-hits.h"
+
+/* Search hits grouped by entity, and by day for each entity, so the log
+ * window can list the entities, dates and logs matching a search without
+ * going through all the hits for each of them. */
+
+typedef struct
+{
+  /* borrowed EmpathyLogHit, the first one of the entity */
+  EmpathyLogHit *first;
+  /* Julian day -> borrowed EmpathyLogHit, the first one of that day */
+  GHashTable *days;
+  /* borrowed EmpathyLogHit, the values of days in the order of the
+   * hits */
+  GPtrArray *day_hits;
+} Entity;
+
+struct _EmpathyLogHits
+{
+  /* owned EmpathyLogHit */
+  GList *hits;
+
+  /* Account path and entity identifier -> owned Entity */
+  GHashTable *entities;
+  /* borrowed Entity, in the order of their first hit */
+  GPtrArray *order;
+};
+
+static gchar *
+dup_entity_key (TpAccount *account,
+    TplEntity *entity)
+{
+  return g_strdup_printf ("%s\n%s", tp_proxy_get_object_path (account),
+      tpl_entity_get_identifier (entity));
+}
+
+static void
+entity_free (gpointer data)
+{
+  Entity *entity = data;
+
+  g_hash_table_unref (entity->days);
+  g_ptr_array_unref (entity->day_hits);
+
+  g_slice_free (Entity, entity);
+}
+
+static Entity *
+lookup_entity (EmpathyLogHits *self,
+    TpAccount *account,
+    TplEntity *target)
+{
+  Entity *entity;
+  gchar *key;
+
+  key = dup_entity_key (account, target);
+  entity = g_hash_table_lookup (self->entities, key);
+  g_free (key);
+
+  return entity;
+}
+
+/* Returns a new hit. @account, @target and @date may be %NULL for the hits
+ * of corrupt logs, which are ignored by empathy_log_hits_new (). */
+EmpathyLogHit *
+empathy_log_hit_new (TpAccount *account,
+    TplEntity *target,
+    GDate *date)
+{
+  EmpathyLogHit *hit;
+
+  hit = g_slice_new0 (EmpathyLogHit);
+
+  if (account != NULL)
+    hit->account = g_object_ref (account);
+  if (target != NULL)
+    hit->target = g_object_ref (target);
+  if (date != NULL)
+    hit->date = g_date_new_julian (g_date_get_julian (date));
+
+  return hit;
+}
+
+void
+empathy_log_hit_free (EmpathyLogHit *hit)
+{
+  tp_clear_object (&hit->account);
+  tp_clear_object (&hit->target);
+  tp_clear_pointer (&hit->date, g_date_free);
+
+  g_slice_free (EmpathyLogHit, hit);
+}
+
+/* Takes ownership of @search_hits, a list of TplLogSearchHit returned by the
+ * log manager, and returns the corresponding list of owned EmpathyLogHit */
+GList *
+empathy_log_hits_from_search (GList *search_hits)
+{
+  GList *hits = NULL, *l;
+
+  for (l = search_hits; l != NULL; l = g_list_next (l))
+    {
+      TplLogSearchHit *search_hit = l->data;
+
+      hits = g_list_prepend (hits, empathy_log_hit_new (search_hit->account,
+            search_hit->target, search_hit->date));
+    }
+
+  tpl_log_manager_search_free (search_hits);
+
+  return g_list_reverse (hits);
+}
+
+/* Takes ownership of @hits, a list of EmpathyLogHit */
+EmpathyLogHits *
+empathy_log_hits_new (GList *hits)
+{
+  EmpathyLogHits *self;
+  GList *l;
+
+  self = g_slice_new0 (EmpathyLogHits);
+  self->hits = hits;
+  self->entities = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      entity_free);
+  self->order = g_ptr_array_new ();
+
+  for (l = hits; l != NULL; l = g_list_next (l))
+    {
+      EmpathyLogHit *hit = l->data;
+      Entity *entity;
+      gpointer day;
+      gchar *key;
+
+      /* Protect against invalid data (corrupt or old log files). */
+      if (hit->account == NULL || hit->target == NULL || hit->date == NULL)
+        continue;
+
+      key = dup_entity_key (hit->account, hit->target);
+      entity = g_hash_table_lookup (self->entities, key);
+
+      if (entity == NULL)
+        {
+          entity = g_slice_new0 (Entity);
+          entity->first = hit;
+          entity->days = g_hash_table_new (NULL, NULL);
+          entity->day_hits = g_ptr_array_new ();
+
+          g_hash_table_insert (self->entities, key, entity);
+          g_ptr_array_add (self->order, entity);
+        }
+      else
+        {
+          g_free (key);
+        }
+
+      day = GUINT_TO_POINTER (g_date_get_julian (hit->date));
+
+      if (!g_hash_table_contains (entity->days, day))
+        {
+          g_hash_table_insert (entity->days, day, hit);
+          g_ptr_array_add (entity->day_hits, hit);
+        }
+    }
+
+  return self;
+}
+
+void
+empathy_log_hits_free (EmpathyLogHits *self)
+{
+  g_ptr_array_unref (self->order);
+  g_hash_table_unref (self->entities);
+  g_list_free_full (self->hits, (GDestroyNotify) empathy_log_hit_free);
+
+  g_slice_free (EmpathyLogHits, self);
+}
+
+/* Returns a list of borrowed EmpathyLogHit, one for each entity with hits,
+ * or only for those of @account if it's not %NULL. Free it with
+ * g_list_free (). */
+GList *
+empathy_log_hits_get_entities (EmpathyLogHits *self,
+    TpAccount *account)
+{
+  GList *result = NULL;
+  guint i;
+
+  for (i = self->order->len; i > 0; i--)
+    {
+      Entity *entity = g_ptr_array_index (self->order, i - 1);
+
+      if (account != NULL && tp_strdiff (
+            tp_proxy_get_object_path (entity->first->account),
+            tp_proxy_get_object_path (account)))
+        continue;
+
+      result = g_list_prepend (result, entity->first);
+    }
+
+  return result;
+}
+
+/* Returns the set of the entities of @accounts and @targets, lists of
+ * TpAccount and TplEntity of the same length, which have hits */
+static GHashTable *
+dup_selected_entities (EmpathyLogHits *self,
+    GList *accounts,
+    GList *targets,
+    GPtrArray *order)
+{
+  GHashTable *selected = g_hash_table_new (NULL, NULL);
+  GList *acc, *targ;
+
+  for (acc = accounts, targ = targets;
+       acc != NULL && targ != NULL;
+       acc = g_list_next (acc), targ = g_list_next (targ))
+    {
+      Entity *entity = lookup_entity (self, acc->data, targ->data);
+
+      if (entity != NULL && !g_hash_table_contains (selected, entity))
+        {
+          g_hash_table_add (selected, entity);
+          g_ptr_array_add (order, entity);
+        }
+    }
+
+  return selected;
+}
+
+/* Returns a list of borrowed GDate, the days on which the entities of
+ * @accounts and @targets have hits, each of them once. Free it with
+ * g_list_free (). */
+GList *
+empathy_log_hits_get_dates (EmpathyLogHits *self,
+    GList *accounts,
+    GList *targets)
+{
+  GHashTable *selected, *days;
+  GPtrArray *order;
+  GList *result = NULL;
+  guint i, j;
+
+  order = g_ptr_array_new ();
+  selected = dup_selected_entities (self, accounts, targets, order);
+  days = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < order->len; i++)
+    {
+      Entity *entity = g_ptr_array_index (order, i);
+
+      for (j = 0; j < entity->day_hits->len; j++)
+        {
+          EmpathyLogHit *hit = g_ptr_array_index (entity->day_hits, j);
+          gpointer day = GUINT_TO_POINTER (g_date_get_julian (hit->date));
+
+          if (g_hash_table_contains (days, day))
+            continue;
+
+          g_hash_table_add (days, day);
+          result = g_list_prepend (result, hit->date);
+        }
+    }
+
+  g_hash_table_unref (days);
+  g_hash_table_unref (selected);
+  g_ptr_array_unref (order);
+
+  return g_list_reverse (result);
+}
+
+/* Returns a list of borrowed EmpathyLogHit, one for each day of @dates on
+ * which the entities of @accounts and @targets have hits, or for any day if
+ * @dates is %NULL. Free it with g_list_free (). */
+GList *
+empathy_log_hits_get_hits (EmpathyLogHits *self,
+    GList *accounts,
+    GList *targets,
+    GList *dates)
+{
+  GHashTable *selected, *days = NULL;
+  GPtrArray *order;
+  GList *result = NULL, *l;
+  guint i, j;
+
+  order = g_ptr_array_new ();
+  selected = dup_selected_entities (self, accounts, targets, order);
+
+  if (dates != NULL)
+    {
+      days = g_hash_table_new (NULL, NULL);
+
+      for (l = dates; l != NULL; l = g_list_next (l))
+        g_hash_table_add (days,
+            GUINT_TO_POINTER (g_date_get_julian (l->data)));
+    }
+
+  for (i = 0; i < order->len; i++)
+    {
+      Entity *entity = g_ptr_array_index (order, i);
+
+      if (days == NULL)
+        {
+          for (j = 0; j < entity->day_hits->len; j++)
+            result = g_list_prepend (result,
+                g_ptr_array_index (entity->day_hits, j));
+
+          continue;
+        }
+
+      /* Look the dates up in whichever of the two is smaller */
+      if (entity->day_hits->len <= g_hash_table_size (days))
+        {
+          for (j = 0; j < entity->day_hits->len; j++)
+            {
+              EmpathyLogHit *hit = g_ptr_array_index (entity->day_hits, j);
+
+              if (g_hash_table_contains (days,
+                    GUINT_TO_POINTER (g_date_get_julian (hit->date))))
+                result = g_list_prepend (result, hit);
+            }
+        }
+      else
+        {
+          GHashTableIter iter;
+          gpointer day, hit;
+
+          g_hash_table_iter_init (&iter, days);
+          while (g_hash_table_iter_next (&iter, &day, NULL))
+            {
+              hit = g_hash_table_lookup (entity->days, day);
+
+              if (hit != NULL)
+                result = g_list_prepend (result, hit);
+            }
+        }
+    }
+
+  tp_clear_pointer (&days, g_hash_table_unref);
+  g_hash_table_unref (selected);
+  g_ptr_array_unref (order);
+
+  return g_list_reverse (result);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_LOG_HITS_H__
+#define __EMPATHY_LOG_HITS_H__
+
+#include <telepathy-logger/telepathy-logger.h>
+
+G_BEGIN_DECLS
+
+/* A day of logs with an entity which matches a search */
+typedef struct
+{
+  TpAccount *account;
+  TplEntity *target;
+  GDate *date;
+} EmpathyLogHit;
+
+EmpathyLogHit * empathy_log_hit_new (TpAccount *account,
+    TplEntity *target,
+    GDate *date);
+void empathy_log_hit_free (EmpathyLogHit *hit);
+
+GList * empathy_log_hits_from_search (GList *search_hits);
+
+typedef struct _EmpathyLogHits EmpathyLogHits;
+
+EmpathyLogHits * empathy_log_hits_new (GList *hits);
+void empathy_log_hits_free (EmpathyLogHits *self);
+
+GList * empathy_log_hits_get_entities (EmpathyLogHits *self,
+    TpAccount *account);
+GList * empathy_log_hits_get_dates (EmpathyLogHits *self,
+    GList *accounts,
+    GList *targets);
+GList * empathy_log_hits_get_hits (EmpathyLogHits *self,
+    GList *accounts,
+    GList *targets,
+    GList *dates);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_LOG_HITS_H__ */
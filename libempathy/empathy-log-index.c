@@ -0,0 +1,1857 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-log-index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "empathy-client-factory.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+/* Inverted index of the text logged by telepathy-logger: each word maps to
+ * the days of the conversations in which it has been said. Searching it is
+ * much cheaper than tpl_log_manager_search_async (), which parses every log
+ * file for every query: the index only gives the days which may match, and
+ * only their logs are read to check they do.
+ *
+ * The index is kept in memory and saved as a text file:
+ *
+ *   empathy-log-index <version>
+ *   c <account path> <target id> <is room> <target alias> <day>,<day>...
+ *   w <word> <conversation>:<day>,<conversation>:<day>...
+ *
+ * Fields are separated by tabs, strings are escaped with g_strescape (),
+ * conversations are numbered in the order they appear and days are Julian
+ * days. */
+
+#define INDEX_VERSION 2
+
+/* Delay before saving the words added by empathy_log_index_add_text () */
+#define SAVE_TIMEOUT 30
+
+/* Longer words are truncated */
+#define MAX_WORD_LEN 64
+
+#define POSTING(conversation, day) \
+  (((guint64) (conversation) << 32) | (guint32) (day))
+#define POSTING_CONVERSATION(posting) ((guint) ((posting) >> 32))
+#define POSTING_DAY(posting) ((guint32) ((posting) & G_MAXUINT32))
+
+typedef struct
+{
+  gchar *account_path;
+  gchar *target_id;
+  gchar *target_alias;
+  gboolean is_room;
+  /* set of indexed Julian days */
+  GHashTable *days;
+} Conversation;
+
+typedef struct
+{
+  /* owned Conversation */
+  GPtrArray *conversations;
+  /* owned "account path\nidentifier" -> GUINT_TO_POINTER (index + 1) */
+  GHashTable *conversation_ids;
+  /* owned word -> owned GArray of sorted and unique guint64 postings */
+  GHashTable *words;
+  /* borrowed keys of words in lexicographic order, NULL until needed again
+   * once words have been added or removed */
+  GPtrArray *vocabulary;
+} IndexData;
+
+typedef enum
+{
+  JOB_GET_ENTITIES,
+  JOB_GET_DATES,
+  JOB_GET_EVENTS,
+} JobType;
+
+typedef struct
+{
+  JobType type;
+  TpAccount *account;
+  TplEntity *target;
+  GDate *date;
+} Job;
+
+struct _EmpathyLogIndexPriv
+{
+  gchar *filename;
+  IndexData *data;
+  /* data has been read from filename */
+  gboolean loaded;
+  /* data has been brought up to date since it has been loaded */
+  gboolean updated;
+  guint save_id;
+  /* data is being written to filename */
+  gboolean saving;
+  /* data has to be written again once saved */
+  gboolean save_pending;
+
+  /* Owned GTask of the running update, NULL if none */
+  GTask *update_task;
+  /* Owned GTasks waiting for the running update to finish */
+  GList *waiting_tasks;
+  TplLogManager *log_manager;
+  /* owned TpAccount to crawl once loaded */
+  GList *accounts;
+  /* owned Job still to run */
+  GQueue *jobs;
+};
+
+enum
+{
+  PROP_FILENAME = 1,
+};
+
+G_DEFINE_TYPE (EmpathyLogIndex, empathy_log_index, G_TYPE_OBJECT);
+
+static void index_save_async (EmpathyLogIndex *self);
+
+static void
+conversation_free (gpointer data)
+{
+  Conversation *conversation = data;
+
+  g_free (conversation->account_path);
+  g_free (conversation->target_id);
+  g_free (conversation->target_alias);
+  g_hash_table_unref (conversation->days);
+
+  g_slice_free (Conversation, conversation);
+}
+
+static void
+postings_free (gpointer data)
+{
+  g_array_unref (data);
+}
+
+static IndexData *
+index_data_new (void)
+{
+  IndexData *data = g_slice_new0 (IndexData);
+
+  data->conversations = g_ptr_array_new_with_free_func (conversation_free);
+  data->conversation_ids = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  data->words = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      postings_free);
+
+  return data;
+}
+
+static void
+index_data_free (IndexData *data)
+{
+  g_ptr_array_unref (data->conversations);
+  g_hash_table_unref (data->conversation_ids);
+  g_hash_table_unref (data->words);
+  tp_clear_pointer (&data->vocabulary, g_ptr_array_unref);
+
+  g_slice_free (IndexData, data);
+}
+
+/* Returns a copy of what is saved of @data */
+static IndexData *
+index_data_copy (IndexData *data)
+{
+  IndexData *copy = index_data_new ();
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
+
+  for (i = 0; i < data->conversations->len; i++)
+    {
+      Conversation *conversation = g_ptr_array_index (data->conversations, i);
+      Conversation *conversation_copy;
+
+      conversation_copy = g_slice_new0 (Conversation);
+      conversation_copy->account_path = g_strdup (conversation->account_path);
+      conversation_copy->target_id = g_strdup (conversation->target_id);
+      conversation_copy->target_alias = g_strdup (conversation->target_alias);
+      conversation_copy->is_room = conversation->is_room;
+      conversation_copy->days = g_hash_table_new (NULL, NULL);
+
+      g_hash_table_iter_init (&iter, conversation->days);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_hash_table_add (conversation_copy->days, key);
+
+      g_ptr_array_add (copy->conversations, conversation_copy);
+    }
+
+  g_hash_table_iter_init (&iter, data->words);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GArray *postings = value;
+      GArray *postings_copy;
+
+      postings_copy = g_array_sized_new (FALSE, FALSE, sizeof (guint64),
+          postings->len);
+      g_array_append_vals (postings_copy, postings->data, postings->len);
+
+      g_hash_table_insert (copy->words, g_strdup (key), postings_copy);
+    }
+
+  return copy;
+}
+
+static gchar *
+dup_conversation_id (const gchar *account_path,
+    const gchar *target_id)
+{
+  return g_strdup_printf ("%s\n%s", account_path, target_id);
+}
+
+/* Takes ownership of the strings */
+static guint
+index_data_take_conversation (IndexData *data,
+    gchar *account_path,
+    gchar *target_id,
+    gchar *target_alias,
+    gboolean is_room)
+{
+  Conversation *conversation;
+  gchar *id;
+  gpointer index;
+
+  id = dup_conversation_id (account_path, target_id);
+  index = g_hash_table_lookup (data->conversation_ids, id);
+
+  if (index != NULL)
+    {
+      g_free (id);
+      g_free (account_path);
+      g_free (target_id);
+      g_free (target_alias);
+
+      return GPOINTER_TO_UINT (index) - 1;
+    }
+
+  conversation = g_slice_new0 (Conversation);
+  conversation->account_path = account_path;
+  conversation->target_id = target_id;
+  conversation->target_alias = target_alias;
+  conversation->is_room = is_room;
+  conversation->days = g_hash_table_new (NULL, NULL);
+
+  g_ptr_array_add (data->conversations, conversation);
+  g_hash_table_insert (data->conversation_ids, id,
+      GUINT_TO_POINTER (data->conversations->len));
+
+  return data->conversations->len - 1;
+}
+
+static guint
+index_data_ensure_conversation (IndexData *data,
+    TpAccount *account,
+    TplEntity *target)
+{
+  return index_data_take_conversation (data,
+      g_strdup (tp_proxy_get_object_path (account)),
+      g_strdup (tpl_entity_get_identifier (target)),
+      g_strdup (tpl_entity_get_alias (target)),
+      tpl_entity_get_entity_type (target) == TPL_ENTITY_ROOM);
+}
+
+static void
+postings_add (GArray *postings,
+    guint64 posting)
+{
+  guint64 *values = (guint64 *) postings->data;
+  guint low = 0, high = postings->len;
+
+  /* Most postings are added in order */
+  if (postings->len == 0 || values[postings->len - 1] < posting)
+    {
+      g_array_append_val (postings, posting);
+      return;
+    }
+
+  while (low < high)
+    {
+      guint middle = (low + high) / 2;
+
+      if (values[middle] < posting)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  if (values[low] != posting)
+    g_array_insert_val (postings, low, posting);
+}
+
+static void
+index_data_add_word (IndexData *data,
+    const gchar *word,
+    guint64 posting)
+{
+  GArray *postings;
+
+  postings = g_hash_table_lookup (data->words, word);
+  if (postings == NULL)
+    {
+      postings = g_array_new (FALSE, FALSE, sizeof (guint64));
+      g_hash_table_insert (data->words, g_strdup (word), postings);
+      tp_clear_pointer (&data->vocabulary, g_ptr_array_unref);
+    }
+
+  postings_add (postings, posting);
+}
+
+/* Removes the postings of the conversations of @conversations, a set of
+ * GUINT_TO_POINTER (conversation + 1). If @days is not %NULL, only the
+ * postings of these Julian days are removed. */
+static void
+index_data_forget (IndexData *data,
+    GHashTable *conversations,
+    GHashTable *days)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (g_hash_table_size (conversations) == 0)
+    return;
+
+  g_hash_table_iter_init (&iter, data->words);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GArray *postings = value;
+      guint i, len = 0;
+
+      for (i = 0; i < postings->len; i++)
+        {
+          guint64 posting = g_array_index (postings, guint64, i);
+
+          if (!g_hash_table_contains (conversations,
+                GUINT_TO_POINTER (POSTING_CONVERSATION (posting) + 1)) ||
+              (days != NULL && !g_hash_table_contains (days,
+                GUINT_TO_POINTER (POSTING_DAY (posting)))))
+            g_array_index (postings, guint64, len++) = posting;
+        }
+
+      if (len == 0)
+        {
+          tp_clear_pointer (&data->vocabulary, g_ptr_array_unref);
+          g_hash_table_iter_remove (&iter);
+        }
+      else
+        g_array_set_size (postings, len);
+    }
+
+  g_hash_table_iter_init (&iter, conversations);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      Conversation *conversation = g_ptr_array_index (data->conversations,
+          GPOINTER_TO_UINT (key) - 1);
+      GHashTableIter days_iter;
+      gpointer day;
+
+      if (days == NULL)
+        {
+          g_hash_table_remove_all (conversation->days);
+          continue;
+        }
+
+      g_hash_table_iter_init (&days_iter, days);
+      while (g_hash_table_iter_next (&days_iter, &day, NULL))
+        g_hash_table_remove (conversation->days, day);
+    }
+}
+
+static void
+index_data_add_text (IndexData *data,
+    guint conversation,
+    guint32 day,
+    const gchar *text)
+{
+  gchar **words;
+  guint i;
+
+  words = empathy_log_index_split_words (text);
+
+  for (i = 0; words[i] != NULL; i++)
+    index_data_add_word (data, words[i], POSTING (conversation, day));
+
+  g_strfreev (words);
+}
+
+static void
+add_word (GPtrArray *words,
+    GString *word)
+{
+  if (word->len == 0)
+    return;
+
+  g_ptr_array_add (words, g_strndup (word->str, word->len));
+  g_string_truncate (word, 0);
+}
+
+/* Splits @text in lower case words, without accents. Returns a
+ * %NULL-terminated array to free with g_strfreev (). */
+gchar **
+empathy_log_index_split_words (const gchar *text)
+{
+  GPtrArray *words;
+  GString *word;
+  gchar *normalized, *folded;
+  const gchar *p;
+
+  words = g_ptr_array_new ();
+
+  if (text == NULL)
+    goto out;
+
+  /* Decompose accented letters so their accents can be dropped */
+  normalized = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+  if (normalized == NULL)
+    goto out;
+
+  folded = g_utf8_casefold (normalized, -1);
+  g_free (normalized);
+
+  word = g_string_new (NULL);
+
+  for (p = folded; *p != '\0'; p = g_utf8_next_char (p))
+    {
+      gunichar c = g_utf8_get_char (p);
+
+      if (g_unichar_ismark (c))
+        continue;
+
+      if (!g_unichar_isalnum (c))
+        add_word (words, word);
+      else if (word->len < MAX_WORD_LEN)
+        g_string_append_unichar (word, c);
+    }
+
+  add_word (words, word);
+
+  g_string_free (word, TRUE);
+  g_free (folded);
+
+out:
+  g_ptr_array_add (words, NULL);
+
+  return (gchar **) g_ptr_array_free (words, FALSE);
+}
+
+/* Persistence */
+
+static void
+append_escaped (GString *string,
+    const gchar *str)
+{
+  gchar *escaped = g_strescape (str != NULL ? str : "", NULL);
+
+  g_string_append_c (string, '\t');
+  g_string_append (string, escaped);
+  g_free (escaped);
+}
+
+static gint
+compare_days (gconstpointer a,
+    gconstpointer b)
+{
+  guint day_a = GPOINTER_TO_UINT (*(gconstpointer *) a);
+  guint day_b = GPOINTER_TO_UINT (*(gconstpointer *) b);
+
+  return day_a < day_b ? -1 : (day_a > day_b ? 1 : 0);
+}
+
+static GString *
+index_data_serialize (IndexData *data)
+{
+  GString *string;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
+
+  string = g_string_sized_new (64 * 1024);
+  g_string_append_printf (string, "empathy-log-index %d\n", INDEX_VERSION);
+
+  for (i = 0; i < data->conversations->len; i++)
+    {
+      Conversation *conversation = g_ptr_array_index (data->conversations, i);
+      GPtrArray *days;
+      guint j;
+
+      g_string_append_c (string, 'c');
+      append_escaped (string, conversation->account_path);
+      append_escaped (string, conversation->target_id);
+      g_string_append_printf (string, "\t%d", conversation->is_room);
+      append_escaped (string, conversation->target_alias);
+      g_string_append_c (string, '\t');
+
+      days = g_ptr_array_sized_new (g_hash_table_size (conversation->days));
+      g_hash_table_iter_init (&iter, conversation->days);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (days, key);
+
+      g_ptr_array_sort (days, compare_days);
+
+      for (j = 0; j < days->len; j++)
+        g_string_append_printf (string, j == 0 ? "%u" : ",%u",
+            GPOINTER_TO_UINT (g_ptr_array_index (days, j)));
+
+      g_ptr_array_unref (days);
+      g_string_append_c (string, '\n');
+    }
+
+  g_hash_table_iter_init (&iter, data->words);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GArray *postings = value;
+      guint j;
+
+      g_string_append_c (string, 'w');
+      append_escaped (string, key);
+      g_string_append_c (string, '\t');
+
+      for (j = 0; j < postings->len; j++)
+        {
+          guint64 posting = g_array_index (postings, guint64, j);
+
+          g_string_append_printf (string, j == 0 ? "%u:%u" : ",%u:%u",
+              POSTING_CONVERSATION (posting), POSTING_DAY (posting));
+        }
+
+      g_string_append_c (string, '\n');
+    }
+
+  return string;
+}
+
+static gboolean
+parse_conversation (IndexData *data,
+    gchar **fields)
+{
+  gchar **days;
+  guint conversation, i;
+
+  if (g_strv_length (fields) != 6)
+    return FALSE;
+
+  conversation = index_data_take_conversation (data,
+      g_strcompress (fields[1]), g_strcompress (fields[2]),
+      g_strcompress (fields[4]), atoi (fields[3]) != 0);
+
+  /* Conversations are stored once, in order */
+  if (conversation != data->conversations->len - 1)
+    return FALSE;
+
+  days = g_strsplit (fields[5], ",", -1);
+
+  for (i = 0; days[i] != NULL; i++)
+    {
+      if (days[i][0] != '\0')
+        g_hash_table_add (
+            ((Conversation *) g_ptr_array_index (data->conversations,
+                conversation))->days,
+            GUINT_TO_POINTER (strtoul (days[i], NULL, 10)));
+    }
+
+  g_strfreev (days);
+
+  return TRUE;
+}
+
+static gboolean
+parse_word (IndexData *data,
+    gchar **fields)
+{
+  gchar *word;
+  gchar **postings;
+  gboolean ret = TRUE;
+  guint i;
+
+  if (g_strv_length (fields) != 3)
+    return FALSE;
+
+  word = g_strcompress (fields[1]);
+  postings = g_strsplit (fields[2], ",", -1);
+
+  for (i = 0; postings[i] != NULL && ret; i++)
+    {
+      gchar *end;
+      guint conversation;
+      guint32 day;
+
+      conversation = strtoul (postings[i], &end, 10);
+      if (*end != ':' || conversation >= data->conversations->len)
+        {
+          ret = FALSE;
+          break;
+        }
+
+      day = strtoul (end + 1, NULL, 10);
+      index_data_add_word (data, word, POSTING (conversation, day));
+    }
+
+  g_strfreev (postings);
+  g_free (word);
+
+  return ret;
+}
+
+/* Returns NULL if @contents isn't a valid index */
+static IndexData *
+index_data_parse (const gchar *contents)
+{
+  IndexData *data;
+  gchar **lines;
+  gint version;
+  guint i;
+
+  if (sscanf (contents, "empathy-log-index %d", &version) != 1 ||
+      version != INDEX_VERSION)
+    return NULL;
+
+  data = index_data_new ();
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (i = 1; lines[i] != NULL; i++)
+    {
+      gchar **fields;
+      gboolean valid = TRUE;
+
+      if (lines[i][0] == '\0')
+        continue;
+
+      fields = g_strsplit (lines[i], "\t", -1);
+
+      if (!tp_strdiff (fields[0], "c"))
+        valid = parse_conversation (data, fields);
+      else if (!tp_strdiff (fields[0], "w"))
+        valid = parse_word (data, fields);
+
+      g_strfreev (fields);
+
+      if (!valid)
+        {
+          DEBUG ("Invalid line %u in the log index", i);
+          index_data_free (data);
+          data = NULL;
+          break;
+        }
+    }
+
+  g_strfreev (lines);
+
+  return data;
+}
+
+/* Number of saves running or waiting to run, in any index. Loading waits
+ * for them so it reads what has been saved last. */
+static GMutex saves_mutex;
+static GCond saves_cond;
+static guint n_saves = 0;
+
+static void
+saves_add (void)
+{
+  g_mutex_lock (&saves_mutex);
+  n_saves++;
+  g_mutex_unlock (&saves_mutex);
+}
+
+static void
+saves_remove (void)
+{
+  g_mutex_lock (&saves_mutex);
+  n_saves--;
+  g_cond_broadcast (&saves_cond);
+  g_mutex_unlock (&saves_mutex);
+}
+
+static void
+load_in_thread (GTask *task,
+    gpointer source_object,
+    gpointer task_data,
+    GCancellable *cancellable)
+{
+  const gchar *filename = task_data;
+  IndexData *data = NULL;
+  gchar *contents;
+  GError *error = NULL;
+
+  g_mutex_lock (&saves_mutex);
+  while (n_saves > 0)
+    g_cond_wait (&saves_cond, &saves_mutex);
+  g_mutex_unlock (&saves_mutex);
+
+  if (g_file_get_contents (filename, &contents, NULL, &error))
+    {
+      data = index_data_parse (contents);
+      g_free (contents);
+    }
+  else
+    {
+      DEBUG ("Failed to read %s: %s", filename, error->message);
+      g_error_free (error);
+    }
+
+  /* Start from scratch if there is no index yet or if it's unusable */
+  if (data == NULL)
+    data = index_data_new ();
+
+  g_task_return_pointer (task, data, (GDestroyNotify) index_data_free);
+}
+
+typedef struct
+{
+  gchar *filename;
+  /* owned snapshot of the index to save */
+  IndexData *data;
+} SaveData;
+
+static void
+save_data_free (gpointer data)
+{
+  SaveData *save = data;
+
+  g_free (save->filename);
+  index_data_free (save->data);
+
+  g_slice_free (SaveData, save);
+}
+
+static void
+save_in_thread (GTask *task,
+    gpointer source_object,
+    gpointer task_data,
+    GCancellable *cancellable)
+{
+  SaveData *save = task_data;
+  GString *string;
+  GFile *file;
+  gchar *dir;
+  GError *error = NULL;
+
+  dir = g_path_get_dirname (save->filename);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  string = index_data_serialize (save->data);
+  file = g_file_new_for_path (save->filename);
+
+  if (!g_file_replace_contents (file, string->str, string->len, NULL, FALSE,
+        G_FILE_CREATE_PRIVATE, NULL, NULL, &error))
+    {
+      DEBUG ("Failed to save the log index: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_object_unref (file);
+  g_string_free (string, TRUE);
+
+  saves_remove ();
+  g_task_return_boolean (task, TRUE);
+}
+
+/* Writes a snapshot of @data to @filename in a thread. The caller has
+ * counted the save with saves_add (). */
+static void
+save_data_async (const gchar *filename,
+    IndexData *data,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task;
+  SaveData *save;
+
+  save = g_slice_new0 (SaveData);
+  save->filename = g_strdup (filename);
+  save->data = index_data_copy (data);
+
+  task = g_task_new (NULL, NULL, callback, user_data);
+  g_task_set_task_data (task, save, save_data_free);
+  g_task_run_in_thread (task, save_in_thread);
+  g_object_unref (task);
+}
+
+static void start_saving (EmpathyLogIndex *self);
+
+static void
+saved_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyLogIndex *self = user_data;
+
+  self->priv->saving = FALSE;
+
+  if (self->priv->save_pending)
+    start_saving (self);
+
+  g_object_unref (self);
+}
+
+/* Saves are written one after the other so the last one wins */
+static void
+start_saving (EmpathyLogIndex *self)
+{
+  self->priv->saving = TRUE;
+  self->priv->save_pending = FALSE;
+
+  save_data_async (self->priv->filename, self->priv->data, saved_cb,
+      g_object_ref (self));
+}
+
+static void
+index_save_async (EmpathyLogIndex *self)
+{
+  if (self->priv->save_id != 0)
+    {
+      g_source_remove (self->priv->save_id);
+      self->priv->save_id = 0;
+    }
+
+  /* The pending save will write the latest data */
+  if (self->priv->save_pending)
+    return;
+
+  self->priv->save_pending = TRUE;
+  saves_add ();
+
+  if (!self->priv->saving)
+    start_saving (self);
+}
+
+static gboolean
+save_timeout_cb (gpointer user_data)
+{
+  EmpathyLogIndex *self = user_data;
+
+  self->priv->save_id = 0;
+  index_save_async (self);
+
+  return FALSE;
+}
+
+/* Updates */
+
+static Job *
+job_new (JobType type,
+    TpAccount *account,
+    TplEntity *target,
+    GDate *date)
+{
+  Job *job = g_slice_new0 (Job);
+
+  job->type = type;
+  job->account = g_object_ref (account);
+
+  if (target != NULL)
+    job->target = g_object_ref (target);
+
+  if (date != NULL)
+    job->date = g_date_new_julian (g_date_get_julian (date));
+
+  return job;
+}
+
+static void
+job_free (gpointer data)
+{
+  Job *job = data;
+
+  g_object_unref (job->account);
+  tp_clear_object (&job->target);
+  tp_clear_pointer (&job->date, g_date_free);
+
+  g_slice_free (Job, job);
+}
+
+static void run_next_job (EmpathyLogIndex *self);
+
+/* Updates requested while another one was running complete with it */
+static void
+update_done (EmpathyLogIndex *self)
+{
+  GList *tasks, *l;
+
+  self->priv->updated = TRUE;
+  index_save_async (self);
+
+  tasks = g_list_prepend (self->priv->waiting_tasks, self->priv->update_task);
+  self->priv->waiting_tasks = NULL;
+  self->priv->update_task = NULL;
+
+  tp_clear_object (&self->priv->log_manager);
+  g_list_free_full (self->priv->accounts, g_object_unref);
+  self->priv->accounts = NULL;
+
+  for (l = tasks; l != NULL; l = g_list_next (l))
+    g_task_return_boolean (l->data, TRUE);
+
+  g_list_free_full (tasks, g_object_unref);
+}
+
+static void
+got_entities_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyLogIndex *self = user_data;
+  Job *job = g_queue_pop_head (self->priv->jobs);
+  GList *entities = NULL, *l;
+  GError *error = NULL;
+
+  if (!tpl_log_manager_get_entities_finish (TPL_LOG_MANAGER (manager),
+        result, &entities, &error))
+    {
+      DEBUG ("Failed to get entities: %s", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      GHashTable *listed, *removed;
+      const gchar *account_path = tp_proxy_get_object_path (job->account);
+      guint i;
+
+      /* Forget the conversations whose logs have been removed since */
+      listed = g_hash_table_new (g_str_hash, g_str_equal);
+      for (l = entities; l != NULL; l = g_list_next (l))
+        g_hash_table_add (listed,
+            (gpointer) tpl_entity_get_identifier (l->data));
+
+      removed = g_hash_table_new (NULL, NULL);
+      for (i = 0; i < self->priv->data->conversations->len; i++)
+        {
+          Conversation *conversation = g_ptr_array_index (
+              self->priv->data->conversations, i);
+
+          if (!tp_strdiff (conversation->account_path, account_path) &&
+              !g_hash_table_contains (listed, conversation->target_id))
+            g_hash_table_add (removed, GUINT_TO_POINTER (i + 1));
+        }
+
+      index_data_forget (self->priv->data, removed, NULL);
+
+      g_hash_table_unref (removed);
+      g_hash_table_unref (listed);
+    }
+
+  for (l = entities; l != NULL; l = g_list_next (l))
+    g_queue_push_tail (self->priv->jobs,
+        job_new (JOB_GET_DATES, job->account, l->data, NULL));
+
+  g_list_free_full (entities, g_object_unref);
+  job_free (job);
+
+  run_next_job (self);
+  g_object_unref (self);
+}
+
+static void
+got_dates_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyLogIndex *self = user_data;
+  Job *job = g_queue_pop_head (self->priv->jobs);
+  Conversation *conversation;
+  GList *dates = NULL, *l;
+  guint conversation_index, last_day = 0;
+  gboolean got_dates;
+  GHashTableIter iter;
+  gpointer key;
+  GError *error = NULL;
+
+  got_dates = tpl_log_manager_get_dates_finish (TPL_LOG_MANAGER (manager),
+      result, &dates, &error);
+  if (!got_dates)
+    {
+      DEBUG ("Failed to get dates: %s", error->message);
+      g_error_free (error);
+    }
+
+  conversation_index = index_data_ensure_conversation (self->priv->data,
+      job->account, job->target);
+  conversation = g_ptr_array_index (self->priv->data->conversations,
+      conversation_index);
+
+  if (got_dates)
+    {
+      GHashTable *listed, *removed, *stale;
+
+      /* Forget the days whose logs have been removed since */
+      listed = g_hash_table_new (NULL, NULL);
+      for (l = dates; l != NULL; l = g_list_next (l))
+        g_hash_table_add (listed,
+            GUINT_TO_POINTER (g_date_get_julian (l->data)));
+
+      stale = g_hash_table_new (NULL, NULL);
+      g_hash_table_iter_init (&iter, conversation->days);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          if (!g_hash_table_contains (listed, key))
+            g_hash_table_add (stale, key);
+        }
+
+      removed = g_hash_table_new (NULL, NULL);
+      if (g_hash_table_size (stale) > 0)
+        g_hash_table_add (removed,
+            GUINT_TO_POINTER (conversation_index + 1));
+
+      index_data_forget (self->priv->data, removed, stale);
+
+      g_hash_table_unref (removed);
+      g_hash_table_unref (stale);
+      g_hash_table_unref (listed);
+    }
+
+  /* The last indexed day may have been logged further since */
+  g_hash_table_iter_init (&iter, conversation->days);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    last_day = MAX (last_day, GPOINTER_TO_UINT (key));
+
+  for (l = dates; l != NULL; l = g_list_next (l))
+    {
+      guint day = g_date_get_julian (l->data);
+
+      if (day >= last_day ||
+          !g_hash_table_contains (conversation->days, GUINT_TO_POINTER (day)))
+        g_queue_push_tail (self->priv->jobs,
+            job_new (JOB_GET_EVENTS, job->account, job->target, l->data));
+    }
+
+  g_list_free_full (dates, (GDestroyNotify) g_date_free);
+  job_free (job);
+
+  run_next_job (self);
+  g_object_unref (self);
+}
+
+static void
+got_events_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyLogIndex *self = user_data;
+  Job *job = g_queue_pop_head (self->priv->jobs);
+  GList *events = NULL, *l;
+  guint conversation;
+  guint32 day;
+  GError *error = NULL;
+
+  if (!tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (manager),
+        result, &events, &error))
+    {
+      DEBUG ("Failed to get events: %s", error->message);
+      g_error_free (error);
+      goto out;
+    }
+
+  conversation = index_data_ensure_conversation (self->priv->data,
+      job->account, job->target);
+  day = g_date_get_julian (job->date);
+
+  for (l = events; l != NULL; l = g_list_next (l))
+    {
+      if (TPL_IS_TEXT_EVENT (l->data))
+        index_data_add_text (self->priv->data, conversation, day,
+            tpl_text_event_get_message (l->data));
+    }
+
+  g_hash_table_add (
+      ((Conversation *) g_ptr_array_index (self->priv->data->conversations,
+          conversation))->days,
+      GUINT_TO_POINTER (day));
+
+out:
+  g_list_free_full (events, g_object_unref);
+  job_free (job);
+
+  run_next_job (self);
+  g_object_unref (self);
+}
+
+/* Jobs run one after the other, the running one stays at the head of the
+ * queue. */
+static void
+run_next_job (EmpathyLogIndex *self)
+{
+  Job *job = g_queue_peek_head (self->priv->jobs);
+
+  if (job == NULL)
+    {
+      update_done (self);
+      return;
+    }
+
+  switch (job->type)
+    {
+      case JOB_GET_ENTITIES:
+        tpl_log_manager_get_entities_async (self->priv->log_manager,
+            job->account, got_entities_cb, g_object_ref (self));
+        break;
+      case JOB_GET_DATES:
+        tpl_log_manager_get_dates_async (self->priv->log_manager,
+            job->account, job->target, TPL_EVENT_MASK_TEXT, got_dates_cb,
+            g_object_ref (self));
+        break;
+      case JOB_GET_EVENTS:
+        tpl_log_manager_get_events_for_date_async (self->priv->log_manager,
+            job->account, job->target, TPL_EVENT_MASK_TEXT, job->date,
+            got_events_cb, g_object_ref (self));
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+}
+
+static void
+start_crawling (EmpathyLogIndex *self)
+{
+  GList *l;
+
+  for (l = self->priv->accounts; l != NULL; l = g_list_next (l))
+    g_queue_push_tail (self->priv->jobs,
+        job_new (JOB_GET_ENTITIES, l->data, NULL, NULL));
+
+  run_next_job (self);
+}
+
+static void
+loaded_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyLogIndex *self = EMPATHY_LOG_INDEX (source);
+  IndexData *data;
+
+  data = g_task_propagate_pointer (G_TASK (result), NULL);
+
+  /* Text added while loading is lost, but it is logged as well and the last
+   * days are indexed again when crawling. */
+  index_data_free (self->priv->data);
+  self->priv->data = data;
+  self->priv->loaded = TRUE;
+
+  DEBUG ("Log index loaded: %u conversations, %u words",
+      data->conversations->len, g_hash_table_size (data->words));
+
+  start_crawling (self);
+}
+
+/**
+ * empathy_log_index_update_async:
+ * @self: an #EmpathyLogIndex
+ * @log_manager: the #TplLogManager to read the logs from
+ * @accounts: a #GList of #TpAccount whose logs should be indexed
+ * @callback: called once the index is up to date
+ * @user_data: data to pass to @callback
+ *
+ * Loads the index from the disk if needed, then indexes the logs which have
+ * been written since the last update and forgets those which have been
+ * removed, in the background.
+ */
+void
+empathy_log_index_update_async (EmpathyLogIndex *self,
+    TplLogManager *log_manager,
+    GList *accounts,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (EMPATHY_IS_LOG_INDEX (self));
+  g_return_if_fail (TPL_IS_LOG_MANAGER (log_manager));
+
+  task = g_task_new (self, NULL, callback, user_data);
+
+  if (self->priv->update_task != NULL)
+    {
+      self->priv->waiting_tasks = g_list_prepend (self->priv->waiting_tasks,
+          task);
+      return;
+    }
+
+  self->priv->update_task = task;
+  self->priv->log_manager = g_object_ref (log_manager);
+  self->priv->accounts = g_list_copy_deep (accounts, (GCopyFunc) g_object_ref,
+      NULL);
+
+  if (self->priv->loaded)
+    {
+      start_crawling (self);
+    }
+  else
+    {
+      GTask *load_task;
+
+      load_task = g_task_new (self, NULL, loaded_cb, NULL);
+      g_task_set_task_data (load_task, g_strdup (self->priv->filename),
+          g_free);
+      g_task_run_in_thread (load_task, load_in_thread);
+      g_object_unref (load_task);
+    }
+}
+
+gboolean
+empathy_log_index_update_finish (EmpathyLogIndex *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* Whether the index knows all the days which may match a search, so
+ * empathy_log_index_search_async () finds the same days as
+ * tpl_log_manager_search_async (). Logs may have been written while Empathy
+ * wasn't running, so this is only the case once this process has updated the
+ * index. */
+gboolean
+empathy_log_index_is_ready (EmpathyLogIndex *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_LOG_INDEX (self), FALSE);
+
+  return self->priv->updated;
+}
+
+/* Indexes @text, which has just been logged in the conversation with @target
+ * on @date */
+void
+empathy_log_index_add_text (EmpathyLogIndex *self,
+    TpAccount *account,
+    TplEntity *target,
+    GDate *date,
+    const gchar *text)
+{
+  guint conversation;
+
+  g_return_if_fail (EMPATHY_IS_LOG_INDEX (self));
+  g_return_if_fail (TP_IS_ACCOUNT (account));
+  g_return_if_fail (TPL_IS_ENTITY (target));
+  g_return_if_fail (date != NULL);
+
+  conversation = index_data_ensure_conversation (self->priv->data, account,
+      target);
+  index_data_add_text (self->priv->data, conversation,
+      g_date_get_julian (date), text);
+
+  if (self->priv->loaded && self->priv->save_id == 0)
+    self->priv->save_id = g_timeout_add_seconds (SAVE_TIMEOUT,
+        save_timeout_cb, self);
+}
+
+/* Forgets the text logged with @target on @account, with everyone on
+ * @account if @target is %NULL, or everything if @account is %NULL, once
+ * these logs have been cleared */
+void
+empathy_log_index_forget (EmpathyLogIndex *self,
+    TpAccount *account,
+    TplEntity *target)
+{
+  GHashTable *removed;
+  guint i;
+
+  g_return_if_fail (EMPATHY_IS_LOG_INDEX (self));
+  g_return_if_fail (account == NULL || TP_IS_ACCOUNT (account));
+  g_return_if_fail (target == NULL || TPL_IS_ENTITY (target));
+  g_return_if_fail (account != NULL || target == NULL);
+
+  removed = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < self->priv->data->conversations->len; i++)
+    {
+      Conversation *conversation = g_ptr_array_index (
+          self->priv->data->conversations, i);
+
+      if (account != NULL && tp_strdiff (conversation->account_path,
+            tp_proxy_get_object_path (account)))
+        continue;
+
+      if (target != NULL && tp_strdiff (conversation->target_id,
+            tpl_entity_get_identifier (target)))
+        continue;
+
+      g_hash_table_add (removed, GUINT_TO_POINTER (i + 1));
+    }
+
+  index_data_forget (self->priv->data, removed, NULL);
+  g_hash_table_unref (removed);
+
+  /* Otherwise the index is pruned when crawling the logs once loaded */
+  if (self->priv->loaded)
+    index_save_async (self);
+}
+
+/* Searching */
+
+static gint
+compare_postings (gconstpointer a,
+    gconstpointer b)
+{
+  guint64 posting_a = *(const guint64 *) a;
+  guint64 posting_b = *(const guint64 *) b;
+
+  return posting_a < posting_b ? -1 : (posting_a > posting_b ? 1 : 0);
+}
+
+static void
+postings_sort_unique (GArray *postings)
+{
+  guint i, len = 0;
+
+  g_array_sort (postings, compare_postings);
+
+  for (i = 0; i < postings->len; i++)
+    {
+      guint64 posting = g_array_index (postings, guint64, i);
+
+      if (len == 0 || g_array_index (postings, guint64, len - 1) != posting)
+        g_array_index (postings, guint64, len++) = posting;
+    }
+
+  g_array_set_size (postings, len);
+}
+
+/* Keeps the postings of @a which are in @b as well */
+static void
+postings_intersect (GArray *a,
+    GArray *b)
+{
+  guint i = 0, j = 0, len = 0;
+
+  while (i < a->len && j < b->len)
+    {
+      guint64 posting_a = g_array_index (a, guint64, i);
+      guint64 posting_b = g_array_index (b, guint64, j);
+
+      if (posting_a < posting_b)
+        {
+          i++;
+        }
+      else if (posting_a > posting_b)
+        {
+          j++;
+        }
+      else
+        {
+          g_array_index (a, guint64, len++) = posting_a;
+          i++;
+          j++;
+        }
+    }
+
+  g_array_set_size (a, len);
+}
+
+static gint
+compare_words (gconstpointer a,
+    gconstpointer b)
+{
+  return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+static GPtrArray *
+index_data_get_vocabulary (IndexData *data)
+{
+  GHashTableIter iter;
+  gpointer key;
+
+  if (data->vocabulary != NULL)
+    return data->vocabulary;
+
+  data->vocabulary = g_ptr_array_sized_new (g_hash_table_size (data->words));
+
+  g_hash_table_iter_init (&iter, data->words);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (data->vocabulary, key);
+
+  g_ptr_array_sort (data->vocabulary, compare_words);
+
+  return data->vocabulary;
+}
+
+static void
+append_postings (GArray *postings,
+    IndexData *data,
+    const gchar *word)
+{
+  GArray *word_postings = g_hash_table_lookup (data->words, word);
+
+  if (word_postings != NULL)
+    g_array_append_vals (postings, word_postings->data, word_postings->len);
+}
+
+/* Appends the postings of the words starting with @prefix to @postings */
+static void
+append_postings_for_prefix (GArray *postings,
+    IndexData *data,
+    const gchar *prefix)
+{
+  GPtrArray *vocabulary = index_data_get_vocabulary (data);
+  guint low = 0, high = vocabulary->len;
+
+  while (low < high)
+    {
+      guint middle = (low + high) / 2;
+
+      if (strcmp (g_ptr_array_index (vocabulary, middle), prefix) < 0)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  for (; low < vocabulary->len; low++)
+    {
+      const gchar *word = g_ptr_array_index (vocabulary, low);
+
+      if (!g_str_has_prefix (word, prefix))
+        break;
+
+      append_postings (postings, data, word);
+    }
+}
+
+/* Appends the postings of the words containing @infix to @postings, and of
+ * those which may have been truncated after it */
+static void
+append_postings_for_infix (GArray *postings,
+    IndexData *data,
+    const gchar *infix)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, data->words);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GArray *word_postings = value;
+
+      if (strstr (key, infix) != NULL || strlen (key) >= MAX_WORD_LEN)
+        g_array_append_vals (postings, word_postings->data,
+            word_postings->len);
+    }
+}
+
+/* Returns the sorted and unique postings of the days in which @text may have
+ * been said. @text may start in the middle of a word and end in the middle of
+ * another, so only the words it contains in full have to match exactly. */
+static GArray *
+index_data_dup_candidates (IndexData *data,
+    const gchar *text)
+{
+  GArray *postings = NULL;
+  gchar **words;
+  guint i, n_words;
+
+  words = empathy_log_index_split_words (text);
+  n_words = g_strv_length (words);
+
+  if (n_words == 0)
+    {
+      /* Any day may match */
+      postings = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+      for (i = 0; i < data->conversations->len; i++)
+        {
+          Conversation *conversation = g_ptr_array_index (
+              data->conversations, i);
+          GHashTableIter iter;
+          gpointer day;
+
+          g_hash_table_iter_init (&iter, conversation->days);
+          while (g_hash_table_iter_next (&iter, &day, NULL))
+            {
+              guint64 posting = POSTING (i, GPOINTER_TO_UINT (day));
+
+              g_array_append_val (postings, posting);
+            }
+        }
+
+      postings_sort_unique (postings);
+    }
+  else if (n_words == 1)
+    {
+      postings = g_array_new (FALSE, FALSE, sizeof (guint64));
+      append_postings_for_infix (postings, data, words[0]);
+      postings_sort_unique (postings);
+    }
+
+  /* The first word may end a longer one, so it can't be looked up */
+  for (i = 1; i < n_words; i++)
+    {
+      GArray *word_postings = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+      if (i == n_words - 1)
+        append_postings_for_prefix (word_postings, data, words[i]);
+      else
+        append_postings (word_postings, data, words[i]);
+
+      postings_sort_unique (word_postings);
+
+      if (postings == NULL)
+        {
+          postings = word_postings;
+        }
+      else
+        {
+          postings_intersect (postings, word_postings);
+          g_array_unref (word_postings);
+        }
+
+      if (postings->len == 0)
+        break;
+    }
+
+  g_strfreev (words);
+
+  return postings;
+}
+
+static void
+hits_free (gpointer hits)
+{
+  g_list_free_full (hits, (GDestroyNotify) empathy_log_hit_free);
+}
+
+typedef struct
+{
+  TplLogManager *log_manager;
+  /* the searched text, case folded as telepathy-logger does */
+  gchar *text;
+  /* owned EmpathyLogHit whose logs are still to be checked */
+  GQueue *candidates;
+  /* owned EmpathyLogHit whose logs contain text, in reverse order */
+  GList *hits;
+} SearchData;
+
+static void
+search_data_free (gpointer data)
+{
+  SearchData *search = data;
+
+  g_object_unref (search->log_manager);
+  g_free (search->text);
+  g_queue_free_full (search->candidates,
+      (GDestroyNotify) empathy_log_hit_free);
+  hits_free (search->hits);
+
+  g_slice_free (SearchData, search);
+}
+
+static void check_next_candidate (GTask *task);
+
+static void
+search_got_events_cb (GObject *manager,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GTask *task = user_data;
+  SearchData *search = g_task_get_task_data (task);
+  EmpathyLogHit *hit = g_queue_pop_head (search->candidates);
+  GList *events = NULL, *l;
+  gboolean found = FALSE;
+  GError *error = NULL;
+
+  if (!tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (manager),
+        result, &events, &error))
+    {
+      DEBUG ("Failed to get events: %s", error->message);
+      g_error_free (error);
+    }
+
+  for (l = events; l != NULL && !found; l = g_list_next (l))
+    {
+      const gchar *message;
+      gchar *folded;
+
+      if (!TPL_IS_TEXT_EVENT (l->data))
+        continue;
+
+      message = tpl_text_event_get_message (l->data);
+      if (message == NULL)
+        continue;
+
+      folded = g_utf8_casefold (message, -1);
+      found = (strstr (folded, search->text) != NULL);
+      g_free (folded);
+    }
+
+  if (found)
+    search->hits = g_list_prepend (search->hits, hit);
+  else
+    empathy_log_hit_free (hit);
+
+  g_list_free_full (events, g_object_unref);
+
+  check_next_candidate (task);
+}
+
+/* Candidates are checked one after the other, the one being checked stays at
+ * the head of the queue */
+static void
+check_next_candidate (GTask *task)
+{
+  SearchData *search = g_task_get_task_data (task);
+  EmpathyLogHit *hit = g_queue_peek_head (search->candidates);
+
+  if (hit == NULL)
+    {
+      g_task_return_pointer (task, g_list_reverse (search->hits), hits_free);
+      search->hits = NULL;
+      g_object_unref (task);
+      return;
+    }
+
+  tpl_log_manager_get_events_for_date_async (search->log_manager,
+      hit->account, hit->target, TPL_EVENT_MASK_TEXT, hit->date,
+      search_got_events_cb, task);
+}
+
+/**
+ * empathy_log_index_search_async:
+ * @self: an #EmpathyLogIndex
+ * @log_manager: the #TplLogManager to read the logs from
+ * @text: the text to search
+ * @callback: called once the logs have been searched
+ * @user_data: data to pass to @callback
+ *
+ * Searches the days of conversations in which @text has been said, ignoring
+ * case, as tpl_log_manager_search_async () does. Only the logs of the days
+ * the index gives are read.
+ */
+void
+empathy_log_index_search_async (EmpathyLogIndex *self,
+    TplLogManager *log_manager,
+    const gchar *text,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  TpSimpleClientFactory *factory;
+  GTask *task;
+  SearchData *search;
+  GArray *postings;
+  guint i;
+
+  g_return_if_fail (EMPATHY_IS_LOG_INDEX (self));
+  g_return_if_fail (TPL_IS_LOG_MANAGER (log_manager));
+  g_return_if_fail (text != NULL);
+
+  search = g_slice_new0 (SearchData);
+  search->log_manager = g_object_ref (log_manager);
+  search->text = g_utf8_casefold (text, -1);
+  search->candidates = g_queue_new ();
+
+  task = g_task_new (self, NULL, callback, user_data);
+  g_task_set_task_data (task, search, search_data_free);
+
+  factory = TP_SIMPLE_CLIENT_FACTORY (empathy_client_factory_dup ());
+  postings = index_data_dup_candidates (self->priv->data, text);
+
+  for (i = 0; i < postings->len; i++)
+    {
+      guint64 posting = g_array_index (postings, guint64, i);
+      Conversation *conversation;
+      TpAccount *account;
+      TplEntity *target;
+      GDate *date;
+
+      conversation = g_ptr_array_index (self->priv->data->conversations,
+          POSTING_CONVERSATION (posting));
+
+      account = tp_simple_client_factory_ensure_account (factory,
+          conversation->account_path, NULL, NULL);
+      target = tpl_entity_new (conversation->target_id,
+          conversation->is_room ? TPL_ENTITY_ROOM : TPL_ENTITY_CONTACT,
+          conversation->target_alias, NULL);
+      date = g_date_new_julian (POSTING_DAY (posting));
+
+      g_queue_push_tail (search->candidates,
+          empathy_log_hit_new (account, target, date));
+
+      g_date_free (date);
+      g_object_unref (target);
+      tp_clear_object (&account);
+    }
+
+  g_array_unref (postings);
+  g_object_unref (factory);
+
+  DEBUG ("Checking %u days for '%s'", search->candidates->length, text);
+
+  check_next_candidate (task);
+}
+
+/**
+ * empathy_log_index_search_finish:
+ * @self: an #EmpathyLogIndex
+ * @result: the #GAsyncResult passed to the callback
+ * @error: a #GError to fill
+ *
+ * Returns: a #GList of #EmpathyLogHit, to free with
+ * g_list_free_full () and empathy_log_hit_free ()
+ */
+GList *
+empathy_log_index_search_finish (EmpathyLogIndex *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+static void
+empathy_log_index_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  EmpathyLogIndex *self = EMPATHY_LOG_INDEX (object);
+
+  switch (property_id)
+    {
+      case PROP_FILENAME:
+        g_value_set_string (value, self->priv->filename);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+empathy_log_index_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  EmpathyLogIndex *self = EMPATHY_LOG_INDEX (object);
+
+  switch (property_id)
+    {
+      case PROP_FILENAME:
+        g_assert (self->priv->filename == NULL); /* construct only */
+        self->priv->filename = g_value_dup_string (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+empathy_log_index_dispose (GObject *object)
+{
+  EmpathyLogIndex *self = EMPATHY_LOG_INDEX (object);
+
+  /* Don't lose the text added since the last save. Running saves keep a ref
+   * on the index, so this is the last one. */
+  if (self->priv->save_id != 0)
+    {
+      g_source_remove (self->priv->save_id);
+      self->priv->save_id = 0;
+
+      saves_add ();
+      save_data_async (self->priv->filename, self->priv->data, NULL, NULL);
+    }
+
+  G_OBJECT_CLASS (empathy_log_index_parent_class)->dispose (object);
+}
+
+static void
+empathy_log_index_finalize (GObject *object)
+{
+  EmpathyLogIndex *self = EMPATHY_LOG_INDEX (object);
+
+  /* Running updates keep a ref on the index */
+  g_assert (self->priv->update_task == NULL);
+
+  g_queue_free_full (self->priv->jobs, job_free);
+  index_data_free (self->priv->data);
+  g_free (self->priv->filename);
+
+  G_OBJECT_CLASS (empathy_log_index_parent_class)->finalize (object);
+}
+
+static void
+empathy_log_index_class_init (EmpathyLogIndexClass *klass)
+{
+  GObjectClass *oclass = G_OBJECT_CLASS (klass);
+  GParamSpec *spec;
+
+  oclass->get_property = empathy_log_index_get_property;
+  oclass->set_property = empathy_log_index_set_property;
+  oclass->dispose = empathy_log_index_dispose;
+  oclass->finalize = empathy_log_index_finalize;
+
+  spec = g_param_spec_string ("filename", "filename",
+      "File the index is saved to",
+      NULL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (oclass, PROP_FILENAME, spec);
+
+  g_type_class_add_private (klass, sizeof (EmpathyLogIndexPriv));
+}
+
+static void
+empathy_log_index_init (EmpathyLogIndex *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndexPriv);
+
+  self->priv->data = index_data_new ();
+  self->priv->jobs = g_queue_new ();
+}
+
+EmpathyLogIndex *
+empathy_log_index_new (const gchar *filename)
+{
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  return g_object_new (EMPATHY_TYPE_LOG_INDEX,
+      "filename", filename,
+      NULL);
+}
+
+/* The index of the user's logs, in XDG_CACHE_HOME */
+EmpathyLogIndex *
+empathy_log_index_dup_singleton (void)
+{
+  static EmpathyLogIndex *singleton = NULL;
+  gchar *filename;
+
+  if (singleton != NULL)
+    return g_object_ref (singleton);
+
+  filename = g_build_filename (g_get_user_cache_dir (), "empathy",
+      "log-index", NULL);
+
+  singleton = empathy_log_index_new (filename);
+  g_object_add_weak_pointer (G_OBJECT (singleton), (gpointer *) &singleton);
+
+  g_free (filename);
+
+  return singleton;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_LOG_INDEX_H__
+#define __EMPATHY_LOG_INDEX_H__
+
+#include <telepathy-logger/telepathy-logger.h>
+
+#include "empathy-log-hits.h"
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_LOG_INDEX         (empathy_log_index_get_type ())
+#define EMPATHY_LOG_INDEX(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndex))
+#define EMPATHY_LOG_INDEX_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndexClass))
+#define EMPATHY_IS_LOG_INDEX(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), EMPATHY_TYPE_LOG_INDEX))
+#define EMPATHY_IS_LOG_INDEX_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), EMPATHY_TYPE_LOG_INDEX))
+#define EMPATHY_LOG_INDEX_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), EMPATHY_TYPE_LOG_INDEX, EmpathyLogIndexClass))
+
+typedef struct _EmpathyLogIndex      EmpathyLogIndex;
+typedef struct _EmpathyLogIndexClass EmpathyLogIndexClass;
+typedef struct _EmpathyLogIndexPriv  EmpathyLogIndexPriv;
+
+struct _EmpathyLogIndex
+{
+  GObject parent;
+  EmpathyLogIndexPriv *priv;
+};
+
+struct _EmpathyLogIndexClass
+{
+  GObjectClass parent_class;
+};
+
+GType empathy_log_index_get_type (void) G_GNUC_CONST;
+
+EmpathyLogIndex * empathy_log_index_dup_singleton (void);
+EmpathyLogIndex * empathy_log_index_new (const gchar *filename);
+
+void empathy_log_index_update_async (EmpathyLogIndex *self,
+    TplLogManager *log_manager,
+    GList *accounts,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+gboolean empathy_log_index_update_finish (EmpathyLogIndex *self,
+    GAsyncResult *result,
+    GError **error);
+
+gboolean empathy_log_index_is_ready (EmpathyLogIndex *self);
+
+void empathy_log_index_add_text (EmpathyLogIndex *self,
+    TpAccount *account,
+    TplEntity *target,
+    GDate *date,
+    const gchar *text);
+
+void empathy_log_index_forget (EmpathyLogIndex *self,
+    TpAccount *account,
+    TplEntity *target);
+
+void empathy_log_index_search_async (EmpathyLogIndex *self,
+    TplLogManager *log_manager,
+    const gchar *text,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+GList * empathy_log_index_search_finish (EmpathyLogIndex *self,
+    GAsyncResult *result,
+    GError **error);
+
+gchar ** empathy_log_index_split_words (const gchar *text);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_LOG_INDEX_H__ */
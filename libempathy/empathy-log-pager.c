@@ -0,0 +1,645 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-log-pager.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+/* Pages through the events logged on a set of dates, for one or more
+ * targets, starting from the newest ones.
+ *
+ * The pager keeps track of the window of events returned so far: every
+ * event whose timestamp is in [lo, hi). Pages are taken just before lo or
+ * just after hi, and the window can be shrunk from either end with
+ * empathy_log_pager_trim_newer () and empathy_log_pager_trim_older () to
+ * bound the number of events the caller keeps.
+ *
+ * Logs are only read a day at a time, and the events logged on a day are
+ * not strictly within that day in UTC depending on the time zone they were
+ * logged in, so a day is assumed to contain events from the previous day up
+ * to the next one. The events of the days read for a page are kept until
+ * the next page is requested, as the following page usually starts in the
+ * last of them. */
+
+typedef struct
+{
+  TpAccount *account;
+  TplEntity *target;
+  TplEventTypeMask event_mask;
+  guint day;
+
+  /* owned TplEvent in chronological order, NULL if not read */
+  GPtrArray *events;
+  /* Request which last used the events */
+  guint generation;
+} Slot;
+
+typedef struct
+{
+  gboolean older;
+  /* Index of the next slot to look at */
+  gint next;
+  /* borrowed TplEvent which could be part of the page */
+  GPtrArray *candidates;
+} Request;
+
+struct _EmpathyLogPagerPriv
+{
+  TplLogManager *log_manager;
+  guint page_size;
+  guint max_events;
+
+  /* owned Slot, sorted by day once sorted is TRUE */
+  GPtrArray *slots;
+  gboolean sorted;
+
+  /* Events returned so far are in [lo, hi). hi is G_MAXINT64 while
+   * the newest events are part of the window. */
+  gint64 lo;
+  gint64 hi;
+  gboolean older_done;
+  /* Sorted timestamps of the events in the window */
+  GArray *timestamps;
+
+  /* The running request, NULL if none */
+  GTask *task;
+  guint generation;
+};
+
+G_DEFINE_TYPE (EmpathyLogPager, empathy_log_pager, G_TYPE_OBJECT);
+
+static void pager_step (EmpathyLogPager *self);
+
+static void
+slot_free (gpointer data)
+{
+  Slot *slot = data;
+
+  g_object_unref (slot->account);
+  g_object_unref (slot->target);
+  tp_clear_pointer (&slot->events, g_ptr_array_unref);
+
+  g_slice_free (Slot, slot);
+}
+
+static gint
+compare_slots (gconstpointer a,
+    gconstpointer b)
+{
+  const Slot *slot_a = *(Slot **) a;
+  const Slot *slot_b = *(Slot **) b;
+
+  if (slot_a->day == slot_b->day)
+    return 0;
+
+  return slot_a->day < slot_b->day ? -1 : 1;
+}
+
+static gint
+compare_events (gconstpointer a,
+    gconstpointer b)
+{
+  gint64 ts_a = tpl_event_get_timestamp (*(TplEvent **) a);
+  gint64 ts_b = tpl_event_get_timestamp (*(TplEvent **) b);
+
+  if (ts_a == ts_b)
+    return 0;
+
+  return ts_a < ts_b ? -1 : 1;
+}
+
+static void
+request_free (gpointer data)
+{
+  Request *request = data;
+
+  g_ptr_array_unref (request->candidates);
+
+  g_slice_free (Request, request);
+}
+
+/* Timestamp of the start of @day, a Julian day, in UTC */
+static gint64
+day_start (guint day)
+{
+  GDate *date = g_date_new_julian (day);
+  GDateTime *datetime;
+  gint64 result;
+
+  datetime = g_date_time_new_utc (g_date_get_year (date),
+      g_date_get_month (date), g_date_get_day (date), 0, 0, 0);
+  result = g_date_time_to_unix (datetime);
+
+  g_date_time_unref (datetime);
+  g_date_free (date);
+
+  return result;
+}
+
+/* Events logged on @day are at or after this timestamp */
+static gint64
+slot_min_timestamp (Slot *slot)
+{
+  return day_start (MAX (slot->day, 2) - 1);
+}
+
+/* Events logged on @day are before this timestamp */
+static gint64
+slot_max_timestamp (Slot *slot)
+{
+  return day_start (slot->day + 2);
+}
+
+static gint64
+candidate_timestamp (Request *request,
+    guint i)
+{
+  return tpl_event_get_timestamp (g_ptr_array_index (request->candidates, i));
+}
+
+/* Whether the events of @slot can't change the page, as we already have
+ * enough candidates closer to the window */
+static gboolean
+request_is_complete (EmpathyLogPager *self,
+    Request *request,
+    Slot *slot)
+{
+  guint n = request->candidates->len;
+
+  if (n < self->priv->page_size)
+    return FALSE;
+
+  g_ptr_array_sort (request->candidates, compare_events);
+
+  if (request->older)
+    return candidate_timestamp (request, n - self->priv->page_size) >=
+        slot_max_timestamp (slot);
+  else
+    return candidate_timestamp (request, self->priv->page_size - 1) <
+        slot_min_timestamp (slot);
+}
+
+static void
+pager_got_events_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  EmpathyLogPager *self = user_data;
+  Request *request = g_task_get_task_data (self->priv->task);
+  Slot *slot = g_ptr_array_index (self->priv->slots, request->next);
+  GList *events, *l;
+  GError *error = NULL;
+
+  if (!tpl_log_manager_get_events_for_date_finish (TPL_LOG_MANAGER (source),
+        result, &events, &error))
+    {
+      GTask *task = self->priv->task;
+
+      DEBUG ("Failed to get events: %s", error->message);
+
+      self->priv->task = NULL;
+      g_task_return_error (task, error);
+      g_object_unref (task);
+      return;
+    }
+
+  slot->events = g_ptr_array_new_with_free_func (g_object_unref);
+
+  /* Transfer the refs */
+  for (l = events; l != NULL; l = g_list_next (l))
+    g_ptr_array_add (slot->events, l->data);
+
+  g_list_free (events);
+
+  pager_step (self);
+}
+
+static void
+pager_finish_request (EmpathyLogPager *self,
+    Request *request)
+{
+  GTask *task = self->priv->task;
+  GPtrArray *candidates = request->candidates;
+  GList *page = NULL;
+  guint first, last, i;
+
+  g_ptr_array_sort (candidates, compare_events);
+
+  if (request->older)
+    {
+      /* Keep the newest candidates, with the ones sharing a timestamp with
+       * the oldest of them */
+      first = candidates->len > self->priv->page_size ?
+          candidates->len - self->priv->page_size : 0;
+
+      while (first > 0 && candidate_timestamp (request, first - 1) ==
+          candidate_timestamp (request, first))
+        first--;
+
+      last = candidates->len;
+
+      if (first == 0 && request->next < 0)
+        self->priv->older_done = TRUE;
+
+      if (last > first)
+        self->priv->lo = candidate_timestamp (request, first);
+    }
+  else
+    {
+      first = 0;
+      last = MIN (candidates->len, self->priv->page_size);
+
+      while (last < candidates->len && candidate_timestamp (request, last) ==
+          candidate_timestamp (request, last - 1))
+        last++;
+
+      if (last == candidates->len &&
+          request->next >= (gint) self->priv->slots->len)
+        self->priv->hi = G_MAXINT64;
+      else if (last > first)
+        self->priv->hi = candidate_timestamp (request, last - 1) + 1;
+    }
+
+  for (i = last; i > first; i--)
+    page = g_list_prepend (page,
+        g_object_ref (g_ptr_array_index (candidates, i - 1)));
+
+  /* Timestamps of the window */
+  for (i = first; i < last; i++)
+    {
+      gint64 timestamp = candidate_timestamp (request, i);
+
+      if (request->older)
+        g_array_insert_val (self->priv->timestamps, i - first, timestamp);
+      else
+        g_array_append_val (self->priv->timestamps, timestamp);
+    }
+
+  /* Forget the days which weren't needed for this page */
+  for (i = 0; i < self->priv->slots->len; i++)
+    {
+      Slot *slot = g_ptr_array_index (self->priv->slots, i);
+
+      if (slot->generation != self->priv->generation)
+        tp_clear_pointer (&slot->events, g_ptr_array_unref);
+    }
+
+  DEBUG ("%u events in the page, %u in the window", last - first,
+      self->priv->timestamps->len);
+
+  self->priv->task = NULL;
+  g_task_return_pointer (task, page, NULL);
+  g_object_unref (task);
+}
+
+/* Look at the next slot which could have events of the page, read its events
+ * if needed, and return the page once there is no such slot */
+static void
+pager_step (EmpathyLogPager *self)
+{
+  Request *request = g_task_get_task_data (self->priv->task);
+  GPtrArray *slots = self->priv->slots;
+
+  while (request->next >= 0 && request->next < (gint) slots->len)
+    {
+      Slot *slot = g_ptr_array_index (slots, request->next);
+      guint i;
+
+      /* Skip the days whose events are all in the window */
+      if (request->older && slot_min_timestamp (slot) >= self->priv->lo)
+        {
+          request->next--;
+          continue;
+        }
+
+      if (!request->older && slot_max_timestamp (slot) <= self->priv->hi)
+        {
+          request->next++;
+          continue;
+        }
+
+      if (request_is_complete (self, request, slot))
+        break;
+
+      if (slot->events == NULL)
+        {
+          GDate *date = g_date_new_julian (slot->day);
+
+          tpl_log_manager_get_events_for_date_async (self->priv->log_manager,
+              slot->account, slot->target, slot->event_mask, date,
+              pager_got_events_cb, self);
+
+          g_date_free (date);
+          return;
+        }
+
+      slot->generation = self->priv->generation;
+
+      for (i = 0; i < slot->events->len; i++)
+        {
+          TplEvent *event = g_ptr_array_index (slot->events, i);
+          gint64 timestamp = tpl_event_get_timestamp (event);
+
+          if (request->older ? timestamp < self->priv->lo :
+              timestamp >= self->priv->hi)
+            g_ptr_array_add (request->candidates, event);
+        }
+
+      request->next += request->older ? -1 : 1;
+    }
+
+  pager_finish_request (self, request);
+}
+
+static void
+pager_get_events_async (EmpathyLogPager *self,
+    gboolean older,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task;
+  Request *request;
+
+  if (self->priv->task != NULL)
+    {
+      g_task_report_new_error (self, callback, user_data,
+          pager_get_events_async, G_IO_ERROR, G_IO_ERROR_PENDING,
+          "A page is already being read");
+      return;
+    }
+
+  if (!self->priv->sorted)
+    {
+      g_ptr_array_sort (self->priv->slots, compare_slots);
+      self->priv->sorted = TRUE;
+    }
+
+  task = g_task_new (self, NULL, callback, user_data);
+  g_task_set_source_tag (task, pager_get_events_async);
+
+  request = g_slice_new0 (Request);
+  request->older = older;
+  request->next = older ? (gint) self->priv->slots->len - 1 : 0;
+  request->candidates = g_ptr_array_new ();
+  g_task_set_task_data (task, request, request_free);
+
+  self->priv->task = task;
+  self->priv->generation++;
+
+  pager_step (self);
+}
+
+static void
+empathy_log_pager_finalize (GObject *object)
+{
+  EmpathyLogPager *self = EMPATHY_LOG_PAGER (object);
+
+  /* Running requests keep a ref on the pager */
+  g_assert (self->priv->task == NULL);
+
+  g_object_unref (self->priv->log_manager);
+  g_ptr_array_unref (self->priv->slots);
+  g_array_unref (self->priv->timestamps);
+
+  G_OBJECT_CLASS (empathy_log_pager_parent_class)->finalize (object);
+}
+
+static void
+empathy_log_pager_class_init (EmpathyLogPagerClass *klass)
+{
+  GObjectClass *oclass = G_OBJECT_CLASS (klass);
+
+  oclass->finalize = empathy_log_pager_finalize;
+
+  g_type_class_add_private (klass, sizeof (EmpathyLogPagerPriv));
+}
+
+static void
+empathy_log_pager_init (EmpathyLogPager *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EMPATHY_TYPE_LOG_PAGER, EmpathyLogPagerPriv);
+
+  self->priv->slots = g_ptr_array_new_with_free_func (slot_free);
+  self->priv->timestamps = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self->priv->lo = G_MAXINT64;
+  self->priv->hi = G_MAXINT64;
+}
+
+/* Pages have @page_size events, or a few more when several events share the
+ * same timestamp. If @max_events is not 0, the trim functions keep at most
+ * that number of events in the window. */
+EmpathyLogPager *
+empathy_log_pager_new (TplLogManager *log_manager,
+    guint page_size,
+    guint max_events)
+{
+  EmpathyLogPager *self;
+
+  g_return_val_if_fail (TPL_IS_LOG_MANAGER (log_manager), NULL);
+  g_return_val_if_fail (page_size > 0, NULL);
+
+  self = g_object_new (EMPATHY_TYPE_LOG_PAGER, NULL);
+  self->priv->log_manager = g_object_ref (log_manager);
+  self->priv->page_size = page_size;
+  self->priv->max_events = max_events;
+
+  return self;
+}
+
+/* Adds the events of @target logged on @date to the ones to page through.
+ * This can only be called before the first page is requested. */
+void
+empathy_log_pager_add_date (EmpathyLogPager *self,
+    TpAccount *account,
+    TplEntity *target,
+    TplEventTypeMask event_mask,
+    GDate *date)
+{
+  Slot *slot;
+
+  g_return_if_fail (EMPATHY_IS_LOG_PAGER (self));
+  g_return_if_fail (TP_IS_ACCOUNT (account));
+  g_return_if_fail (TPL_IS_ENTITY (target));
+  g_return_if_fail (date != NULL);
+  g_return_if_fail (self->priv->timestamps->len == 0);
+
+  slot = g_slice_new0 (Slot);
+  slot->account = g_object_ref (account);
+  slot->target = g_object_ref (target);
+  slot->event_mask = event_mask;
+  slot->day = g_date_get_julian (date);
+
+  g_ptr_array_add (self->priv->slots, slot);
+  self->priv->sorted = FALSE;
+}
+
+/* Reads the page of events preceding the window, and adds them to it */
+void
+empathy_log_pager_get_older_async (EmpathyLogPager *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  g_return_if_fail (EMPATHY_IS_LOG_PAGER (self));
+
+  pager_get_events_async (self, TRUE, callback, user_data);
+}
+
+/* Reads the page of events following the window, and adds them to it */
+void
+empathy_log_pager_get_newer_async (EmpathyLogPager *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  g_return_if_fail (EMPATHY_IS_LOG_PAGER (self));
+
+  pager_get_events_async (self, FALSE, callback, user_data);
+}
+
+/* @events is set to a list of owned TplEvent in chronological order, empty
+ * if there are no more events in that direction */
+gboolean
+empathy_log_pager_get_events_finish (EmpathyLogPager *self,
+    GAsyncResult *result,
+    GList **events,
+    GError **error)
+{
+  GError *err = NULL;
+  GList *page;
+
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+  page = g_task_propagate_pointer (G_TASK (result), &err);
+
+  if (err != NULL)
+    {
+      g_propagate_error (error, err);
+      return FALSE;
+    }
+
+  if (events != NULL)
+    *events = page;
+  else
+    g_list_free_full (page, g_object_unref);
+
+  return TRUE;
+}
+
+gboolean
+empathy_log_pager_has_older (EmpathyLogPager *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_LOG_PAGER (self), FALSE);
+
+  return !self->priv->older_done && self->priv->slots->len > 0;
+}
+
+gboolean
+empathy_log_pager_has_newer (EmpathyLogPager *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_LOG_PAGER (self), FALSE);
+
+  return self->priv->hi != G_MAXINT64;
+}
+
+/* Whether a page is being read */
+gboolean
+empathy_log_pager_is_busy (EmpathyLogPager *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_LOG_PAGER (self), FALSE);
+
+  return self->priv->task != NULL;
+}
+
+/* If the window has too many events, removes the newest ones from it and
+ * sets @timestamp to the timestamp from which events have been removed */
+gboolean
+empathy_log_pager_trim_newer (EmpathyLogPager *self,
+    gint64 *timestamp)
+{
+  GArray *timestamps = self->priv->timestamps;
+  guint i;
+
+  g_return_val_if_fail (EMPATHY_IS_LOG_PAGER (self), FALSE);
+
+  if (self->priv->max_events == 0 || timestamps->len <= self->priv->max_events)
+    return FALSE;
+
+  /* Events sharing a timestamp are kept or removed together */
+  for (i = self->priv->max_events;
+       i < timestamps->len &&
+       g_array_index (timestamps, gint64, i) ==
+       g_array_index (timestamps, gint64, i - 1);
+       i++)
+    ;
+
+  if (i == timestamps->len)
+    return FALSE;
+
+  self->priv->hi = g_array_index (timestamps, gint64, i);
+  g_array_set_size (timestamps, i);
+
+  if (timestamp != NULL)
+    *timestamp = self->priv->hi;
+
+  return TRUE;
+}
+
+/* If the window has too many events, removes the oldest ones from it and
+ * sets @timestamp to the timestamp before which events have been removed */
+gboolean
+empathy_log_pager_trim_older (EmpathyLogPager *self,
+    gint64 *timestamp)
+{
+  GArray *timestamps = self->priv->timestamps;
+  guint i;
+
+  g_return_val_if_fail (EMPATHY_IS_LOG_PAGER (self), FALSE);
+
+  if (self->priv->max_events == 0 || timestamps->len <= self->priv->max_events)
+    return FALSE;
+
+  for (i = timestamps->len - self->priv->max_events;
+       i > 0 &&
+       g_array_index (timestamps, gint64, i - 1) ==
+       g_array_index (timestamps, gint64, i);
+       i--)
+    ;
+
+  if (i == 0)
+    return FALSE;
+
+  self->priv->lo = g_array_index (timestamps, gint64, i);
+  self->priv->older_done = FALSE;
+  g_array_remove_range (timestamps, 0, i);
+
+  if (timestamp != NULL)
+    *timestamp = self->priv->lo;
+
+  return TRUE;
+}
+
+/* Number of events in the window */
+guint
+empathy_log_pager_get_n_events (EmpathyLogPager *self)
+{
+  g_return_val_if_fail (EMPATHY_IS_LOG_PAGER (self), 0);
+
+  return self->priv->timestamps->len;
+}
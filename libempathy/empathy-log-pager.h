@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_LOG_PAGER_H__
+#define __EMPATHY_LOG_PAGER_H__
+
+#include <telepathy-logger/telepathy-logger.h>
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_LOG_PAGER         (empathy_log_pager_get_type ())
+#define EMPATHY_LOG_PAGER(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), EMPATHY_TYPE_LOG_PAGER, EmpathyLogPager))
+#define EMPATHY_LOG_PAGER_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), EMPATHY_TYPE_LOG_PAGER, EmpathyLogPagerClass))
+#define EMPATHY_IS_LOG_PAGER(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), EMPATHY_TYPE_LOG_PAGER))
+#define EMPATHY_IS_LOG_PAGER_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), EMPATHY_TYPE_LOG_PAGER))
+#define EMPATHY_LOG_PAGER_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), EMPATHY_TYPE_LOG_PAGER, EmpathyLogPagerClass))
+
+typedef struct _EmpathyLogPager      EmpathyLogPager;
+typedef struct _EmpathyLogPagerClass EmpathyLogPagerClass;
+typedef struct _EmpathyLogPagerPriv  EmpathyLogPagerPriv;
+
+struct _EmpathyLogPager
+{
+  GObject parent;
+  EmpathyLogPagerPriv *priv;
+};
+
+struct _EmpathyLogPagerClass
+{
+  GObjectClass parent_class;
+};
+
+GType empathy_log_pager_get_type (void) G_GNUC_CONST;
+
+EmpathyLogPager * empathy_log_pager_new (TplLogManager *log_manager,
+    guint page_size,
+    guint max_events);
+
+void empathy_log_pager_add_date (EmpathyLogPager *self,
+    TpAccount *account,
+    TplEntity *target,
+    TplEventTypeMask event_mask,
+    GDate *date);
+
+void empathy_log_pager_get_older_async (EmpathyLogPager *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+void empathy_log_pager_get_newer_async (EmpathyLogPager *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+gboolean empathy_log_pager_get_events_finish (EmpathyLogPager *self,
+    GAsyncResult *result,
+    GList **events,
+    GError **error);
+
+gboolean empathy_log_pager_has_older (EmpathyLogPager *self);
+gboolean empathy_log_pager_has_newer (EmpathyLogPager *self);
+gboolean empathy_log_pager_is_busy (EmpathyLogPager *self);
+
+gboolean empathy_log_pager_trim_newer (EmpathyLogPager *self,
+    gint64 *timestamp);
+gboolean empathy_log_pager_trim_older (EmpathyLogPager *self,
+    gint64 *timestamp);
+
+guint empathy_log_pager_get_n_events (EmpathyLogPager *self);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_LOG_PAGER_H__ */
@@ -669,6 +669,25 @@ empathy_message_equal (EmpathyMessage *message1, EmpathyMessage *message2)
 	return FALSE;
 }
 
+/* Hash function consistent with empathy_message_equal(), so messages can be
+ * used as keys of a GHashTable created with both. */
+guint
+empathy_message_hash (EmpathyMessage *message)
+{
+	EmpathyMessagePriv *priv;
+	guint hash;
+
+	g_return_val_if_fail (EMPATHY_IS_MESSAGE (message), 0);
+
+	priv = GET_PRIV (message);
+
+	/* tp_strdiff() considers NULL and "" equal */
+	hash = g_int64_hash (&priv->timestamp);
+	hash = hash * 31 + g_str_hash (priv->body != NULL ? priv->body : "");
+
+	return hash;
+}
+
 EmpathyMessage *
 empathy_message_new_from_tp_message (TpMessage *tp_msg,
 				     gboolean incoming)
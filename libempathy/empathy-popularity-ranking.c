@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+#include "empathy-popularity-ranking.h"
+
+/* Items (borrowed) sorted by popularity, most popular first. Items having
+ * the same popularity are kept in the order they have been added. The
+ * ranking also tracks the top_len first items having a non-zero popularity,
+ * so callers can tell when this list changes. */
+
+/* The constant INDIVIDUALS_COUNT_COMPRESS_FACTOR represents the number of
+ * interactions needed to be considered as 1 interaction */
+#define INTERACTION_COUNT_COMPRESS_FACTOR 50
+
+/* The constant DAY_IN_SECONDS represents the seconds in a day */
+#define DAY_IN_SECONDS 86400
+
+typedef struct
+{
+  gpointer item;
+  guint popularity;
+  /* Position of the item in the order they have been added */
+  guint64 serial;
+} Entry;
+
+struct _EmpathyPopularityRanking
+{
+  /* owned Entry, most popular first */
+  GSequence *entries;
+  /* item -> GSequenceIter of its Entry */
+  GHashTable *iters;
+  guint64 next_serial;
+
+  guint top_len;
+  /* The top_len first items (borrowed) with a non-zero popularity */
+  GList *top;
+};
+
+/* Contacts that have been interacted with within the last 30 days and have
+ * have an interaction count > INTERACTION_COUNT_COMPRESS_FACTOR have a
+ * popularity value of the count/INTERACTION_COUNT_COMPRESS_FACTOR.
+ * Timestamps are in seconds; @now should be the same for all the contacts
+ * compared together. */
+guint
+empathy_popularity_compute (guint interaction_count,
+    gint64 last_interaction,
+    gint64 now)
+{
+  if (now - last_interaction > 30 * DAY_IN_SECONDS)
+    return 0;
+
+  return interaction_count / INTERACTION_COUNT_COMPRESS_FACTOR;
+}
+
+static void
+entry_free (gpointer data)
+{
+  g_slice_free (Entry, data);
+}
+
+static gint
+compare_entry (gconstpointer a,
+    gconstpointer b,
+    gpointer user_data)
+{
+  const Entry *entry_a = a;
+  const Entry *entry_b = b;
+
+  if (entry_a->popularity != entry_b->popularity)
+    return entry_a->popularity > entry_b->popularity ? -1 : 1;
+
+  if (entry_a->serial != entry_b->serial)
+    return entry_a->serial < entry_b->serial ? -1 : 1;
+
+  return 0;
+}
+
+EmpathyPopularityRanking *
+empathy_popularity_ranking_new (guint top_len)
+{
+  EmpathyPopularityRanking *ranking;
+
+  ranking = g_slice_new0 (EmpathyPopularityRanking);
+  ranking->entries = g_sequence_new (entry_free);
+  ranking->iters = g_hash_table_new (NULL, NULL);
+  ranking->top_len = top_len;
+
+  return ranking;
+}
+
+void
+empathy_popularity_ranking_free (EmpathyPopularityRanking *ranking)
+{
+  if (ranking == NULL)
+    return;
+
+  g_list_free (ranking->top);
+  g_hash_table_unref (ranking->iters);
+  g_sequence_free (ranking->entries);
+  g_slice_free (EmpathyPopularityRanking, ranking);
+}
+
+/* Rebuild the top list from the head of the sequence and return TRUE if
+ * its members changed. */
+static gboolean
+update_top (EmpathyPopularityRanking *ranking)
+{
+  GSequenceIter *iter;
+  GList *new_top = NULL, *l;
+  gboolean changed;
+  guint i, n = 0;
+
+  iter = g_sequence_get_begin_iter (ranking->entries);
+
+  for (i = 0; i < ranking->top_len && !g_sequence_iter_is_end (iter); i++)
+    {
+      Entry *entry = g_sequence_get (iter);
+
+      if (entry->popularity == 0)
+        break;
+
+      new_top = g_list_prepend (new_top, entry->item);
+      n++;
+
+      iter = g_sequence_iter_next (iter);
+    }
+
+  new_top = g_list_reverse (new_top);
+
+  changed = (n != g_list_length (ranking->top));
+  for (l = new_top; l != NULL && !changed; l = g_list_next (l))
+    {
+      if (g_list_find (ranking->top, l->data) == NULL)
+        changed = TRUE;
+    }
+
+  g_list_free (ranking->top);
+  ranking->top = new_top;
+
+  return changed;
+}
+
+/* Add @item to the ranking or move it to its new position. Returns TRUE if
+ * the members of the top list changed. */
+gboolean
+empathy_popularity_ranking_set (EmpathyPopularityRanking *ranking,
+    gpointer item,
+    guint popularity)
+{
+  GSequenceIter *iter;
+  Entry *entry;
+
+  g_return_val_if_fail (ranking != NULL, FALSE);
+
+  iter = g_hash_table_lookup (ranking->iters, item);
+  if (iter == NULL)
+    {
+      entry = g_slice_new0 (Entry);
+      entry->item = item;
+      entry->popularity = popularity;
+      entry->serial = ranking->next_serial++;
+
+      iter = g_sequence_insert_sorted (ranking->entries, entry,
+          compare_entry, NULL);
+      g_hash_table_insert (ranking->iters, item, iter);
+    }
+  else
+    {
+      entry = g_sequence_get (iter);
+      if (entry->popularity == popularity)
+        return FALSE;
+
+      entry->popularity = popularity;
+      g_sequence_sort_changed (iter, compare_entry, NULL);
+    }
+
+  return update_top (ranking);
+}
+
+/* Returns TRUE if the members of the top list changed */
+gboolean
+empathy_popularity_ranking_remove (EmpathyPopularityRanking *ranking,
+    gpointer item)
+{
+  GSequenceIter *iter;
+
+  g_return_val_if_fail (ranking != NULL, FALSE);
+
+  iter = g_hash_table_lookup (ranking->iters, item);
+  if (iter == NULL)
+    return FALSE;
+
+  g_hash_table_remove (ranking->iters, item);
+  g_sequence_remove (iter);
+
+  return update_top (ranking);
+}
+
+gboolean
+empathy_popularity_ranking_contains (EmpathyPopularityRanking *ranking,
+    gpointer item)
+{
+  g_return_val_if_fail (ranking != NULL, FALSE);
+
+  return g_hash_table_contains (ranking->iters, item);
+}
+
+guint
+empathy_popularity_ranking_get_popularity (EmpathyPopularityRanking *ranking,
+    gpointer item)
+{
+  GSequenceIter *iter;
+  Entry *entry;
+
+  g_return_val_if_fail (ranking != NULL, 0);
+
+  iter = g_hash_table_lookup (ranking->iters, item);
+  if (iter == NULL)
+    return 0;
+
+  entry = g_sequence_get (iter);
+  return entry->popularity;
+}
+
+/* Returns the most popular items (borrowed), at most top_len of them and
+ * only those with a non-zero popularity. The list is owned by the ranking. */
+GList *
+empathy_popularity_ranking_get_top (EmpathyPopularityRanking *ranking)
+{
+  g_return_val_if_fail (ranking != NULL, NULL);
+
+  return ranking->top;
+}
+
+/* Returns all the items, most popular first. Free with g_list_free(). */
+GList *
+empathy_popularity_ranking_dup_items (EmpathyPopularityRanking *ranking)
+{
+  GSequenceIter *iter;
+  GList *items = NULL;
+
+  g_return_val_if_fail (ranking != NULL, NULL);
+
+  for (iter = g_sequence_get_begin_iter (ranking->entries);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      Entry *entry = g_sequence_get (iter);
+
+      items = g_list_prepend (items, entry->item);
+    }
+
+  return g_list_reverse (items);
+}
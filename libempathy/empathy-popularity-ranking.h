@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_POPULARITY_RANKING_H__
+#define __EMPATHY_POPULARITY_RANKING_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EmpathyPopularityRanking EmpathyPopularityRanking;
+
+guint empathy_popularity_compute (guint interaction_count,
+    gint64 last_interaction,
+    gint64 now);
+
+EmpathyPopularityRanking * empathy_popularity_ranking_new (guint top_len);
+void empathy_popularity_ranking_free (EmpathyPopularityRanking *ranking);
+
+gboolean empathy_popularity_ranking_set (EmpathyPopularityRanking *ranking,
+    gpointer item,
+    guint popularity);
+gboolean empathy_popularity_ranking_remove (EmpathyPopularityRanking *ranking,
+    gpointer item);
+
+gboolean empathy_popularity_ranking_contains (
+    EmpathyPopularityRanking *ranking,
+    gpointer item);
+guint empathy_popularity_ranking_get_popularity (
+    EmpathyPopularityRanking *ranking,
+    gpointer item);
+
+GList * empathy_popularity_ranking_get_top (EmpathyPopularityRanking *ranking);
+GList * empathy_popularity_ranking_dup_items (
+    EmpathyPopularityRanking *ranking);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_POPULARITY_RANKING_H__ */
@@ -0,0 +1,394 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <telepathy-glib/telepathy-glib.h>
+#include <tp-account-widgets/tpaw-time.h>
+
+#include "empathy-adium-template.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+/* Size of the synthetic transcript used to check the time cache */
+#define N_MESSAGES 10000
+
+/* Replace each keyword by something identifying it, including characters
+ * that have to be escaped. */
+static const gchar *
+test_replace_keyword (EmpathyAdiumKeyword keyword,
+    const gchar *format,
+    gchar **to_free,
+    gpointer user_data)
+{
+  /* Some keywords are replaced by nothing */
+  if (keyword == EMPATHY_ADIUM_KEYWORD_SENDER_STATUS_ICON ||
+      keyword == EMPATHY_ADIUM_KEYWORD_VARIANT)
+    return NULL;
+
+  *to_free = g_strdup_printf ("<%d \"%s\"\\\n>", keyword,
+      format != NULL ? format : "");
+
+  return *to_free;
+}
+
+/* Brute force expansion, looking for keywords at each position of the
+ * html, as theme_adium_add_html() used to do. */
+static gboolean
+reference_match (const gchar **str,
+    const gchar *match)
+{
+  gint len;
+
+  len = strlen (match);
+  if (strncmp (*str, match, len) == 0)
+    {
+      *str += len - 1;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+reference_match_with_format (const gchar **str,
+    const gchar *match,
+    gchar **format)
+{
+  const gchar *cur = *str;
+  const gchar *end;
+
+  if (!reference_match (&cur, match))
+    return FALSE;
+
+  cur++;
+
+  end = strstr (cur, "}%");
+  if (!end)
+    return FALSE;
+
+  *format = g_strndup (cur , end - cur);
+  *str = end + 1;
+  return TRUE;
+}
+
+static gchar *
+reference_expand (const gchar *html)
+{
+  GString *string;
+  const gchar *cur;
+
+  string = g_string_new (NULL);
+
+  for (cur = html; *cur != '\0'; cur++)
+    {
+      EmpathyAdiumKeyword keyword;
+      const gchar *replace;
+      gchar *dup_replace = NULL;
+      gchar *format = NULL;
+
+      if (reference_match (&cur, "%userIconPath%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_USER_ICON_PATH;
+      else if (reference_match (&cur, "%senderScreenName%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SENDER_SCREEN_NAME;
+      else if (reference_match (&cur, "%sender%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SENDER;
+      else if (reference_match (&cur, "%senderColor%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SENDER_COLOR;
+      else if (reference_match (&cur, "%senderStatusIcon%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SENDER_STATUS_ICON;
+      else if (reference_match (&cur, "%messageDirection%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_MESSAGE_DIRECTION;
+      else if (reference_match (&cur, "%senderDisplayName%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SENDER_DISPLAY_NAME;
+      else if (reference_match (&cur, "%senderPrefix%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SENDER_PREFIX;
+      else if (reference_match_with_format (&cur, "%textbackgroundcolor{",
+            &format))
+        keyword = EMPATHY_ADIUM_KEYWORD_TEXT_BACKGROUND_COLOR;
+      else if (reference_match (&cur, "%message%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_MESSAGE;
+      else if (reference_match (&cur, "%time%") ||
+           reference_match_with_format (&cur, "%time{", &format))
+        keyword = EMPATHY_ADIUM_KEYWORD_TIME;
+      else if (reference_match (&cur, "%shortTime%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SHORT_TIME;
+      else if (reference_match (&cur, "%service%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_SERVICE;
+      else if (reference_match (&cur, "%variant%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_VARIANT;
+      else if (reference_match (&cur, "%userIcons%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_USER_ICONS;
+      else if (reference_match (&cur, "%messageClasses%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_MESSAGE_CLASSES;
+      else if (reference_match (&cur, "%status%"))
+        keyword = EMPATHY_ADIUM_KEYWORD_STATUS;
+      else
+        {
+          empathy_adium_template_append_escaped (string, cur, 1);
+          continue;
+        }
+
+      replace = test_replace_keyword (keyword, format, &dup_replace, NULL);
+      empathy_adium_template_append_escaped (string, replace, -1);
+
+      g_free (dup_replace);
+      g_free (format);
+    }
+
+  return g_string_free (string, FALSE);
+}
+
+static void
+check_template (const gchar *html)
+{
+  EmpathyAdiumTemplate *tmpl;
+  GString *string;
+  gchar *expected;
+
+  tmpl = empathy_adium_template_new (html);
+  g_assert (tmpl != NULL);
+
+  string = g_string_new (NULL);
+  empathy_adium_template_expand (tmpl, string, test_replace_keyword, NULL);
+  expected = reference_expand (html);
+
+  g_assert_cmpstr (string->str, ==, expected);
+
+  /* Expanding twice gives the same result */
+  g_string_truncate (string, 0);
+  empathy_adium_template_expand (tmpl, string, test_replace_keyword, NULL);
+  g_assert_cmpstr (string->str, ==, expected);
+
+  g_free (expected);
+  g_string_free (string, TRUE);
+  empathy_adium_template_free (tmpl);
+}
+
+static void
+test_template_strings (void)
+{
+  const gchar *tests[] = {
+    "",
+    "plain text",
+    "%message%",
+    "<div class=\"%messageClasses%\">%sender%: %message%</div>\n",
+    "%senderScreenName%%sender%%senderColor%%senderDisplayName%",
+    "%time{HH:mm:ss}% %time% %shortTime% %time{}%",
+    "%textbackgroundcolor{0.5}% %textbackgroundcolor{",
+    "%time{unterminated %message%",
+    "100% %% %unknown% %sender",
+    "back\\slash \"quotes\" \r\n new\nlines",
+    "%userIconPath% %userIcons% %service% %variant% %status%",
+    "%senderStatusIcon%%messageDirection%%senderPrefix%",
+    NULL
+  };
+  guint i;
+
+  for (i = 0; tests[i] != NULL; i++)
+    {
+      DEBUG ("Checking '%s'", tests[i]);
+      check_template (tests[i]);
+    }
+}
+
+static void
+test_template_bundled_themes (void)
+{
+  const gchar *files[] = {
+    "Content.html",
+    "Status.html",
+    "Incoming/Content.html",
+    "Incoming/NextContent.html",
+    "Incoming/Context.html",
+    "Incoming/NextContext.html",
+    "Outgoing/Content.html",
+    "Outgoing/NextContent.html",
+    "Outgoing/Context.html",
+    "Outgoing/NextContext.html",
+    NULL
+  };
+  gchar *themes_dir;
+  GDir *dir;
+  const gchar *name;
+  guint checked = 0;
+
+  themes_dir = g_build_filename (SRCDIR, "..", "data", "themes", NULL);
+  dir = g_dir_open (themes_dir, 0, NULL);
+  g_assert (dir != NULL);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      guint i;
+
+      if (!g_str_has_suffix (name, ".AdiumMessageStyle"))
+        continue;
+
+      for (i = 0; files[i] != NULL; i++)
+        {
+          gchar *path;
+          gchar *html;
+
+          path = g_build_filename (themes_dir, name, "Contents", "Resources",
+              files[i], NULL);
+
+          if (g_file_get_contents (path, &html, NULL, NULL))
+            {
+              DEBUG ("Checking %s", path);
+              check_template (html);
+              checked++;
+              g_free (html);
+            }
+
+          g_free (path);
+        }
+    }
+
+  g_assert_cmpuint (checked, >, 0);
+
+  g_dir_close (dir);
+  g_free (themes_dir);
+}
+
+static gint64 *
+new_transcript (void)
+{
+  GRand *rand;
+  gint64 *timestamps;
+  gint64 timestamp;
+  guint i;
+
+  /* Messages a few seconds apart, with a few longer pauses crossing
+   * minutes, hours and days */
+  rand = g_rand_new_with_seed (42);
+  timestamps = g_new (gint64, N_MESSAGES);
+  timestamp = 1350000000;
+
+  for (i = 0; i < N_MESSAGES; i++)
+    {
+      if (g_rand_int_range (rand, 0, 100) == 0)
+        timestamp += g_rand_int_range (rand, 60, 2 * 24 * 60 * 60);
+      else
+        timestamp += g_rand_int_range (rand, 0, 30);
+
+      timestamps[i] = timestamp;
+    }
+
+  g_rand_free (rand);
+  return timestamps;
+}
+
+static const gchar *time_formats[] = {
+  TPAW_TIME_FORMAT_DISPLAY_SHORT,
+  TPAW_TIME_DATE_FORMAT_DISPLAY_SHORT,
+  "%H:%M:%S",
+  "%-d %B %Y %I:%M %p",
+  "%T %z",
+  "100%% %Z",
+  NULL
+};
+
+/* The cached strings must be the ones tpaw_time_to_string_local() would
+ * have returned */
+static void
+test_time_cache (void)
+{
+  EmpathyAdiumTimeCache *cache;
+  gint64 *timestamps;
+  gint64 before[] = { -86401, -61, -60, -59, -1, 0, 59, 60 };
+  guint i, j;
+
+  cache = empathy_adium_time_cache_new ();
+  timestamps = new_transcript ();
+
+  for (j = 0; time_formats[j] != NULL; j++)
+    {
+      for (i = 0; i < N_MESSAGES; i++)
+        {
+          gchar *expected;
+
+          expected = tpaw_time_to_string_local (timestamps[i], time_formats[j]);
+          g_assert_cmpstr (empathy_adium_time_cache_format (cache,
+                timestamps[i], time_formats[j]), ==, expected);
+          g_free (expected);
+        }
+
+      /* Around the epoch, where rounding changes sign */
+      for (i = 0; i < G_N_ELEMENTS (before); i++)
+        {
+          gchar *expected;
+
+          expected = tpaw_time_to_string_local (before[i], time_formats[j]);
+          g_assert_cmpstr (empathy_adium_time_cache_format (cache,
+                before[i], time_formats[j]), ==, expected);
+          g_free (expected);
+        }
+    }
+
+  empathy_adium_time_cache_clear (cache);
+  g_assert_cmpstr (empathy_adium_time_cache_format (cache, 0, "%s"), ==, "0");
+
+  g_free (timestamps);
+  empathy_adium_time_cache_free (cache);
+}
+
+/* Per message cost of %time% with and without the cache. Run with -m perf
+ * to get the timings. */
+static void
+test_time_cache_perf (void)
+{
+  EmpathyAdiumTimeCache *cache;
+  gint64 *timestamps;
+  gdouble uncached, cached;
+  guint i;
+
+  if (!g_test_perf ())
+    return;
+
+  timestamps = new_transcript ();
+
+  g_test_timer_start ();
+  for (i = 0; i < N_MESSAGES; i++)
+    g_free (tpaw_time_to_string_local (timestamps[i],
+          TPAW_TIME_FORMAT_DISPLAY_SHORT));
+  uncached = g_test_timer_elapsed ();
+
+  cache = empathy_adium_time_cache_new ();
+
+  g_test_timer_start ();
+  for (i = 0; i < N_MESSAGES; i++)
+    empathy_adium_time_cache_format (cache, timestamps[i],
+        TPAW_TIME_FORMAT_DISPLAY_SHORT);
+  cached = g_test_timer_elapsed ();
+
+  g_test_message ("%%time%% of %u messages: %.3f us per message uncached, "
+      "%.3f us cached", N_MESSAGES, uncached * G_USEC_PER_SEC / N_MESSAGES,
+      cached * G_USEC_PER_SEC / N_MESSAGES);
+  g_test_minimized_result (cached, "%u cached %%time%%: %.3fs", N_MESSAGES,
+      cached);
+
+  empathy_adium_time_cache_free (cache);
+  g_free (timestamps);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/adium-template/strings", test_template_strings);
+  g_test_add_func ("/adium-template/bundled-themes",
+      test_template_bundled_themes);
+  g_test_add_func ("/adium-template/time-cache", test_time_cache);
+  g_test_add_func ("/adium-template/time-cache-perf", test_time_cache_perf);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,208 @@
+#include "config.h"
+
+#include "empathy-avatar-cache.h"
+#include "empathy-gsettings.h"
+#include "empathy-ui-utils.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+static GdkPixbuf *
+new_pixbuf (guint32 color)
+{
+  GdkPixbuf *pixbuf;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 16, 16);
+  gdk_pixbuf_fill (pixbuf, color);
+
+  return pixbuf;
+}
+
+static EmpathyAvatar *
+new_avatar (const gchar *token)
+{
+  EmpathyAvatar *avatar;
+  GdkPixbuf *pixbuf;
+  gchar *data;
+  gsize len;
+  gboolean result;
+
+  pixbuf = new_pixbuf (0x336699ff);
+  result = gdk_pixbuf_save_to_buffer (pixbuf, &data, &len, "png", NULL, NULL);
+  g_assert (result);
+
+  avatar = empathy_avatar_new ((guchar *) data, len, "image/png", NULL);
+  avatar->token = g_strdup (token);
+
+  g_free (data);
+  g_object_unref (pixbuf);
+
+  return avatar;
+}
+
+/* Displaying the same avatar several times only decodes it once */
+static void
+test_avatar_cache_decode_once (void)
+{
+  EmpathyAvatarCache *cache = empathy_avatar_cache_get_default ();
+  EmpathyAvatar *avatar;
+  GdkPixbuf *first, *pixbuf;
+  guint hits, misses;
+  guint i;
+
+  empathy_avatar_cache_clear (cache);
+  hits = empathy_avatar_cache_get_hits (cache);
+  misses = empathy_avatar_cache_get_misses (cache);
+
+  avatar = new_avatar ("test-token");
+
+  first = empathy_pixbuf_from_avatar_scaled (avatar, 48, 48);
+  g_assert (GDK_IS_PIXBUF (first));
+  g_assert_cmpuint (empathy_avatar_cache_get_misses (cache), ==, misses + 1);
+  g_assert_cmpuint (empathy_avatar_cache_get_hits (cache), ==, hits);
+
+  for (i = 0; i < 10; i++)
+    {
+      pixbuf = empathy_pixbuf_from_avatar_scaled (avatar, 48, 48);
+      g_assert (pixbuf == first);
+      g_object_unref (pixbuf);
+    }
+
+  g_assert_cmpuint (empathy_avatar_cache_get_misses (cache), ==, misses + 1);
+  g_assert_cmpuint (empathy_avatar_cache_get_hits (cache), ==, hits + 10);
+
+  /* Other sizes are decoded separately */
+  pixbuf = empathy_pixbuf_from_avatar_scaled (avatar, 32, 32);
+  g_assert (pixbuf != first);
+  g_assert_cmpuint (empathy_avatar_cache_get_misses (cache), ==, misses + 2);
+  g_object_unref (pixbuf);
+
+  g_object_unref (first);
+  empathy_avatar_unref (avatar);
+
+  /* Avatars without token are not cached */
+  avatar = new_avatar (NULL);
+  hits = empathy_avatar_cache_get_hits (cache);
+  misses = empathy_avatar_cache_get_misses (cache);
+
+  first = empathy_pixbuf_from_avatar_scaled (avatar, 48, 48);
+  pixbuf = empathy_pixbuf_from_avatar_scaled (avatar, 48, 48);
+  g_assert (pixbuf != first);
+
+  g_assert_cmpuint (empathy_avatar_cache_get_misses (cache), ==, misses);
+  g_assert_cmpuint (empathy_avatar_cache_get_hits (cache), ==, hits);
+
+  g_object_unref (first);
+  g_object_unref (pixbuf);
+  empathy_avatar_unref (avatar);
+}
+
+static gboolean
+cache_contains (EmpathyAvatarCache *cache,
+    const gchar *key)
+{
+  GdkPixbuf *pixbuf;
+
+  pixbuf = empathy_avatar_cache_lookup (cache, key, 16, 16);
+  if (pixbuf == NULL)
+    return FALSE;
+
+  g_object_unref (pixbuf);
+  return TRUE;
+}
+
+static void
+test_avatar_cache_lru (void)
+{
+  EmpathyAvatarCache *cache;
+  GdkPixbuf *pixbuf;
+  gsize pixbuf_size;
+
+  pixbuf = new_pixbuf (0xffffffff);
+  pixbuf_size = gdk_pixbuf_get_rowstride (pixbuf) *
+      gdk_pixbuf_get_height (pixbuf);
+
+  /* Room for 3 avatars */
+  cache = empathy_avatar_cache_new (3 * pixbuf_size);
+
+  empathy_avatar_cache_insert (cache, "a", 16, 16, pixbuf);
+  empathy_avatar_cache_insert (cache, "b", 16, 16, pixbuf);
+  empathy_avatar_cache_insert (cache, "c", 16, 16, pixbuf);
+  g_assert_cmpuint (empathy_avatar_cache_get_size (cache), ==,
+      3 * pixbuf_size);
+
+  /* "a" is now the most recently used one, so adding "d" drops "b" */
+  g_assert (cache_contains (cache, "a"));
+  empathy_avatar_cache_insert (cache, "d", 16, 16, pixbuf);
+
+  g_assert (!cache_contains (cache, "b"));
+  g_assert (cache_contains (cache, "a"));
+  g_assert (cache_contains (cache, "c"));
+  g_assert (cache_contains (cache, "d"));
+  g_assert_cmpuint (empathy_avatar_cache_get_size (cache), ==,
+      3 * pixbuf_size);
+
+  /* Replacing an avatar does not use more memory */
+  empathy_avatar_cache_insert (cache, "d", 16, 16, pixbuf);
+  g_assert_cmpuint (empathy_avatar_cache_get_size (cache), ==,
+      3 * pixbuf_size);
+
+  empathy_avatar_cache_remove (cache, "c");
+  g_assert (!cache_contains (cache, "c"));
+  g_assert_cmpuint (empathy_avatar_cache_get_size (cache), ==,
+      2 * pixbuf_size);
+
+  /* Reducing the budget drops the least recently used avatars */
+  empathy_avatar_cache_set_budget (cache, pixbuf_size);
+  g_assert_cmpuint (empathy_avatar_cache_get_size (cache), ==, pixbuf_size);
+  g_assert (cache_contains (cache, "d"));
+
+  empathy_avatar_cache_clear (cache);
+  g_assert_cmpuint (empathy_avatar_cache_get_size (cache), ==, 0);
+  g_assert (!cache_contains (cache, "d"));
+
+  empathy_avatar_cache_free (cache);
+  g_object_unref (pixbuf);
+}
+
+static void
+test_avatar_cache_budget_setting (void)
+{
+  EmpathyAvatarCache *cache = empathy_avatar_cache_get_default ();
+  GSettings *gsettings;
+
+  gsettings = g_settings_new (EMPATHY_PREFS_UI_SCHEMA);
+
+  /* The default cache follows the key, which is in KiB */
+  g_assert_cmpuint (empathy_avatar_cache_get_budget (cache), ==,
+      (gsize) g_settings_get_uint (gsettings,
+        EMPATHY_PREFS_UI_AVATAR_CACHE_SIZE) * 1024);
+
+  g_settings_set_uint (gsettings, EMPATHY_PREFS_UI_AVATAR_CACHE_SIZE, 42);
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+  g_assert_cmpuint (empathy_avatar_cache_get_budget (cache), ==, 42 * 1024);
+
+  g_settings_reset (gsettings, EMPATHY_PREFS_UI_AVATAR_CACHE_SIZE);
+  g_object_unref (gsettings);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init_with_session_bus (argc, argv);
+
+  g_test_add_func ("/avatar-cache/decode-once", test_avatar_cache_decode_once);
+  g_test_add_func ("/avatar-cache/lru", test_avatar_cache_lru);
+  g_test_add_func ("/avatar-cache/budget-setting",
+      test_avatar_cache_budget_setting);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,323 @@
+#include "config.h"
+
+#include "empathy-backlog-reader.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "fake/jabber/account0"
+/* How telepathy-logger names the directory of this account */
+#define ACCOUNT_DIR "fake_jabber_account0"
+#define CONTACT_ID "contact@example.com"
+
+#define N_DAYS 5
+#define N_MESSAGES 60
+
+#define PAGE_SIZE 40
+
+/* Timestamps of all the fixture messages, in chronological order */
+static GArray *fixture_timestamps = NULL;
+
+static TpAccount *
+dup_test_account (void)
+{
+  TpDBusDaemon *dbus;
+  TpSimpleClientFactory *factory;
+  TpAccount *account;
+  GError *error = NULL;
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  factory = tp_simple_client_factory_new (dbus);
+  account = tp_simple_client_factory_ensure_account (factory, ACCOUNT_PATH,
+      NULL, &error);
+  g_assert_no_error (error);
+
+  g_object_unref (factory);
+  g_object_unref (dbus);
+
+  return account;
+}
+
+/* Writes logs the way telepathy-logger's XML store does, in
+ * XDG_DATA_HOME/TpLogger/logs/<account>/<identifier>/<date>.log */
+static void
+generate_fixture (void)
+{
+  gchar *dir;
+  guint d, m;
+
+  fixture_timestamps = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  dir = g_build_filename (g_get_user_data_dir (), "TpLogger", "logs",
+      ACCOUNT_DIR, CONTACT_ID, NULL);
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+  for (d = 0; d < N_DAYS; d++)
+    {
+      GString *log;
+      gchar *path;
+      GError *error = NULL;
+
+      log = g_string_new ("<?xml version='1.0' encoding='utf-8'?>\n"
+          "<?xml-stylesheet type=\"text/xsl\" "
+          "href=\"log-store-xml.xsl\"?>\n<log>\n");
+
+      for (m = 0; m < N_MESSAGES; m++)
+        {
+          GDateTime *datetime;
+          gint64 timestamp;
+
+          g_string_append_printf (log,
+              "<message time='201303%02uT%02u:%02u:00' cm_id='%u' id='%s' "
+              "name='Contact' token='' isuser='false' type='normal'>"
+              "Message %u</message>\n",
+              d + 1, m / 6, (m % 6) * 10, m, CONTACT_ID, m);
+
+          datetime = g_date_time_new_utc (2013, 3, d + 1, m / 6,
+              (m % 6) * 10, 0);
+          timestamp = g_date_time_to_unix (datetime);
+          g_array_append_val (fixture_timestamps, timestamp);
+          g_date_time_unref (datetime);
+        }
+
+      g_string_append (log, "</log>\n");
+
+      path = g_strdup_printf ("%s/201303%02u.log", dir, d + 1);
+      g_file_set_contents (path, log->str, log->len, &error);
+      g_assert_no_error (error);
+
+      g_free (path);
+      g_string_free (log, TRUE);
+    }
+
+  g_free (dir);
+}
+
+static EmpathyBacklogReader *
+reader_new (TpAccount *account)
+{
+  EmpathyBacklogReader *reader;
+  TplLogManager *log_manager;
+  TplLogWalker *walker;
+  TplEntity *target;
+
+  log_manager = tpl_log_manager_dup_singleton ();
+  target = tpl_entity_new (CONTACT_ID, TPL_ENTITY_CONTACT, "Contact", NULL);
+
+  walker = tpl_log_manager_walk_filtered_events (log_manager, account, target,
+      TPL_EVENT_MASK_TEXT, NULL, NULL);
+  reader = empathy_backlog_reader_new (walker);
+
+  g_object_unref (walker);
+  g_object_unref (target);
+  g_object_unref (log_manager);
+
+  return reader;
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  GArray *timestamps;
+} PageData;
+
+static void
+got_page_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  PageData *data = user_data;
+  GList *events, *l;
+  GError *error = NULL;
+
+  empathy_backlog_reader_get_page_finish (EMPATHY_BACKLOG_READER (source),
+      result, &events, &error);
+  g_assert_no_error (error);
+
+  for (l = events; l != NULL; l = g_list_next (l))
+    {
+      gint64 timestamp = tpl_event_get_timestamp (l->data);
+
+      g_array_append_val (data->timestamps, timestamp);
+    }
+
+  g_list_free_full (events, g_object_unref);
+
+  g_main_loop_quit (data->loop);
+}
+
+static void
+pending_page_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GError *error = NULL;
+
+  g_assert (!empathy_backlog_reader_get_page_finish (
+        EMPATHY_BACKLOG_READER (source), result, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_PENDING);
+
+  g_error_free (error);
+}
+
+/* Returns the timestamps of the events of the next page. If @prefetched is
+ * TRUE, the page is expected to have been read ahead already. */
+static GArray *
+get_page (EmpathyBacklogReader *reader,
+    gboolean prefetched)
+{
+  PageData data;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.timestamps = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  empathy_backlog_reader_get_page_async (reader, got_page_cb, &data);
+
+  /* Pages read ahead are returned right away. Only one page is read at a
+   * time otherwise. */
+  if (prefetched)
+    g_assert_cmpuint (empathy_backlog_reader_get_n_prefetched (reader), ==,
+        0);
+  else
+    empathy_backlog_reader_get_page_async (reader, pending_page_cb, NULL);
+
+  g_main_loop_run (data.loop);
+  g_main_loop_unref (data.loop);
+
+  return data.timestamps;
+}
+
+static void
+test_backlog_reader_page_size (void)
+{
+  EmpathyBacklogReader *reader;
+  TpAccount *account;
+
+  account = dup_test_account ();
+  reader = reader_new (account);
+
+  /* Pages fill the view, and get bigger while they are asked for quickly */
+  g_assert_cmpuint (empathy_backlog_reader_update_page_size (reader, 10, 50),
+      ==, 10);
+  g_assert_cmpuint (empathy_backlog_reader_update_page_size (reader, 10, 50),
+      ==, 20);
+  g_assert_cmpuint (empathy_backlog_reader_update_page_size (reader, 10, 50),
+      ==, 40);
+  g_assert_cmpuint (empathy_backlog_reader_update_page_size (reader, 10, 50),
+      ==, 50);
+  g_assert_cmpuint (empathy_backlog_reader_get_page_size (reader), ==, 50);
+
+  /* But never get smaller than the minimum */
+  g_assert_cmpuint (empathy_backlog_reader_update_page_size (reader, 10, 0),
+      ==, EMPATHY_BACKLOG_READER_MIN_PAGE_SIZE);
+  g_assert_cmpuint (empathy_backlog_reader_update_page_size (reader, 0, 50),
+      ==, EMPATHY_BACKLOG_READER_MIN_PAGE_SIZE);
+
+  g_object_unref (reader);
+  g_object_unref (account);
+}
+
+static void
+test_backlog_reader_prefetch (void)
+{
+  EmpathyBacklogReader *reader;
+  TpAccount *account;
+  guint n_pages = 0, remaining, i;
+
+  account = dup_test_account ();
+  reader = reader_new (account);
+
+  g_assert_cmpuint (empathy_backlog_reader_update_page_size (reader,
+        PAGE_SIZE, PAGE_SIZE), ==, PAGE_SIZE);
+  g_assert (empathy_backlog_reader_has_more (reader));
+  g_assert (!empathy_backlog_reader_has_prefetched (reader));
+
+  remaining = fixture_timestamps->len;
+
+  /* Go back to the first event, reading the next page ahead each time the
+   * previous one is returned */
+  while (empathy_backlog_reader_has_more (reader))
+    {
+      gboolean prefetched = FALSE;
+      GArray *page;
+
+      if (n_pages > 0)
+        {
+          empathy_backlog_reader_prefetch (reader, 1);
+          g_assert (empathy_backlog_reader_has_prefetched (reader));
+
+          /* Every other page is asked for once it has been read ahead,
+           * and the others while it is being read */
+          if (n_pages % 2 == 0 && remaining >= PAGE_SIZE)
+            {
+              while (empathy_backlog_reader_get_n_prefetched (reader) <
+                  PAGE_SIZE)
+                g_main_context_iteration (NULL, TRUE);
+
+              prefetched = TRUE;
+            }
+        }
+
+      page = get_page (reader, prefetched);
+
+      if (remaining >= PAGE_SIZE)
+        g_assert_cmpuint (page->len, ==, PAGE_SIZE);
+      else
+        g_assert_cmpuint (page->len, ==, remaining);
+
+      /* Pages are the events preceding the previous one, in chronological
+       * order */
+      remaining -= page->len;
+      for (i = 0; i < page->len; i++)
+        g_assert_cmpint (g_array_index (page, gint64, i), ==,
+            g_array_index (fixture_timestamps, gint64, remaining + i));
+
+      g_array_unref (page);
+      n_pages++;
+    }
+
+  DEBUG ("%u events in %u pages", fixture_timestamps->len, n_pages);
+
+  g_assert_cmpuint (remaining, ==, 0);
+  g_assert_cmpuint (n_pages, ==,
+      (fixture_timestamps->len + PAGE_SIZE - 1) / PAGE_SIZE);
+  g_assert (!empathy_backlog_reader_has_prefetched (reader));
+
+  g_object_unref (reader);
+  g_object_unref (account);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  gchar *dir, *data_dir;
+
+  /* Use a log tree of our own */
+  dir = g_dir_make_tmp ("empathy-backlog-reader-test-XXXXXX", NULL);
+  g_assert (dir != NULL);
+
+  data_dir = g_build_filename (dir, "data", NULL);
+  g_setenv ("XDG_DATA_HOME", data_dir, TRUE);
+
+  test_init_with_session_bus (argc, argv);
+
+  generate_fixture ();
+
+  g_test_add_func ("/backlog-reader/page-size",
+      test_backlog_reader_page_size);
+  g_test_add_func ("/backlog-reader/prefetch", test_backlog_reader_prefetch);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  g_array_unref (fixture_timestamps);
+  g_free (data_dir);
+  g_free (dir);
+
+  return result;
+}
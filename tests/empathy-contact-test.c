@@ -0,0 +1,427 @@
+#include "config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "empathy-contact.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_EVENTS 50000
+#define N_ENTITIES 100
+#define N_AVATAR_CONTACTS 20
+
+#define AVATAR_TOKEN "avatar-token"
+#define AVATAR_DATA "not really a PNG"
+
+/* How telepathy-logger names the directory of the test account */
+#define ACCOUNT_DIR "fake_jabber_account0"
+#define N_LOG_CHECKS 5
+
+static TpAccount *
+dup_test_account (void)
+{
+  TpDBusDaemon *dbus;
+  TpSimpleClientFactory *factory;
+  TpAccount *account;
+  GError *error = NULL;
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  factory = tp_simple_client_factory_new (dbus);
+  account = tp_simple_client_factory_ensure_account (factory,
+      TP_ACCOUNT_OBJECT_PATH_BASE "fake/jabber/account0", NULL, &error);
+  g_assert_no_error (error);
+
+  g_object_unref (factory);
+  g_object_unref (dbus);
+
+  return account;
+}
+
+static void
+test_contact_from_tpl_contact (void)
+{
+  TpAccount *account;
+  GPtrArray *contacts;
+  GHashTable *created;
+  EmpathyContact *contact;
+  gdouble elapsed;
+  guint i;
+
+  account = dup_test_account ();
+
+  /* Like a log page, keep a ref on the contact of each event */
+  contacts = g_ptr_array_new_with_free_func (g_object_unref);
+  created = g_hash_table_new (NULL, NULL);
+
+  g_test_timer_start ();
+
+  for (i = 0; i < N_EVENTS; i++)
+    {
+      TplEntity *entity;
+      guint n = g_test_rand_int_range (0, N_ENTITIES);
+      gchar *id, *alias;
+
+      id = g_strdup_printf ("contact%u@example.com", n);
+      /* Every entity is renamed half way through the log */
+      alias = g_strdup_printf ("Contact %u%s", n,
+          i < N_EVENTS / 2 ? "" : " (renamed)");
+
+      entity = tpl_entity_new (id, TPL_ENTITY_CONTACT, alias, "");
+      contact = empathy_contact_from_tpl_contact (account, entity);
+
+      g_assert_cmpstr (empathy_contact_get_id (contact), ==, id);
+      g_assert_cmpstr (empathy_contact_get_alias (contact), ==, alias);
+      g_assert (empathy_contact_get_account (contact) == account);
+
+      g_ptr_array_add (contacts, contact);
+      g_hash_table_add (created, contact);
+
+      g_object_unref (entity);
+      g_free (id);
+      g_free (alias);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "%u events: %f seconds", N_EVENTS,
+      elapsed);
+
+  /* At most one contact per entity and alias */
+  DEBUG ("%u contacts for %u events", g_hash_table_size (created), N_EVENTS);
+  g_assert_cmpuint (g_hash_table_size (created), <=, 2 * N_ENTITIES);
+
+  /* The cache doesn't keep contacts alive */
+  contact = g_ptr_array_index (contacts, 0);
+  g_object_add_weak_pointer (G_OBJECT (contact), (gpointer *) &contact);
+
+  g_hash_table_unref (created);
+  g_ptr_array_unref (contacts);
+
+  g_assert (contact == NULL);
+
+  g_object_unref (account);
+}
+
+static gchar *
+dup_avatar_dir (void)
+{
+  /* Matches the account of dup_test_account () */
+  return g_build_filename (g_get_user_cache_dir (), "telepathy", "avatars",
+      "fake", "jabber", NULL);
+}
+
+static EmpathyContact *
+contact_new_with_avatar (TpAccount *account,
+    guint n,
+    const gchar *token)
+{
+  EmpathyContact *contact;
+  TplEntity *entity;
+  gchar *id;
+
+  id = g_strdup_printf ("avatar%u@example.com", n);
+  entity = tpl_entity_new (id, TPL_ENTITY_CONTACT, id, token);
+  contact = empathy_contact_from_tpl_contact (account, entity);
+
+  g_object_unref (entity);
+  g_free (id);
+
+  return contact;
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  guint n_loaded;
+} AvatarData;
+
+static void
+avatar_notify_cb (EmpathyContact *contact,
+    GParamSpec *pspec,
+    AvatarData *data)
+{
+  data->n_loaded++;
+
+  if (data->n_loaded == N_AVATAR_CONTACTS)
+    g_main_loop_quit (data->loop);
+}
+
+static void
+test_contact_avatar_cache (void)
+{
+  TpAccount *account;
+  EmpathyContact *contacts[N_AVATAR_CONTACTS];
+  EmpathyContact *contact;
+  EmpathyAvatar *avatar;
+  AvatarData data = { NULL, 0 };
+  gchar *dir, *token, *path;
+  guint i;
+  GError *error = NULL;
+
+  account = dup_test_account ();
+
+  dir = dup_avatar_dir ();
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+  token = tp_escape_as_identifier (AVATAR_TOKEN);
+  path = g_build_filename (dir, token, NULL);
+  g_file_set_contents (path, AVATAR_DATA, -1, &error);
+  g_assert_no_error (error);
+
+  /* Request the same avatar for many contacts at once */
+  for (i = 0; i < N_AVATAR_CONTACTS; i++)
+    {
+      contacts[i] = contact_new_with_avatar (account, i, AVATAR_TOKEN);
+
+      /* The file is read asynchronously, and only known once it has been */
+      g_assert (empathy_contact_get_avatar (contacts[i]) == NULL);
+      g_assert (empathy_contact_get_avatar_filename (contacts[i]) == NULL);
+
+      g_signal_connect (contacts[i], "notify::avatar",
+          G_CALLBACK (avatar_notify_cb), &data);
+    }
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (data.loop);
+
+  g_assert_cmpuint (data.n_loaded, ==, N_AVATAR_CONTACTS);
+
+  avatar = empathy_contact_get_avatar (contacts[0]);
+  g_assert (avatar != NULL);
+  g_assert_cmpstr (avatar->token, ==, AVATAR_TOKEN);
+  g_assert_cmpstr (avatar->filename, ==, path);
+  g_assert_cmpuint (avatar->len, ==, strlen (AVATAR_DATA));
+  g_assert_cmpstr (empathy_contact_get_avatar_filename (contacts[0]), ==,
+      path);
+
+  /* The file has been read once and its avatar is shared */
+  for (i = 1; i < N_AVATAR_CONTACTS; i++)
+    g_assert (empathy_contact_get_avatar (contacts[i]) == avatar);
+
+  /* The avatar directory is only created once */
+  g_assert_cmpint (g_unlink (path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+
+  contact = contact_new_with_avatar (account, N_AVATAR_CONTACTS,
+      "another-token");
+  g_assert (!g_file_test (dir, G_FILE_TEST_EXISTS));
+
+  /* A missing file is not an error */
+  g_assert (empathy_contact_get_avatar (contact) == NULL);
+  g_assert (empathy_contact_get_avatar_filename (contact) == NULL);
+
+  for (i = 0; i < N_AVATAR_CONTACTS; i++)
+    g_object_unref (contacts[i]);
+
+  g_object_unref (contact);
+  g_main_loop_unref (data.loop);
+  g_free (path);
+  g_free (token);
+  g_free (dir);
+  g_object_unref (account);
+}
+
+/* Writes a log the way telepathy-logger's XML store does */
+static void
+write_log (const gchar *id)
+{
+  gchar *dir, *path;
+  GError *error = NULL;
+
+  dir = g_build_filename (g_get_user_data_dir (), "TpLogger", "logs",
+      ACCOUNT_DIR, id, NULL);
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+  path = g_build_filename (dir, "20130301.log", NULL);
+  g_file_set_contents (path, "<?xml version='1.0' encoding='utf-8'?>\n"
+      "<log>\n<message time='20130301T10:00:00' cm_id='0' id='contact' "
+      "name='Contact' token='' isuser='false' type='normal'>Hi</message>\n"
+      "</log>\n", -1, &error);
+  g_assert_no_error (error);
+
+  g_free (path);
+  g_free (dir);
+}
+
+static EmpathyContact *
+contact_new_with_id (TpAccount *account,
+    const gchar *id)
+{
+  EmpathyContact *contact;
+  TplEntity *entity;
+
+  entity = tpl_entity_new (id, TPL_ENTITY_CONTACT, id, "");
+  contact = empathy_contact_from_tpl_contact (account, entity);
+  g_object_unref (entity);
+
+  return contact;
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  guint n_pending;
+  guint n_with_log;
+} HasLogData;
+
+static void
+has_log_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  HasLogData *data = user_data;
+  GError *error = NULL;
+
+  if (empathy_contact_has_log_finish (EMPATHY_CONTACT (source), result,
+        &error))
+    data->n_with_log++;
+
+  g_assert_no_error (error);
+
+  if (--data->n_pending == 0)
+    g_main_loop_quit (data->loop);
+}
+
+/* Returns how many of @n_checks checks found logs with @contact */
+static guint
+check_has_log (EmpathyContact *contact,
+    guint n_checks)
+{
+  HasLogData data = { NULL, n_checks, 0 };
+  guint i;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+
+  for (i = 0; i < n_checks; i++)
+    empathy_contact_has_log_async (contact, has_log_cb, &data);
+
+  g_main_loop_run (data.loop);
+  g_main_loop_unref (data.loop);
+
+  return data.n_with_log;
+}
+
+static void
+has_log_notify_cb (GObject *object,
+    GParamSpec *pspec,
+    gpointer user_data)
+{
+  guint *n_notified = user_data;
+
+  (*n_notified)++;
+}
+
+static void
+test_contact_has_log (void)
+{
+  TpAccount *account;
+  EmpathyContact *logged, *unlogged;
+  guint n_notified = 0;
+
+  account = dup_test_account ();
+
+  write_log ("logged@example.com");
+
+  logged = contact_new_with_id (account, "logged@example.com");
+  unlogged = contact_new_with_id (account, "unlogged@example.com");
+
+  g_signal_connect (unlogged, "notify::has-log",
+      G_CALLBACK (has_log_notify_cb), &n_notified);
+
+  /* Until the logs have been looked up, they are assumed to exist */
+  g_assert (empathy_contact_can_do_action (logged, EMPATHY_ACTION_VIEW_LOGS));
+  g_assert (empathy_contact_can_do_action (unlogged,
+        EMPATHY_ACTION_VIEW_LOGS));
+  g_assert_cmpuint (n_notified, ==, 0);
+
+  /* Concurrent checks all get the answer */
+  g_assert_cmpuint (check_has_log (logged, N_LOG_CHECKS), ==, N_LOG_CHECKS);
+  g_assert_cmpuint (check_has_log (unlogged, N_LOG_CHECKS), ==, 0);
+
+  /* "has-log" is notified once the answer is known */
+  g_assert_cmpuint (n_notified, ==, 1);
+
+  g_assert (empathy_contact_can_do_action (logged, EMPATHY_ACTION_VIEW_LOGS));
+  g_assert (!empathy_contact_can_do_action (unlogged,
+        EMPATHY_ACTION_VIEW_LOGS));
+
+  /* The answer is remembered until the logger gets new events */
+  write_log ("unlogged@example.com");
+  g_assert_cmpuint (check_has_log (unlogged, 1), ==, 0);
+
+  empathy_contact_invalidate_has_log (account, "unlogged@example.com");
+  g_assert_cmpuint (check_has_log (unlogged, 1), ==, 1);
+
+  empathy_contact_invalidate_has_log (NULL, NULL);
+  g_assert_cmpuint (check_has_log (logged, 1), ==, 1);
+  g_assert_cmpuint (check_has_log (unlogged, 1), ==, 1);
+
+  g_object_unref (logged);
+  g_object_unref (unlogged);
+  g_object_unref (account);
+}
+
+/* Removes @path and everything below it */
+static void
+remove_tree (const gchar *path)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *child = g_build_filename (path, name, NULL);
+
+          remove_tree (child);
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_remove (path);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  gchar *dir, *cache_dir, *data_dir;
+
+  /* Don't touch the real avatar cache and logs */
+  dir = g_dir_make_tmp ("empathy-contact-test-XXXXXX", NULL);
+  g_assert (dir != NULL);
+
+  cache_dir = g_build_filename (dir, "cache", NULL);
+  data_dir = g_build_filename (dir, "data", NULL);
+  g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+  g_setenv ("XDG_DATA_HOME", data_dir, TRUE);
+
+  test_init_with_session_bus (argc, argv);
+
+  g_test_add_func ("/contact/from-tpl-contact",
+      test_contact_from_tpl_contact);
+  g_test_add_func ("/contact/avatar-cache",
+      test_contact_avatar_cache);
+  g_test_add_func ("/contact/has-log",
+      test_contact_has_log);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  remove_tree (dir);
+
+  g_free (data_dir);
+  g_free (cache_dir);
+  g_free (dir);
+
+  return result;
+}
@@ -0,0 +1,387 @@
+#include "config.h"
+
+#include "empathy-avatar-cache.h"
+#include "empathy-individual-store.h"
+#include "empathy-ui-utils.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_INDIVIDUALS 50
+#define N_PRESENCE_CHANGES 100
+
+/* Individuals without any persona but with a given alias and avatar, so they
+ * can be displayed in a store without any backend. */
+
+typedef struct
+{
+  FolksIndividual parent;
+  gchar *alias;
+  GLoadableIcon *avatar;
+} TestIndividual;
+
+typedef struct
+{
+  FolksIndividualClass parent_class;
+} TestIndividualClass;
+
+static void test_individual_alias_details_init (FolksAliasDetailsIface *iface);
+static void test_individual_avatar_details_init (
+    FolksAvatarDetailsIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestIndividual, test_individual,
+    FOLKS_TYPE_INDIVIDUAL,
+    G_IMPLEMENT_INTERFACE (FOLKS_TYPE_ALIAS_DETAILS,
+        test_individual_alias_details_init)
+    G_IMPLEMENT_INTERFACE (FOLKS_TYPE_AVATAR_DETAILS,
+        test_individual_avatar_details_init))
+
+static const gchar *
+test_individual_get_alias (FolksAliasDetails *details)
+{
+  TestIndividual *self = (TestIndividual *) details;
+
+  return self->alias;
+}
+
+static GLoadableIcon *
+test_individual_get_avatar (FolksAvatarDetails *details)
+{
+  TestIndividual *self = (TestIndividual *) details;
+
+  return self->avatar;
+}
+
+static void
+test_individual_alias_details_init (FolksAliasDetailsIface *iface)
+{
+  iface->get_alias = test_individual_get_alias;
+}
+
+static void
+test_individual_avatar_details_init (FolksAvatarDetailsIface *iface)
+{
+  iface->get_avatar = test_individual_get_avatar;
+}
+
+static void
+test_individual_finalize (GObject *object)
+{
+  TestIndividual *self = (TestIndividual *) object;
+
+  g_free (self->alias);
+  g_clear_object (&self->avatar);
+
+  G_OBJECT_CLASS (test_individual_parent_class)->finalize (object);
+}
+
+static void
+test_individual_class_init (TestIndividualClass *klass)
+{
+  GObjectClass *oclass = G_OBJECT_CLASS (klass);
+
+  oclass->finalize = test_individual_finalize;
+}
+
+static void
+test_individual_init (TestIndividual *self)
+{
+}
+
+static FolksIndividual *
+test_individual_new (const gchar *alias)
+{
+  TestIndividual *self;
+  GdkPixbuf *pixbuf;
+  GBytes *bytes;
+  gchar *data;
+  gsize len;
+  gboolean result;
+
+  self = g_object_new (test_individual_get_type (), NULL);
+  self->alias = g_strdup (alias);
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 64, 64);
+  gdk_pixbuf_fill (pixbuf, 0x336699ff);
+  result = gdk_pixbuf_save_to_buffer (pixbuf, &data, &len, "png", NULL, NULL);
+  g_assert (result);
+
+  bytes = g_bytes_new_take (data, len);
+  self->avatar = G_LOADABLE_ICON (g_bytes_icon_new (bytes));
+
+  g_bytes_unref (bytes);
+  g_object_unref (pixbuf);
+
+  return FOLKS_INDIVIDUAL (self);
+}
+
+/* Avatars are looked up in the cache when they are requested, cached ones
+ * are then delivered from an idle callback */
+static void
+run_pending_sources (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+static gboolean
+store_has_all_avatars (GtkTreeModel *model)
+{
+  GtkTreeIter iter;
+  gboolean valid;
+  gboolean result = TRUE;
+
+  for (valid = gtk_tree_model_get_iter_first (model, &iter);
+       valid && result;
+       valid = gtk_tree_model_iter_next (model, &iter))
+    {
+      FolksIndividual *individual;
+      GdkPixbuf *pixbuf;
+
+      gtk_tree_model_get (model, &iter,
+          EMPATHY_INDIVIDUAL_STORE_COL_INDIVIDUAL, &individual,
+          EMPATHY_INDIVIDUAL_STORE_COL_PIXBUF_AVATAR, &pixbuf,
+          -1);
+
+      if (individual != NULL && pixbuf == NULL)
+        result = FALSE;
+
+      tp_clear_object (&individual);
+      tp_clear_object (&pixbuf);
+    }
+
+  return result;
+}
+
+/* Wait for the avatars decoded in a thread to reach the store */
+static void
+wait_for_avatars (EmpathyIndividualStore *store)
+{
+  while (!store_has_all_avatars (GTK_TREE_MODEL (store)))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+/* Number of avatars requested, decoded or not */
+static guint
+count_avatar_loads (void)
+{
+  EmpathyAvatarCache *cache = empathy_avatar_cache_get_default ();
+
+  return empathy_avatar_cache_get_hits (cache) +
+      empathy_avatar_cache_get_misses (cache);
+}
+
+static void
+test_individual_store_presence_storm (void)
+{
+  EmpathyIndividualStore *store;
+  GList *individuals = NULL, *l;
+  GeeSet *empty_set;
+  guint loads, misses;
+  guint i;
+
+  store = g_object_new (EMPATHY_TYPE_INDIVIDUAL_STORE, NULL);
+  empathy_avatar_cache_clear (empathy_avatar_cache_get_default ());
+
+  loads = count_avatar_loads ();
+  misses = empathy_avatar_cache_get_misses (
+      empathy_avatar_cache_get_default ());
+
+  for (i = 0; i < N_INDIVIDUALS; i++)
+    {
+      FolksIndividual *individual = test_individual_new ("Test contact");
+
+      individual_store_add_individual_and_connect (store, individual);
+      individuals = g_list_prepend (individuals, individual);
+    }
+
+  wait_for_avatars (store);
+
+  /* Each avatar has been decoded once */
+  g_assert_cmpuint (count_avatar_loads (), ==, loads + N_INDIVIDUALS);
+  g_assert_cmpuint (empathy_avatar_cache_get_misses (
+      empathy_avatar_cache_get_default ()), ==, misses + N_INDIVIDUALS);
+
+  loads = count_avatar_loads ();
+
+  /* Presence changes don't reload the avatars */
+  for (i = 0; i < N_PRESENCE_CHANGES; i++)
+    {
+      for (l = individuals; l != NULL; l = g_list_next (l))
+        {
+          g_object_notify (l->data, "presence-type");
+          g_object_notify (l->data, "presence-message");
+        }
+    }
+
+  run_pending_sources ();
+
+  DEBUG ("%u avatar loads during %u presence changes",
+      count_avatar_loads () - loads, N_PRESENCE_CHANGES * N_INDIVIDUALS);
+  g_assert_cmpuint (count_avatar_loads (), ==, loads);
+
+  /* Avatar changes do */
+  for (l = individuals; l != NULL; l = g_list_next (l))
+    g_object_notify (l->data, "avatar");
+
+  run_pending_sources ();
+
+  g_assert_cmpuint (count_avatar_loads (), ==, loads + N_INDIVIDUALS);
+
+  loads = count_avatar_loads ();
+
+  /* So do changes of personas, which bring their own avatar */
+  empty_set = gee_set_empty (G_TYPE_NONE, NULL, NULL);
+
+  for (l = individuals; l != NULL; l = g_list_next (l))
+    g_signal_emit_by_name (l->data, "personas-changed", empty_set,
+        empty_set);
+
+  g_clear_object (&empty_set);
+  run_pending_sources ();
+
+  g_assert_cmpuint (count_avatar_loads (), ==, loads + N_INDIVIDUALS);
+
+  for (l = individuals; l != NULL; l = g_list_next (l))
+    individual_store_remove_individual_and_disconnect (store, l->data);
+
+  g_list_free_full (individuals, g_object_unref);
+  g_object_unref (store);
+}
+
+/* Aliases in various scripts, with and without accents */
+static const gchar *aliases[] = {
+  "zoé", "Zoe", "Émile", "emile", "Ægir", "Øystein", "Åsa", "ßtraße",
+  "Алексей", "александр", "Ёжик", "Βασίλης", "αλέξης", "李小龍", "山田太郎",
+  "김민준", "محمد", "דוד", "Nguyễn", "Ünal", "ünal", "123", "_bob", "Bob",
+  "bob", "", NULL
+};
+
+static gint
+compare_individuals_cb (gconstpointer a,
+    gconstpointer b)
+{
+  return empathy_individual_compare_by_alias (*(FolksIndividual **) a,
+      *(FolksIndividual **) b);
+}
+
+static gint
+sign (gint value)
+{
+  return value < 0 ? -1 : (value > 0 ? 1 : 0);
+}
+
+static void
+test_individual_store_collate (void)
+{
+  EmpathyIndividualStore *store;
+  GPtrArray *individuals;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  FolksIndividual *previous = NULL;
+  TestIndividual *changed;
+  gchar *key;
+  gboolean valid;
+  guint i, j, n_rows = 0;
+
+  individuals = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (i = 0; aliases[i] != NULL; i++)
+    g_ptr_array_add (individuals, test_individual_new (aliases[i]));
+
+  /* Comparing the keys is the same as collating the aliases */
+  for (i = 0; i < individuals->len; i++)
+    {
+      for (j = 0; j < individuals->len; j++)
+        {
+          g_assert_cmpint (sign (empathy_individual_compare_by_alias (
+                      g_ptr_array_index (individuals, i),
+                      g_ptr_array_index (individuals, j))), ==,
+              sign (g_utf8_collate (aliases[i], aliases[j])));
+        }
+    }
+
+  g_ptr_array_sort (individuals, compare_individuals_cb);
+  for (i = 1; i < individuals->len; i++)
+    {
+      g_assert_cmpint (g_utf8_collate (
+            folks_alias_details_get_alias (
+              g_ptr_array_index (individuals, i - 1)),
+            folks_alias_details_get_alias (
+              g_ptr_array_index (individuals, i))), <=, 0);
+    }
+
+  /* The key follows alias changes */
+  changed = g_ptr_array_index (individuals, 0);
+  g_free (changed->alias);
+  changed->alias = g_strdup ("Ωmega");
+
+  key = g_utf8_collate_key ("Ωmega", -1);
+  g_assert_cmpstr (empathy_individual_get_collate_key (
+        FOLKS_INDIVIDUAL (changed)), ==, key);
+  g_free (key);
+
+  /* Rows of a store sorted by name are in the same order */
+  store = g_object_new (EMPATHY_TYPE_INDIVIDUAL_STORE,
+      "show-groups", FALSE,
+      "sort-criterium", EMPATHY_INDIVIDUAL_STORE_SORT_NAME,
+      NULL);
+  model = GTK_TREE_MODEL (store);
+
+  for (i = 0; i < individuals->len; i++)
+    individual_store_add_individual_and_connect (store,
+        g_ptr_array_index (individuals, i));
+
+  for (valid = gtk_tree_model_get_iter_first (model, &iter); valid;
+       valid = gtk_tree_model_iter_next (model, &iter))
+    {
+      FolksIndividual *individual;
+
+      gtk_tree_model_get (model, &iter,
+          EMPATHY_INDIVIDUAL_STORE_COL_INDIVIDUAL, &individual,
+          -1);
+
+      if (individual == NULL)
+        continue;
+
+      if (previous != NULL)
+        g_assert_cmpint (g_utf8_collate (
+              folks_alias_details_get_alias (FOLKS_ALIAS_DETAILS (previous)),
+              folks_alias_details_get_alias (
+                FOLKS_ALIAS_DETAILS (individual))), <=, 0);
+
+      previous = individual;
+      g_object_unref (individual);
+      n_rows++;
+    }
+
+  /* Individuals with an empty alias are not displayed */
+  g_assert_cmpuint (n_rows, ==, individuals->len - 1);
+
+  for (i = 0; i < individuals->len; i++)
+    individual_store_remove_individual_and_disconnect (store,
+        g_ptr_array_index (individuals, i));
+
+  g_object_unref (store);
+  g_ptr_array_unref (individuals);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init_with_session_bus (argc, argv);
+
+  g_test_add_func ("/individual-store/presence-storm",
+      test_individual_store_presence_storm);
+  g_test_add_func ("/individual-store/collate",
+      test_individual_store_collate);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
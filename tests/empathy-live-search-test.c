@@ -5,11 +5,14 @@
 #include <string.h>
 #include <tp-account-widgets/tpaw-live-search.h>
 
+#include "empathy-ui-utils.h"
 #include "test-helper.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_TESTS
 #include "empathy-debug.h"
 
+#define N_RANDOM_STRINGS 20000
+
 typedef struct
 {
   const gchar *string;
@@ -17,6 +20,20 @@ typedef struct
   gboolean should_match;
 } LiveSearchTest;
 
+static gboolean
+match_key (const gchar *string,
+    GPtrArray *words)
+{
+  gchar *key;
+  gboolean match;
+
+  key = empathy_live_search_strip_key (string);
+  match = empathy_live_search_match_key (key, words);
+  g_free (key);
+
+  return match;
+}
+
 static void
 test_live_search (void)
 {
@@ -56,6 +73,7 @@ test_live_search (void)
     {
       gboolean match;
       gboolean ok;
+      GPtrArray *words;
 
       match = tpaw_live_search_match_string (tests[i].string, tests[i].prefix);
       ok = (match == tests[i].should_match);
@@ -65,9 +83,114 @@ test_live_search (void)
           ok ? "OK" : "FAILED");
 
       g_assert (ok);
+
+      /* Matching with a stripped key gives the same result */
+      words = tpaw_live_search_strip_utf8_string (tests[i].prefix);
+      g_assert (match == match_key (tests[i].string, words));
+      tp_clear_pointer (&words, g_ptr_array_unref);
     }
 }
 
+/* Pieces of mixed-case, accented (composed and decomposed) and separated
+ * words to build random strings from */
+static const gchar *pieces[] = {
+  "a", "A", "b", "e", "\xc3\xa9" /* é */, "e\xcc\x81" /* e + U+0301 */,
+  "\xc3\x89" /* É */, "o", "\xc3\xb6" /* ö */, "\xc3\x8f" /* Ï */, "x",
+  " ", "  ", "-", ".", "@", "_", "\xce\xb1" /* α */, "\xd0\x96" /* Ж */,
+  "1", "\xe2\x80\x8b" /* zero width space */,
+};
+
+static gchar *
+random_string (GRand *rand,
+    guint max_pieces)
+{
+  GString *str = g_string_new (NULL);
+  guint i, n;
+
+  n = g_rand_int_range (rand, 0, max_pieces + 1);
+  for (i = 0; i < n; i++)
+    g_string_append (str,
+        pieces[g_rand_int_range (rand, 0, G_N_ELEMENTS (pieces))]);
+
+  return g_string_free (str, FALSE);
+}
+
+/* Matching against a key stripped once must give the same result than
+ * stripping the string each time. */
+static void
+test_live_search_key (void)
+{
+  GRand *rand;
+  guint i, n_matches = 0;
+
+  rand = g_rand_new_with_seed (42);
+
+  for (i = 0; i < N_RANDOM_STRINGS; i++)
+    {
+      gchar *string, *text;
+      GPtrArray *words;
+      gboolean match;
+
+      string = random_string (rand, 12);
+      text = random_string (rand, 4);
+      words = tpaw_live_search_strip_utf8_string (text);
+
+      match = tpaw_live_search_match_words (string, words);
+      g_assert (match == match_key (string, words));
+
+      if (match)
+        n_matches++;
+
+      tp_clear_pointer (&words, g_ptr_array_unref);
+      g_free (string);
+      g_free (text);
+    }
+
+  DEBUG ("%u strings out of %u matched", n_matches, N_RANDOM_STRINGS);
+  g_assert_cmpuint (n_matches, >, 0);
+  g_assert_cmpuint (n_matches, <, N_RANDOM_STRINGS);
+
+  g_rand_free (rand);
+}
+
+/* The roster only filters the contacts which matched the previous search when
+ * the new one extends it, so extending a search should never match a string
+ * which did not match before. */
+static void
+test_live_search_extend (void)
+{
+  GRand *rand;
+  guint i;
+
+  rand = g_rand_new_with_seed (42);
+
+  for (i = 0; i < N_RANDOM_STRINGS; i++)
+    {
+      gchar *string, *text, *suffix, *extended;
+      GPtrArray *words, *extended_words;
+
+      string = random_string (rand, 12);
+      text = random_string (rand, 3);
+      suffix = random_string (rand, 2);
+      extended = g_strconcat (text, suffix, NULL);
+
+      words = tpaw_live_search_strip_utf8_string (text);
+      extended_words = tpaw_live_search_strip_utf8_string (extended);
+
+      if (tpaw_live_search_match_words (string, extended_words))
+        g_assert (tpaw_live_search_match_words (string, words));
+
+      tp_clear_pointer (&words, g_ptr_array_unref);
+      tp_clear_pointer (&extended_words, g_ptr_array_unref);
+      g_free (string);
+      g_free (text);
+      g_free (suffix);
+      g_free (extended);
+    }
+
+  g_rand_free (rand);
+}
+
 int
 main (int argc,
     char **argv)
@@ -77,6 +200,8 @@ main (int argc,
   test_init (argc, argv);
 
   g_test_add_func ("/live-search", test_live_search);
+  g_test_add_func ("/live-search/key", test_live_search_key);
+  g_test_add_func ("/live-search/extend", test_live_search_extend);
 
   result = g_test_run ();
   test_deinit ();
@@ -0,0 +1,274 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "empathy-log-events-mirror.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+/* Events of the fixture day */
+#define N_EVENTS 5000
+/* One event out of GROUP_RATIO has child rows, like calls do */
+#define GROUP_RATIO 50
+#define N_CHILDREN 3
+
+enum
+{
+  COL_TEXT,
+  COL_DATE,
+  COL_ICON,
+  COL_COUNT
+};
+
+static const gchar *icons[] = {
+  "format-justify-fill", "call-start", "call-stop", "", NULL
+};
+
+static void
+load_status_cb (WebKitWebView *webview,
+    GParamSpec *pspec,
+    GMainLoop *loop)
+{
+  WebKitLoadStatus status = webkit_web_view_get_load_status (webview);
+
+  if (status == WEBKIT_LOAD_FINISHED || status == WEBKIT_LOAD_FAILED)
+    g_main_loop_quit (loop);
+}
+
+static WebKitWebView *
+log_webview_new (void)
+{
+  WebKitWebView *webview;
+  GMainLoop *loop;
+  gchar *filename, *uri;
+
+  webview = WEBKIT_WEB_VIEW (webkit_web_view_new ());
+  g_object_ref_sink (webview);
+
+  filename = g_build_filename (g_getenv ("EMPATHY_SRCDIR"), "data",
+      "empathy-log-window.html", NULL);
+  uri = g_filename_to_uri (filename, NULL, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_signal_connect (webview, "notify::load-status",
+      G_CALLBACK (load_status_cb), loop);
+
+  webkit_web_view_load_uri (webview, uri);
+  g_main_loop_run (loop);
+
+  g_assert_cmpint (webkit_web_view_get_load_status (webview), ==,
+      WEBKIT_LOAD_FINISHED);
+
+  g_signal_handlers_disconnect_by_func (webview, load_status_cb, loop);
+  g_main_loop_unref (loop);
+  g_free (uri);
+  g_free (filename);
+
+  return webview;
+}
+
+static GtkTreeStore *
+events_store_new (void)
+{
+  return gtk_tree_store_new (COL_COUNT,
+      G_TYPE_STRING, /* text */
+      G_TYPE_STRING, /* pretty date */
+      G_TYPE_STRING); /* icon */
+}
+
+static void
+maybe_flush (EmpathyLogEventsMirror *mirror,
+    gboolean flush_each)
+{
+  if (flush_each)
+    empathy_log_events_mirror_flush (mirror);
+}
+
+/* Fills @store the way the log window does, appending rows before setting
+ * their content. If @flush_each is TRUE, each change is executed on its
+ * own as the log window used to do. */
+static void
+fill_store (GtkTreeStore *store,
+    EmpathyLogEventsMirror *mirror,
+    gboolean flush_each)
+{
+  guint i, j;
+
+  for (i = 0; i < N_EVENTS; i++)
+    {
+      GtkTreeIter iter;
+      gchar *text, *date;
+
+      text = g_strdup_printf ("Message %u: it's a \\ test &amp; <b>more</b>",
+          i);
+      date = g_strdup_printf ("%02u:%02u", (i / 60) % 24, i % 60);
+
+      gtk_tree_store_append (store, &iter, NULL);
+      maybe_flush (mirror, flush_each);
+
+      gtk_tree_store_set (store, &iter,
+          COL_TEXT, text,
+          COL_DATE, date,
+          COL_ICON, icons[i % (G_N_ELEMENTS (icons) - 1)],
+          -1);
+      maybe_flush (mirror, flush_each);
+
+      if (i % GROUP_RATIO == 0)
+        {
+          for (j = 0; j < N_CHILDREN; j++)
+            {
+              GtkTreeIter child;
+
+              gtk_tree_store_append (store, &child, &iter);
+              maybe_flush (mirror, flush_each);
+
+              gtk_tree_store_set (store, &child,
+                  COL_TEXT, "Call details",
+                  COL_DATE, date,
+                  -1);
+              maybe_flush (mirror, flush_each);
+            }
+        }
+
+      g_free (text);
+      g_free (date);
+    }
+
+  empathy_log_events_mirror_execute_script (mirror, "expandAll()");
+  maybe_flush (mirror, flush_each);
+}
+
+static gboolean
+quit_loop_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+  return FALSE;
+}
+
+/* Runs the main loop until the idle callbacks, including the mirror's,
+ * have been dispatched */
+static void
+run_idles (void)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  g_idle_add_full (G_PRIORITY_LOW, quit_loop_cb, loop, NULL);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+}
+
+static gchar *
+dup_page_content (WebKitWebView *webview)
+{
+  WebKitDOMDocument *document;
+  WebKitDOMElement *treeview;
+
+  document = webkit_web_view_get_dom_document (webview);
+  treeview = webkit_dom_document_get_element_by_id (document, "treeview");
+  g_assert (treeview != NULL);
+
+  return webkit_dom_html_element_get_inner_html (
+      WEBKIT_DOM_HTML_ELEMENT (treeview));
+}
+
+static void
+test_log_events_mirror_batch (void)
+{
+  WebKitWebView *batched_view, *reference_view;
+  GtkTreeStore *batched_store, *reference_store;
+  EmpathyLogEventsMirror *batched, *reference;
+  GtkTreeIter iter;
+  gchar *batched_content, *reference_content;
+  gdouble elapsed;
+  guint n_reference;
+
+  batched_view = log_webview_new ();
+  reference_view = log_webview_new ();
+
+  batched_store = events_store_new ();
+  reference_store = events_store_new ();
+
+  batched = empathy_log_events_mirror_new (GTK_TREE_MODEL (batched_store),
+      batched_view, COL_TEXT, COL_DATE, COL_ICON);
+  reference = empathy_log_events_mirror_new (
+      GTK_TREE_MODEL (reference_store), reference_view,
+      COL_TEXT, COL_DATE, COL_ICON);
+
+  /* All the changes of a fetch are executed at once */
+  g_test_timer_start ();
+
+  fill_store (batched_store, batched, FALSE);
+  g_assert_cmpuint (empathy_log_events_mirror_get_n_executed (batched), ==,
+      0);
+
+  run_idles ();
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "%u events: %f seconds", N_EVENTS,
+      elapsed);
+
+  g_assert_cmpuint (empathy_log_events_mirror_get_n_executed (batched), ==,
+      1);
+
+  /* The page is the same as when executing each change on its own */
+  fill_store (reference_store, reference, TRUE);
+  run_idles ();
+
+  n_reference = empathy_log_events_mirror_get_n_executed (reference);
+  DEBUG ("%u scripts rather than %u",
+      empathy_log_events_mirror_get_n_executed (batched), n_reference);
+  g_assert_cmpuint (n_reference, >, 2 * N_EVENTS);
+
+  batched_content = dup_page_content (batched_view);
+  reference_content = dup_page_content (reference_view);
+  g_assert (strstr (batched_content, "Call details") != NULL);
+  g_assert_cmpstr (batched_content, ==, reference_content);
+  g_free (batched_content);
+  g_free (reference_content);
+
+  /* So are removed rows */
+  g_assert (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (batched_store),
+        &iter, NULL, 1));
+  gtk_tree_store_remove (batched_store, &iter);
+  g_assert (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (reference_store),
+        &iter, NULL, 1));
+  gtk_tree_store_remove (reference_store, &iter);
+  empathy_log_events_mirror_flush (reference);
+
+  run_idles ();
+
+  g_assert_cmpuint (empathy_log_events_mirror_get_n_executed (batched), ==,
+      2);
+
+  batched_content = dup_page_content (batched_view);
+  reference_content = dup_page_content (reference_view);
+  g_assert_cmpstr (batched_content, ==, reference_content);
+  g_free (batched_content);
+  g_free (reference_content);
+
+  empathy_log_events_mirror_free (batched);
+  empathy_log_events_mirror_free (reference);
+  g_object_unref (batched_store);
+  g_object_unref (reference_store);
+  g_object_unref (batched_view);
+  g_object_unref (reference_view);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/log-events-mirror/batch",
+      test_log_events_mirror_batch);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,350 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "empathy-log-hits.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_ACCOUNTS 4
+#define N_ENTITIES 250
+#define N_DAYS 365
+#define N_HITS 100000
+/* One hit out of INVALID_RATIO has no target, like those of corrupt logs */
+#define INVALID_RATIO 1000
+
+/* Entities and days of the search selected in the log window */
+#define N_SELECTED 40
+#define N_SELECTED_DAYS 30
+
+/* Whether the entity of an account has hits on a day */
+static gboolean present[N_ACCOUNTS][N_ENTITIES][N_DAYS];
+
+static TpAccount *accounts[N_ACCOUNTS];
+
+/* Julian day of the first day with hits */
+static guint32 first_day;
+
+static void
+create_accounts (void)
+{
+  TpDBusDaemon *dbus;
+  TpSimpleClientFactory *factory;
+  GError *error = NULL;
+  guint a;
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  factory = tp_simple_client_factory_new (dbus);
+
+  for (a = 0; a < N_ACCOUNTS; a++)
+    {
+      gchar *path;
+
+      path = g_strdup_printf ("%sfake/jabber/account%u",
+          TP_ACCOUNT_OBJECT_PATH_BASE, a);
+      accounts[a] = tp_simple_client_factory_ensure_account (factory, path,
+          NULL, &error);
+      g_assert_no_error (error);
+
+      g_free (path);
+    }
+
+  g_object_unref (factory);
+  g_object_unref (dbus);
+}
+
+static TplEntity *
+entity_new (guint e)
+{
+  TplEntity *entity;
+  gchar *id, *alias;
+
+  id = g_strdup_printf ("contact%u@example.com", e);
+  alias = g_strdup_printf ("Contact %u", e);
+  entity = tpl_entity_new (id, TPL_ENTITY_CONTACT, alias, NULL);
+
+  g_free (id);
+  g_free (alias);
+
+  return entity;
+}
+
+static GDate *
+date_new (guint d)
+{
+  return g_date_new_julian (first_day + d);
+}
+
+/* Returns a list of N_HITS EmpathyLogHit the way the log manager does,
+ * several of them for the same entity and day */
+static GList *
+generate_hits (GRand *rand,
+    TplEntity **entities)
+{
+  GList *hits = NULL;
+  guint i;
+
+  memset (present, 0, sizeof (present));
+
+  for (i = 0; i < N_HITS; i++)
+    {
+      EmpathyLogHit *hit;
+      GDate *date;
+      guint a, e, d;
+
+      a = g_rand_int_range (rand, 0, N_ACCOUNTS);
+      e = g_rand_int_range (rand, 0, N_ENTITIES);
+      /* Make some entities talk much more than others */
+      if (e % 2 == 0)
+        e = e / 10;
+      d = g_rand_int_range (rand, 0, N_DAYS);
+
+      date = date_new (d);
+
+      if (i % INVALID_RATIO != 0)
+        {
+          hit = empathy_log_hit_new (accounts[a], entities[e], date);
+          present[a][e][d] = TRUE;
+        }
+      else
+        {
+          hit = empathy_log_hit_new (accounts[a], NULL, date);
+        }
+
+      hits = g_list_prepend (hits, hit);
+      g_date_free (date);
+    }
+
+  return hits;
+}
+
+static guint
+count_entities (gint account)
+{
+  guint a, e, d, n = 0;
+
+  for (a = 0; a < N_ACCOUNTS; a++)
+    {
+      if (account >= 0 && (guint) account != a)
+        continue;
+
+      for (e = 0; e < N_ENTITIES; e++)
+        {
+          for (d = 0; d < N_DAYS; d++)
+            {
+              if (present[a][e][d])
+                {
+                  n++;
+                  break;
+                }
+            }
+        }
+    }
+
+  return n;
+}
+
+static void
+test_log_hits_index (void)
+{
+  EmpathyLogHits *hits;
+  TplEntity *entities[N_ENTITIES];
+  GList *selected_accounts = NULL, *selected_targets = NULL;
+  GList *selected_dates = NULL, *l;
+  gboolean selected[N_ACCOUNTS][N_ENTITIES];
+  gboolean selected_days[N_DAYS];
+  gboolean expected_days[N_DAYS];
+  guint n_expected_days = 0, n_expected_hits = 0, n_expected_anytime = 0;
+  GRand *rand;
+  GDate *date;
+  gdouble elapsed;
+  guint i, a, e, d;
+
+  rand = g_rand_new_with_seed (42);
+
+  date = g_date_new_dmy (1, G_DATE_JANUARY, 2013);
+  first_day = g_date_get_julian (date);
+  g_date_free (date);
+
+  for (e = 0; e < N_ENTITIES; e++)
+    entities[e] = entity_new (e);
+
+  hits = empathy_log_hits_new (generate_hits (rand, entities));
+
+  /* Entities with hits, on all the accounts and on each of them */
+  l = empathy_log_hits_get_entities (hits, NULL);
+  g_assert_cmpuint (g_list_length (l), ==, count_entities (-1));
+  g_list_free (l);
+
+  for (a = 0; a < N_ACCOUNTS; a++)
+    {
+      l = empathy_log_hits_get_entities (hits, accounts[a]);
+      g_assert_cmpuint (g_list_length (l), ==, count_entities (a));
+
+      for (; l != NULL; l = g_list_delete_link (l, l))
+        {
+          EmpathyLogHit *hit = l->data;
+
+          g_assert (hit->account == accounts[a]);
+        }
+    }
+
+  /* Select entities, some of them twice, using other TplEntity objects
+   * than the hits like the who view does */
+  memset (selected, 0, sizeof (selected));
+  memset (expected_days, 0, sizeof (expected_days));
+
+  for (i = 0; i < N_SELECTED; i++)
+    {
+      a = g_rand_int_range (rand, 0, N_ACCOUNTS);
+      e = g_rand_int_range (rand, 0, N_ENTITIES / 5);
+
+      selected_accounts = g_list_prepend (selected_accounts, accounts[a]);
+      selected_targets = g_list_prepend (selected_targets, entity_new (e));
+
+      if (selected[a][e])
+        continue;
+
+      selected[a][e] = TRUE;
+
+      for (d = 0; d < N_DAYS; d++)
+        {
+          if (!present[a][e][d])
+            continue;
+
+          n_expected_anytime++;
+
+          if (!expected_days[d])
+            n_expected_days++;
+          expected_days[d] = TRUE;
+        }
+    }
+
+  /* Select some days */
+  memset (selected_days, 0, sizeof (selected_days));
+
+  for (i = 0; i < N_SELECTED_DAYS; i++)
+    {
+      d = g_rand_int_range (rand, 0, N_DAYS);
+
+      selected_days[d] = TRUE;
+      selected_dates = g_list_prepend (selected_dates, date_new (d));
+    }
+
+  for (a = 0; a < N_ACCOUNTS; a++)
+    for (e = 0; e < N_ENTITIES; e++)
+      for (d = 0; d < N_DAYS; d++)
+        if (selected[a][e] && selected_days[d] && present[a][e][d])
+          n_expected_hits++;
+
+  /* Dates of the selected entities, each of them once */
+  l = empathy_log_hits_get_dates (hits, selected_accounts, selected_targets);
+  g_assert_cmpuint (g_list_length (l), ==, n_expected_days);
+
+  for (; l != NULL; l = g_list_delete_link (l, l))
+    {
+      d = g_date_get_julian (l->data) - first_day;
+
+      g_assert (expected_days[d]);
+      expected_days[d] = FALSE;
+    }
+
+  /* One hit per entity and day */
+  l = empathy_log_hits_get_hits (hits, selected_accounts, selected_targets,
+      selected_dates);
+  g_assert_cmpuint (g_list_length (l), ==, n_expected_hits);
+  g_list_free (l);
+
+  l = empathy_log_hits_get_hits (hits, selected_accounts, selected_targets,
+      NULL);
+  g_assert_cmpuint (g_list_length (l), ==, n_expected_anytime);
+  g_list_free (l);
+
+  empathy_log_hits_free (hits);
+
+  /* Populating the three views from the hits doesn't depend on how many
+   * rows they already have */
+  g_test_timer_start ();
+
+  hits = empathy_log_hits_new (generate_hits (rand, entities));
+
+  l = empathy_log_hits_get_entities (hits, NULL);
+  g_list_free (l);
+  l = empathy_log_hits_get_dates (hits, selected_accounts, selected_targets);
+  g_list_free (l);
+  l = empathy_log_hits_get_hits (hits, selected_accounts, selected_targets,
+      NULL);
+  g_list_free (l);
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "%u hits: %f seconds", N_HITS, elapsed);
+
+  empathy_log_hits_free (hits);
+
+  g_list_free_full (selected_dates, (GDestroyNotify) g_date_free);
+  g_list_free_full (selected_targets, g_object_unref);
+  g_list_free (selected_accounts);
+
+  for (e = 0; e < N_ENTITIES; e++)
+    g_object_unref (entities[e]);
+
+  g_rand_free (rand);
+}
+
+static void
+test_log_hits_empty (void)
+{
+  EmpathyLogHits *hits;
+  GList *selected_accounts, *selected_targets, *selected_dates;
+
+  selected_accounts = g_list_prepend (NULL, accounts[0]);
+  selected_targets = g_list_prepend (NULL, entity_new (0));
+  selected_dates = g_list_prepend (NULL,
+      g_date_new_dmy (1, G_DATE_JANUARY, 2013));
+
+  /* A search without hits */
+  hits = empathy_log_hits_new (NULL);
+
+  g_assert (empathy_log_hits_get_entities (hits, NULL) == NULL);
+  g_assert (empathy_log_hits_get_entities (hits, accounts[0]) == NULL);
+  g_assert (empathy_log_hits_get_dates (hits, selected_accounts,
+        selected_targets) == NULL);
+  g_assert (empathy_log_hits_get_hits (hits, selected_accounts,
+        selected_targets, selected_dates) == NULL);
+  g_assert (empathy_log_hits_get_hits (hits, selected_accounts,
+        selected_targets, NULL) == NULL);
+
+  empathy_log_hits_free (hits);
+
+  g_list_free_full (selected_dates, (GDestroyNotify) g_date_free);
+  g_list_free_full (selected_targets, g_object_unref);
+  g_list_free (selected_accounts);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  guint a;
+
+  test_init_with_session_bus (argc, argv);
+
+  create_accounts ();
+
+  g_test_add_func ("/log-hits/index", test_log_hits_index);
+  g_test_add_func ("/log-hits/empty", test_log_hits_empty);
+
+  result = g_test_run ();
+
+  for (a = 0; a < N_ACCOUNTS; a++)
+    g_object_unref (accounts[a]);
+
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,518 @@
+#include "config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "empathy-log-index.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "fake/jabber/account0"
+/* How telepathy-logger names the directory of this account */
+#define ACCOUNT_DIR "fake_jabber_account0"
+
+#define N_CONTACTS 5
+#define N_DAYS 20
+#define N_MESSAGES 10
+#define N_WORDS_PER_MESSAGE 6
+
+static const gchar *vocabulary[] = {
+  "hello", "help", "helmet", "world", "word", "Café", "cafe", "naïve",
+  "NAIVE", "Straße", "meeting", "meet", "tomorrow", "today", "κόσμε", "мир",
+  "456", "a", NULL
+};
+
+/* Queries which only match the text of messages, not the XML markup of the
+ * log files which telepathy-logger searches as well */
+static const gchar *queries[] = {
+  "hello", "hel", "elp", "elmet", "help", "world", "orl", "word", "Café",
+  "cafe", "caf", "naïve", "NAIVE", "STRASSE", "meet", "eeting", "today",
+  "tomorrow", "κόσμε", "Κόσμε", "мир", "456", "hello world", "lo wor",
+  "café meeting", "tomorrow, 456", "zebra", "hello zebra",
+};
+
+static TpAccount *
+dup_test_account (void)
+{
+  TpDBusDaemon *dbus;
+  TpSimpleClientFactory *factory;
+  TpAccount *account;
+  GError *error = NULL;
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  factory = tp_simple_client_factory_new (dbus);
+  account = tp_simple_client_factory_ensure_account (factory, ACCOUNT_PATH,
+      NULL, &error);
+  g_assert_no_error (error);
+
+  g_object_unref (factory);
+  g_object_unref (dbus);
+
+  return account;
+}
+
+/* Writes @messages, said by @id on @date, the way telepathy-logger's XML
+ * store does, in XDG_DATA_HOME/TpLogger/logs/<account>/<identifier>/<date>.log
+ */
+static void
+write_log (const gchar *id,
+    GDate *date,
+    const gchar * const *messages)
+{
+  GString *log;
+  gchar name[16], *dir, *path;
+  guint m;
+  GError *error = NULL;
+
+  dir = g_build_filename (g_get_user_data_dir (), "TpLogger", "logs",
+      ACCOUNT_DIR, id, NULL);
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+  log = g_string_new ("<?xml version='1.0' encoding='utf-8'?>\n"
+      "<?xml-stylesheet type=\"text/xsl\" "
+      "href=\"log-store-xml.xsl\"?>\n<log>\n");
+
+  g_date_strftime (name, sizeof (name), "%Y%m%d", date);
+
+  for (m = 0; messages[m] != NULL; m++)
+    {
+      gchar *escaped = g_markup_escape_text (messages[m], -1);
+
+      g_string_append_printf (log, "<message time='%sT10:%02u:00' "
+          "cm_id='%u' id='%s' name='Contact' token='' "
+          "isuser='false' type='normal'>%s</message>\n",
+          name, m, m, id, escaped);
+
+      g_free (escaped);
+    }
+
+  g_string_append (log, "</log>\n");
+
+  g_date_strftime (name, sizeof (name), "%Y%m%d.log", date);
+  path = g_build_filename (dir, name, NULL);
+  g_file_set_contents (path, log->str, log->len, &error);
+  g_assert_no_error (error);
+
+  g_free (path);
+  g_string_free (log, TRUE);
+  g_free (dir);
+}
+
+static void
+generate_fixture (void)
+{
+  GDate *first;
+  guint c, d, m, w;
+
+  first = g_date_new_dmy (1, G_DATE_JANUARY, 2013);
+
+  for (c = 0; c < N_CONTACTS; c++)
+    {
+      gchar *id;
+
+      id = g_strdup_printf ("contact%u@example.com", c);
+
+      for (d = 0; d < N_DAYS; d++)
+        {
+          GDate *date;
+          gchar *messages[N_MESSAGES + 1] = { NULL, };
+
+          /* Not everybody talks every day */
+          if (g_test_rand_int_range (0, 3) == 0)
+            continue;
+
+          date = g_date_new_julian (g_date_get_julian (first) + 2 * d);
+
+          for (m = 0; m < N_MESSAGES; m++)
+            {
+              GString *text = g_string_new (NULL);
+
+              for (w = 0; w < N_WORDS_PER_MESSAGE; w++)
+                {
+                  if (w > 0)
+                    g_string_append (text, w % 3 == 0 ? ", " : " ");
+
+                  g_string_append (text, vocabulary[g_test_rand_int_range (0,
+                          G_N_ELEMENTS (vocabulary) - 1)]);
+                }
+
+              messages[m] = g_string_free (text, FALSE);
+            }
+
+          write_log (id, date, (const gchar * const *) messages);
+
+          for (m = 0; m < N_MESSAGES; m++)
+            g_free (messages[m]);
+
+          g_date_free (date);
+        }
+
+      g_free (id);
+    }
+
+  g_date_free (first);
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  GList *hits;
+} SearchData;
+
+static void
+search_logs_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  SearchData *data = user_data;
+  GError *error = NULL;
+
+  tpl_log_manager_search_finish (TPL_LOG_MANAGER (source), result,
+      &data->hits, &error);
+  g_assert_no_error (error);
+
+  g_main_loop_quit (data->loop);
+}
+
+/* Returns the "identifier/day" whose logs contain @text according to the
+ * logger */
+static GHashTable *
+search_logs (const gchar *text)
+{
+  TplLogManager *log_manager;
+  GHashTable *result;
+  SearchData data = { NULL, NULL };
+  GList *l;
+
+  result = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  log_manager = tpl_log_manager_dup_singleton ();
+  data.loop = g_main_loop_new (NULL, FALSE);
+
+  tpl_log_manager_search_async (log_manager, text, TPL_EVENT_MASK_TEXT,
+      search_logs_cb, &data);
+  g_main_loop_run (data.loop);
+
+  for (l = data.hits; l != NULL; l = g_list_next (l))
+    {
+      TplLogSearchHit *hit = l->data;
+
+      g_hash_table_add (result, g_strdup_printf ("%s/%u",
+            tpl_entity_get_identifier (hit->target),
+            g_date_get_julian (hit->date)));
+    }
+
+  tpl_log_manager_search_free (data.hits);
+  g_main_loop_unref (data.loop);
+  g_object_unref (log_manager);
+
+  return result;
+}
+
+static void
+index_search_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  SearchData *data = user_data;
+  GError *error = NULL;
+
+  data->hits = empathy_log_index_search_finish (EMPATHY_LOG_INDEX (source),
+      result, &error);
+  g_assert_no_error (error);
+
+  g_main_loop_quit (data->loop);
+}
+
+/* Returns the "identifier/day" whose logs contain @text according to the
+ * index */
+static GHashTable *
+index_search (EmpathyLogIndex *index,
+    const gchar *text)
+{
+  TplLogManager *log_manager;
+  GHashTable *result;
+  SearchData data = { NULL, NULL };
+  GList *l;
+
+  result = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  log_manager = tpl_log_manager_dup_singleton ();
+  data.loop = g_main_loop_new (NULL, FALSE);
+
+  empathy_log_index_search_async (index, log_manager, text, index_search_cb,
+      &data);
+  g_main_loop_run (data.loop);
+
+  for (l = data.hits; l != NULL; l = g_list_next (l))
+    {
+      EmpathyLogHit *hit = l->data;
+      gchar *key;
+
+      g_assert_cmpstr (tp_proxy_get_object_path (hit->account), ==,
+          ACCOUNT_PATH);
+
+      key = g_strdup_printf ("%s/%u", tpl_entity_get_identifier (hit->target),
+          g_date_get_julian (hit->date));
+
+      /* Each day is only returned once */
+      g_assert (!g_hash_table_contains (result, key));
+      g_hash_table_add (result, key);
+    }
+
+  g_list_free_full (data.hits, (GDestroyNotify) empathy_log_hit_free);
+  g_main_loop_unref (data.loop);
+  g_object_unref (log_manager);
+
+  return result;
+}
+
+/* Checks the index finds the same days as the logger for @text, and returns
+ * how many */
+static guint
+check_search (EmpathyLogIndex *index,
+    const gchar *text)
+{
+  GHashTable *expected, *found;
+  GHashTableIter iter;
+  gpointer key;
+  guint n_days;
+
+  expected = search_logs (text);
+  found = index_search (index, text);
+  n_days = g_hash_table_size (expected);
+
+  DEBUG ("'%s': %u days", text, n_days);
+
+  g_assert_cmpuint (g_hash_table_size (found), ==, n_days);
+
+  g_hash_table_iter_init (&iter, expected);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_assert (g_hash_table_contains (found, key));
+
+  g_hash_table_unref (expected);
+  g_hash_table_unref (found);
+
+  return n_days;
+}
+
+static void
+check_all_searches (EmpathyLogIndex *index)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (queries); i++)
+    check_search (index, queries[i]);
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  EmpathyLogIndex *index;
+  guint check_id;
+} UpdateData;
+
+static void
+update_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  UpdateData *data = user_data;
+  GError *error = NULL;
+
+  empathy_log_index_update_finish (EMPATHY_LOG_INDEX (source), result,
+      &error);
+  g_assert_no_error (error);
+
+  if (data->check_id != 0)
+    {
+      g_source_remove (data->check_id);
+      data->check_id = 0;
+    }
+
+  g_main_loop_quit (data->loop);
+}
+
+/* The index isn't ready before the update, even once it has been loaded */
+static gboolean
+check_not_ready_cb (gpointer user_data)
+{
+  UpdateData *data = user_data;
+
+  g_assert (!empathy_log_index_is_ready (data->index));
+
+  return TRUE;
+}
+
+static void
+update_index (EmpathyLogIndex *index,
+    TpAccount *account)
+{
+  TplLogManager *log_manager;
+  UpdateData data = { NULL, index, 0 };
+  GList *accounts;
+
+  log_manager = tpl_log_manager_dup_singleton ();
+  accounts = g_list_prepend (NULL, account);
+  data.loop = g_main_loop_new (NULL, FALSE);
+
+  if (!empathy_log_index_is_ready (index))
+    data.check_id = g_idle_add (check_not_ready_cb, &data);
+
+  empathy_log_index_update_async (index, log_manager, accounts, update_cb,
+      &data);
+  g_main_loop_run (data.loop);
+
+  g_assert (empathy_log_index_is_ready (index));
+
+  g_main_loop_unref (data.loop);
+  g_list_free (accounts);
+  g_object_unref (log_manager);
+}
+
+/* Removes the logs of @id, or only those of one of its days if @one_day */
+static void
+remove_logs (const gchar *id,
+    gboolean one_day)
+{
+  GDir *dir;
+  gchar *path;
+  const gchar *name;
+
+  path = g_build_filename (g_get_user_data_dir (), "TpLogger", "logs",
+      ACCOUNT_DIR, id, NULL);
+  dir = g_dir_open (path, 0, NULL);
+  g_assert (dir != NULL);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *file = g_build_filename (path, name, NULL);
+
+      g_assert_cmpint (g_unlink (file), ==, 0);
+      g_free (file);
+
+      if (one_day)
+        break;
+    }
+
+  g_dir_close (dir);
+
+  if (!one_day)
+    g_assert_cmpint (g_rmdir (path), ==, 0);
+
+  g_free (path);
+}
+
+static void
+test_log_index_search (void)
+{
+  EmpathyLogIndex *index;
+  TpAccount *account;
+  TplEntity *target;
+  GDate *date;
+  gchar *filename;
+  const gchar *unicorns[] = { "Unicorns everywhere", NULL };
+
+  account = dup_test_account ();
+  generate_fixture ();
+
+  filename = g_build_filename (g_get_user_cache_dir (), "empathy",
+      "log-index", NULL);
+
+  /* Build the index from scratch */
+  index = empathy_log_index_new (filename);
+  g_assert (!empathy_log_index_is_ready (index));
+
+  update_index (index, account);
+  check_all_searches (index);
+  g_object_unref (index);
+
+  /* Load it back and bring it up to date */
+  index = empathy_log_index_new (filename);
+  update_index (index, account);
+  check_all_searches (index);
+
+  g_assert (g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  /* Text added as it is logged is found straight away */
+  target = tpl_entity_new ("contact0@example.com", TPL_ENTITY_CONTACT,
+      "Contact 0", NULL);
+  date = g_date_new_dmy (1, G_DATE_JANUARY, 2014);
+
+  write_log ("contact0@example.com", date, unicorns);
+  empathy_log_index_add_text (index, account, target, date, unicorns[0]);
+
+  g_assert_cmpuint (check_search (index, "unicorns EVERY"), ==, 1);
+  g_assert_cmpuint (check_search (index, "corns every"), ==, 1);
+  g_assert_cmpuint (check_search (index, "every unic"), ==, 0);
+
+  /* Logs removed since the last update are forgotten by the next one */
+  remove_logs ("contact1@example.com", TRUE);
+  remove_logs ("contact2@example.com", FALSE);
+
+  update_index (index, account);
+  check_all_searches (index);
+
+  /* Clearing logs forgets them straight away */
+  g_object_unref (target);
+  target = tpl_entity_new ("contact3@example.com", TPL_ENTITY_CONTACT,
+      "Contact 3", NULL);
+
+  remove_logs ("contact3@example.com", FALSE);
+  empathy_log_index_forget (index, account, target);
+  check_all_searches (index);
+  g_assert_cmpuint (check_search (index, "unicorn"), ==, 1);
+
+  remove_logs ("contact0@example.com", FALSE);
+  remove_logs ("contact1@example.com", FALSE);
+  remove_logs ("contact4@example.com", FALSE);
+
+  empathy_log_index_forget (index, account, NULL);
+  g_assert_cmpuint (check_search (index, "unicorn"), ==, 0);
+  g_assert_cmpuint (check_search (index, "hel"), ==, 0);
+
+  /* Nothing is found once the index is loaded back either */
+  g_object_unref (index);
+
+  index = empathy_log_index_new (filename);
+  update_index (index, account);
+  g_assert_cmpuint (check_search (index, "hel"), ==, 0);
+
+  g_date_free (date);
+  g_object_unref (target);
+  g_object_unref (index);
+  g_object_unref (account);
+  g_free (filename);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  gchar *dir, *data_dir, *cache_dir;
+
+  /* Use a log tree and a cache of our own */
+  dir = g_dir_make_tmp ("empathy-log-index-test-XXXXXX", NULL);
+  g_assert (dir != NULL);
+
+  data_dir = g_build_filename (dir, "data", NULL);
+  cache_dir = g_build_filename (dir, "cache", NULL);
+  g_setenv ("XDG_DATA_HOME", data_dir, TRUE);
+  g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+  test_init_with_session_bus (argc, argv);
+
+  g_test_add_func ("/log-index/search", test_log_index_search);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  g_free (cache_dir);
+  g_free (data_dir);
+  g_free (dir);
+
+  return result;
+}
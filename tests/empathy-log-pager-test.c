@@ -0,0 +1,429 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "empathy-log-pager.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define ACCOUNT_PATH TP_ACCOUNT_OBJECT_PATH_BASE "fake/jabber/account0"
+/* How telepathy-logger names the directory of this account */
+#define ACCOUNT_DIR "fake_jabber_account0"
+#define CONTACT_ID "contact@example.com"
+
+#define N_DAYS 12
+#define N_MESSAGES 100
+/* One message out of TIE_RATIO has the same timestamp as the previous one */
+#define TIE_RATIO 7
+
+#define PAGE_SIZE 40
+#define MAX_EVENTS 100
+
+/* Dates of the fixture logs */
+static GList *fixture_dates = NULL;
+/* Timestamps of all the fixture messages, in chronological order */
+static GArray *fixture_timestamps = NULL;
+
+static TpAccount *
+dup_test_account (void)
+{
+  TpDBusDaemon *dbus;
+  TpSimpleClientFactory *factory;
+  TpAccount *account;
+  GError *error = NULL;
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  factory = tp_simple_client_factory_new (dbus);
+  account = tp_simple_client_factory_ensure_account (factory, ACCOUNT_PATH,
+      NULL, &error);
+  g_assert_no_error (error);
+
+  g_object_unref (factory);
+  g_object_unref (dbus);
+
+  return account;
+}
+
+/* Writes logs the way telepathy-logger's XML store does, in
+ * XDG_DATA_HOME/TpLogger/logs/<account>/<identifier>/<date>.log */
+static void
+generate_fixture (void)
+{
+  GDate *first;
+  gchar *dir;
+  guint d, m;
+
+  fixture_timestamps = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  dir = g_build_filename (g_get_user_data_dir (), "TpLogger", "logs",
+      ACCOUNT_DIR, CONTACT_ID, NULL);
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+  first = g_date_new_dmy (1, G_DATE_MARCH, 2013);
+
+  for (d = 0; d < N_DAYS; d++)
+    {
+      GDate *date;
+      GString *log;
+      gchar name[16], *path;
+      guint seconds = 0;
+      GError *error = NULL;
+
+      /* Leave a few days out */
+      if (d % 4 == 3)
+        continue;
+
+      date = g_date_new_julian (g_date_get_julian (first) + d);
+      g_date_strftime (name, sizeof (name), "%Y%m%d", date);
+
+      log = g_string_new ("<?xml version='1.0' encoding='utf-8'?>\n"
+          "<?xml-stylesheet type=\"text/xsl\" "
+          "href=\"log-store-xml.xsl\"?>\n<log>\n");
+
+      for (m = 0; m < N_MESSAGES; m++)
+        {
+          GDateTime *datetime;
+          gint64 timestamp;
+
+          if (m % TIE_RATIO != 0)
+            seconds += 800;
+
+          g_string_append_printf (log, "<message time='%sT%02u:%02u:%02u' "
+              "cm_id='%u' id='%s' name='Contact' token='' "
+              "isuser='false' type='normal'>Message %u</message>\n",
+              name, seconds / 3600, (seconds / 60) % 60, seconds % 60,
+              m, CONTACT_ID, m);
+
+          datetime = g_date_time_new_utc (g_date_get_year (date),
+              g_date_get_month (date), g_date_get_day (date),
+              seconds / 3600, (seconds / 60) % 60, seconds % 60);
+          timestamp = g_date_time_to_unix (datetime);
+          g_array_append_val (fixture_timestamps, timestamp);
+          g_date_time_unref (datetime);
+        }
+
+      g_string_append (log, "</log>\n");
+
+      g_date_strftime (name, sizeof (name), "%Y%m%d.log", date);
+      path = g_build_filename (dir, name, NULL);
+      g_file_set_contents (path, log->str, log->len, &error);
+      g_assert_no_error (error);
+
+      fixture_dates = g_list_prepend (fixture_dates, date);
+
+      g_free (path);
+      g_string_free (log, TRUE);
+    }
+
+  g_date_free (first);
+  g_free (dir);
+}
+
+static EmpathyLogPager *
+pager_new (TpAccount *account,
+    guint max_events)
+{
+  EmpathyLogPager *pager;
+  TplLogManager *log_manager;
+  TplEntity *target;
+  GList *l;
+
+  log_manager = tpl_log_manager_dup_singleton ();
+  target = tpl_entity_new (CONTACT_ID, TPL_ENTITY_CONTACT, "Contact", NULL);
+
+  pager = empathy_log_pager_new (log_manager, PAGE_SIZE, max_events);
+
+  /* Dates are given in any order */
+  for (l = fixture_dates; l != NULL; l = g_list_next (l))
+    empathy_log_pager_add_date (pager, account, target, TPL_EVENT_MASK_TEXT,
+        l->data);
+
+  g_object_unref (target);
+  g_object_unref (log_manager);
+
+  return pager;
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  GArray *timestamps;
+} PageData;
+
+static void
+got_page_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  PageData *data = user_data;
+  GList *events, *l;
+  GError *error = NULL;
+
+  empathy_log_pager_get_events_finish (EMPATHY_LOG_PAGER (source), result,
+      &events, &error);
+  g_assert_no_error (error);
+
+  for (l = events; l != NULL; l = g_list_next (l))
+    {
+      gint64 timestamp = tpl_event_get_timestamp (l->data);
+
+      g_array_append_val (data->timestamps, timestamp);
+    }
+
+  g_list_free_full (events, g_object_unref);
+
+  g_main_loop_quit (data->loop);
+}
+
+static void
+pending_page_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GError *error = NULL;
+
+  g_assert (!empathy_log_pager_get_events_finish (EMPATHY_LOG_PAGER (source),
+        result, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_PENDING);
+
+  g_error_free (error);
+}
+
+/* Returns the timestamps of the events of the page, checking they are in
+ * chronological order */
+static GArray *
+get_page (EmpathyLogPager *pager,
+    gboolean older)
+{
+  PageData data;
+  guint i;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.timestamps = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  if (older)
+    empathy_log_pager_get_older_async (pager, got_page_cb, &data);
+  else
+    empathy_log_pager_get_newer_async (pager, got_page_cb, &data);
+
+  /* Only one page is read at a time. The page may have been taken from
+   * days already read though. */
+  if (empathy_log_pager_is_busy (pager))
+    empathy_log_pager_get_older_async (pager, pending_page_cb, NULL);
+
+  g_main_loop_run (data.loop);
+  g_main_loop_unref (data.loop);
+
+  g_assert (!empathy_log_pager_is_busy (pager));
+
+  for (i = 1; i < data.timestamps->len; i++)
+    g_assert_cmpint (g_array_index (data.timestamps, gint64, i - 1), <=,
+        g_array_index (data.timestamps, gint64, i));
+
+  return data.timestamps;
+}
+
+static void
+check_page_size (GArray *page)
+{
+  /* Pages may be extended to the events sharing a timestamp with their
+   * last one */
+  g_assert_cmpuint (page->len, >=, PAGE_SIZE);
+  g_assert_cmpuint (page->len, <=, PAGE_SIZE + 1);
+}
+
+/* Checks that @window is a contiguous part of the fixture, and returns where
+ * it starts */
+static guint
+check_window (GArray *window)
+{
+  guint first, i;
+
+  g_assert_cmpuint (window->len, >, 0);
+
+  for (first = 0; first < fixture_timestamps->len; first++)
+    {
+      if (g_array_index (fixture_timestamps, gint64, first) ==
+          g_array_index (window, gint64, 0))
+        break;
+    }
+
+  /* The window starts with the first event of that timestamp */
+  g_assert_cmpuint (first + window->len, <=, fixture_timestamps->len);
+
+  for (i = 0; i < window->len; i++)
+    g_assert_cmpint (g_array_index (window, gint64, i), ==,
+        g_array_index (fixture_timestamps, gint64, first + i));
+
+  return first;
+}
+
+/* Removes the timestamps at or after @cut from @window if @newer is TRUE, the
+ * ones before it otherwise */
+static void
+remove_from_window (GArray *window,
+    gint64 cut,
+    gboolean newer)
+{
+  guint i;
+
+  for (i = 0; i < window->len; i++)
+    {
+      if (g_array_index (window, gint64, i) >= cut)
+        break;
+    }
+
+  if (newer)
+    g_array_set_size (window, i);
+  else
+    g_array_remove_range (window, 0, i);
+}
+
+static void
+test_log_pager_older (void)
+{
+  EmpathyLogPager *pager;
+  TpAccount *account;
+  GArray *all;
+  guint n_pages = 0;
+
+  account = dup_test_account ();
+  pager = pager_new (account, 0);
+  all = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  g_assert (empathy_log_pager_has_older (pager));
+  g_assert (!empathy_log_pager_has_newer (pager));
+
+  /* Page back to the first event, each page preceding the previous one */
+  while (empathy_log_pager_has_older (pager))
+    {
+      GArray *page = get_page (pager, TRUE);
+
+      if (empathy_log_pager_has_older (pager))
+        check_page_size (page);
+
+      if (page->len > 0 && all->len > 0)
+        g_assert_cmpint (g_array_index (page, gint64, page->len - 1), <,
+            g_array_index (all, gint64, 0));
+
+      g_array_prepend_vals (all, page->data, page->len);
+      g_array_unref (page);
+
+      n_pages++;
+    }
+
+  DEBUG ("%u events in %u pages", all->len, n_pages);
+
+  g_assert_cmpuint (n_pages, >=, fixture_timestamps->len / (PAGE_SIZE + 1));
+  g_assert_cmpuint (all->len, ==, fixture_timestamps->len);
+  g_assert_cmpuint (check_window (all), ==, 0);
+  g_assert_cmpuint (empathy_log_pager_get_n_events (pager), ==, all->len);
+  g_assert (!empathy_log_pager_has_newer (pager));
+
+  g_array_unref (all);
+  g_object_unref (pager);
+  g_object_unref (account);
+}
+
+static void
+test_log_pager_window (void)
+{
+  EmpathyLogPager *pager;
+  TpAccount *account;
+  GArray *window;
+  gint64 cut;
+  gboolean trimmed = FALSE;
+
+  account = dup_test_account ();
+  pager = pager_new (account, MAX_EVENTS);
+  window = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  /* Scroll back to the first event, forgetting the newest ones */
+  while (empathy_log_pager_has_older (pager))
+    {
+      GArray *page = get_page (pager, TRUE);
+
+      g_array_prepend_vals (window, page->data, page->len);
+      g_array_unref (page);
+
+      if (empathy_log_pager_trim_newer (pager, &cut))
+        {
+          remove_from_window (window, cut, TRUE);
+          trimmed = TRUE;
+        }
+
+      g_assert_cmpuint (empathy_log_pager_get_n_events (pager), ==,
+          window->len);
+      g_assert_cmpuint (window->len, <=, MAX_EVENTS + 1);
+      check_window (window);
+    }
+
+  g_assert (trimmed);
+  g_assert_cmpuint (check_window (window), ==, 0);
+  g_assert (empathy_log_pager_has_newer (pager));
+
+  /* And forth to the last one, forgetting the oldest ones */
+  while (empathy_log_pager_has_newer (pager))
+    {
+      GArray *page = get_page (pager, FALSE);
+
+      g_assert_cmpuint (page->len, >, 0);
+      g_assert_cmpint (g_array_index (page, gint64, 0), >,
+          g_array_index (window, gint64, window->len - 1));
+
+      g_array_append_vals (window, page->data, page->len);
+      g_array_unref (page);
+
+      if (empathy_log_pager_trim_older (pager, &cut))
+        remove_from_window (window, cut, FALSE);
+
+      g_assert_cmpuint (empathy_log_pager_get_n_events (pager), ==,
+          window->len);
+      g_assert_cmpuint (window->len, <=, MAX_EVENTS + 1);
+      check_window (window);
+    }
+
+  g_assert_cmpuint (check_window (window) + window->len, ==,
+      fixture_timestamps->len);
+  g_assert (empathy_log_pager_has_older (pager));
+
+  g_array_unref (window);
+  g_object_unref (pager);
+  g_object_unref (account);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+  gchar *dir, *data_dir;
+
+  /* Use a log tree of our own */
+  dir = g_dir_make_tmp ("empathy-log-pager-test-XXXXXX", NULL);
+  g_assert (dir != NULL);
+
+  data_dir = g_build_filename (dir, "data", NULL);
+  g_setenv ("XDG_DATA_HOME", data_dir, TRUE);
+
+  test_init_with_session_bus (argc, argv);
+
+  generate_fixture ();
+
+  g_test_add_func ("/log-pager/older", test_log_pager_older);
+  g_test_add_func ("/log-pager/window", test_log_pager_window);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  g_list_free_full (fixture_dates, (GDestroyNotify) g_date_free);
+  g_array_unref (fixture_timestamps);
+  g_free (data_dir);
+  g_free (dir);
+
+  return result;
+}
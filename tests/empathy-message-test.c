@@ -0,0 +1,159 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "empathy-message.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_PENDING 300
+#define N_EVENTS 5000
+
+static const gchar *bodies[] = {
+  "hello",
+  "hello ",
+  "Hello",
+  "hello world",
+  "",
+  "héllo",
+  "a much longer message which only differs at the very end: 1",
+  "a much longer message which only differs at the very end: 2",
+  NULL,
+};
+
+static EmpathyMessage *
+new_message (const gchar *body,
+    gint64 timestamp)
+{
+  return g_object_new (EMPATHY_TYPE_MESSAGE,
+      "body", body,
+      "timestamp", timestamp,
+      NULL);
+}
+
+static EmpathyMessage *
+new_random_message (GRand *rand)
+{
+  /* Few timestamps and bodies, so we get many duplicates and messages
+   * differing only by their timestamp or their body */
+  return new_message (
+      bodies[g_rand_int_range (rand, 0, G_N_ELEMENTS (bodies))],
+      g_rand_int_range (rand, 1000, 1020));
+}
+
+static void
+test_message_hash_equal (void)
+{
+  EmpathyMessage *a, *b;
+
+  /* Equal messages have the same hash */
+  a = new_message ("hello", 1000);
+  b = new_message ("hello", 1000);
+  g_assert (empathy_message_equal (a, b));
+  g_assert_cmpuint (empathy_message_hash (a), ==, empathy_message_hash (b));
+  g_object_unref (b);
+
+  /* Near-duplicates are not equal */
+  b = new_message ("hello", 1001);
+  g_assert (!empathy_message_equal (a, b));
+  g_object_unref (b);
+
+  b = new_message ("hello ", 1000);
+  g_assert (!empathy_message_equal (a, b));
+  g_object_unref (b);
+
+  g_object_unref (a);
+
+  a = new_message (NULL, 1000);
+  b = new_message (NULL, 1000);
+  g_assert (empathy_message_equal (a, b));
+  g_assert_cmpuint (empathy_message_hash (a), ==, empathy_message_hash (b));
+  g_object_unref (b);
+
+  /* A missing body is the same as an empty one */
+  b = new_message ("", 1000);
+  g_assert (empathy_message_equal (a, b));
+  g_assert_cmpuint (empathy_message_hash (a), ==, empathy_message_hash (b));
+  g_object_unref (b);
+  g_object_unref (a);
+}
+
+/* Filtering log events against pending messages through a hash table must
+ * give the same result than comparing each event to each pending message
+ * as chat_log_filter() used to do. */
+static void
+test_message_dedup_index (void)
+{
+  GRand *rand;
+  GPtrArray *pending;
+  GHashTable *index;
+  guint i, n_filtered = 0;
+
+  rand = g_rand_new_with_seed (42);
+  pending = g_ptr_array_new_with_free_func (g_object_unref);
+  index = g_hash_table_new ((GHashFunc) empathy_message_hash,
+      (GEqualFunc) empathy_message_equal);
+
+  for (i = 0; i < N_PENDING; i++)
+    {
+      EmpathyMessage *message = new_random_message (rand);
+
+      g_ptr_array_add (pending, message);
+      g_hash_table_add (index, message);
+    }
+
+  for (i = 0; i < N_EVENTS; i++)
+    {
+      EmpathyMessage *event = new_random_message (rand);
+      gboolean found = FALSE;
+      guint j;
+
+      for (j = 0; j < pending->len; j++)
+        {
+          if (empathy_message_equal (event, g_ptr_array_index (pending, j)))
+            {
+              found = TRUE;
+              break;
+            }
+        }
+
+      g_assert (found == g_hash_table_contains (index, event));
+
+      if (found)
+        n_filtered++;
+
+      g_object_unref (event);
+    }
+
+  DEBUG ("%u events out of %u filtered", n_filtered, N_EVENTS);
+
+  /* Make sure both cases have been covered */
+  g_assert_cmpuint (n_filtered, >, 0);
+  g_assert_cmpuint (n_filtered, <, N_EVENTS);
+
+  g_hash_table_unref (index);
+  g_ptr_array_unref (pending);
+  g_rand_free (rand);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/message/hash-equal", test_message_hash_equal);
+  g_test_add_func ("/message/dedup-index", test_message_dedup_index);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,241 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "empathy-popularity-ranking.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define DAY (24 * 60 * 60)
+
+#define N_ITEMS 40
+#define N_OPERATIONS 5000
+#define N_STREAMS 20
+#define TOP_LEN 5
+
+static void
+test_popularity_compute (void)
+{
+  gint64 now = 1380000000;
+
+  /* Less than 50 interactions */
+  g_assert_cmpuint (empathy_popularity_compute (0, now, now), ==, 0);
+  g_assert_cmpuint (empathy_popularity_compute (49, now, now), ==, 0);
+
+  g_assert_cmpuint (empathy_popularity_compute (50, now, now), ==, 1);
+  g_assert_cmpuint (empathy_popularity_compute (149, now - DAY, now), ==, 2);
+  g_assert_cmpuint (empathy_popularity_compute (500, now - 30 * DAY, now),
+      ==, 10);
+
+  /* Interactions older than 30 days don't count */
+  g_assert_cmpuint (empathy_popularity_compute (500, now - 30 * DAY - 1, now),
+      ==, 0);
+}
+
+/* Brute-force implementation of the ranking: items sorted by decreasing
+ * popularity then by the order in which they have been added. */
+typedef struct
+{
+  gboolean present[N_ITEMS];
+  guint popularity[N_ITEMS];
+  guint64 serial[N_ITEMS];
+  guint64 next_serial;
+} Reference;
+
+static Reference *sort_reference = NULL;
+
+static gint
+compare_reference_items (gconstpointer a,
+    gconstpointer b)
+{
+  guint i = *(const guint *) a;
+  guint j = *(const guint *) b;
+
+  if (sort_reference->popularity[i] != sort_reference->popularity[j])
+    return sort_reference->popularity[i] > sort_reference->popularity[j] ?
+        -1 : 1;
+
+  return sort_reference->serial[i] < sort_reference->serial[j] ? -1 : 1;
+}
+
+/* Fill @order with the present items, most popular first, and return their
+ * number. */
+static guint
+reference_sort (Reference *ref,
+    guint *order)
+{
+  guint i, n = 0;
+
+  for (i = 0; i < N_ITEMS; i++)
+    {
+      if (ref->present[i])
+        order[n++] = i;
+    }
+
+  sort_reference = ref;
+  qsort (order, n, sizeof (guint), compare_reference_items);
+  sort_reference = NULL;
+
+  return n;
+}
+
+static guint
+reference_top (Reference *ref,
+    guint *top)
+{
+  guint order[N_ITEMS];
+  guint i, n, n_top = 0;
+
+  n = reference_sort (ref, order);
+
+  for (i = 0; i < n && n_top < TOP_LEN; i++)
+    {
+      if (ref->popularity[order[i]] == 0)
+        break;
+
+      top[n_top++] = order[i];
+    }
+
+  return n_top;
+}
+
+static gboolean
+same_members (const guint *a,
+    guint n_a,
+    const guint *b,
+    guint n_b)
+{
+  guint i, j;
+
+  if (n_a != n_b)
+    return FALSE;
+
+  for (i = 0; i < n_a; i++)
+    {
+      gboolean found = FALSE;
+
+      for (j = 0; j < n_b && !found; j++)
+        found = (a[i] == b[j]);
+
+      if (!found)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Items are stored as index + 1 as NULL can't be used */
+#define ITEM(i) GUINT_TO_POINTER ((i) + 1)
+
+static void
+check_ranking (EmpathyPopularityRanking *ranking,
+    Reference *ref)
+{
+  guint order[N_ITEMS], top[TOP_LEN];
+  guint i, n, n_top;
+  GList *items, *l;
+
+  n = reference_sort (ref, order);
+
+  items = empathy_popularity_ranking_dup_items (ranking);
+  g_assert_cmpuint (g_list_length (items), ==, n);
+
+  for (l = items, i = 0; l != NULL; l = g_list_next (l), i++)
+    g_assert (l->data == ITEM (order[i]));
+
+  g_list_free (items);
+
+  n_top = reference_top (ref, top);
+  l = empathy_popularity_ranking_get_top (ranking);
+  g_assert_cmpuint (g_list_length (l), ==, n_top);
+
+  for (i = 0; l != NULL; l = g_list_next (l), i++)
+    g_assert (l->data == ITEM (top[i]));
+}
+
+static void
+run_stream (void)
+{
+  EmpathyPopularityRanking *ranking;
+  Reference ref;
+  guint op;
+
+  memset (&ref, 0, sizeof (ref));
+  ranking = empathy_popularity_ranking_new (TOP_LEN);
+
+  for (op = 0; op < N_OPERATIONS; op++)
+    {
+      guint old_top[TOP_LEN], new_top[TOP_LEN];
+      guint n_old, n_new;
+      guint i = g_test_rand_int_range (0, N_ITEMS);
+      gboolean changed;
+
+      n_old = reference_top (&ref, old_top);
+
+      if (g_test_rand_int_range (0, 10) == 0)
+        {
+          changed = empathy_popularity_ranking_remove (ranking, ITEM (i));
+          ref.present[i] = FALSE;
+        }
+      else
+        {
+          /* Few different values so we have plenty of ties */
+          guint pop = g_test_rand_int_range (0, 8);
+
+          changed = empathy_popularity_ranking_set (ranking, ITEM (i), pop);
+
+          if (!ref.present[i])
+            {
+              ref.present[i] = TRUE;
+              ref.serial[i] = ref.next_serial++;
+            }
+
+          ref.popularity[i] = pop;
+        }
+
+      n_new = reference_top (&ref, new_top);
+
+      /* Only membership changes are reported */
+      g_assert_cmpint (changed, ==,
+          !same_members (old_top, n_old, new_top, n_new));
+
+      g_assert_cmpint (empathy_popularity_ranking_contains (ranking, ITEM (i)),
+          ==, ref.present[i]);
+      g_assert_cmpuint (empathy_popularity_ranking_get_popularity (ranking,
+          ITEM (i)), ==, ref.present[i] ? ref.popularity[i] : 0);
+
+      check_ranking (ranking, &ref);
+    }
+
+  empathy_popularity_ranking_free (ranking);
+}
+
+static void
+test_popularity_ranking_random (void)
+{
+  guint i;
+
+  for (i = 0; i < N_STREAMS; i++)
+    run_stream ();
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/popularity/compute", test_popularity_compute);
+  g_test_add_func ("/popularity/random-streams",
+      test_popularity_ranking_random);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
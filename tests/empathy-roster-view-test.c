@@ -0,0 +1,330 @@
+#include "config.h"
+
+#include "empathy-roster-contact.h"
+#include "empathy-roster-model.h"
+#include "empathy-roster-view.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_INDIVIDUALS 20000
+#define N_GROUPS 10
+/* Visible rows plus the margins the view keeps above and below them, with
+ * plenty of slack for themes with smaller rows. */
+#define MAX_MATERIALIZED 150
+
+#define N_REFILTER_INDIVIDUALS 10000
+#define N_REFILTERS 10
+/* One individual out of TOP_RATIO is in the top group */
+#define TOP_RATIO 50
+
+/* A roster model containing a fixed list of individuals without any persona,
+ * so we can display a huge roster without any backend. */
+
+typedef struct
+{
+  GObject parent;
+  GList *individuals;
+} TestRosterModel;
+
+typedef struct
+{
+  GObjectClass parent_class;
+} TestRosterModelClass;
+
+static void test_roster_model_iface_init (EmpathyRosterModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestRosterModel, test_roster_model, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (EMPATHY_TYPE_ROSTER_MODEL,
+        test_roster_model_iface_init))
+
+static void
+test_roster_model_finalize (GObject *object)
+{
+  TestRosterModel *self = (TestRosterModel *) object;
+
+  g_list_free_full (self->individuals, g_object_unref);
+
+  G_OBJECT_CLASS (test_roster_model_parent_class)->finalize (object);
+}
+
+static void
+test_roster_model_class_init (TestRosterModelClass *klass)
+{
+  GObjectClass *oclass = G_OBJECT_CLASS (klass);
+
+  oclass->finalize = test_roster_model_finalize;
+}
+
+static void
+test_roster_model_init (TestRosterModel *self)
+{
+}
+
+static GList *
+test_roster_model_get_individuals (EmpathyRosterModel *model)
+{
+  TestRosterModel *self = (TestRosterModel *) model;
+
+  return g_list_copy (self->individuals);
+}
+
+static GList *
+test_roster_model_dup_groups_for_individual (EmpathyRosterModel *model,
+    FolksIndividual *individual)
+{
+  const gchar *group;
+
+  group = g_object_get_data (G_OBJECT (individual), "test-group");
+
+  return g_list_prepend (NULL, g_strdup (group));
+}
+
+static void
+test_roster_model_iface_init (EmpathyRosterModelInterface *iface)
+{
+  iface->get_individuals = test_roster_model_get_individuals;
+  iface->dup_groups_for_individual =
+      test_roster_model_dup_groups_for_individual;
+}
+
+static EmpathyRosterModel *
+test_roster_model_new (guint n_individuals)
+{
+  TestRosterModel *self;
+  guint i;
+
+  self = g_object_new (test_roster_model_get_type (), NULL);
+
+  for (i = 0; i < n_individuals; i++)
+    {
+      FolksIndividual *individual = folks_individual_new (NULL);
+
+      g_object_set_data_full (G_OBJECT (individual), "test-group",
+          g_strdup_printf ("group %u", i % N_GROUPS), g_free);
+
+      self->individuals = g_list_prepend (self->individuals, individual);
+    }
+
+  return EMPATHY_ROSTER_MODEL (self);
+}
+
+static void
+run_pending_sources (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+/* Returns the first contact row displayed at @y or below it, if any */
+static EmpathyRosterContact *
+get_contact_at_y (EmpathyRosterView *view,
+    gint y)
+{
+  GtkListBoxRow *row;
+
+  row = gtk_list_box_get_row_at_y (GTK_LIST_BOX (view), y);
+  while (row != NULL && !EMPATHY_IS_ROSTER_CONTACT (row))
+    row = gtk_list_box_get_row_at_index (GTK_LIST_BOX (view),
+        gtk_list_box_row_get_index (row) + 1);
+
+  return (EmpathyRosterContact *) row;
+}
+
+/* Let the view be allocated and create the widgets of the rows displayed at
+ * @y */
+static void
+wait_for_widgets (EmpathyRosterView *view,
+    gint y)
+{
+  EmpathyRosterContact *contact;
+
+  for (contact = get_contact_at_y (view, y);
+       contact == NULL || !empathy_roster_contact_has_widgets (contact);
+       contact = get_contact_at_y (view, y))
+    g_main_context_iteration (NULL, TRUE);
+
+  /* Rows getting their real height may have scheduled another pass */
+  run_pending_sources ();
+}
+
+static guint
+count_materialized (EmpathyRosterView *view,
+    guint *n_contacts)
+{
+  GList *children, *l;
+  guint n = 0;
+
+  *n_contacts = 0;
+
+  children = gtk_container_get_children (GTK_CONTAINER (view));
+  for (l = children; l != NULL; l = g_list_next (l))
+    {
+      if (!EMPATHY_IS_ROSTER_CONTACT (l->data))
+        continue;
+
+      (*n_contacts)++;
+
+      if (empathy_roster_contact_has_widgets (l->data))
+        n++;
+    }
+
+  g_list_free (children);
+  return n;
+}
+
+static void
+check_view (EmpathyRosterView *view,
+    guint expected_contacts)
+{
+  GtkAdjustment *adjustment;
+  gdouble value;
+  guint n, n_contacts;
+
+  wait_for_widgets (view, 0);
+
+  n = count_materialized (view, &n_contacts);
+  DEBUG ("%u rows out of %u have widgets", n, n_contacts);
+
+  g_assert_cmpuint (n_contacts, ==, expected_contacts);
+  g_assert_cmpuint (n, >, 0);
+  g_assert_cmpuint (n, <=, MAX_MATERIALIZED);
+
+  /* Scroll to the middle of the roster */
+  adjustment = gtk_list_box_get_adjustment (GTK_LIST_BOX (view));
+  g_assert (adjustment != NULL);
+
+  value = (gtk_adjustment_get_upper (adjustment) -
+      gtk_adjustment_get_page_size (adjustment)) / 2;
+  gtk_adjustment_set_value (adjustment, value);
+
+  /* Visible rows have their widgets */
+  wait_for_widgets (view, (gint) value + 1);
+
+  n = count_materialized (view, &n_contacts);
+  DEBUG ("%u rows have widgets after scrolling", n);
+
+  g_assert_cmpuint (n, >, 0);
+  g_assert_cmpuint (n, <=, MAX_MATERIALIZED);
+}
+
+static void
+test_roster_view_bounded (gboolean show_groups)
+{
+  EmpathyRosterModel *model;
+  GtkWidget *window, *sw, *view;
+
+  model = test_roster_model_new (N_INDIVIDUALS);
+
+  window = gtk_offscreen_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), 300, 600);
+
+  sw = gtk_scrolled_window_new (NULL, NULL);
+  gtk_container_add (GTK_CONTAINER (window), sw);
+
+  view = empathy_roster_view_new (model);
+  empathy_roster_view_show_offline (EMPATHY_ROSTER_VIEW (view), TRUE);
+  empathy_roster_view_show_groups (EMPATHY_ROSTER_VIEW (view), show_groups);
+  gtk_container_add (GTK_CONTAINER (sw), view);
+
+  gtk_widget_show_all (window);
+
+  check_view (EMPATHY_ROSTER_VIEW (view), N_INDIVIDUALS);
+
+  /* Hiding offline contacts filters out all of them */
+  empathy_roster_view_show_offline (EMPATHY_ROSTER_VIEW (view), FALSE);
+  run_pending_sources ();
+
+  g_assert (empathy_roster_view_is_empty (EMPATHY_ROSTER_VIEW (view)));
+
+  gtk_widget_destroy (window);
+  g_object_unref (model);
+}
+
+static void
+test_roster_view_no_groups (void)
+{
+  test_roster_view_bounded (FALSE);
+}
+
+static void
+test_roster_view_groups (void)
+{
+  test_roster_view_bounded (TRUE);
+}
+
+/* Time full re-filters of the roster, checking for each contact whether it's
+ * a top one. */
+static void
+test_roster_view_refilter (void)
+{
+  EmpathyRosterModel *model;
+  GtkWidget *window, *sw, *view;
+  GList *individuals, *l;
+  gdouble elapsed = 0;
+  guint i;
+
+  model = test_roster_model_new (N_REFILTER_INDIVIDUALS);
+
+  individuals = empathy_roster_model_get_individuals (model);
+  for (l = individuals, i = 0; l != NULL; l = g_list_next (l), i++)
+    {
+      if (i % TOP_RATIO == 0)
+        g_object_set_data (l->data, "test-group",
+            EMPATHY_ROSTER_MODEL_GROUP_TOP_GROUP);
+    }
+  g_list_free (individuals);
+
+  window = gtk_offscreen_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), 300, 600);
+
+  sw = gtk_scrolled_window_new (NULL, NULL);
+  gtk_container_add (GTK_CONTAINER (window), sw);
+
+  view = empathy_roster_view_new (model);
+  empathy_roster_view_show_groups (EMPATHY_ROSTER_VIEW (view), FALSE);
+  gtk_container_add (GTK_CONTAINER (sw), view);
+
+  gtk_widget_show_all (window);
+  run_pending_sources ();
+
+  for (i = 0; i < N_REFILTERS; i++)
+    {
+      g_test_timer_start ();
+      empathy_roster_view_show_offline (EMPATHY_ROSTER_VIEW (view), TRUE);
+      empathy_roster_view_show_offline (EMPATHY_ROSTER_VIEW (view), FALSE);
+      elapsed += g_test_timer_elapsed ();
+    }
+
+  DEBUG ("Re-filtering %u contacts took %.2f ms on average",
+      N_REFILTER_INDIVIDUALS, elapsed * 1000 / (2 * N_REFILTERS));
+  g_test_minimized_result (elapsed / (2 * N_REFILTERS),
+      "Re-filtering %u contacts", N_REFILTER_INDIVIDUALS);
+
+  /* None of them is online or favourite */
+  run_pending_sources ();
+  g_assert (empathy_roster_view_is_empty (EMPATHY_ROSTER_VIEW (view)));
+
+  gtk_widget_destroy (window);
+  g_object_unref (model);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/roster-view/bounded-widgets", test_roster_view_no_groups);
+  g_test_add_func ("/roster-view/bounded-widgets-groups",
+      test_roster_view_groups);
+  g_test_add_func ("/roster-view/refilter", test_roster_view_refilter);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
@@ -0,0 +1,369 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "empathy-smiley-manager.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_TEXTS 100000
+#define MAX_TEXT_LEN 40
+
+/* Same smileys as empathy_smiley_manager_load() */
+static const gchar *default_smileys[] = {
+  "O:-)", "O:)", "X-(", ":@", "B-)", ":'(", ">:-)", ">:)", ":-[", ":[",
+  ":-$", ":$", ":-*", ":*", ":-))", ":))", ":-(|)", ":(|)", ":-|", ":|",
+  ":-P", ":P", ":-p", ":p", ":-(", ":(", ":-&", ":&", ":-)", ":)", ":-D",
+  ":D", ":-d", ":d", ":-!", ":!", ":-O", ":O", ":-o", ":o", "|-)", "|)",
+  ":-/", ":/", ";-)", ";)", ":-S", ":S", ":-s", ":s",
+  NULL
+};
+
+/* Smileys overlapping each other in various ways, and non-ASCII ones */
+static const gchar *extra_smileys[] = {
+  "abcd", "b", "bc", "cdx", "aab", "\342\204\242" /* ™ */,
+  "<3", "\342\231\245\342\231\245\342\231\245" /* ♥♥♥ */,
+  NULL
+};
+
+/* The matcher empathy_smiley_manager_parse_len() used before smileys were
+ * compiled into an automaton: a trie walked again from the next character
+ * each time a potential smiley turns out not to be one. */
+typedef struct _RefTree RefTree;
+struct _RefTree
+{
+  gunichar c;
+  const gchar *smiley;
+  GSList *children;
+};
+
+static RefTree *
+ref_tree_new (gunichar c)
+{
+  RefTree *tree;
+
+  tree = g_slice_new0 (RefTree);
+  tree->c = c;
+
+  return tree;
+}
+
+static void
+ref_tree_free (RefTree *tree)
+{
+  g_slist_free_full (tree->children, (GDestroyNotify) ref_tree_free);
+  g_slice_free (RefTree, tree);
+}
+
+static RefTree *
+ref_tree_find_child (RefTree *tree,
+    gunichar c)
+{
+  GSList *l;
+
+  for (l = tree->children; l != NULL; l = l->next)
+    {
+      RefTree *child = l->data;
+
+      if (child->c == c)
+        return child;
+    }
+
+  return NULL;
+}
+
+static void
+ref_tree_insert (RefTree *tree,
+    const gchar *smiley)
+{
+  const gchar *str;
+
+  for (str = smiley; *str != '\0'; str = g_utf8_next_char (str))
+    {
+      RefTree *child;
+
+      child = ref_tree_find_child (tree, g_utf8_get_char (str));
+      if (child == NULL)
+        {
+          child = ref_tree_new (g_utf8_get_char (str));
+          tree->children = g_slist_prepend (tree->children, child);
+        }
+
+      tree = child;
+    }
+
+  tree->smiley = smiley;
+}
+
+typedef struct
+{
+  const gchar *smiley;
+  guint start;
+  guint end;
+} RefHit;
+
+static GArray *
+ref_parse_len (RefTree *root,
+    const gchar *text,
+    gssize len)
+{
+  GArray *hits;
+  RefTree *cur_tree = root;
+  const gchar *cur_str;
+  const gchar *start = NULL;
+  RefHit hit;
+
+  hits = g_array_new (FALSE, FALSE, sizeof (RefHit));
+
+  if (len < 0)
+    len = G_MAXSSIZE;
+
+  for (cur_str = text;
+       *cur_str != '\0' && cur_str - text < len;
+       cur_str = g_utf8_next_char (cur_str))
+    {
+      RefTree *child;
+      gunichar c;
+
+      c = g_utf8_get_char (cur_str);
+      child = ref_tree_find_child (cur_tree, c);
+
+      if (child != NULL)
+        {
+          if (cur_tree == root)
+            start = cur_str;
+          cur_tree = child;
+          continue;
+        }
+
+      if (cur_tree->smiley != NULL)
+        {
+          hit.smiley = cur_tree->smiley;
+          hit.start = start - text;
+          hit.end = cur_str - text;
+          g_array_append_val (hits, hit);
+
+          cur_tree = ref_tree_find_child (root, c);
+          if (cur_tree != NULL)
+            start = cur_str;
+          else
+            cur_tree = root;
+        }
+      else if (cur_tree != root)
+        {
+          cur_str = start;
+          cur_tree = root;
+        }
+    }
+
+  if (cur_tree->smiley != NULL)
+    {
+      hit.smiley = cur_tree->smiley;
+      hit.start = start - text;
+      hit.end = cur_str - text;
+      g_array_append_val (hits, hit);
+    }
+
+  return hits;
+}
+
+/* Path of the image used for smiley, as found by the manager */
+static const gchar *
+get_smiley_path (EmpathySmileyManager *manager,
+    const gchar *smiley)
+{
+  GSList *hits;
+  EmpathySmileyHit *hit;
+  const gchar *path;
+
+  hits = empathy_smiley_manager_parse_len (manager, smiley, -1);
+  g_assert_cmpuint (g_slist_length (hits), ==, 1);
+
+  hit = hits->data;
+  g_assert_cmpuint (hit->start, ==, 0);
+  g_assert_cmpuint (hit->end, ==, strlen (smiley));
+  path = hit->path;
+
+  g_slist_free_full (hits, (GDestroyNotify) empathy_smiley_hit_free);
+
+  return path;
+}
+
+static void
+append_hit_cb (EmpathySmileyManager *manager,
+    const EmpathySmileyHit *hit,
+    gpointer user_data)
+{
+  GArray *hits = user_data;
+
+  g_array_append_vals (hits, hit, 1);
+}
+
+static void
+check_parse (EmpathySmileyManager *manager,
+    RefTree *root,
+    const gchar *text,
+    gssize len)
+{
+  GSList *hits, *l;
+  GArray *expected;
+  GArray *foreach_hits;
+  guint i = 0;
+
+  hits = empathy_smiley_manager_parse_len (manager, text, len);
+  expected = ref_parse_len (root, text, len);
+
+  foreach_hits = g_array_new (FALSE, FALSE, sizeof (EmpathySmileyHit));
+  empathy_smiley_manager_foreach_hit (manager, text, len, append_hit_cb,
+      foreach_hits);
+  g_assert_cmpuint (foreach_hits->len, ==, expected->len);
+
+  for (l = hits; l != NULL; l = l->next, i++)
+    {
+      EmpathySmileyHit *hit = l->data;
+      RefHit *ref;
+
+      g_assert_cmpuint (i, <, expected->len);
+      ref = &g_array_index (expected, RefHit, i);
+
+      g_assert_cmpuint (hit->start, ==, ref->start);
+      g_assert_cmpuint (hit->end, ==, ref->end);
+      g_assert_cmpstr (hit->path, ==, get_smiley_path (manager, ref->smiley));
+      g_assert (hit->pixbuf != NULL);
+
+      /* Same hits without allocating them */
+      g_assert (memcmp (hit, &g_array_index (foreach_hits,
+              EmpathySmileyHit, i), sizeof (EmpathySmileyHit)) == 0);
+    }
+
+  g_assert_cmpuint (i, ==, expected->len);
+
+  g_slist_free_full (hits, (GDestroyNotify) empathy_smiley_hit_free);
+  g_array_unref (foreach_hits);
+  g_array_unref (expected);
+}
+
+static void
+test_smiley_manager_random_corpus (void)
+{
+  EmpathySmileyManager *manager;
+  RefTree *root;
+  GString *alphabet;
+  GPtrArray *chars;
+  GRand *rand;
+  const gchar *c;
+  guint i;
+
+  manager = empathy_smiley_manager_dup_singleton ();
+  empathy_smiley_manager_add (manager, "face-smile", extra_smileys[0],
+      extra_smileys[1], extra_smileys[2], extra_smileys[3], extra_smileys[4],
+      extra_smileys[5], extra_smileys[6], extra_smileys[7], NULL);
+
+  root = ref_tree_new (0);
+  for (i = 0; default_smileys[i] != NULL; i++)
+    ref_tree_insert (root, default_smileys[i]);
+  for (i = 0; extra_smileys[i] != NULL; i++)
+    ref_tree_insert (root, extra_smileys[i]);
+
+  /* Random texts made of the characters used in smileys, and a few
+   * others */
+  alphabet = g_string_new (" xe\303\251");
+  for (i = 0; default_smileys[i] != NULL; i++)
+    g_string_append (alphabet, default_smileys[i]);
+  for (i = 0; extra_smileys[i] != NULL; i++)
+    g_string_append (alphabet, extra_smileys[i]);
+
+  chars = g_ptr_array_new ();
+  for (c = alphabet->str; *c != '\0'; c = g_utf8_next_char (c))
+    g_ptr_array_add (chars, (gpointer) c);
+
+  rand = g_rand_new_with_seed (42);
+
+  for (i = 0; i < N_TEXTS; i++)
+    {
+      GString *text;
+      guint len, j;
+
+      text = g_string_new (NULL);
+      len = g_rand_int_range (rand, 0, MAX_TEXT_LEN);
+
+      for (j = 0; j < len; j++)
+        {
+          const gchar *ch;
+
+          ch = g_ptr_array_index (chars,
+              g_rand_int_range (rand, 0, chars->len));
+          g_string_append_len (text, ch, g_utf8_next_char (ch) - ch);
+        }
+
+      check_parse (manager, root, text->str, -1);
+
+      /* Only parse the beginning of the text, possibly in the middle of
+       * a character */
+      check_parse (manager, root, text->str,
+          g_rand_int_range (rand, 0, text->len + 1));
+
+      g_string_free (text, TRUE);
+    }
+
+  g_rand_free (rand);
+  g_ptr_array_unref (chars);
+  g_string_free (alphabet, TRUE);
+  ref_tree_free (root);
+  g_object_unref (manager);
+}
+
+static void
+test_smiley_manager_overlapping (void)
+{
+  EmpathySmileyManager *manager;
+  GSList *hits;
+  EmpathySmileyHit *hit;
+
+  manager = empathy_smiley_manager_dup_singleton ();
+
+  /* ">:(" is not a smiley, but ":(" is */
+  hits = empathy_smiley_manager_parse_len (manager, "a >:( b", -1);
+  g_assert_cmpuint (g_slist_length (hits), ==, 1);
+  hit = hits->data;
+  g_assert_cmpuint (hit->start, ==, 3);
+  g_assert_cmpuint (hit->end, ==, 5);
+  g_slist_free_full (hits, (GDestroyNotify) empathy_smiley_hit_free);
+
+  /* The longest smiley wins */
+  hits = empathy_smiley_manager_parse_len (manager, ":-)):)", -1);
+  g_assert_cmpuint (g_slist_length (hits), ==, 2);
+  hit = hits->data;
+  g_assert_cmpuint (hit->start, ==, 0);
+  g_assert_cmpuint (hit->end, ==, 4);
+  hit = hits->next->data;
+  g_assert_cmpuint (hit->start, ==, 4);
+  g_assert_cmpuint (hit->end, ==, 6);
+  g_slist_free_full (hits, (GDestroyNotify) empathy_smiley_hit_free);
+
+  g_object_unref (manager);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int result;
+
+  test_init (argc, argv);
+
+  g_test_add_func ("/smiley-manager/overlapping",
+      test_smiley_manager_overlapping);
+  g_test_add_func ("/smiley-manager/random-corpus",
+      test_smiley_manager_random_corpus);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  return result;
+}
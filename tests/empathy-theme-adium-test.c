@@ -0,0 +1,569 @@
+#include "config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "empathy-contact.h"
+#include "empathy-gsettings.h"
+#include "empathy-message.h"
+#include "empathy-theme-adium.h"
+#include "test-helper.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_TESTS
+#include "empathy-debug.h"
+
+#define N_MESSAGES 100
+
+/* Synthetic transcript timed with -m perf */
+#define N_TRANSCRIPT_MESSAGES 10000
+#define N_TRANSCRIPT_SENDERS 5
+
+#define AVATAR_TOKEN "avatar-token"
+#define AVATAR_DATA "not really a PNG"
+
+/* Unread messages, and those of them acknowledged */
+#define N_UNREAD 1500
+#define N_ACKED 1000
+
+static TpAccount *
+dup_test_account (void)
+{
+  TpDBusDaemon *dbus;
+  TpSimpleClientFactory *factory;
+  TpAccount *account;
+  GError *error = NULL;
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  factory = tp_simple_client_factory_new (dbus);
+  account = tp_simple_client_factory_ensure_account (factory,
+      TP_ACCOUNT_OBJECT_PATH_BASE "fake/jabber/account0", NULL, &error);
+  g_assert_no_error (error);
+
+  g_object_unref (factory);
+  g_object_unref (dbus);
+
+  return account;
+}
+
+static EmpathyContact *
+dup_contact_with_avatar (const gchar *id,
+    const gchar *avatar_token)
+{
+  TpAccount *account;
+  TplEntity *entity;
+  EmpathyContact *contact;
+
+  account = dup_test_account ();
+  entity = tpl_entity_new (id, TPL_ENTITY_CONTACT, "Contact", avatar_token);
+  contact = empathy_contact_from_tpl_contact (account, entity);
+
+  g_object_unref (entity);
+  g_object_unref (account);
+
+  return contact;
+}
+
+static EmpathyContact *
+dup_contact (const gchar *id)
+{
+  return dup_contact_with_avatar (id, "");
+}
+
+static EmpathyContact *
+dup_test_contact (void)
+{
+  return dup_contact ("contact@example.com");
+}
+
+/* Returns a message received from @sender at @timestamp, still pending with
+ * @id */
+static EmpathyMessage *
+message_new_at (EmpathyContact *sender,
+    guint32 id,
+    gint64 timestamp)
+{
+  TpMessage *tp_msg;
+  EmpathyMessage *msg;
+  gchar *body;
+
+  body = g_strdup_printf ("Message %u: it's a \\ test & <b>more</b>", id);
+  tp_msg = tp_client_message_new_text (TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL,
+      body);
+  tp_message_set_uint32 (tp_msg, 0, "pending-message-id", id);
+  if (timestamp != 0)
+    tp_message_set_int64 (tp_msg, 0, "message-received", timestamp);
+
+  msg = empathy_message_new_from_tp_message (tp_msg, TRUE);
+  empathy_message_set_sender (msg, sender);
+
+  g_object_unref (tp_msg);
+  g_free (body);
+
+  return msg;
+}
+
+/* Returns a message received from @sender now, still pending with @id */
+static EmpathyMessage *
+message_new (EmpathyContact *sender,
+    guint32 id)
+{
+  return message_new_at (sender, id, 0);
+}
+
+static void
+append_messages (EmpathyThemeAdium *view,
+    EmpathyContact *sender,
+    guint first,
+    guint n)
+{
+  guint i;
+
+  for (i = first; i < first + n; i++)
+    {
+      EmpathyMessage *msg = message_new (sender, i);
+
+      empathy_theme_adium_append_message (view, msg, FALSE);
+      g_object_unref (msg);
+    }
+}
+
+static void
+load_finished_cb (WebKitWebView *view,
+    WebKitWebFrame *frame,
+    GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+/* Waits until the page of @view is loaded. This handler is connected after
+ * the view's own one, so the view has installed its scripts by then. */
+static void
+wait_for_page (EmpathyThemeAdium *view)
+{
+  GMainLoop *loop;
+  gulong id;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  id = g_signal_connect (view, "load-finished",
+      G_CALLBACK (load_finished_cb), loop);
+
+  g_main_loop_run (loop);
+
+  g_signal_handler_disconnect (view, id);
+  g_main_loop_unref (loop);
+}
+
+static EmpathyThemeAdium *
+theme_adium_new_for_theme (const gchar *theme)
+{
+  EmpathyAdiumData *data;
+  EmpathyThemeAdium *view;
+  gchar *path;
+
+  path = g_build_filename (g_getenv ("EMPATHY_SRCDIR"), "data", "themes",
+      theme, NULL);
+  data = empathy_adium_data_new (path);
+
+  view = empathy_theme_adium_new (data, NULL);
+  g_object_ref_sink (view);
+  wait_for_page (view);
+
+  empathy_adium_data_unref (data);
+  g_free (path);
+
+  return view;
+}
+
+static EmpathyThemeAdium *
+theme_adium_new (void)
+{
+  return theme_adium_new_for_theme ("Classic.AdiumMessageStyle");
+}
+
+static gsize
+get_chat_js_size (void)
+{
+  gchar *path, *js;
+  gsize len;
+  GError *error = NULL;
+
+  path = g_build_filename (g_getenv ("EMPATHY_SRCDIR"), "src",
+      "empathy-chat.js", NULL);
+  g_file_get_contents (path, &js, &len, &error);
+  g_assert_no_error (error);
+
+  g_free (js);
+  g_free (path);
+
+  return len;
+}
+
+static gboolean
+quit_loop_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+run_idles (void)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+
+  g_idle_add_full (G_PRIORITY_LOW, quit_loop_cb, loop, NULL);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+}
+
+/* Messages with an id of the form 3n + 2 are left unread */
+static gboolean
+is_acked (guint32 id)
+{
+  return id % 3 != 2;
+}
+
+static void
+ack_messages (EmpathyThemeAdium *view,
+    EmpathyContact *sender,
+    guint first,
+    guint n)
+{
+  guint i;
+
+  for (i = first; i < first + n; i++)
+    {
+      EmpathyMessage *msg;
+
+      if (!is_acked (i))
+        continue;
+
+      msg = message_new (sender, i);
+      empathy_theme_adium_message_acknowledged (view, msg);
+      g_object_unref (msg);
+    }
+}
+
+/* Returns the number of messages still having an unread mark, checking
+ * they are the ones which were not acknowledged */
+static guint
+count_unread_messages (EmpathyThemeAdium *view)
+{
+  static const gchar prefix[] = "x-empathy-message-id-";
+  WebKitDOMDocument *dom;
+  WebKitDOMNodeList *nodes;
+  GError *error = NULL;
+  guint i, n;
+
+  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (view));
+  nodes = webkit_dom_document_query_selector_all (dom, ".focus", &error);
+  g_assert_no_error (error);
+
+  n = webkit_dom_node_list_get_length (nodes);
+
+  for (i = 0; i < n; i++)
+    {
+      WebKitDOMNode *node = webkit_dom_node_list_item (nodes, i);
+      gchar *class_name;
+      const gchar *id_str;
+
+      class_name = webkit_dom_element_get_class_name (
+          WEBKIT_DOM_ELEMENT (node));
+      id_str = strstr (class_name, prefix);
+      g_assert (id_str != NULL);
+
+      g_assert (!is_acked (g_ascii_strtoull (id_str + sizeof (prefix) - 1,
+              NULL, 10)));
+
+      g_free (class_name);
+    }
+
+  g_object_unref (nodes);
+
+  return n;
+}
+
+static void
+test_theme_adium_ack_messages (void)
+{
+  EmpathyThemeAdium *view;
+  EmpathyContact *sender;
+  GSettings *gsettings;
+  gdouble elapsed;
+
+  /* Keep all the messages in the view */
+  gsettings = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
+  g_settings_set_uint (gsettings, EMPATHY_PREFS_CHAT_MAX_RENDERED_MESSAGES,
+      0);
+
+  sender = dup_test_contact ();
+  view = theme_adium_new ();
+
+  /* The view doesn't have the focus, so new messages are unread. Half of
+   * them are acknowledged before the others are added. */
+  append_messages (view, sender, 0, N_UNREAD / 2);
+
+  g_test_timer_start ();
+
+  ack_messages (view, sender, 0, N_UNREAD / 2);
+  run_idles ();
+
+  append_messages (view, sender, N_UNREAD / 2, N_UNREAD - N_UNREAD / 2);
+  ack_messages (view, sender, N_UNREAD / 2, N_UNREAD - N_UNREAD / 2);
+  run_idles ();
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "%u acknowledged messages: %f seconds",
+      N_ACKED, elapsed);
+
+  g_assert_cmpuint (empathy_theme_adium_get_n_messages (view), ==, N_UNREAD);
+  g_assert_cmpuint (count_unread_messages (view), ==, N_UNREAD - N_ACKED);
+
+  g_object_unref (view);
+  g_object_unref (sender);
+
+  g_settings_reset (gsettings, EMPATHY_PREFS_CHAT_MAX_RENDERED_MESSAGES);
+  g_object_unref (gsettings);
+}
+
+static void
+test_theme_adium_script_bytes (void)
+{
+  EmpathyThemeAdium *view;
+  EmpathyContact *sender;
+  guint64 loaded, appended;
+  gsize js_size;
+
+  js_size = get_chat_js_size ();
+  sender = dup_test_contact ();
+  view = theme_adium_new ();
+
+  /* The helpers are installed once the page is loaded */
+  loaded = empathy_theme_adium_get_script_bytes (view);
+  g_assert_cmpuint (loaded, >=, js_size);
+
+  /* Messages only call them */
+  append_messages (view, sender, 0, N_MESSAGES);
+  appended = empathy_theme_adium_get_script_bytes (view) - loaded;
+
+  DEBUG ("%u messages: %" G_GUINT64_FORMAT " bytes, %" G_GSIZE_FORMAT
+      " bytes of helpers", N_MESSAGES, appended, js_size);
+  g_assert_cmpuint (appended, >, 0);
+  g_assert_cmpuint (appended / N_MESSAGES, <, js_size);
+
+  /* They are installed again in the new page */
+  empathy_theme_adium_clear (view);
+  wait_for_page (view);
+
+  g_assert_cmpuint (empathy_theme_adium_get_script_bytes (view), >=,
+      loaded + appended + js_size);
+
+  g_object_unref (view);
+  g_object_unref (sender);
+}
+
+/* Cost of adding each message of a long conversation with a few senders.
+ * Run with -m perf to get the timings. */
+static void
+test_theme_adium_add_message_perf (void)
+{
+  EmpathyThemeAdium *view;
+  EmpathyContact *senders[N_TRANSCRIPT_SENDERS];
+  GSettings *gsettings;
+  GRand *rand;
+  gint64 timestamp = 1350000000;
+  gdouble elapsed;
+  guint i;
+
+  if (!g_test_perf ())
+    return;
+
+  /* Keep all the messages in the view */
+  gsettings = g_settings_new (EMPATHY_PREFS_CHAT_SCHEMA);
+  g_settings_set_uint (gsettings, EMPATHY_PREFS_CHAT_MAX_RENDERED_MESSAGES,
+      0);
+
+  for (i = 0; i < N_TRANSCRIPT_SENDERS; i++)
+    {
+      gchar *id = g_strdup_printf ("contact%u@example.com", i);
+
+      senders[i] = dup_contact (id);
+      g_free (id);
+    }
+
+  view = theme_adium_new ();
+
+  /* Messages a few seconds apart, with a few longer pauses, from senders
+   * taking turns now and then */
+  rand = g_rand_new_with_seed (42);
+
+  g_test_timer_start ();
+
+  for (i = 0; i < N_TRANSCRIPT_MESSAGES; i++)
+    {
+      EmpathyMessage *msg;
+
+      if (g_rand_int_range (rand, 0, 100) == 0)
+        timestamp += g_rand_int_range (rand, 60, 2 * 24 * 60 * 60);
+      else
+        timestamp += g_rand_int_range (rand, 0, 30);
+
+      msg = message_new_at (
+          senders[g_rand_int_range (rand, 0, N_TRANSCRIPT_SENDERS)], i,
+          timestamp);
+      empathy_theme_adium_append_message (view, msg, FALSE);
+      g_object_unref (msg);
+    }
+
+  /* Including the batched scripts */
+  run_idles ();
+
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_message ("%u messages: %.3f us per message", N_TRANSCRIPT_MESSAGES,
+      elapsed * G_USEC_PER_SEC / N_TRANSCRIPT_MESSAGES);
+  g_test_minimized_result (elapsed, "%u added messages: %fs",
+      N_TRANSCRIPT_MESSAGES, elapsed);
+
+  g_assert_cmpuint (empathy_theme_adium_get_n_messages (view), ==,
+      N_TRANSCRIPT_MESSAGES);
+
+  g_rand_free (rand);
+  g_object_unref (view);
+
+  for (i = 0; i < N_TRANSCRIPT_SENDERS; i++)
+    g_object_unref (senders[i]);
+
+  g_settings_reset (gsettings, EMPATHY_PREFS_CHAT_MAX_RENDERED_MESSAGES);
+  g_object_unref (gsettings);
+}
+
+/* Removes the empty directories from @path up to @top, excluded */
+static void
+remove_dirs (const gchar *path,
+    const gchar *top)
+{
+  gchar *dir = g_strdup (path);
+
+  while (tp_strdiff (dir, top))
+    {
+      gchar *parent = g_path_get_dirname (dir);
+
+      g_assert_cmpint (g_rmdir (dir), ==, 0);
+      g_free (dir);
+      dir = parent;
+    }
+
+  g_free (dir);
+}
+
+static void
+avatar_notify_cb (EmpathyContact *contact,
+    GParamSpec *pspec,
+    GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+/* Returns the src of the avatar shown with the only message of @view */
+static gchar *
+dup_avatar_src (EmpathyThemeAdium *view)
+{
+  WebKitDOMDocument *dom;
+  WebKitDOMElement *img;
+  GError *error = NULL;
+
+  dom = webkit_web_view_get_dom_document (WEBKIT_WEB_VIEW (view));
+  img = webkit_dom_document_query_selector (dom, "img.avatar", &error);
+  g_assert_no_error (error);
+  g_assert (img != NULL);
+
+  return webkit_dom_element_get_attribute (img, "src");
+}
+
+static void
+test_theme_adium_avatar_file (void)
+{
+  EmpathyThemeAdium *view;
+  EmpathyContact *sender;
+  EmpathyMessage *msg;
+  GMainLoop *loop;
+  gchar *dir, *token, *path, *src;
+  GError *error = NULL;
+
+  /* Matches the account of dup_test_account () */
+  dir = g_build_filename (g_get_user_cache_dir (), "telepathy", "avatars",
+      "fake", "jabber", NULL);
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0700), ==, 0);
+
+  token = tp_escape_as_identifier (AVATAR_TOKEN);
+  path = g_build_filename (dir, token, NULL);
+  g_file_set_contents (path, AVATAR_DATA, -1, &error);
+  g_assert_no_error (error);
+
+  view = theme_adium_new_for_theme ("Boxes.AdiumMessageStyle");
+
+  sender = dup_contact_with_avatar ("avatar@example.com", AVATAR_TOKEN);
+
+  /* The message is shown before the contact has read its avatar file */
+  g_assert (empathy_contact_get_avatar_filename (sender) == NULL);
+
+  msg = message_new (sender, 0);
+  empathy_theme_adium_append_message (view, msg, FALSE);
+  g_object_unref (msg);
+
+  /* Then gets it once the file is known */
+  loop = g_main_loop_new (NULL, FALSE);
+  g_signal_connect (sender, "notify::avatar",
+      G_CALLBACK (avatar_notify_cb), loop);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  src = dup_avatar_src (view);
+  g_assert_cmpstr (src, ==, path);
+
+  g_free (src);
+  g_object_unref (view);
+  g_object_unref (sender);
+
+  g_assert_cmpint (g_unlink (path), ==, 0);
+  remove_dirs (dir, g_get_user_cache_dir ());
+
+  g_free (path);
+  g_free (token);
+  g_free (dir);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  gchar *dir;
+  int result;
+
+  /* Don't use the user's avatar cache */
+  dir = g_dir_make_tmp ("empathy-theme-adium-test-XXXXXX", NULL);
+  g_assert (dir != NULL);
+  g_setenv ("XDG_CACHE_HOME", dir, TRUE);
+
+  test_init_with_session_bus (argc, argv);
+
+  g_test_add_func ("/theme-adium/script-bytes",
+      test_theme_adium_script_bytes);
+  g_test_add_func ("/theme-adium/ack-messages",
+      test_theme_adium_ack_messages);
+  g_test_add_func ("/theme-adium/add-message-perf",
+      test_theme_adium_add_message_perf);
+  g_test_add_func ("/theme-adium/avatar-file",
+      test_theme_adium_avatar_file);
+
+  result = g_test_run ();
+  test_deinit ();
+
+  g_rmdir (dir);
+  g_free (dir);
+
+  return result;
+}
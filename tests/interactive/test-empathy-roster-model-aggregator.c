@@ -7,11 +7,13 @@
 
 static gboolean show_offline = FALSE;
 static gboolean show_groups = FALSE;
+static gint benchmark = 0;
 
 static GOptionEntry entries[] =
   {
     { "offline", 0, 0, G_OPTION_ARG_NONE, &show_offline, "Show offline contacts", NULL },
     { "groups", 0, 0, G_OPTION_ARG_NONE, &show_groups, "Show groups", NULL },
+    { "benchmark", 0, 0, G_OPTION_ARG_INT, &benchmark, "Time the loading of N fake individuals, then exit", "N" },
     { NULL }
   };
 
@@ -91,6 +93,103 @@ filter (EmpathyRosterModel *model,
   return TRUE;
 }
 
+static void
+emit_individuals_changed (FolksIndividualAggregator *aggregator,
+    GList *individuals)
+{
+  GeeSet *added, *removed;
+  GList *l;
+
+  added = GEE_SET (gee_hash_set_new (FOLKS_TYPE_INDIVIDUAL, g_object_ref,
+        g_object_unref, NULL, NULL, NULL, NULL, NULL, NULL));
+  removed = gee_set_empty (FOLKS_TYPE_INDIVIDUAL, g_object_ref,
+      g_object_unref);
+
+  for (l = individuals; l != NULL; l = g_list_next (l))
+    gee_collection_add (GEE_COLLECTION (added), l->data);
+
+  g_signal_emit_by_name (aggregator, "individuals-changed", added, removed,
+      NULL, NULL, FOLKS_GROUP_DETAILS_CHANGE_REASON_NONE);
+
+  g_object_unref (added);
+  g_object_unref (removed);
+}
+
+/* Add @n_individuals individuals without any persona to a view, either all
+ * at once as when connecting, or one by one, and return how long it took. */
+static gdouble
+time_load (guint n_individuals,
+    gboolean one_by_one)
+{
+  FolksIndividualAggregator *aggregator;
+  EmpathyRosterModel *model;
+  GtkWidget *window, *scrolled, *view;
+  GList *individuals = NULL, *l;
+  GTimer *timer;
+  gdouble elapsed;
+  guint i;
+
+  for (i = 0; i < n_individuals; i++)
+    individuals = g_list_prepend (individuals, folks_individual_new (NULL));
+
+  aggregator = folks_individual_aggregator_dup ();
+  model = EMPATHY_ROSTER_MODEL (
+      empathy_roster_model_aggregator_new_with_aggregator (aggregator,
+        NULL, NULL));
+
+  window = gtk_offscreen_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), 300, 600);
+
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_container_add (GTK_CONTAINER (window), scrolled);
+
+  view = empathy_roster_view_new (model);
+  empathy_roster_view_show_offline (EMPATHY_ROSTER_VIEW (view), show_offline);
+  empathy_roster_view_show_groups (EMPATHY_ROSTER_VIEW (view), show_groups);
+  gtk_container_add (GTK_CONTAINER (scrolled), view);
+
+  gtk_widget_show_all (window);
+
+  timer = g_timer_new ();
+
+  if (one_by_one)
+    {
+      for (l = individuals; l != NULL; l = g_list_next (l))
+        {
+          GList single = { l->data, NULL, NULL };
+
+          emit_individuals_changed (aggregator, &single);
+        }
+    }
+  else
+    {
+      emit_individuals_changed (aggregator, individuals);
+    }
+
+  /* Let the view lay out the new rows */
+  while (gtk_events_pending ())
+    gtk_main_iteration ();
+
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_timer_destroy (timer);
+  gtk_widget_destroy (window);
+  g_object_unref (model);
+  g_object_unref (aggregator);
+  g_list_free_full (individuals, g_object_unref);
+
+  return elapsed;
+}
+
+static void
+run_benchmark (guint n_individuals)
+{
+  g_print ("Loading %u individuals at once: %.3f s\n", n_individuals,
+      time_load (n_individuals, FALSE));
+  g_print ("Loading %u individuals one by one: %.3f s\n", n_individuals,
+      time_load (n_individuals, TRUE));
+}
+
 int
 main (int argc,
     char **argv)
@@ -112,6 +211,12 @@ main (int argc,
       return 1;
     }
 
+  if (benchmark > 0)
+    {
+      run_benchmark (benchmark);
+      return 0;
+    }
+
   window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
 
   empathy_set_css_provider (window);
@@ -22,6 +22,8 @@
 
 #include "empathy-ui-utils.h"
 
+static GTestDBus *test_bus = NULL;
+
 void
 test_init (int argc,
     char **argv)
@@ -31,10 +33,29 @@ test_init (int argc,
   empathy_gtk_init ();
 }
 
+/* For the tests using a TpAccount or GSettings: they get a private session
+ * bus, and the schemas of the build tree with settings kept in memory */
+void
+test_init_with_session_bus (int argc,
+    char **argv)
+{
+  g_setenv ("GSETTINGS_SCHEMA_DIR", GSETTINGS_SCHEMA_DIR, TRUE);
+  g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+  test_bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (test_bus);
+
+  test_init (argc, argv);
+}
+
 void
 test_deinit (void)
 {
-  ;
+  if (test_bus != NULL)
+    {
+      g_test_dbus_down (test_bus);
+      g_clear_object (&test_bus);
+    }
 }
 
 gchar *
@@ -24,6 +24,8 @@
 
 void test_init (int argc,
     char **argv);
+void test_init_with_session_bus (int argc,
+    char **argv);
 
 void test_deinit (void);
 